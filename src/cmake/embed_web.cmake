@@ -0,0 +1,31 @@
+# 把 WEB_DIR 下的静态文件生成 C 数组，写到 OUT（由 static_assets.cpp include）
+# 用法：cmake -DWEB_DIR=... -DOUT=... -P embed_web.cmake
+
+file(GLOB files RELATIVE "${WEB_DIR}" "${WEB_DIR}/*")
+list(SORT files)
+
+set(body "// generated by embed_web.cmake, do not edit\n")
+set(table "")
+set(i 0)
+foreach(name IN LISTS files)
+    if(IS_DIRECTORY "${WEB_DIR}/${name}")
+        continue()
+    endif()
+    file(READ "${WEB_DIR}/${name}" hex HEX)
+    file(SIZE "${WEB_DIR}/${name}" size)
+    string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1," hex "${hex}")
+    string(APPEND body "static const unsigned char kWebAsset${i}[] = {${hex}0x00};\n")
+    string(APPEND table "    {\"/${name}\", kWebAsset${i}, ${size}},\n")
+    math(EXPR i "${i} + 1")
+endforeach()
+
+string(APPEND body "static const EmbeddedAsset kEmbeddedWeb[] = {\n${table}    {nullptr, nullptr, 0},\n};\n")
+
+# 内容没变就不重写，避免无谓的重新编译
+if(EXISTS "${OUT}")
+    file(READ "${OUT}" old)
+    if(old STREQUAL body)
+        return()
+    endif()
+endif()
+file(WRITE "${OUT}" "${body}")
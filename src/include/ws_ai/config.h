@@ -1,22 +1,115 @@
 #pragma once
+#include <cstddef>
 #include <string>
+#include <vector>
 
 namespace ws_ai {
 
+// 一个可选模型：name 给请求里的 "model" 字段用，path 是 GGUF 文件
+struct ModelSpec {
+  std::string name;
+  std::string path;
+};
+
 struct Config {
   // http server
   std::string host = "0.0.0.0";  // 新增：监听地址（默认对外）
   int port = 8080;
 
+  // 流式 / 进度观察连接走单独端口上的事件循环（watch_server.h），不占 httplib 的线程
+  int watch_port      = 0;      // WS_AI_WATCH_PORT=8081，0 = 不开（和主端口一样监听 host，默认不多开一个对外端口）
+  int watch_threads   = 1;
+  int watch_max_conns = 20000;
+
+  // 本机客户端（截图快捷键守护进程）走 Unix domain socket 上的二进制提交协议（local_server.h），不经过 TCP / JSON
+  std::string uds_path;              // WS_AI_UDS=/tmp/ws_ai.sock，空 = 不开
+  int    uds_max_conns    = 64;
+  size_t uds_max_image_mb = 64;
+
+  // 文件夹监控（folder_watcher.h）：新保存进这些目录的截图按原路径直接提交，结果写到旁边的 <图片>.ws_ai.json
+  std::vector<std::string> folder_dirs;  // WS_AI_FOLDERS="~/Screenshots,/data/shots"（不递归）
+  int folder_debounce_ms = 300;          // 文件最后一次写完后这么久没有新动静才提交
+  int folder_inflight    = 0;            // 监控提交的任务最多同时排队 + 在跑几个（0 = job_workers 的 2 倍），其余在监控里排着
+
+  // 分发模式（dispatcher.h）：本进程不做推理，把任务按负载 / 缓存亲和转给一组 worker（各自是普通的 ws_ai_server）
+  std::vector<std::string> workers;  // WS_AI_WORKERS="127.0.0.1:9001,127.0.0.1:9002"
+  int spawn_workers     = 0;         // WS_AI_SPAWN_WORKERS=N：在本机起 N 个 worker，端口 port+1 .. port+N（watch 端口接着往后排）
+  int worker_poll_ms    = 250;       // 同步进度 + 健康检查的间隔
+  int worker_fail_after = 2;         // 连续失败几次算挂掉（挂掉的 worker 上没完成的任务换一个重跑）
+  int worker_retries    = 2;         // 一个任务最多换几次 worker
+
+  // 流水线："vision"（Vision OCR + llama）或 "mock"（合成延迟，压测 HTTP / 任务队列用），WS_AI_PIPELINE
+  std::string pipeline = "vision";
+  int   mock_ocr_ms      = 300;   // 模拟 OCR 平均耗时（±25%）
+  int   mock_prefill_ms  = 150;
+  float mock_tok_per_sec = 50.f;  // 模拟 decode 速率
+  int   mock_tokens      = 120;
+  float mock_error_rate  = 0.f;   // 按比例随机失败
+  int   mock_mem_mb      = 256;   // 模拟每个任务生成阶段的内存占用（给 MemoryGovernor 记账）
+
   // paths
   std::string model_path = "models/GGUF/qwen2.5-1.5b-instruct-q4_k_m.gguf";
   std::string web_root   = "src/web";
   std::string upload_dir = "/tmp/ws_ai_upload";
-  std::string job_dir    = "/tmp/ws_ai_jobs";
+  std::string job_dir    = "/tmp/ws_ai_jobs";  // WS_AI_JOB_DIR
+
+  // 任务日志（job_journal.h）：提交、状态变化、结果追加写到 job_dir/journal.log，崩溃 / 重启后回放，没跑完的重新排队
+  bool journal            = true;   // WS_AI_JOURNAL=0 关闭
+  bool journal_sync       = true;   // 提交时等所在的那批 fdatasync 完再返回 id；WS_AI_JOURNAL_SYNC=0 不等（崩溃可能丢最后几毫秒的提交）
+  int  journal_compact_mb = 64;     // 日志超过这么大（且超过上次快照的 2 倍）时压缩成快照
+  int  journal_retain_sec = 86400;  // 压缩时丢掉提交超过这么久、已经结束的任务（0 = 都留着）
+
+  // 多模型：为空时只注册一个 "default" -> model_path
+  // 环境变量 WS_AI_MODELS="fast=a.gguf;default=b.gguf;deep=c.gguf"
+  std::vector<ModelSpec> models;
+  std::string default_model = "default";
+  size_t model_budget_mb = 0;  // 常驻模型内存上限（0 = 不限），超出按 LRU 卸载
+  int model_idle_sec = 600;    // 空闲多久卸载（0 = 不卸载）
+
+  // OCR 前处理（灰度 + 自动对比度 + 对比度增强 + 按行高缩小）
+  bool  ocr_preprocess     = true;
+  float ocr_contrast       = 1.6f;
+  int   ocr_target_text_px = 24;    // 正文行高大于它时按比例缩小（0 = 不缩）
+  int   ocr_max_side       = 4096;  // 解码时长边上限，超大截图不再全分辨率解码
+
+  // 近重复截图复用：上传时算感知哈希，和最近完成的任务比汉明距离，够近就直接返回上次结果
+  int    dedup_max_distance = 6;     // pHash 汉明距离阈值（<0 关闭）
+  size_t dedup_capacity     = 4096;  // 索引里保留最近多少个任务
+
+  // 语义缓存（embed_index.h）：换设备 / 换缩放比例截的同一篇文章像素对不上，但 OCR 文本的向量很接近；
+  // OCR 之后算文本向量，和最近完成的任务比余弦相似度，超过阈值就直接返回上次结果，不再生成
+  float  semcache_threshold = 0.f;   // 余弦阈值（0 = 关闭），WS_AI_SEMCACHE=0.92
+  size_t semcache_capacity  = 4096;  // 索引里保留最近多少个任务
+  std::string embed_model;           // WS_AI_EMBED_MODEL：空 = 任务自己的模型开 embeddings 模式，"ngram" = 不用模型的字符 n-gram，其它 = 向量模型 GGUF 路径
+  int    embed_max_tokens   = 512;   // 算向量时 OCR 文本最多取多少 token
+
+  // 每个 job 的 span 记录（/api/trace?id=，Chrome trace 格式），WS_AI_TRACE=1 打开
+  // 默认关：每个排队 / 运行中的 job 要占一个 ~24 KB 的环，结束后才压成紧凑数组
+  bool trace              = false;
+  int  trace_decode_every = 32;  // decode 阶段每 N 个 token 记一个 span
 
   // llama context
   int n_ctx   = 4096;
   int n_batch = 1024;
+  int ctx_pool_size = 1;  // 每个模型保留几个空闲 context 复用（0 = 每个 job 新建）
+  std::string kv_type = "f16";  // KV cache 精度：f16 / q8_0 / q4_0（量化的 V 要 flash attention），WS_AI_KV_TYPE
+
+  // 并发执行任务（memory_governor.h）：每个任务进入 OCR / 生成前按估算占用向内存预算预订，放不下就排队
+  int    job_workers   = 0;  // 同时执行的任务数（0 = 按 CPU 自动，见 thread_plan.h），WS_AI_JOB_WORKERS
+  size_t mem_budget_mb = 0;  // 任务内存预算，不含模型权重（0 = 物理内存的 60% 减去 model_budget_mb），WS_AI_MEM_BUDGET_MB
+  int max_candidates = 8;  // 请求里 n_candidates 的上限
+
+  // 追问（/api/followup）：任务结束时把 KV 状态压缩存到 job_dir/kv，追问时恢复后只 prefill 新问题
+  int kv_ttl_sec        = 1800;  // 过期删除（0 = 不保存，追问走冷启动重算）
+  int kv_compress_level = 1;     // zlib 级别（没有 zlib 时原样存）
+  int kv_queue_mb       = 256;   // 等后台压缩的原始状态最多占多少内存，超了在任务自己的线程里同步压缩写盘，WS_AI_KV_QUEUE_MB
+
+  // 线程规划（0 = 按 CPU 拓扑自动决定，见 thread_plan.h；启动时打印实际布局）
+  int  n_threads       = 0;      // llama decode
+  int  n_threads_batch = 0;      // llama prefill
+  int  ocr_workers     = 0;      // 批处理的 OCR 线程
+  int  http_workers    = 0;      // httplib 线程池
+  bool pin_threads     = false;  // Linux：按角色绑核（llama 放在同一 NUMA 节点）
 
   // sampling
   int   top_k = 40;
@@ -26,6 +119,16 @@ struct Config {
   int max_new_tokens   = 800;
   int min_new_tokens   = 160;
   int max_resample_eos = 64;
+
+  // 带 deadline 的任务（deadline.h）：来不及时缩短输出最多缩到这么多 token，再少就换小模型或者直接失败
+  int deadline_min_tokens = 64;  // WS_AI_DEADLINE_MIN_TOKENS
+
+  // 输出结构监控（output_monitor.h）：两段写完、开始出题 / 列编号、换成英文时立即停止生成
+  bool structure_stop    = true;   // WS_AI_STRUCTURE_STOP=0 关闭
+  bool structure_grammar = false;  // WS_AI_GRAMMAR=1：再用 GBNF 把输出限制成两段
 };
 
-} // namespace ws_ai
\ No newline at end of file
+// 环境变量覆盖（WS_AI_PORT / WS_AI_HOST / WS_AI_MODEL / WS_AI_MODELS ...），server 和命令行工具共用
+void apply_env_overrides(Config &cfg);
+
+} // namespace ws_ai
@@ -0,0 +1,71 @@
+#pragma once
+#include "ws_ai/config.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace ws_ai {
+
+// 开始执行一个带 deadline 的任务前的决定
+struct DeadlinePlan {
+    bool feasible = true;
+    std::string model;        // 可能换成了更小的模型
+    int max_new_tokens = 0;   // >0：缩短后的生成上限
+    int min_new_tokens = -1;  // 缩短时同时压低下限（不然早 EOS 会被硬拖）
+    double est_ms = 0;        // 按这个计划预计还要多久；0 = 没有实测数据，不判断
+    std::string why;          // 不可行时的原因
+};
+
+// 按实测速率判断 deadline 来不来得及：每个任务结束后喂一次 OCR 耗时、首 token 延迟、decode 速率和生成了多少 token
+// （指数滑动平均，模型各算各的），估算 = OCR + 首 token + 典型 token 数 / decode 速率。
+// 没跑过的模型按 GGUF 文件大小从跑过的模型推（首 token 延迟和文件大小成正比、decode 速率成反比，粗略但够排序用）。
+//
+// 来不及时依次试：缩短输出（不少于典型长度的一半）→ 换一个来得及的更小模型 → 缩短到 floor → 更小模型再缩短，
+// 都不行就判为不可行，任务直接失败、不占算力。不加锁，调用方自己同步（JobManager 用 mu_）。
+class DeadlinePlanner {
+public:
+    explicit DeadlinePlanner(const Config &cfg);
+
+    // 任务成功结束后调用；ocr_ms <= 0 表示没有 OCR（追问），这时首 token 延迟也不计（KV 恢复比冷 prefill 快得多）
+    void observe(const std::string &model, double ocr_ms, double ttft_ms, int gen_tokens, double decode_ms,
+                 double run_ms);
+
+    // remaining_ms 之内能不能跑完，跑不完时怎么降级；allow_switch = false 时不换模型（追问要接着用原模型的 KV）
+    DeadlinePlan plan(const std::string &model, bool has_ocr, double remaining_ms, bool allow_switch = true) const;
+
+    // 提交时粗判：前面 ahead 个任务按平均耗时摊到 workers 个 worker 上算等待，
+    // 加上最省的跑法（最快的模型、只生成 floor 个 token）也来不及就返回 true 并写 why
+    bool hopeless(const std::string &model, bool has_ocr, double remaining_ms, size_t ahead, size_t busy,
+                  size_t workers, std::string &why) const;
+
+    // /api/stats 里的 "rates"
+    std::string rates_json() const;
+
+private:
+    struct Rate {
+        double ttft_ms = 0;
+        double decode_tok_s = 0;
+        double gen_tokens = 0;  // 典型生成长度（结构监控常常提前停，比 max_new_tokens 小得多）
+        double run_ms = 0;      // 整个任务在 worker 上的耗时，算排队等待用
+        int samples = 0;
+    };
+
+    bool rate_of(const std::string &model, Rate &out) const;
+    double estimate_ms(const Rate &r, bool has_ocr, double tokens) const;
+    int tokens_within(const Rate &r, bool has_ocr, double budget_ms) const;
+    std::vector<std::string> smaller_models(const std::string &model) const;  // 从大到小
+
+private:
+    std::map<std::string, Rate> rates_;
+    std::map<std::string, uint64_t> sizes_;  // 模型名 -> GGUF 文件大小（文件不存在为 0）
+    double ocr_ms_ = 0;
+    int ocr_samples_ = 0;
+    int max_new_tokens_;
+    int min_new_tokens_;
+    int floor_tokens_;
+};
+
+} // namespace ws_ai
@@ -0,0 +1,107 @@
+#pragma once
+#include "ws_ai/config.h"
+#include "ws_ai/image_hash.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace httplib {
+class Client;
+class DataSink;
+class Server;
+}
+
+namespace ws_ai {
+
+// 配了 WS_AI_WORKERS 或 WS_AI_SPAWN_WORKERS 就以分发模式启动
+inline bool dispatcher_mode(const Config &cfg) { return !cfg.workers.empty() || cfg.spawn_workers > 0; }
+
+// 分发模式：本进程只收请求，把任务通过 HTTP 转给一组 worker（每个都是普通的 ws_ai_server，有自己的模型和队列）。
+//
+// 路由：先看缓存亲和（同一张图 / 近重复截图发给上次处理它的 worker，那边的近重复复用和追问的 KV 状态才用得上），
+// 亲和的 worker 比最闲的多积压不超过两个任务的量就发给它；否则发给估计剩余 token 最少的 worker
+// （每个任务按最近完成任务的平均生成 token 数估计，按进度递减）。
+// 后台线程每 worker_poll_ms 向每个 worker POST /api/progress 拉一次在跑任务的进度，兼做健康检查：
+// 连续失败 worker_fail_after 次判为挂掉，上面没完成的任务换一个 worker 重新提交（最多 worker_retries 次）。
+//
+// 对客户端的接口和单机一样（/api/upload、/api/clipboard、/api/status、/api/stream、/api/followup ...），
+// 任务 id 是 dispatcher 自己的，状态和流式输出从 worker 代理回来；流式输出中途换了 worker 时先发一个 reset 事件。
+// 追问只能发到原任务所在的 worker（KV 状态在那边），那个 worker 挂了就失败。
+class Dispatcher {
+public:
+    explicit Dispatcher(const Config &cfg);
+    ~Dispatcher();
+
+    Dispatcher(const Dispatcher &) = delete;
+    Dispatcher &operator=(const Dispatcher &) = delete;
+
+    // 起本机 worker 进程（Config::spawn_workers，可执行文件就是自己）并开始健康检查；失败写 err
+    bool start(std::string &err);
+    void stop();
+
+    // 注册 /api/* 路由（静态页面由 HttpServer 注册）
+    void install(httplib::Server &svr);
+
+    std::string stats_json() const;
+
+private:
+    struct Worker;
+    struct Job;
+    struct Payload;
+
+    // 转发一次提交：返回 worker 的 HTTP 状态码（连不上为 -1），body 为响应
+    int forward(const Worker &w, const Payload &p, std::string &body) const;
+    // 选 worker 并提交（新任务和重试都走这里）；exclude 里的 worker 不选。
+    // 成功返回 true；worker 拒绝（4xx）时 status / body 是它的响应，原样回给客户端
+    bool place(const std::string &id, std::vector<int> exclude, int &status, std::string &body);
+    int pick(const Job &job, const std::vector<int> &exclude, bool &affinity) const;
+
+    void poll_loop();
+    // 拉一次进度；worker 上丢了的任务（挂掉 / 重启过）放进 lost，由调用方换 worker 重试
+    void poll_worker(int wi, httplib::Client &cli, std::vector<std::string> &lost);
+    void retry(const std::string &id, int failed_worker);
+    // 结束超过 journal_retain_sec 的任务从表里删掉（和单机的任务日志保留同样久；0 = 一直留着）
+    void expire();
+
+    // 以下要求持有 mu_
+    void charge(Job &job, int64_t tokens);  // 把记在 worker 上的剩余 token 调成 tokens
+    void detach(Job &job);                  // 从当前 worker 上摘下（等重试）
+    void finish(Job &job, bool ok);
+
+    std::string status_json(const std::string &id);
+    bool relay_stream(const std::string &id, httplib::DataSink &sink);
+    std::string local_status(const Job &job) const;
+    std::string rewrite_status(const std::string &json, const Job &job) const;
+
+    bool spawn_workers(std::string &err);
+    std::string new_id() const;
+
+private:
+    Config cfg_;
+    std::vector<std::unique_ptr<Worker>> workers_;  // start 之后不再增减
+
+    mutable std::mutex mu_;
+    std::unordered_map<std::string, Job> jobs_;
+    std::unordered_map<std::string, std::string> by_remote_;  // "<worker>/<remote id>" -> 任务 id
+    std::deque<std::pair<std::chrono::steady_clock::time_point, std::string>> finished_;  // 按结束时间，expire 用
+    HammingIndex affinity_;  // 图片指纹 -> worker 下标
+    double est_tokens_ = 0;  // 最近完成任务生成 token 数的 EWMA
+
+    uint64_t submitted_ = 0, completed_ = 0, retried_ = 0, failed_ = 0, affinity_hits_ = 0, expired_ = 0;
+
+    std::thread poller_;
+    std::atomic<bool> stop_{false};
+    std::mutex stop_mu_;
+    std::condition_variable stop_cv_;
+};
+
+} // namespace ws_ai
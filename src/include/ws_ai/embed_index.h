@@ -0,0 +1,69 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace ws_ai {
+
+// 语义缓存用的文本向量索引：同一篇文章换台设备 / 换个缩放比例再截，OCR 文本会差一些（换行、个别错字、多截少截一两行），
+// 像素哈希和内容哈希都对不上，但文本向量的余弦相似度仍然很高。
+//
+// 向量先归一化成单位长度，再按每条向量自己的最大绝对值量化成 int8（每条一个 float scale），内存是 float 的 1/4；
+// 行按 32 字节对齐补零，查询量化后逐行做 int8 点积（SSE2 / AVX2 / NEON，编译期选择，标量兜底），
+// 余弦 ≈ dot * scale_q * scale_row。几千条、几百维暴力扫一遍不到一毫秒，不建近似索引。
+//
+// 维度在第一次 insert 时定下来，之后维度不同的向量插入 / 查询直接忽略（换了向量模型要重启）。
+// 容量满了按插入顺序淘汰最旧的。不加锁，调用方自己同步。
+class EmbeddingIndex {
+public:
+    struct Match {
+        std::string key;
+        float score = 0;  // 余弦相似度
+    };
+
+    explicit EmbeddingIndex(size_t capacity);
+
+    // 向量全 0 或维度不对时不插入，返回 false
+    bool insert(const std::vector<float> &v, const std::string &key);
+
+    // 相似度 >= min_score 的前 k 个，从高到低
+    std::vector<Match> top_k(const std::vector<float> &q, int k, float min_score) const;
+
+    // 删掉这些 key 的向量（扫一遍整个索引），返回删了几条
+    size_t erase(const std::vector<std::string> &keys);
+
+    size_t size() const { return size_; }
+    size_t capacity() const { return keys_.size(); }
+    int dim() const { return dim_; }
+    size_t memory_bytes() const;
+
+private:
+    std::vector<int8_t> rows_;    // capacity * stride_
+    std::vector<float> scales_;   // 0 = 空槽
+    std::vector<std::string> keys_;
+    int dim_ = 0;
+    size_t stride_ = 0;
+    size_t next_ = 0;
+    size_t size_ = 0;
+};
+
+// 归一化 + 量化：out 长度 stride（>= v.size()，多出来的补 0），返回 scale；全 0 向量返回 0
+float quantize_unit_i8(const std::vector<float> &v, size_t stride, int8_t *out);
+
+// int8 点积（n 不要求对齐）
+int32_t dot_i8(const int8_t *a, const int8_t *b, size_t n);
+
+// 不用模型的文本向量：去掉空白和 ASCII 标点、ASCII 转小写后，按 Unicode 字符取 2-gram / 3-gram，
+// 哈希到 dim 个桶（带符号）再归一化。中文截图里相邻两三个字的组合区分度很高，换行、少量错字只动到几个 n-gram。
+// mock 流水线和 WS_AI_EMBED_MODEL=ngram 用
+constexpr int kNgramEmbeddingDim = 512;
+void ngram_embedding(const std::string &text, int dim, std::vector<float> &out);
+
+// 当前编译进来的 SIMD 后端名（"avx2" / "sse2" / "neon" / "neon-dotprod" / "scalar"）
+const char *embed_backend();
+
+// bench 用：强制走标量实现做对比
+void embed_force_scalar(bool on);
+
+} // namespace ws_ai
@@ -0,0 +1,73 @@
+#pragma once
+#include "ws_ai/config.h"
+#include "ws_ai/job_manager.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace ws_ai {
+
+// 文件夹监控：截图工具保存到 Config::folder_dirs 里的图片，按原路径直接交给 JobManager（不上传、不拷贝），
+// 结束后把最终状态 JSON（和 /api/status 一样，含 result）写到图片旁边的 <图片>.ws_ai.json。
+//
+// Linux 用 inotify 等 IN_CLOSE_WRITE / IN_MOVED_TO（写完关闭、或者临时文件改名过来），其它平台退回定时扫目录
+// （大小 / 修改时间变了算一次写入）。同一个文件在 folder_debounce_ms 内又有动静就重新计时，隐藏文件（截图工具的临时文件）不看。
+// 只处理启动之后新出现的文件。
+//
+// 一次拖进几百张图时不全部塞进 JobManager 的队列（会把之后的粘贴 / 上传堵在后面）：
+// 监控自己排着，同时在 JobManager 里的最多 folder_inflight 个，有空位就把能放的一批用 submit_images 一次放进去，
+// 刚好让 OCR 和生成一直有活干。
+class FolderWatcher {
+public:
+    FolderWatcher(const Config &cfg, std::shared_ptr<JobManager> jm);
+    ~FolderWatcher();
+
+    FolderWatcher(const FolderWatcher &) = delete;
+    FolderWatcher &operator=(const FolderWatcher &) = delete;
+
+    // 一个目录都监控不了时返回 false 并写 err；部分目录失败只打日志
+    bool start(std::string &err);
+    void stop();
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    void loop();
+    void read_events(Clock::time_point now);  // inotify
+    void scan_dirs(Clock::time_point now, bool initial);  // 其它平台
+    void touch(const std::string &path, Clock::time_point now);
+    void collect();  // 结束的任务写旁路文件
+    void admit();    // 有空位就放一批进 JobManager
+
+private:
+    Config cfg_;
+    std::shared_ptr<JobManager> jm_;
+    std::vector<std::string> dirs_;
+    size_t max_inflight_ = 1;
+
+    int inotify_fd_ = -1;
+    std::unordered_map<int, std::string> wd_dirs_;  // inotify watch -> 目录
+    std::unordered_map<std::string, std::pair<int64_t, int64_t>> seen_;  // 扫目录时：路径 -> (大小, mtime)
+
+    std::unordered_map<std::string, Clock::time_point> pending_;  // 等 debounce 的文件 -> 最后一次动静
+    std::deque<std::string> backlog_;                             // 写完了、等空位提交
+    std::unordered_map<std::string, std::string> inflight_;       // job id -> 图片路径
+    std::unordered_set<std::string> queued_paths_;                // backlog_ + inflight_ 里的路径
+
+    uint64_t submitted_ = 0;
+    uint64_t written_ = 0;
+
+    std::thread th_;
+    std::atomic<bool> stop_{false};
+};
+
+} // namespace ws_ai
@@ -12,6 +12,10 @@ public:
     // 阻塞启动
     void serve_forever();
 
+private:
+    // 分发模式（dispatcher.h）：不加载模型，只转发给 worker
+    void serve_dispatcher();
+
 private:
     Config cfg_;
     std::shared_ptr<JobManager> jm_;
@@ -0,0 +1,70 @@
+#pragma once
+#include "ws_ai/image_preproc.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace ws_ai {
+
+// 感知哈希指纹：两张“几乎一样”的截图（裁剪差几像素、光标 / 角标不同）汉明距离很小
+struct ImageFingerprint {
+  uint64_t phash = 0;  // 32x32 DCT 低频 8x8 与中位数比较，抗缩放 / 轻微裁剪
+  uint64_t dhash = 0;  // 9x8 相邻像素梯度符号，便宜，用来二次确认
+};
+
+// 从灰度图算指纹；图太小（任一边 < 32）返回 false
+bool compute_fingerprint(const GrayImage &img, ImageFingerprint &out);
+
+inline int hamming64(uint64_t a, uint64_t b) { return __builtin_popcountll(a ^ b); }
+
+// 最近 N 个指纹的汉明距离索引（multi-index hashing）：
+// 64 位拆成 4 段 16 位，各建一张表。距离 <= r 的两个哈希至少有一段距离 <= r/4（抽屉原理），
+// 所以查询只需在每张表里枚举半径 r/4 内的段值，再对候选算完整 popcount。
+// 每张表是 65536 个桶头 + 挂在条目上的双向链表，固定 1 MiB 加每条几十字节，淘汰 O(1)。
+// 容量满了按插入顺序淘汰最旧的。不加锁，调用方自己同步。
+class HammingIndex {
+public:
+  struct Match {
+    std::string key;
+    int distance = 0;
+  };
+
+  explicit HammingIndex(size_t capacity);
+
+  void insert(const ImageFingerprint &fp, const std::string &key);
+  // 删掉 key 那一条（fp 用来定位桶），不在索引里返回 false
+  bool erase(const ImageFingerprint &fp, const std::string &key);
+
+  // phash 距离 <= max_dist 且 dhash 距离 <= 3 * max_dist 的项里，phash 距离最小的一个
+  std::optional<Match> find(const ImageFingerprint &fp, int max_dist) const;
+
+  size_t size() const { return size_; }
+  size_t capacity() const { return entries_.size(); }
+  size_t memory_bytes() const;
+
+private:
+  static constexpr int kParts = 4;
+  static constexpr uint32_t kNone = 0xffffffffu;
+
+  struct Entry {
+    ImageFingerprint fp;
+    uint32_t next[kParts];
+    uint32_t prev[kParts];
+    bool live = false;
+    std::string key;
+  };
+
+  static uint16_t part(uint64_t h, int i) { return (uint16_t)(h >> (16 * i)); }
+  void unlink(uint32_t slot);
+
+private:
+  std::vector<Entry> entries_;  // 环形缓冲
+  size_t next_ = 0;
+  size_t size_ = 0;
+  std::vector<uint32_t> heads_[kParts];  // 每段 65536 个桶头
+};
+
+} // namespace ws_ai
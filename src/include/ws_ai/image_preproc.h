@@ -0,0 +1,58 @@
+#pragma once
+#include "ws_ai/config.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace ws_ai {
+
+// 8-bit 灰度图，行紧密排列（stride == width）
+struct GrayImage {
+  int width = 0;
+  int height = 0;
+  std::vector<uint8_t> pixels;
+
+  bool empty() const { return width <= 0 || height <= 0; }
+  uint8_t *row(int y) { return pixels.data() + (size_t)y * (size_t)width; }
+  const uint8_t *row(int y) const { return pixels.data() + (size_t)y * (size_t)width; }
+};
+
+// OCR 前处理参数（对应 scripts/infer_image.py 的 grayscale + autocontrast + Contrast(1.6)）
+struct PreprocOptions {
+  bool enabled = true;
+  float contrast = 1.6f;       // 1.0 = 不变
+  float autocontrast_cutoff = 0.0f;  // 两端各裁掉的像素比例（%），同 PIL cutoff
+  int target_text_px = 24;     // 估计出的文字行高超过它就按比例缩小（0 = 不缩）
+  int max_side = 4096;         // 解码时长边上限（ImageIO 缩略图解码，避免全分辨率位图）
+};
+
+PreprocOptions preproc_options_from_config(const Config &cfg);
+
+// ---- 单步 kernel（SSE2 / AVX2 / NEON，编译期选择，标量兜底）----
+
+// RGBA8（或 BGRA8 时把 bgr=true）-> 亮度，BT.601 权重（77/150/29）/256
+void rgba_to_luma(const uint8_t *rgba, int width, int height, size_t stride, bool bgr, GrayImage &out);
+
+// 直方图自动拉伸：把 [lo, hi] 映射到 [0, 255]；返回是否改动
+bool autocontrast(GrayImage &img, float cutoff_percent = 0.0f);
+
+// 以平均灰度为中心缩放对比度（同 PIL ImageEnhance.Contrast）
+void enhance_contrast(GrayImage &img, float factor);
+
+// 面积平均缩放（只缩小）
+void downscale_area(const GrayImage &in, int out_w, int out_h, GrayImage &out);
+
+// 按行投影估计正文行高（像素）；估不出返回 0
+int estimate_text_height(const GrayImage &img);
+
+// 整条前处理：autocontrast -> contrast -> 按行高缩小
+void preprocess_for_ocr(GrayImage &img, const PreprocOptions &opt);
+
+// 当前编译进来的 SIMD 后端名（"avx2" / "sse2" / "neon" / "scalar"）
+const char *preproc_backend();
+
+// bench 用：强制走标量实现做对比
+void preproc_force_scalar(bool on);
+
+} // namespace ws_ai
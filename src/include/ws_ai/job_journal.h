@@ -0,0 +1,102 @@
+#pragma once
+#include "ws_ai/config.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace ws_ai {
+
+// 任务日志：JobManager 的提交、状态变化和结果按记录追加写到 job_dir/journal.log，进程崩溃 / 重启后回放重建任务表。
+//
+// 格式（本机字节序，只给同一台机器读）：文件头 "WSJL" u32 version，之后每条记录 u32 len, u32 crc32, u8 type, payload[len]，
+// crc 覆盖 type + payload。回放读到长度不够或 crc 对不上就停下（崩溃时写了一半的尾巴），后面的丢掉。
+//
+// 组提交：append 只把记录拷进内存缓冲（调用方在自己的锁里调用，日志顺序和内存里的一致），后台线程把攒下的一批
+// 一次 write + fdatasync。fsync 期间新来的记录进下一批，负载越高一批越大，每条记录摊到的 fsync 越少；
+// 需要持久化保证的（提交）用 wait_durable 等自己那一批写完。
+//
+// 压缩：启动回放完、以及日志超过 journal_compact_mb（且超过上次快照的 2 倍）时，用 snapshot 回调生成全部存活任务的记录，
+// 写临时文件、fsync 后 rename 替换日志。回调在调用方的锁里调用 discard_pending：还没写盘的记录都已经反映在快照里。
+class JobJournal {
+public:
+    explicit JobJournal(const Config &cfg);
+    ~JobJournal();  // 把缓冲写完再退出
+
+    JobJournal(const JobJournal &) = delete;
+    JobJournal &operator=(const JobJournal &) = delete;
+
+    bool enabled() const { return enabled_; }
+
+    struct ReplayStats {
+        uint64_t records = 0;
+        uint64_t bytes = 0;
+        uint64_t dropped_bytes = 0;  // 坏掉的尾巴
+        double ms = 0;
+    };
+    // start 之前调用一次；没有日志文件时返回 true、records = 0。文件头不对时返回 false（旧文件改名成 .bad 留着）
+    bool replay(const std::function<void(char type, const std::string &payload)> &fn, ReplayStats &st,
+                std::string &err);
+
+    // 先用 snapshot 压缩一次（替换掉回放过的旧日志），再开写线程；失败时写 err，之后 append 全部忽略
+    using SnapshotFn = std::function<std::string()>;
+    bool start(SnapshotFn snapshot, std::string &err);
+
+    // 返回序号；没开 / 已经失败时返回 0
+    uint64_t append(char type, const std::string &payload);
+    // 阻塞到 seq 及之前的记录都已落盘（写失败 / 退出时直接返回）
+    void wait_durable(uint64_t seq);
+    // snapshot 回调里调用：丢掉还没写盘的记录（快照已经包含它们），返回快照覆盖到的序号
+    uint64_t discard_pending();
+
+    // 把一条记录编码后追加到 out（snapshot 回调拼快照用）
+    static void encode(std::string &out, char type, const std::string &payload);
+
+    // /api/stats 里的 "journal"
+    std::string stats_json() const;
+
+private:
+    void writer_loop();
+    bool compact(std::string &err);
+    bool open_append(std::string &err);
+    void fail(const std::string &why);
+
+private:
+    std::string dir_;
+    std::string path_;
+    bool enabled_ = false;
+    uint64_t compact_bytes_ = 0;
+    SnapshotFn snapshot_;
+    int fd_ = -1;  // 只有写线程（以及 start 里第一次压缩）用
+    int lock_fd_ = -1;  // job_dir/journal.lock 上的 flock：同一个目录只能有一个进程写日志
+
+    mutable std::mutex mu_;
+    std::condition_variable cv_;          // 有新记录 / 退出
+    std::condition_variable durable_cv_;  // durable_ 前进
+    std::string buf_;
+    uint64_t buf_records_ = 0;
+    uint64_t next_seq_ = 1;
+    uint64_t durable_ = 0;
+    uint64_t snapshot_seq_ = 0;  // 最近一次快照覆盖到的序号
+    bool stop_ = false;
+    bool failed_ = false;
+
+    // 统计（mu_）
+    ReplayStats replay_;
+    uint64_t file_bytes_ = 0;
+    uint64_t snapshot_bytes_ = 0;
+    uint64_t appended_ = 0;
+    uint64_t commits_ = 0;
+    uint64_t max_batch_ = 0;
+    double sync_ms_ = 0;  // 累计 write + fdatasync
+    double max_sync_ms_ = 0;
+    uint64_t compactions_ = 0;
+    double compact_ms_ = 0;  // 最近一次
+
+    std::thread writer_;
+};
+
+} // namespace ws_ai
@@ -1,32 +1,86 @@
 #pragma once
 
 #include "ws_ai/config.h"
+#include "ws_ai/deadline.h"
+#include "ws_ai/embed_index.h"
+#include "ws_ai/image_hash.h"
+#include "ws_ai/job_journal.h"
+#include "ws_ai/lock_stats.h"
+#include "ws_ai/memory_governor.h"
+#include "ws_ai/pipeline.h"
+#include "ws_ai/thread_plan.h"
+#include "ws_ai/trace.h"
 
 #include <atomic>
 #include <chrono>
 #include <condition_variable>
+#include <cstddef>
+#include <functional>
 #include <memory> // ✅ 如果你头里用 shared_ptr / unique_ptr
+#include <deque>
 #include <mutex>
-#include <queue>
 #include <string>
 #include <thread> // ✅ 必须：std::thread
 #include <unordered_map>
+#include <vector>
 
 namespace ws_ai {
 class Pipeline;
+class ModelRegistry;
 
 enum class JobState { queued, running, done, error };
 
 struct JobInfo {
   std::string id;
   std::string image_path;
+  std::string model;  // 已解析后的模型名
+  int n_candidates = 1;
+  bool all_candidates = false;  // 状态里带上全部候选（否则只有最好的）
+  std::vector<Candidate> candidates;
 
   JobState state = JobState::queued;
   int progress = 0;   // 0..100（给前端进度条）
   std::string result; // done 时填
   std::string error;  // error 时填
+  std::string ocr_text;
+  std::string partial;  // running 时已生成的文本（流式输出）
+
+  // 近重复检测
+  bool has_fingerprint = false;
+  ImageFingerprint fingerprint;
+  std::string dup_of;     // 非空：结果复用自这个任务
+  int dup_distance = 0;
+  float dup_similarity = 0;  // >0：语义缓存命中（OCR 文本向量的余弦相似度），这时没有 dup_distance
+
+  // 追问：parent 非空表示这是一次追问（没有图片）
+  std::string parent;
+  std::string question;
+  std::string transcript;  // 完整对话，下一次追问冷启动用（不输出）
+  int prompt_tokens = 0;
+  double ttft_ms = 0;
+  double restore_ms = 0;
+  bool kv_restored = false;
+
+  // 生成怎么结束的（RunStats::stop_reason）；结构监控提前停下时 tokens_saved 为省掉的预算
+  std::string stop_reason;
+  int gen_tokens = 0;
+  int tokens_saved = 0;
+  int tokens_cut = 0;
+
+  // deadline（提交后多少毫秒内要结果）：> 0 时按 deadline 插队，开始执行前按实测速率决定要不要降级，
+  // 做了什么记在 degraded 里（"priority" / "model=fast" / "max_new_tokens=200"）
+  int deadline_ms = 0;
+  std::chrono::steady_clock::time_point deadline;
+  std::vector<std::string> degraded;
+  int max_new_tokens = 0;   // 降级后的生成上限 / 下限（0 / -1 = 用 Config 的）
+  int min_new_tokens = -1;
+  double elapsed_ms = 0;    // 有 deadline 的任务结束时：提交到结束
 
   std::chrono::system_clock::time_point created_at;
+
+  // Config::trace 打开时才有；queued_us 用来记排队时长
+  std::shared_ptr<JobTrace> trace;
+  uint64_t queued_us = 0;
 };
 
 // OCR + LLM 流水线接口（避免在头文件里引入 Objective-C / Vision）
@@ -39,40 +93,168 @@ struct JobInfo {
 //                             std::string &err_out) = 0;
 // };
 
-// 工厂函数：在 pipeline.mm 里实现
-std::unique_ptr<Pipeline> make_pipeline(const Config &cfg);
+
+// /api/stream 等待的结果
+enum class StreamEvent { delta, done, error, timeout, not_found };
+
+// 一次不阻塞的流式快照（WatchServer 用）：partial 从 from 起的部分 + 当前进度 / 状态
+struct StreamSnapshot {
+  size_t from = 0;      // text 在 partial 里的起点（from 超出时截到 partial 末尾）
+  std::string text;
+  int progress = 0;
+  JobState state = JobState::queued;
+  std::string final_json;  // done / error 时为最终状态 JSON
+};
 
 class JobManager : public std::enable_shared_from_this<JobManager> {
 public:
+  // 按 cfg.pipeline 选流水线："mock" -> 合成流水线，其它 -> Vision + llama
   explicit JobManager(Config cfg);
+  // 注入自定义流水线（压测 / 替换实现）；传空等同上面
+  JobManager(Config cfg, std::unique_ptr<Pipeline> pipeline);
   ~JobManager();
 
-  // http_server.cpp 需要的两个接口：
-  std::string submit_image(const std::string &image_path);
+  // http_server.cpp 需要的接口：
+  // model 为空用默认模型；调用前先用 has_model 校验
+  // n_candidates > 1：生成多个候选取格式分最高的（上限 Config::max_candidates），all_candidates 时全部返回
+  // deadline_ms > 0：提交后这么多毫秒内要结果（见 deadline.h），按实测速率判断已经来不及的任务直接以 error 结束
+  std::string submit_image(const std::string &image_path, const std::string &model = "",
+                           int n_candidates = 1, bool all_candidates = false, int deadline_ms = 0);
+  // 批量提交（文件夹监控一批放进来）：指纹在锁外逐个算，入队只拿一次锁、一次唤醒所有 worker。
+  // 返回的 id 和 image_paths 一一对应
+  std::vector<std::string> submit_images(const std::vector<std::string> &image_paths, const std::string &model = "");
   std::string get_status_json(const std::string &id) const;
 
+  // 追问：在已完成的任务（或追问）后面接一轮提问，返回新任务 id；
+  // 任务不存在 / 没完成时返回空串并写 err
+  std::string submit_followup(const std::string &parent_id, const std::string &question, std::string &err);
+
+  bool has_model(const std::string &model) const;
+  std::string get_models_json() const;
+
+  // 近重复 / 语义缓存命中统计
+  std::string get_dedup_json() const;
+
+  // Chrome trace-event JSON：单个 job（找不到 / 没开 trace 返回空串）与全局滚动 trace
+  std::string get_trace_json(const std::string &id) const;
+  std::string get_global_trace_json() const;
+
+  // 流式输出：从 offset 起等新文本，有新文本 / 任务结束 / 超时就返回。
+  // delta 时 chunk 为新文本并推进 offset；done / error 时 chunk 为最终状态 JSON
+  StreamEvent wait_stream(const std::string &id, size_t &offset, std::string &chunk, int timeout_ms) const;
+
+  // 不阻塞版本：一次拿到 partial[from..]、进度和状态，任务不存在返回 false
+  bool stream_snapshot(const std::string &id, size_t from, StreamSnapshot &out) const;
+
+  // 任务有新文本 / 状态变化时回调（worker 线程里调用，不持 mu_），给 WatchServer 做 fan-out。
+  // 只有一个监听者；传空取消，返回后不会再被调用
+  using UpdateListener = std::function<void(const std::string &id)>;
+  void set_update_listener(UpdateListener fn);
+
+  // 服务端统计：队列深度、任务数、JobManager 锁争用
+  std::string get_stats_json() const;
+
+  // 一批任务的简要进度（分发模式下 dispatcher 每轮拉一次，兼做健康检查）：
+  // {"ok":true,"queued":N,"running":N,"jobs":[{"id","state","progress","gen_tokens"}]}，不存在的 state 为 "not_found"
+  std::string get_progress_json(const std::vector<std::string> &ids) const;
+
+  // GET /api/memory：任务内存预算和各阶段当前的预订（MemoryGovernor::status_json）
+  std::string get_memory_json() const;
+
 private:
   void worker_loop();
+  // 建一个图片任务（含指纹，不持锁）；admit_locked 持 mu_ 入表：近重复命中直接完成返回 false，否则入队返回 true
+  JobInfo make_image_job(const std::string &image_path, const std::string &model, int n_candidates,
+                         bool all_candidates, int deadline_ms = 0) const;
+  bool admit_locked(JobInfo &job);
+  // 以下持 mu_：有 deadline 的任务按 deadline 找插入位置（排在没有 deadline / deadline 更晚的任务前面）；
+  // 开始执行前按剩余时间定计划，来不及时写 error 返回 false
+  std::deque<std::string>::iterator queue_position_locked(const JobInfo &job);
+  bool plan_deadline_locked(JobInfo &job);
+  std::string status_json(const JobInfo &job) const;
+  void notify_update(const std::string &id);
+  bool reuse_near_duplicate(JobInfo &job);
+  // 不持锁调用。任务结束、最后一个 span 写完后把 trace 的环换成紧凑数组
+  void freeze_trace(const std::string &id);
+  // 不持锁调用。语义缓存里找同模型、已完成、相似度够的任务，命中时写 src / score / result
+  bool find_semantic_match(const std::string &model, const std::vector<float> &embedding, std::string &src,
+                           float &score, std::string &result);
+  // 任务日志：启动时回放重建 jobs_ / queue_；snapshot 给压缩用（持 mu_ 编码全部存活任务）；
+  // journal_job_locked 持 mu_ 追加一条整个任务的记录，返回序号给 wait_durable
+  void recover();
+  std::string journal_snapshot();
+  uint64_t journal_job_locked(const JobInfo &job);
+  // 持 mu_：结束的任务提交超过 journal_retain_sec 后从 jobs_ 和近重复索引里删掉（和日志压缩同一个标准，
+  // 重启前后查到的一样）；删掉的 id 追加到 sem_out，调用方放开 mu_ 后交给 expire_semantic 从语义缓存里删
+  void expire_locked(std::vector<std::string> &sem_out);
+  void expire_semantic(const std::vector<std::string> &ids);
   std::string new_id() const;
   static const char *state_to_cstr(JobState s);
-  static std::string json_escape(const std::string &s);
 
 private:
   Config cfg_;
+  ThreadPlan plan_;
 
+  // 注意声明顺序：pipeline_ 持有的模型租约要先于 registry 释放
+  std::shared_ptr<ModelRegistry> models_;
   std::unique_ptr<Pipeline> pipeline_;
 
-  mutable std::mutex mu_;
-  mutable std::condition_variable cv_;
+  mutable StatMutex mu_;
+  mutable std::condition_variable_any cv_;
+  mutable std::condition_variable_any stream_cv_;  // partial 有新内容 / 任务结束
+
+  std::mutex listener_mu_;
+  UpdateListener listener_;
 
   // 存所有 job 的信息（查询用）
   std::unordered_map<std::string, JobInfo> jobs_;
 
-  // 排队等待执行的 job id
-  std::queue<std::string> queue_;
+  // 排队等待执行的 job id（有 deadline 的会插到前面）
+  std::deque<std::string> queue_;
+  size_t running_ = 0;
+
+  // deadline 调度（受 mu_ 保护）：实测速率和各种降级的次数
+  DeadlinePlanner planner_;
+  size_t dl_jobs_ = 0;
+  size_t dl_met_ = 0;
+  size_t dl_missed_ = 0;
+  size_t dl_rejected_ = 0;     // 提交时 / 开始前判为来不及，没跑
+  size_t dl_prioritized_ = 0;
+  size_t dl_shrunk_ = 0;
+  size_t dl_switched_ = 0;
+
+  // 最近完成任务的感知哈希（受 mu_ 保护）
+  HammingIndex dedup_;
+  size_t dedup_lookups_ = 0;
+  size_t dedup_hits_ = 0;
+
+  // 最近完成任务的 OCR 文本向量：查询要扫整个索引，比汉明索引慢，用单独的锁不占 mu_
+  mutable std::mutex sem_mu_;
+  EmbeddingIndex semcache_;
+  size_t sem_lookups_ = 0;
+  size_t sem_hits_ = 0;
+  double sem_lookup_us_ = 0;  // 累计
+  double sem_lookup_max_us_ = 0;
+
+  // 结构监控提前停下的任务数和累计省下 / 截掉的 token（/api/stats）
+  size_t early_stops_ = 0;
+  uint64_t tokens_saved_ = 0;
+  uint64_t tokens_cut_ = 0;
+
+  // 任务内存记账：job worker 并发跑 OCR / 生成时按预算放行
+  MemoryGovernor memory_;
+
+  // 任务日志（append 在 mu_ 里调用，和内存里的顺序一致）；启动时恢复了多少任务、重新排队多少
+  JobJournal journal_;
+  size_t recovered_ = 0;
+  size_t requeued_ = 0;
+
+  // 按结束先后排的任务 id（受 mu_ 保护），expire_locked 从头上删；删掉了多少个
+  std::deque<std::string> finished_;
+  size_t expired_ = 0;
 
-  // worker
-  std::thread worker_;
+  // job worker（ThreadPlan::job_workers 个）
+  std::vector<std::thread> workers_;
   std::atomic<bool> stop_{false};
 
   // 当前任务进度（worker 写，status 读）
@@ -0,0 +1,80 @@
+#pragma once
+#include "ws_ai/config.h"
+#include "ws_ai/llm_runner.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace ws_ai {
+
+// 任务结束时的 sequence KV 状态，按 job id 存在 job_dir/kv/<id>.kv，给 /api/followup 恢复用。
+// 压缩 + 写盘在后台线程做，不拖慢 job 结束；还没写完时 load 直接从内存队列里取。
+// 排队的是未压缩的完整状态，不在 MemoryGovernor 的账上：总量超过 kv_queue_mb 时不再排队，
+// 由调用 save 的 job worker 自己同步压缩写盘（一次结束一大批任务时内存不会跟着涨，代价是这些任务晚一点结束）。
+// 文件超过 kv_ttl_sec 就删（写入时顺带清理，读取时发现过期也删）。
+class KvStore {
+public:
+    explicit KvStore(const Config &cfg);
+    ~KvStore();  // 等队列写完
+
+    KvStore(const KvStore &) = delete;
+    KvStore &operator=(const KvStore &) = delete;
+
+    bool enabled() const { return ttl_sec_ > 0; }
+
+    // key 标识状态来自哪个模型（用模型路径），恢复时必须一致
+    void save(const std::string &id, const std::string &key, SeqState st);
+    // 不存在 / 过期 / key 不一致 / 文件损坏返回 false 并写 err
+    bool load(const std::string &id, const std::string &key, SeqState &out, std::string &err);
+    // 等后台把已提交的都写完
+    void flush();
+
+    struct Stats {
+        uint64_t saved = 0;
+        uint64_t raw_bytes = 0;     // 累计原始大小
+        uint64_t stored_bytes = 0;  // 累计落盘大小
+        double compress_ms = 0;     // 累计压缩耗时
+        uint64_t loads = 0;
+        uint64_t load_hits = 0;
+        uint64_t sync_saves = 0;    // 队列满了、在调用线程里同步写的次数
+    };
+    Stats stats() const;
+
+private:
+    struct Pending {
+        std::string id;
+        std::string key;
+        SeqState st;
+    };
+
+    std::string path_of(const std::string &id) const;
+    void writer_loop();
+    bool write_file(const Pending &p);
+    bool read_file(const std::string &path, const std::string &key, SeqState &out, std::string &err);
+    void sweep();
+
+private:
+    std::string dir_;
+    int ttl_sec_ = 0;
+    int level_ = 1;
+    uint64_t queue_cap_ = 0;  // kv_queue_mb
+
+    mutable std::mutex mu_;
+    std::condition_variable cv_;
+    std::deque<std::shared_ptr<Pending>> queue_;
+    std::shared_ptr<Pending> writing_;  // 正在写的那个，load 也能命中
+    uint64_t queued_bytes_ = 0;         // queue_ + writing_ 的原始大小
+    bool stop_ = false;
+    Stats stats_;
+    std::chrono::steady_clock::time_point last_sweep_{};
+
+    std::thread writer_;
+};
+
+} // namespace ws_ai
@@ -1,9 +1,22 @@
 #pragma once
+#include "ws_ai/config.h"
+#include "ws_ai/output_monitor.h"
+
+#include <atomic>
+#include <cstdint>
 #include <functional>
+#include <optional>
 #include <string>
+#include <vector>
+
+struct llama_model;
+struct llama_context;
+struct llama_vocab;
 
 namespace ws_ai {
 
+class JobTrace;
+
 struct GenParams {
     int max_new_tokens = 800;     // 输出太短就加大
     int min_new_tokens = 250;     // 不到这个长度不允许 EOS 结束（配合重采样）
@@ -12,12 +25,138 @@ struct GenParams {
     float top_p = 0.9f;
     int   top_k = 40;
     float temp  = 0.6f;
+
+    std::string kv_type = "f16";  // KV cache 精度（见 Config::kv_type）
+
+    // 计算线程（0 = llama.cpp 默认）
+    int n_threads = 0;
+    int n_threads_batch = 0;
+};
+
+GenParams gen_params_from_config(const Config &cfg);
+
+// kv_type 认不认识（f16 / q8_0 / q4_0 / f32）
+bool kv_type_supported(const std::string &kv_type);
+
+// 按 LlmRunner 构造参数粗估 context 占的内存：KV cache（按 kv_type）+ logits + 一个 batch 的计算图（偏保守），
+// MemoryGovernor 预订用。池里复用的 context 也按这个算（用的时候才占）
+uint64_t estimate_context_bytes(const llama_model *model, const GenParams &params, int n_ctx, int n_batch,
+                                int n_seq = 1, bool unified_kv = false);
+
+// 文本向量（语义缓存用）：临时建一个 embeddings 模式的小 context 跑一遍 text（超过 max_tokens 截掉）。
+// 模型自带 pooling（bge / e5 这类向量模型）用它的池化结果，生成模型取各 token 最后一层隐状态的平均。
+// 没有归一化；失败返回 false 并写 err
+bool embed_text(llama_model *model, const std::string &text, const GenParams &params, int max_tokens,
+                std::vector<float> &out, std::string &err);
+
+// 一个 sequence 的 KV 状态（llama_state_seq_get_data 的原始字节），用于追问时接着算
+struct SeqState {
+    std::vector<uint8_t> data;
+    int32_t n_past = 0;          // KV 里的 token 数
+    std::vector<int32_t> tail;   // 已采样但还没进 KV 的 token（max_new_tokens 截断时），恢复后先补上
 };
 
 struct LLMResult {
     bool ok = false;
     std::string text;
     std::string error;
+
+    int n_prompt_tokens = 0;
+    int n_gen_tokens = 0;
+    double prefill_ms = 0;  // 进入 slot 到第一个 token（含 KV 恢复和 prompt decode）
+    double decode_ms = 0;   // 第一个 token 到结束
+    double restore_ms = 0;  // llama_state_seq_set_data 耗时
+    double score = 0;       // generate_candidates 的打分
+
+    StopReason stop_reason = StopReason::none;
+    int n_cut_tokens = 0;    // 已经生成、又因为跑偏 / 换语言被截掉的 token
+    int n_saved_tokens = 0;  // 结构监控提前停下时剩余的生成预算（不停的话最多还会生成这么多）
+
+    SeqState state;  // GenRequest::save_state 且成功时填
+};
+
+// 一条生成请求；回调都在 generate 所在线程里调用
+struct GenRequest {
+    std::string prompt;
+    // 每接受一个 token 回调一次：piece 为新文本，n_gen 为已生成 token 数
+    std::function<void(const std::string &piece, int n_gen)> on_token;
+    const std::atomic<bool> *cancel = nullptr;
+    JobTrace *trace = nullptr;  // 非空时记录 tokenize / prefill 分块 / decode（每 N token 一段）
+
+    // 追问：先把这份 KV 恢复到 sequence，再只 prefill prompt（新的一轮对话）
+    const SeqState *restore = nullptr;
+    // 结束时导出 sequence 的 KV 到 LLMResult::state
+    bool save_state = false;
+
+    // 输出结构监控（默认关）；grammar 非空时是 GBNF，采样只能走语法允许的 token
+    MonitorOptions monitor;
+    std::string grammar;
+
+    // 这一条的生成上限 / 下限（deadline 调度缩短输出时用）；0 / -1 = 用 GenParams 的
+    int max_new_tokens = 0;
+    int min_new_tokens = -1;
+
+    void *user = nullptr;  // 调用方自己的上下文，原样带回 on_done
+};
+
+// 生成引擎：一个 llama_context 上开 n_seq 个 sequence，连续批处理
+// （某个 sequence 结束后空出的 slot 立刻接下一条 prompt，prefill 和其它 slot 的 decode 同批进行）
+class LlmRunner {
+public:
+    // unified_kv：所有 sequence 共用一块 KV（generate_candidates 用，fork 出来的 sequence 共享 prompt 的 cell），
+    // 容量是 n_ctx + (n_seq-1) * max_new_tokens；否则每个 sequence 各自 n_ctx
+    LlmRunner(llama_model *model, const GenParams &params, int n_ctx, int n_batch, int n_seq = 1,
+              bool unified_kv = false);
+    // 复用一个已有的 context（见 LoadedModel::take_context），必须是同样参数、n_seq = 1 创建的；
+    // reuse 为空时等同上面
+    LlmRunner(llama_model *model, llama_context *reuse, const GenParams &params, int n_ctx, int n_batch);
+    ~LlmRunner();
+
+    LlmRunner(const LlmRunner &) = delete;
+    LlmRunner &operator=(const LlmRunner &) = delete;
+
+    bool ok() const { return ctx_ != nullptr; }
+    const std::string &error() const { return error_; }
+    int n_seq() const { return n_seq_; }
+    bool reused() const { return reused_; }
+
+    // 交出 context（KV 已清空），之后 runner 不可用；用来放回 context 池
+    llama_context *release_context();
+
+    // 取下一条请求：block=true 时可以阻塞等待（此时没有正在跑的 sequence）；
+    // 返回 nullopt：block=false 表示暂时没有，block=true 表示输入结束
+    using NextFn = std::function<std::optional<GenRequest>(bool block)>;
+    using DoneFn = std::function<void(GenRequest &req, LLMResult &res)>;
+
+    // 跑到 next 返回结束且所有 sequence 都完成为止
+    void run(const NextFn &next, const DoneFn &on_done);
+
+    // 便捷接口：一组 prompt 并发生成，结果按输入顺序返回
+    std::vector<LLMResult> generate(std::vector<GenRequest> reqs);
+
+    // 同一个 prompt 生成 n 个候选（n <= n_seq）：prompt 只 prefill 一次，KV fork 到 n 个 sequence，
+    // 各自独立采样、同一个 batch 里一起 decode。按 score 从高到低返回（失败的排最后）；
+    // req.save_state 时只导出第一个（最好的）的 KV。on_token 对每个候选都会回调
+    using ScoreFn = std::function<double(const std::string &text)>;
+    std::vector<LLMResult> generate_candidates(GenRequest req, int n, const ScoreFn &score);
+
+private:
+    struct Slot;
+    void sample_slot(Slot &s, const llama_vocab *vocab);
+    void cut_slot(Slot &s, size_t keep);
+    void save_slot_state(Slot &s);
+    void finalize_result(Slot &s);
+    void finish_slot(Slot &s, const DoneFn &on_done);
+
+private:
+    llama_model *model_ = nullptr;
+    llama_context *ctx_ = nullptr;
+    GenParams params_;
+    int n_ctx_seq_ = 0;
+    int n_batch_ = 0;
+    int n_seq_ = 1;
+    bool reused_ = false;
+    std::string error_;
 };
 
 // on_delta: 每产生一段文本就回调（用于流式累积 + 进度推进）
@@ -27,4 +166,4 @@ LLMResult run_llm_summarize(const std::string& model_path,
                             const GenParams& params,
                             const std::function<void(const std::string&)>& on_delta);
 
-} // namespace ws_ai
\ No newline at end of file
+} // namespace ws_ai
@@ -0,0 +1,138 @@
+#pragma once
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace ws_ai {
+
+// Unix domain socket 上的二进制提交协议（LocalServer 和 ws_ai_loadgen 共用）。
+//
+// 帧：4 字节负载长度（小端）+ 1 字节类型 + 负载
+//
+//   客户端 -> 服务端
+//     'S' 提交：负载 = 一行选项（"model=fast&n_candidates=4&candidates=all&deadline_ms=3000&stream=0"，可以是空行）+ '\n' + 图片原始字节。
+//         也可以不带字节：同一次 sendmsg 里用 SCM_RIGHTS 传一个只读的 fd（memfd / 普通文件），负载只有选项行，
+//         图片不经过 socket；有名字的普通文件服务端直接用原路径，memfd 拷一份临时文件。
+//   服务端 -> 客户端
+//     'I' 任务 id
+//     'D' 新生成的文本（stream=1 时，默认）
+//     'F' 任务结束：最终状态 JSON（和 /api/status 一样，成功失败都是它）
+//     'E' 提交被拒：{"ok":false,"error":"..."}
+//
+// 一个连接上可以连续提交：收到 'F'（stream=0 时收到 'I'）之后就能发下一个 'S'。
+namespace local_proto {
+
+constexpr char kSubmit = 'S';
+constexpr char kId     = 'I';
+constexpr char kDelta  = 'D';
+constexpr char kFinal  = 'F';
+constexpr char kError  = 'E';
+
+constexpr size_t kHeaderSize = 5;
+
+#ifdef MSG_NOSIGNAL
+constexpr int kSendFlags = MSG_NOSIGNAL;
+#else
+constexpr int kSendFlags = 0;  // macOS：socket 上设 SO_NOSIGPIPE
+#endif
+
+// 写一帧；fd >= 0 时用第一次 sendmsg 把它带过去（发送方之后可以关掉自己的那份）
+inline bool send_frame(int sock, char type, const std::string &payload, int fd = -1) {
+    const uint32_t n = (uint32_t)payload.size();
+    char head[kHeaderSize] = {(char)(n & 0xFF), (char)((n >> 8) & 0xFF), (char)((n >> 16) & 0xFF), (char)(n >> 24), type};
+
+    iovec iov[2];
+    iov[0].iov_base = head;
+    iov[0].iov_len = kHeaderSize;
+    iov[1].iov_base = const_cast<char *>(payload.data());
+    iov[1].iov_len = payload.size();
+
+    msghdr msg{};
+    msg.msg_iov = iov;
+    msg.msg_iovlen = payload.empty() ? 1 : 2;
+    alignas(cmsghdr) char cbuf[CMSG_SPACE(sizeof(int))];
+    if (fd >= 0) {
+        std::memset(cbuf, 0, sizeof(cbuf));
+        msg.msg_control = cbuf;
+        msg.msg_controllen = sizeof(cbuf);
+        cmsghdr *c = CMSG_FIRSTHDR(&msg);
+        c->cmsg_level = SOL_SOCKET;
+        c->cmsg_type = SCM_RIGHTS;
+        c->cmsg_len = CMSG_LEN(sizeof(int));
+        std::memcpy(CMSG_DATA(c), &fd, sizeof(int));
+    }
+
+    ssize_t w;
+    do {
+        w = ::sendmsg(sock, &msg, kSendFlags);
+    } while (w < 0 && errno == EINTR);
+    if (w < 0) return false;
+
+    // 没写完的部分接着写（fd 已经随第一段过去了）
+    size_t done = (size_t)w;
+    const size_t total = kHeaderSize + payload.size();
+    while (done < total) {
+        const char *p = done < kHeaderSize ? head + done : payload.data() + (done - kHeaderSize);
+        const size_t len = done < kHeaderSize ? kHeaderSize - done : total - done;
+        w = ::send(sock, p, len, kSendFlags);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) return false;
+        done += (size_t)w;
+    }
+    return true;
+}
+
+// 读满 n 字节；途中收到的 fd 放进 *fd_out（已经有一个时多余的直接关掉）
+inline bool recv_full(int sock, char *buf, size_t n, int *fd_out) {
+    size_t got = 0;
+    while (got < n) {
+        iovec iov{buf + got, n - got};
+        msghdr msg{};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        alignas(cmsghdr) char cbuf[CMSG_SPACE(sizeof(int) * 4)];
+        msg.msg_control = cbuf;
+        msg.msg_controllen = sizeof(cbuf);
+#ifdef MSG_CMSG_CLOEXEC
+        const ssize_t r = ::recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+#else
+        const ssize_t r = ::recvmsg(sock, &msg, 0);
+#endif
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return false;
+        for (cmsghdr *c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c)) {
+            if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS) continue;
+            const size_t k = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            for (size_t i = 0; i < k; ++i) {
+                int fd;
+                std::memcpy(&fd, CMSG_DATA(c) + i * sizeof(int), sizeof(int));
+                if (fd_out && *fd_out < 0) *fd_out = fd;
+                else ::close(fd);
+            }
+        }
+        got += (size_t)r;
+    }
+    return true;
+}
+
+// 读一帧。对方带了 fd 时写进 *fd_out（没带保持 -1，调用方负责关）；连接关闭、出错或负载超过 max 返回 false
+inline bool recv_frame(int sock, char &type, std::string &payload, int *fd_out, size_t max) {
+    if (fd_out) *fd_out = -1;
+    char head[kHeaderSize];
+    if (!recv_full(sock, head, kHeaderSize, fd_out)) return false;
+    const uint32_t n = (uint32_t)(unsigned char)head[0] | (uint32_t)(unsigned char)head[1] << 8 |
+                       (uint32_t)(unsigned char)head[2] << 16 | (uint32_t)(unsigned char)head[3] << 24;
+    type = head[4];
+    if (n > max) return false;
+    payload.resize(n);
+    return n == 0 || recv_full(sock, &payload[0], n, fd_out);
+}
+
+} // namespace local_proto
+} // namespace ws_ai
@@ -0,0 +1,60 @@
+#pragma once
+#include "ws_ai/config.h"
+#include "ws_ai/job_manager.h"
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace ws_ai {
+
+// 本机提交入口：监听 Config::uds_path 上的 Unix domain socket，协议见 local_proto.h。
+// 截图快捷键守护进程和服务在同一台机器上，走这里不用 base64 / multipart、不过 TCP 栈；
+// 图片可以直接给字节，也可以用 SCM_RIGHTS 传 memfd / 文件的 fd（有名字的文件直接用原路径、不拷贝，memfd 拷一份），
+// 任务 id 和流式输出在同一个连接上回来。
+//
+// 本机客户端不多，一个连接一个线程（最多 Config::uds_max_conns 个），流式输出和 /api/stream 一样用 JobManager::wait_stream。
+// socket 文件权限 0600：只有同一个用户能连。
+class LocalServer {
+public:
+    LocalServer(const Config &cfg, std::shared_ptr<JobManager> jm);
+    ~LocalServer();
+
+    LocalServer(const LocalServer &) = delete;
+    LocalServer &operator=(const LocalServer &) = delete;
+
+    // 绑定 socket 文件（已有的旧 socket 文件会先删掉）并启动 accept 线程；失败返回 false 并写 err
+    bool start(const std::string &path, std::string &err);
+    void stop();
+
+private:
+    struct Conn {
+        int fd = -1;
+        std::thread th;
+        std::atomic<bool> finished{false};
+    };
+
+    void accept_loop();
+    void serve(Conn *c);
+    // 处理一个 'S' 帧；连接还能继续用返回 true
+    bool submit(int sock, const std::string &payload, int image_fd);
+    // stream=1：把 delta 和最终状态推给客户端，直到任务结束；客户端断开返回 false
+    bool stream_job(int sock, const std::string &id);
+
+private:
+    Config cfg_;
+    std::shared_ptr<JobManager> jm_;
+    std::string path_;
+    int listen_fd_ = -1;
+    std::thread accept_th_;
+    std::atomic<bool> stop_{false};
+
+    std::mutex conns_mu_;
+    std::list<std::unique_ptr<Conn>> conns_;
+};
+
+} // namespace ws_ai
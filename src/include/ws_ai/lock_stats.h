@@ -0,0 +1,61 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+namespace ws_ai {
+
+// 带争用统计的互斥量：先 try_lock，拿不到才算一次争用并计等待时长。
+// 满足 Lockable，配合 std::lock_guard / std::unique_lock / std::condition_variable_any 使用。
+class StatMutex {
+public:
+    struct Stats {
+        uint64_t acquisitions = 0;
+        uint64_t contended = 0;
+        uint64_t wait_ns = 0;
+        uint64_t max_wait_ns = 0;
+    };
+
+    void lock() {
+        if (m_.try_lock()) {
+            acquisitions_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        const auto t0 = std::chrono::steady_clock::now();
+        m_.lock();
+        const uint64_t ns = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - t0).count();
+        acquisitions_.fetch_add(1, std::memory_order_relaxed);
+        contended_.fetch_add(1, std::memory_order_relaxed);
+        wait_ns_.fetch_add(ns, std::memory_order_relaxed);
+        uint64_t prev = max_wait_ns_.load(std::memory_order_relaxed);
+        while (ns > prev && !max_wait_ns_.compare_exchange_weak(prev, ns, std::memory_order_relaxed)) {}
+    }
+
+    bool try_lock() {
+        if (!m_.try_lock()) return false;
+        acquisitions_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    void unlock() { m_.unlock(); }
+
+    Stats stats() const {
+        Stats s;
+        s.acquisitions = acquisitions_.load(std::memory_order_relaxed);
+        s.contended = contended_.load(std::memory_order_relaxed);
+        s.wait_ns = wait_ns_.load(std::memory_order_relaxed);
+        s.max_wait_ns = max_wait_ns_.load(std::memory_order_relaxed);
+        return s;
+    }
+
+private:
+    std::mutex m_;
+    std::atomic<uint64_t> acquisitions_{0};
+    std::atomic<uint64_t> contended_{0};
+    std::atomic<uint64_t> wait_ns_{0};
+    std::atomic<uint64_t> max_wait_ns_{0};
+};
+
+} // namespace ws_ai
@@ -0,0 +1,118 @@
+#pragma once
+#include "ws_ai/config.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+
+namespace ws_ai {
+
+// 任务里占内存的阶段：OCR（解码后的位图 + 前处理副本 + Vision）和生成（KV cache + logits + 计算图）
+enum class MemStage { ocr, llm };
+constexpr int kMemStageCount = 2;
+
+const char *mem_stage_name(MemStage s);
+
+// 全局内存记账：任务进入 OCR / 生成阶段前按估算占用预订，预算不够就排队等，阶段结束（或取消）时归还。
+// 多个 job worker 并发跑时靠它兜住峰值，而不是只开一个 worker。
+//
+// 按到达顺序放行（先来的大任务不会被后面的小任务一直插队饿死）；一个任务同一时刻只持有一个阶段的预订，
+// 所以不会互相等成死锁。单个预订比整个预算还大时，等其它预订都归还后单独放行（否则永远跑不了）。
+// 估算本身是粗略的上限（estimate_image_bytes / estimate_context_bytes），模型权重不算在内（见 ModelRegistry）。
+class MemoryGovernor {
+public:
+    // budget_bytes = 0 表示不限（只记账）
+    explicit MemoryGovernor(uint64_t budget_bytes);
+    ~MemoryGovernor();
+
+    MemoryGovernor(const MemoryGovernor &) = delete;
+    MemoryGovernor &operator=(const MemoryGovernor &) = delete;
+
+    // 预订凭证：析构时归还。move-only；拿到空凭证表示没有预订成功
+    class Reservation {
+    public:
+        Reservation() = default;
+        Reservation(Reservation &&o) noexcept;
+        Reservation &operator=(Reservation &&o) noexcept;
+        ~Reservation() { release(); }
+
+        Reservation(const Reservation &) = delete;
+        Reservation &operator=(const Reservation &) = delete;
+
+        explicit operator bool() const { return gov_ != nullptr; }
+        uint64_t bytes() const { return bytes_; }
+        double wait_ms() const { return wait_ms_; }
+        void release();
+
+    private:
+        friend class MemoryGovernor;
+        MemoryGovernor *gov_ = nullptr;
+        MemStage stage_ = MemStage::ocr;
+        uint64_t bytes_ = 0;
+        uint64_t ticket_ = 0;
+        double wait_ms_ = 0;
+    };
+
+    // 阻塞到预订成功；cancel 置位或 shutdown 时返回空凭证并写 err
+    Reservation reserve(MemStage stage, const std::string &job_id, uint64_t bytes,
+                        const std::atomic<bool> *cancel, std::string &err);
+
+    // 唤醒所有等待者并让它们失败（JobManager 析构时）
+    void shutdown();
+
+    uint64_t budget() const { return budget_; }
+    uint64_t reserved() const;
+
+    // GET /api/memory：预算、总预订、每个阶段的当前预订 / 峰值 / 等待统计、正在持有和排队的预订
+    std::string status_json() const;
+
+private:
+    struct Entry {
+        uint64_t ticket = 0;
+        std::string job_id;
+        MemStage stage = MemStage::ocr;
+        uint64_t bytes = 0;
+        bool granted = false;
+        std::chrono::steady_clock::time_point since;
+    };
+
+    struct StageStats {
+        uint64_t reserved = 0;
+        int active = 0;
+        uint64_t peak = 0;
+        uint64_t granted = 0;
+        uint64_t waited = 0;      // 需要排队的次数
+        double wait_ms = 0;       // 累计排队时间
+        double max_wait_ms = 0;
+        uint64_t oversized = 0;   // 比整个预算还大、单独放行的次数
+        uint64_t cancelled = 0;
+    };
+
+    bool can_grant_locked(const Entry &e) const;
+    void release(MemStage stage, uint64_t ticket, uint64_t bytes);
+
+private:
+    uint64_t budget_ = 0;
+
+    mutable std::mutex mu_;
+    std::condition_variable cv_;
+    std::list<Entry> entries_;  // 已放行的 + 排队的（按 ticket 递增）
+    uint64_t next_ticket_ = 1;
+    uint64_t reserved_ = 0;
+    uint64_t peak_ = 0;
+    StageStats stages_[kMemStageCount];
+    bool stop_ = false;
+};
+
+// Config::mem_budget_mb；为 0 时按物理内存的 60% 减去模型预算（Config::model_budget_mb）自动决定
+uint64_t memory_budget_from_config(const Config &cfg);
+
+// OCR 阶段的估算：从文件头读出宽高（PNG / JPEG / GIF / BMP / WebP），按 max_side 缩放后
+// 每像素约 8 字节（RGBA 位图 + 灰度 + 前处理副本 + Vision 内部缓冲）。读不出尺寸时按 max_side 的正方形算
+uint64_t estimate_image_bytes(const std::string &path, int max_side);
+
+} // namespace ws_ai
@@ -0,0 +1,14 @@
+#pragma once
+#include "ws_ai/config.h"
+#include "ws_ai/pipeline.h"
+
+#include <memory>
+
+namespace ws_ai {
+
+// 合成流水线：不碰 Vision / llama，按配置模拟 OCR 耗时、prefill 耗时和固定速率吐 token。
+// 用来在任何机器（包括 Linux）上压测 HTTP / JobManager 这一层。WS_AI_PIPELINE=mock 启用。
+// 图片旁边放一个 <图片>.txt 时把它当 OCR 结果（语义缓存按它算字符 n-gram 向量）。
+std::unique_ptr<Pipeline> make_mock_pipeline(const Config &cfg);
+
+} // namespace ws_ai
@@ -0,0 +1,93 @@
+#pragma once
+#include "ws_ai/config.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct llama_model;
+struct llama_context;
+
+namespace ws_ai {
+
+// 已加载到内存的模型；最后一个引用释放时 llama_model_free
+struct LoadedModel {
+  std::string name;
+  std::string path;
+  llama_model *model = nullptr;
+  uint64_t size_bytes = 0;
+
+  // 空闲 context 池：流水线的 context 参数都一样，用完放回来给下一个 job / 追问，
+  // 省掉每次 llama_init_from_model 分配 KV cache。随模型一起释放（先于模型）
+  size_t ctx_pool_cap = 0;
+  llama_context *take_context();          // 池空返回 nullptr
+  void put_context(llama_context *ctx);   // 池满直接 llama_free
+
+  ~LoadedModel();
+
+private:
+  std::mutex ctx_mu_;
+  std::vector<llama_context *> idle_ctx_;
+};
+
+// 租约：持有期间模型不会被 LRU / 空闲回收卸载
+using ModelLease = std::shared_ptr<LoadedModel>;
+
+// 多模型注册表：按需加载、跨 job 共享、超内存预算时卸载最久未用的模型、空闲超时卸载
+// 注意：所有租约必须在 registry 析构前释放
+class ModelRegistry {
+public:
+  explicit ModelRegistry(const Config &cfg);
+  ~ModelRegistry();
+
+  ModelRegistry(const ModelRegistry &) = delete;
+  ModelRegistry &operator=(const ModelRegistry &) = delete;
+
+  // "" -> default_model；未注册返回 ""
+  std::string resolve(const std::string &name) const;
+  bool has(const std::string &name) const { return !resolve(name).empty(); }
+
+  // 获取模型（必要时加载）；失败返回 nullptr 并写 err
+  ModelLease acquire(const std::string &name, std::string &err);
+
+  // GET /api/models
+  std::string status_json() const;
+
+private:
+  struct Entry {
+    ModelSpec spec;
+    std::shared_ptr<LoadedModel> loaded;  // nullptr = 未常驻
+    bool loading = false;
+    int active = 0;  // 未归还的租约数
+    int loads = 0;
+    std::chrono::steady_clock::time_point last_used{};
+  };
+
+  Entry *find_locked(const std::string &name);
+  const Entry *find_locked(const std::string &name) const;
+  uint64_t resident_bytes_locked() const;
+  // 腾出空间直到 resident + need <= budget（只动没有租约的模型）
+  std::vector<std::shared_ptr<LoadedModel>> evict_for_locked(uint64_t need, const Entry *keep);
+  void release(const std::string &name);
+  void reaper_loop();
+
+private:
+  std::string default_model_;
+  uint64_t budget_bytes_ = 0;
+  int idle_sec_ = 0;
+  size_t ctx_pool_cap_ = 0;
+
+  mutable std::mutex mu_;
+  std::condition_variable cv_;  // 加载完成 / 停止
+  std::vector<Entry> entries_;
+
+  std::thread reaper_;
+  bool stop_ = false;
+};
+
+} // namespace ws_ai
@@ -1,10 +1,21 @@
 #pragma once
+#include "ws_ai/image_preproc.h"
+
 #include <string>
 
 namespace ws_ai {
 
+class JobTrace;
+
 // 使用 Vision OCR：输入图片路径 -> 输出识别文本（UTF-8）
 // 失败返回空字符串
 std::string ocr_with_vision(const std::string& image_path);
 
-} // namespace ws_ai
\ No newline at end of file
+// 同上，但先走前处理：长边限制解码 -> 灰度 -> 自动对比度/对比度 -> 按行高缩小
+// trace 非空时记录 decode / preprocess / vision 三段
+std::string ocr_with_vision(const std::string& image_path, const PreprocOptions& opt, JobTrace* trace = nullptr);
+
+// 解码成灰度图（ImageIO 缩略图解码，长边不超过 max_side）；失败返回 false
+bool decode_image_luma(const std::string& image_path, int max_side, GrayImage& out);
+
+} // namespace ws_ai
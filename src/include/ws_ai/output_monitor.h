@@ -0,0 +1,85 @@
+#pragma once
+#include "ws_ai/config.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace ws_ai {
+
+// 生成为什么结束（LLMResult::stop_reason，/api/status 里输出名字）
+enum class StopReason {
+    none,
+    eos,            // 模型自己结束
+    max_tokens,     // max_new_tokens / n_ctx 用完
+    stop_string,    // <|im_end|> 之类
+    paragraphs,     // 要求的段落都写完了
+    drift,          // 开始出题、列编号、复述任务指令
+    language,       // 中文写着写着换成了英文
+    cancelled,
+    error,
+};
+
+const char *stop_reason_name(StopReason r);
+
+// 是不是输出结构监控主动停下的（这些情况才算“省下”了 token）
+inline bool stopped_by_monitor(StopReason r) {
+    return r == StopReason::paragraphs || r == StopReason::drift || r == StopReason::language;
+}
+
+struct MonitorOptions {
+    bool enabled = false;
+    int paragraphs = 2;             // 写完这么多段就停（0 = 不按段数停，追问用）
+    int min_paragraph_chars = 24;   // 短于这个的行（标题、“总结：”）不算一段
+    bool drift_markers = true;
+    bool language_switch = true;
+    int lang_window = 48;           // 最近多少个字母 / 汉字里看英文占比
+    float max_latin_ratio = 0.8f;   // 超过就算换了语言（前面得已经出现过中文）
+};
+
+// Config -> 摘要任务用的监控参数（Config::structure_stop 关掉时 enabled = false）
+MonitorOptions monitor_options_from_config(const Config &cfg);
+
+// build_prompt 要求的两段格式写成 GBNF（Config::structure_grammar 时交给 llama 的 grammar sampler）：
+// 两段非空文本，中间一个空行，段首不能是编号 / 分点 / 标题符号
+const char *two_paragraph_grammar();
+
+// 小模型写完两段后常见的跑偏标记（开始出题、列编号、复述任务指令）：从 from 开始找最早的一个，没有返回 npos
+size_t find_drift_marker(const std::string &text, size_t from = 0);
+
+// 流式检查输出结构：每接受一个 token 喂一次完整文本，发现该停了就返回原因和要保留的长度。
+// 只增量扫描新增部分，按完整的 UTF-8 字符推进（半个字符留到下次）
+class OutputMonitor {
+public:
+    OutputMonitor() = default;
+    explicit OutputMonitor(const MonitorOptions &o) : o_(o) {}
+
+    // text 为到目前为止的全部输出（已包含新 piece）。返回 none 表示继续；
+    // 否则 keep 为应该保留的字节数（跑偏的部分从这里截掉）
+    StopReason feed(const std::string &text, size_t &keep);
+
+    // 模型想 EOS 时问一下：段落已经写够（最后一段没有换行也算）就直接接受，不再重采样
+    bool complete() const;
+
+    int paragraphs() const { return paras_; }
+
+private:
+    bool line_is_paragraph() const;
+
+private:
+    MonitorOptions o_;
+    size_t scanned_ = 0;         // 已经处理过的字节
+
+    int paras_ = 0;              // 已经写完的段数
+    int line_chars_ = 0;         // 当前行的非空白字符数
+    uint32_t line_last_ = 0;     // 当前行最后一个非空白字符
+
+    std::vector<uint8_t> window_;  // 最近的字母 / 汉字：1 = 拉丁字母
+    size_t win_pos_ = 0;
+    int win_latin_ = 0;
+    bool seen_cjk_ = false;
+    size_t sentence_end_ = 0;    // 最近一个句末标点之后
+};
+
+} // namespace ws_ai
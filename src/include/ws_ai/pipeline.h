@@ -1,20 +1,100 @@
 #pragma once
 #include <atomic>
+#include <functional>
 #include <memory>
 #include <string>
+#include <vector>
 #include "ws_ai/config.h"
+#include "ws_ai/memory_governor.h"
 
 namespace ws_ai {
 
+class ModelRegistry;
+class JobTrace;
+class MemoryGovernor;
+
+// 多候选生成时的一个候选
+struct Candidate {
+    std::string text;
+    double score = 0;  // score_summary_format
+    int n_tokens = 0;
+};
+
+// 流水线回填给 JobManager 的统计（/api/status 里输出）
+struct RunStats {
+    std::string transcript;  // 到本轮回答结束的完整 ChatML 对话；追问时 KV 状态不可用就用它冷启动
+    int prompt_tokens = 0;   // 实际 prefill 的 token 数（追问恢复 KV 后只有新一轮）
+    int gen_tokens = 0;
+    double ttft_ms = 0;      // 开始生成到第一个 token（含 KV 恢复 + prefill）
+    double decode_ms = 0;    // 第一个 token 到生成结束
+    double ocr_ms = 0;       // OCR（含预处理），追问为 0
+    double restore_ms = 0;   // 追问：读 KV 文件 + 解压 + 恢复到 context
+    bool kv_restored = false;
+    std::string stop_reason;  // stop_reason_name(StopReason)
+    int tokens_saved = 0;     // 结构监控提前停下省掉的生成预算（多候选时是各候选之和）
+    int tokens_cut = 0;       // 生成了又被截掉的 token
+    std::vector<Candidate> candidates;  // n_candidates > 1 时按分数从高到低
+};
+
+// 追问：在 parent 那次对话后面接一轮用户提问
+struct FollowupRequest {
+    std::string parent_id;   // KV 状态按这个 id 找
+    std::string question;
+    std::string transcript;  // parent 的 RunStats::transcript
+};
+
+// 单个任务随请求携带的参数
+struct JobOptions {
+    std::string job_id;
+    std::string model;  // 空 = Config::default_model
+    int n_candidates = 1;  // >1：一次 prefill 生成多个候选，按格式打分取最好的
+    int max_new_tokens = 0;   // >0：这个任务的生成上限（deadline 来不及时缩短），否则用 Config 的
+    int min_new_tokens = -1;  // >=0：同上，生成下限
+
+    // OCR 完成后回调识别文本（JobManager 存下来，近重复命中时直接复用）
+    std::function<void(const std::string &)> on_ocr;
+
+    // 语义缓存（Config::semcache_threshold > 0 时 JobManager 设置）：OCR 之后流水线算出文本向量交给它，
+    // 返回 true 时 result 为缓存的结果，流水线不再生成、直接返回它
+    std::function<bool(const std::vector<float> &embedding, std::string &result)> on_embedding;
+
+    // 生成过程中每段新文本回调一次（/api/stream 流式输出用）
+    std::function<void(const std::string &)> on_delta;
+
+    JobTrace *trace = nullptr;  // 非空时记录各阶段 span
+    RunStats *stats = nullptr;  // 非空时回填
+    MemoryGovernor *memory = nullptr;  // 非空时 OCR / 生成前先预订内存（JobManager 多个 worker 并发时）
+};
+
 class Pipeline {
 public:
     virtual ~Pipeline() = default;
     virtual std::string run(const std::string &image_path,
+                            const JobOptions &opts,
                             std::atomic<int> &progress,
                             std::atomic<bool> &cancel_flag,
                             std::string &err_out) = 0;
+
+    // 追问；默认不支持
+    virtual std::string followup(const FollowupRequest &req,
+                                 const JobOptions &opts,
+                                 std::atomic<int> &progress,
+                                 std::atomic<bool> &cancel_flag,
+                                 std::string &err_out) {
+        (void)req; (void)opts; (void)cancel_flag;
+        progress.store(100);
+        err_out = "当前流水线不支持追问";
+        return "";
+    }
 };
 
-std::unique_ptr<Pipeline> make_pipeline(const Config &cfg);
+// 流水线进入 OCR / 生成阶段前调用：opts.memory 为空时不记账直接返回 true；
+// 否则阻塞到预订成功（trace 里记一段 mem_wait），取消 / 退出时返回 false 并写 err
+bool reserve_stage_memory(const JobOptions &opts, MemStage stage, uint64_t bytes,
+                          const std::atomic<bool> &cancel_flag, MemoryGovernor::Reservation &out, std::string &err);
+
+// 模型由 registry 统一加载/共享，pipeline 只在每次 run 时租用
+std::unique_ptr<Pipeline> make_pipeline(const Config &cfg,
+                                        std::shared_ptr<ModelRegistry> models);
 
-} // namespace ws_ai
\ No newline at end of file
+} // namespace ws_ai
@@ -3,4 +3,9 @@
 
 namespace ws_ai {
 std::string build_prompt(const std::string &ocr_text);
+// 候选打分：越接近 build_prompt 要求的格式（两段中文、不分点、无标题、每段长度适中）分越高，满分 1
+double score_summary_format(const std::string &text);
+
+// 追问：接在上一轮 assistant 回答后面（先补上回答的结束标记），再开新的 user / assistant 轮
+std::string build_followup_prompt(const std::string &question);
 } // namespace ws_ai
\ No newline at end of file
@@ -0,0 +1,41 @@
+#pragma once
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <string>
+
+namespace ws_ai {
+
+// 一个静态文件的三种预压缩表示（启动时算好，之后只读）
+struct StaticAsset {
+  std::string mime;
+  std::string etag;           // 强 ETag（内容哈希），不同编码加后缀
+  bool immutable = false;     // 带版本号引用的资源可以长期缓存
+
+  std::shared_ptr<const std::string> identity;
+  std::shared_ptr<const std::string> gzip;     // 空指针 = 没有（太小或不划算）
+  std::shared_ptr<const std::string> brotli;
+};
+
+// 前端静态资源：web_root 目录存在时从目录加载，否则用构建时嵌入的副本
+// index.html 里对其它资源的引用会被改写成 "/app.js?v=<hash>"，这样 html 走 304，
+// 其余资源可以 immutable 长期缓存
+class StaticAssets {
+public:
+  // 返回加载的文件数（0 = 没有可用资源）
+  size_t load(const std::string &web_root);
+
+  // url: "/"、"/app.js" ...；找不到返回 nullptr
+  const StaticAsset *find(const std::string &url) const;
+
+  const std::map<std::string, StaticAsset> &all() const { return assets_; }
+
+private:
+  void add(const std::string &url, std::string content);
+  void finalize();
+
+private:
+  std::map<std::string, StaticAsset> assets_;
+};
+
+} // namespace ws_ai
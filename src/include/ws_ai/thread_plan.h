@@ -0,0 +1,57 @@
+#pragma once
+#include "ws_ai/config.h"
+
+#include <string>
+#include <vector>
+
+namespace ws_ai {
+
+// CPU 拓扑：逻辑核 -> 物理核 / NUMA 节点（Linux 读 sysfs，macOS 读 sysctl）
+struct CpuInfo {
+    int id = 0;     // 逻辑 CPU 编号
+    int core = 0;   // 物理核（同一物理核上的 SMT 兄弟相同）
+    int node = 0;   // NUMA 节点
+};
+
+struct CpuTopology {
+    int n_logical = 1;
+    int n_physical = 1;
+    int n_perf = 0;                 // Apple Silicon 性能核数（其它平台 0）
+    int n_nodes = 1;
+    std::vector<CpuInfo> cpus;      // 只有 Linux 填；空 = 不支持绑核
+};
+
+CpuTopology detect_cpu_topology();
+
+enum class ThreadRole { llm, ocr, http };
+
+// 线程规划：llama decode / prefill 线程数、OCR worker 数、HTTP worker 数，以及可选的绑核方案
+struct ThreadPlan {
+    int n_threads = 1;        // 每个任务的 llama 线程数（服务端多个 job worker 时平分）
+    int n_threads_batch = 1;
+    int job_workers = 1;      // 服务端同时执行的任务数
+    int ocr_workers = 1;
+    int http_workers = 2;
+
+    bool pin = false;
+    int llm_node = -1;
+    std::vector<int> llm_cpus, ocr_cpus, http_cpus;  // 空 = 不绑
+
+    CpuTopology topo;
+
+    std::string report() const;
+};
+
+// Config 里为 0 的项自动决定。overlap_ocr=true 表示 OCR 与生成同时跑（批处理流水线），
+// 给 OCR 单独留核；服务端每个 job worker 串行跑 OCR -> LLM，几个 worker 平分性能核
+ThreadPlan make_thread_plan(const Config &cfg, bool overlap_ocr);
+ThreadPlan make_thread_plan(const Config &cfg, bool overlap_ocr, const CpuTopology &topo);
+
+// 把规划结果写回 Config（之后各组件直接读 cfg.n_threads 等）
+void apply_thread_plan(const ThreadPlan &plan, Config &cfg);
+
+// 把当前线程绑到该角色的核上；之后在这个线程里创建的线程（ggml 计算线程、httplib 线程池）会继承。
+// 不支持 / 没开绑核时返回 false
+bool pin_current_thread(const ThreadPlan &plan, ThreadRole role);
+
+} // namespace ws_ai
@@ -0,0 +1,95 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace ws_ai {
+
+// 轻量 span 记录：每个 job 一个无锁环形缓冲 + 全局滚动环，导出成 Chrome trace-event JSON
+// （chrome://tracing 或 https://ui.perfetto.dev 直接打开）。
+// 关闭时 JobManager 不创建 JobTrace，各处埋点只剩一次空指针判断。
+
+struct TraceEvent {
+    const char *name = nullptr;  // 必须是静态字符串
+    uint64_t ts_us = 0;          // 相对进程启动
+    uint64_t dur_us = 0;
+    uint32_t tid = 0;
+    uint32_t job = 0;            // JobTrace 序号
+    int64_t arg = -1;            // 可选数值（token 数、chunk 大小），<0 不输出
+};
+
+uint64_t trace_now_us();
+
+// 多写者无锁环：写端 fetch_add 占位，每个槽一个 seqlock；读端拷贝快照，丢弃正在写 / 已被覆盖的槽
+class TraceRing {
+public:
+    explicit TraceRing(size_t capacity);  // 向上取 2 的幂
+
+    void push(const TraceEvent &e);
+    std::vector<TraceEvent> snapshot() const;  // 按时间排序
+
+private:
+    struct Slot {
+        std::atomic<uint64_t> seq{0};  // 2*idx+1 写入中，2*idx+2 已完成
+        std::atomic<uint64_t> w[5];
+    };
+    std::unique_ptr<Slot[]> slots_;
+    size_t mask_ = 0;
+    std::atomic<uint64_t> head_{0};
+};
+
+class JobTrace {
+public:
+    JobTrace(std::string job_id, int decode_every);
+
+    const std::string &job_id() const { return job_id_; }
+    uint32_t seq() const { return seq_; }
+    int decode_every() const { return decode_every_; }  // decode 阶段每 N 个 token 记一个 span
+
+    // 同时写入本 job 的环和全局滚动环
+    void span(const char *name, uint64_t start_us, uint64_t dur_us, int64_t arg = -1);
+
+    std::string chrome_json() const;
+
+    // job 结束后换成这个：环里的 span 拷成紧凑数组（环本身 512 槽 ~24 KB），之后再写只进全局环
+    std::shared_ptr<JobTrace> frozen() const;
+
+private:
+    JobTrace() = default;
+
+    std::string job_id_;
+    uint32_t seq_ = 0;
+    int decode_every_ = 32;
+    std::unique_ptr<TraceRing> ring_;  // frozen 之后为空
+    std::vector<TraceEvent> spans_;    // frozen 之后的 span
+};
+
+// RAII：构造时记开始时间，析构时写 span；trace 为空什么都不做
+class TraceSpan {
+public:
+    TraceSpan(JobTrace *t, const char *name, int64_t arg = -1)
+    : t_(t), name_(name), arg_(arg) {
+        if (t_) start_ = trace_now_us();
+    }
+    ~TraceSpan() {
+        if (t_) t_->span(name_, start_, trace_now_us() - start_, arg_);
+    }
+    void set_arg(int64_t a) { arg_ = a; }
+
+    TraceSpan(const TraceSpan &) = delete;
+    TraceSpan &operator=(const TraceSpan &) = delete;
+
+private:
+    JobTrace *t_;
+    const char *name_;
+    int64_t arg_;
+    uint64_t start_ = 0;
+};
+
+// 全局滚动 trace（最近若干千个 span，所有 job），每个 job 一条 process 轨道
+std::string global_trace_json();
+
+} // namespace ws_ai
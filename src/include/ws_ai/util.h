@@ -16,6 +16,9 @@ bool read_file_binary(const std::string& path, std::string& out);
 // 简单的 content-type 推断
 std::string guess_mime(const std::string& path);
 
+// JSON 字符串转义（不含两侧引号）
+std::string json_escape(const std::string& s);
+
 // 路径拼接（非常简化，不处理复杂边界）
 std::string join_path(const std::string& a, const std::string& b);
 
@@ -0,0 +1,61 @@
+#pragma once
+#include "ws_ai/config.h"
+#include "ws_ai/job_manager.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace ws_ai {
+
+// 流式 / 进度观察连接的事件循环，监听 Config::watch_port（和主端口分开）。
+// httplib 一个连接占一个线程，开着的 /api/stream 会把线程池占满、把上传堵在后面；
+// 这里少量线程用 epoll（Linux，其它平台退回 poll）挂住成千上万个空闲连接，
+// JobManager 有更新时回调过来，按 job id 把事件推给所有订阅了它的连接。
+//
+//   GET /api/stream?id=   SSE：delta / done / error，格式和主端口上的一样
+//   GET /api/watch?id=    SSE：进度或状态变化时发 progress，结束时 done / error（给只显示进度条的页面）
+//   GET /api/watch/stats  当前连接数、推送计数
+//
+// 响应不分块、以关闭连接结束，带 Access-Control-Allow-Origin: *（页面在主端口上）。
+class WatchServer {
+public:
+    WatchServer(const Config &cfg, std::shared_ptr<JobManager> jm);
+    ~WatchServer();
+
+    WatchServer(const WatchServer &) = delete;
+    WatchServer &operator=(const WatchServer &) = delete;
+
+    // 绑定端口并启动事件循环线程；失败返回 false 并写 err
+    bool start(const std::string &host, int port, std::string &err);
+    void stop();
+
+    std::string stats_json() const;
+
+private:
+    struct Loop;  // watch_server.cpp
+
+    // 计数（各循环线程直接累加）
+    struct Counters {
+        std::atomic<int64_t> open{0};
+        std::atomic<uint64_t> accepted{0};
+        std::atomic<uint64_t> rejected{0};     // 超过 watch_max_conns
+        std::atomic<uint64_t> dropped_slow{0}; // 发送缓冲积压太多被断开
+        std::atomic<uint64_t> events{0};
+        std::atomic<uint64_t> bytes{0};
+        std::atomic<uint64_t> wakeups{0};      // 处理了多少批更新
+    };
+
+    void on_update(const std::string &id);
+
+private:
+    Config cfg_;
+    std::shared_ptr<JobManager> jm_;
+    int listen_fd_ = -1;
+    std::vector<std::unique_ptr<Loop>> loops_;
+    Counters counters_;
+};
+
+} // namespace ws_ai
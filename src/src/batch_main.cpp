@@ -0,0 +1,353 @@
+// ws_ai_batch：离线批处理，目录 / glob / 文件列表 -> JSONL
+//
+//   ws_ai_batch -o out.jsonl -j 4 ~/Screenshots
+//   ws_ai_batch -o out.jsonl "shots/*.png" @more_files.txt
+//
+// 模型只加载一次常驻；OCR 线程和生成线程流水线并行；生成端在同一个 context 里
+// 跑多个 sequence（连续批处理）。输出文件追加写，重跑时跳过已经有结果的图片。
+#include "ws_ai/config.h"
+#include "ws_ai/llm_runner.h"
+#include "ws_ai/model_registry.h"
+#include "ws_ai/ocr_vision.h"
+#include "ws_ai/output_monitor.h"
+#include "ws_ai/prompt.h"
+#include "ws_ai/thread_plan.h"
+#include "ws_ai/util.h"
+
+#include <json.hpp>
+
+#include <glob.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+struct Options {
+    std::vector<std::string> inputs;
+    std::string out_path = "batch_out.jsonl";
+    std::string model;
+    int parallel = 4;
+    int ocr_workers = 0;      // 0 = 按线程规划
+    int n_threads = 0;
+    int n_threads_batch = 0;
+    bool pin = false;
+    bool resume = true;
+    bool retry_errors = false;
+};
+
+struct Item {
+    std::string path;
+    std::string ocr;
+    double ocr_ms = 0;
+    Clock::time_point t_begin;     // 开始 OCR
+    Clock::time_point t_ocr_done;  // 进入生成队列
+};
+
+double ms_since(Clock::time_point a, Clock::time_point b = Clock::now()) {
+    return std::chrono::duration<double, std::milli>(b - a).count();
+}
+
+void usage() {
+    std::cerr <<
+        "用法: ws_ai_batch [选项] <目录|glob|@列表文件>...\n"
+        "  -o, --out FILE       输出 JSONL（默认 batch_out.jsonl，追加写）\n"
+        "  -m, --model NAME     WS_AI_MODELS 里的模型名，或直接给 .gguf 路径\n"
+        "  -j, --parallel N     同时生成的 sequence 数（默认 4）\n"
+        "      --ocr-workers N  OCR 线程数（默认按 CPU 自动）\n"
+        "  -t, --threads N      llama decode 线程数（默认按 CPU 自动）\n"
+        "      --threads-batch N  llama prefill 线程数\n"
+        "      --pin            Linux 下按角色绑核\n"
+        "      --no-resume      不跳过输出文件里已有的图片\n"
+        "      --retry-errors   续跑时重做之前失败的图片\n";
+}
+
+bool parse_args(int argc, char **argv, Options &o) {
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        auto value = [&](int &idx) -> const char * { return idx + 1 < argc ? argv[++idx] : nullptr; };
+        if (a == "-h" || a == "--help") return false;
+        else if (a == "-o" || a == "--out") { const char *v = value(i); if (!v) return false; o.out_path = v; }
+        else if (a == "-m" || a == "--model") { const char *v = value(i); if (!v) return false; o.model = v; }
+        else if (a == "-j" || a == "--parallel") { const char *v = value(i); if (!v) return false; o.parallel = std::max(1, std::atoi(v)); }
+        else if (a == "--ocr-workers") { const char *v = value(i); if (!v) return false; o.ocr_workers = std::max(1, std::atoi(v)); }
+        else if (a == "-t" || a == "--threads") { const char *v = value(i); if (!v) return false; o.n_threads = std::max(1, std::atoi(v)); }
+        else if (a == "--threads-batch") { const char *v = value(i); if (!v) return false; o.n_threads_batch = std::max(1, std::atoi(v)); }
+        else if (a == "--pin") o.pin = true;
+        else if (a == "--no-resume") o.resume = false;
+        else if (a == "--retry-errors") o.retry_errors = true;
+        else if (!a.empty() && a[0] == '-') { std::cerr << "未知参数: " << a << "\n"; return false; }
+        else o.inputs.push_back(a);
+    }
+    return !o.inputs.empty();
+}
+
+bool is_image_file(const fs::path &p) {
+    std::string ext = p.extension().string();
+    for (auto &c : ext) c = (char)tolower((unsigned char)c);
+    static const char *kExts[] = {".png", ".jpg", ".jpeg", ".webp", ".heic", ".heif", ".tif", ".tiff", ".bmp", ".gif"};
+    for (const char *e : kExts) if (ext == e) return true;
+    return false;
+}
+
+// 目录（递归）、glob、@列表文件、单个文件 -> 排序去重后的路径列表
+std::vector<std::string> expand_inputs(const std::vector<std::string> &inputs) {
+    std::set<std::string> out;
+    std::error_code ec;
+    for (const auto &in : inputs) {
+        if (in.size() > 1 && in[0] == '@') {
+            std::ifstream ifs(in.substr(1));
+            std::string line;
+            while (std::getline(ifs, line)) {
+                if (!line.empty() && line.back() == '\r') line.pop_back();
+                if (!line.empty()) out.insert(line);
+            }
+        } else if (fs::is_directory(in, ec)) {
+            for (auto it = fs::recursive_directory_iterator(in, ec); !ec && it != fs::recursive_directory_iterator(); it.increment(ec)) {
+                if (it->is_regular_file() && is_image_file(it->path())) out.insert(it->path().string());
+            }
+        } else if (in.find_first_of("*?[") != std::string::npos) {
+            glob_t g{};
+            if (glob(in.c_str(), 0, nullptr, &g) == 0) {
+                for (size_t i = 0; i < g.gl_pathc; ++i) out.insert(g.gl_pathv[i]);
+            }
+            globfree(&g);
+        } else {
+            out.insert(in);
+        }
+    }
+    return {out.begin(), out.end()};
+}
+
+// 已有输出里的图片路径（续跑时跳过）
+std::set<std::string> load_done(const std::string &out_path, bool retry_errors) {
+    std::set<std::string> done;
+    std::ifstream ifs(out_path);
+    std::string line;
+    while (std::getline(ifs, line)) {
+        auto j = nlohmann::json::parse(line, nullptr, /*allow_exceptions*/ false);
+        if (!j.is_object() || !j.contains("path")) continue;  // 上次被杀时写了一半的行
+        if (retry_errors && !j.value("ok", false)) continue;
+        done.insert(j["path"].get<std::string>());
+    }
+    return done;
+}
+
+// 一行 JSONL 输出；多线程写，自己加锁并 flush，保证被杀时最多丢半行
+class JsonlWriter {
+public:
+    explicit JsonlWriter(const std::string &path) : ofs_(path, std::ios::app) {}
+    bool ok() const { return (bool)ofs_; }
+
+    void write(const nlohmann::json &j) {
+        const std::string line = j.dump(-1, ' ', false, nlohmann::json::error_handler_t::replace);
+        std::lock_guard<std::mutex> lk(mu_);
+        ofs_ << line << "\n";
+        ofs_.flush();
+    }
+
+private:
+    std::mutex mu_;
+    std::ofstream ofs_;
+};
+
+} // namespace
+
+int main(int argc, char **argv) {
+    Options opt;
+    if (!parse_args(argc, argv, opt)) {
+        usage();
+        return 2;
+    }
+
+    ws_ai::Config cfg;
+    ws_ai::apply_env_overrides(cfg);
+    if (opt.model.size() > 5 && opt.model.compare(opt.model.size() - 5, 5, ".gguf") == 0) {
+        cfg.models = {{"cli", opt.model}};
+        cfg.default_model = "cli";
+        opt.model.clear();
+    }
+    cfg.model_idle_sec = 0;  // 批处理期间常驻
+
+    // 线程布局：OCR 和生成流水线并行，给 OCR 留核
+    if (opt.ocr_workers > 0) cfg.ocr_workers = opt.ocr_workers;
+    if (opt.n_threads > 0) cfg.n_threads = opt.n_threads;
+    if (opt.n_threads_batch > 0) cfg.n_threads_batch = opt.n_threads_batch;
+    if (opt.pin) cfg.pin_threads = true;
+    const ws_ai::ThreadPlan plan = ws_ai::make_thread_plan(cfg, /*overlap_ocr*/ true);
+    ws_ai::apply_thread_plan(plan, cfg);
+    opt.ocr_workers = cfg.ocr_workers;
+    std::cerr << plan.report();
+
+    std::vector<std::string> files = expand_inputs(opt.inputs);
+    const size_t n_found = files.size();
+    if (opt.resume) {
+        const auto done = load_done(opt.out_path, opt.retry_errors);
+        files.erase(std::remove_if(files.begin(), files.end(),
+                                   [&](const std::string &f) { return done.count(f) > 0; }),
+                    files.end());
+    }
+    std::cerr << "[batch] " << n_found << " images, " << (n_found - files.size()) << " already done, "
+              << files.size() << " to process\n";
+    if (files.empty()) return 0;
+
+    JsonlWriter writer(opt.out_path);
+    if (!writer.ok()) {
+        std::cerr << "无法写入输出文件: " << opt.out_path << "\n";
+        return 1;
+    }
+
+    ws_ai::ModelRegistry models(cfg);
+    std::string err;
+    ws_ai::ModelLease lease = models.acquire(opt.model, err);
+    if (!lease) {
+        std::cerr << err << "\n";
+        return 1;
+    }
+
+    const auto t_all = Clock::now();
+    std::atomic<size_t> n_ok{0}, n_err{0};
+    std::atomic<long long> n_gen_tokens{0}, n_saved_tokens{0};
+
+    auto write_error = [&](const Item &it, const std::string &msg) {
+        nlohmann::json j;
+        j["path"] = it.path;
+        j["ok"] = false;
+        j["error"] = msg;
+        j["timings_ms"] = {{"ocr", it.ocr_ms}, {"total", ms_since(it.t_begin)}};
+        writer.write(j);
+        n_err++;
+    };
+
+    // 1) OCR 线程：按顺序领图片，结果放进有界队列（满了就等，避免 OCR 跑太远占内存）
+    const size_t queue_cap = (size_t)(opt.parallel * 2 + opt.ocr_workers);
+    std::mutex qmu;
+    std::condition_variable q_not_empty, q_not_full;
+    std::deque<Item> queue;
+    std::atomic<size_t> next_file{0};
+    int ocr_running = opt.ocr_workers;
+
+    const ws_ai::PreprocOptions preproc = ws_ai::preproc_options_from_config(cfg);
+    std::vector<std::thread> ocr_threads;
+    for (int w = 0; w < opt.ocr_workers; ++w) {
+        ocr_threads.emplace_back([&] {
+            ws_ai::pin_current_thread(plan, ws_ai::ThreadRole::ocr);
+            for (;;) {
+                const size_t i = next_file.fetch_add(1);
+                if (i >= files.size()) break;
+
+                Item it;
+                it.path = files[i];
+                it.t_begin = Clock::now();
+                it.ocr = ws_ai::ocr_with_vision(it.path, preproc);
+                it.ocr_ms = ms_since(it.t_begin);
+                if (it.ocr.find_first_not_of(" \t\r\n") == std::string::npos) {
+                    write_error(it, "OCR失败或未识别到文字");
+                    continue;
+                }
+                it.t_ocr_done = Clock::now();
+
+                std::unique_lock<std::mutex> lk(qmu);
+                q_not_full.wait(lk, [&] { return queue.size() < queue_cap; });
+                queue.push_back(std::move(it));
+                q_not_empty.notify_one();
+            }
+            std::lock_guard<std::mutex> lk(qmu);
+            ocr_running--;
+            q_not_empty.notify_all();
+        });
+    }
+
+    // 2) 生成：一个 context、opt.parallel 个 sequence（ggml 计算线程继承主线程的亲和性）
+    ws_ai::pin_current_thread(plan, ws_ai::ThreadRole::llm);
+    ws_ai::LlmRunner runner(lease->model, ws_ai::gen_params_from_config(cfg), cfg.n_ctx, cfg.n_batch, opt.parallel);
+    if (!runner.ok()) std::cerr << runner.error() << "\n";
+
+    std::vector<Item> in_flight((size_t)opt.parallel * 4);  // user 指针指向这里的槽位
+    std::vector<size_t> free_slots;
+    for (size_t i = in_flight.size(); i-- > 0;) free_slots.push_back(i);
+
+    runner.run(
+        [&](bool block) -> std::optional<ws_ai::GenRequest> {
+            std::unique_lock<std::mutex> lk(qmu);
+            if (block) q_not_empty.wait(lk, [&] { return !queue.empty() || ocr_running == 0; });
+            if (queue.empty() || free_slots.empty()) return std::nullopt;
+
+            const size_t slot = free_slots.back();
+            free_slots.pop_back();
+            in_flight[slot] = std::move(queue.front());
+            queue.pop_front();
+            q_not_full.notify_one();
+            lk.unlock();
+
+            ws_ai::GenRequest r;
+            r.prompt = ws_ai::build_prompt(in_flight[slot].ocr);
+            r.monitor = ws_ai::monitor_options_from_config(cfg);
+            if (cfg.structure_grammar) r.grammar = ws_ai::two_paragraph_grammar();
+            r.user = &in_flight[slot];
+            return r;
+        },
+        [&](ws_ai::GenRequest &req, ws_ai::LLMResult &res) {
+            Item &it = *static_cast<Item *>(req.user);
+            const double queue_ms = ms_since(it.t_ocr_done) - res.prefill_ms - res.decode_ms;
+
+            nlohmann::json j;
+            j["path"] = it.path;
+            j["ok"] = res.ok;
+            j["model"] = lease->name;
+            if (res.ok) j["result"] = res.text;
+            else j["error"] = res.error;
+            j["ocr_chars"] = it.ocr.size();
+            j["prompt_tokens"] = res.n_prompt_tokens;
+            j["gen_tokens"] = res.n_gen_tokens;
+            j["stop_reason"] = ws_ai::stop_reason_name(res.stop_reason);
+            if (ws_ai::stopped_by_monitor(res.stop_reason)) {
+                j["tokens_saved"] = res.n_saved_tokens;
+                j["tokens_cut"] = res.n_cut_tokens;
+            }
+            j["timings_ms"] = {
+                {"ocr", it.ocr_ms},
+                {"queue", std::max(0.0, queue_ms)},
+                {"prefill", res.prefill_ms},
+                {"decode", res.decode_ms},
+                {"total", ms_since(it.t_begin)},
+            };
+            writer.write(j);
+
+            (res.ok ? n_ok : n_err)++;
+            n_gen_tokens += res.n_gen_tokens;
+            n_saved_tokens += res.n_saved_tokens;
+            const size_t finished = n_ok + n_err;
+            std::fprintf(stderr, "[batch] %zu/%zu %s %.0f ms %s\n", finished, files.size(),
+                         res.ok ? "ok " : "err", ms_since(it.t_begin), it.path.c_str());
+
+            it = Item{};
+            std::lock_guard<std::mutex> lk(qmu);
+            free_slots.push_back((size_t)(&it - in_flight.data()));
+        });
+
+    for (auto &t : ocr_threads) t.join();
+
+    const double secs = ms_since(t_all) / 1000.0;
+    std::fprintf(stderr, "[batch] done: %zu ok, %zu failed in %.1f s (%.2f img/s, %.1f gen tok/s, %lld tokens saved by early stop)\n",
+                 n_ok.load(), n_err.load(), secs, (n_ok + n_err) / std::max(secs, 1e-9),
+                 n_gen_tokens.load() / std::max(secs, 1e-9), n_saved_tokens.load());
+    return n_err.load() == 0 ? 0 : 1;
+}
@@ -0,0 +1,1070 @@
+// ws_ai_bench：OCR 前处理各个 kernel 的耗时（SIMD vs 标量）
+//
+//   ws_ai_bench                 # 默认 2560x1600 合成截图
+//   ws_ai_bench 3840 2160 20    # 宽 高 重复次数
+//   ws_ai_bench hash 100000     # 近重复索引：指纹耗时、抗裁剪距离、N 条时的查询延迟和内存
+//   ws_ai_bench semcache 4096 [--model emb.gguf] [--threshold 0.92] [--articles 200]
+//                               # 语义缓存：同一篇文章的 OCR 变体 / 不同文章的相似度和命中率，N 条时的查询延迟和内存；
+//                               # 顺带检查 SIMD / 标量点积一致、top-k 顺序和阈值、淘汰、mock 流水线上的端到端命中，不对时返回 1
+//   ws_ai_bench threads model.gguf [--threads 2,4,8] [--ocr 0,1,2] [--image shot.png]
+//                               # 线程扫描：OCR 并发 x llama 线程数 -> prefill / decode tok/s、OCR img/s
+//   ws_ai_bench followup model.gguf [--image shot.png | --text ocr.txt] [--question "..."]
+//                               # 追问首 token 延迟：恢复 KV 状态 vs 冷启动重算（含 OCR）
+//   ws_ai_bench candidates model.gguf [--n 4] [--gen 64] [--text ocr.txt]
+//                               # 多候选：共享 prefill + fork vs 各自 prefill（串行 / 同 batch）
+//   ws_ai_bench structure model.gguf [--runs 5] [--text ocr.txt]
+//                               # 结构监控：同一份输出上能省多少 token，开 / 关的实际 token 数和耗时
+//
+// 输出 ms / 次 和 ms / 百万像素，方便换机器、换编译选项（-DWS_AI_NATIVE=ON）对比。
+#include "ws_ai/config.h"
+#include "ws_ai/embed_index.h"
+#include "ws_ai/image_hash.h"
+#include "ws_ai/image_preproc.h"
+#include "ws_ai/job_manager.h"
+#include "ws_ai/kv_store.h"
+#include "ws_ai/llm_runner.h"
+#include "ws_ai/model_registry.h"
+#include "ws_ai/ocr_vision.h"
+#include "ws_ai/output_monitor.h"
+#include "ws_ai/prompt.h"
+#include "ws_ai/thread_plan.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+// 合成一张“截图”：浅色背景、深色侧栏和标题栏，正文是一行行长短不一的深色字块，带一点噪声
+std::vector<uint8_t> make_screenshot(int w, int h, int line_px, unsigned seed = 42) {
+    std::vector<uint8_t> rgba((size_t)w * h * 4);
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<int> noise(-6, 6), glyph(0, 3);
+    std::vector<int> line_end(h / (line_px * 2) + 1);
+    for (auto &e : line_end) e = w / 5 + (int)(rng() % (unsigned)(w * 7 / 10));
+
+    const int pitch = line_px * 2, sidebar = w / 6, header = h / 12;
+    for (int y = 0; y < h; ++y) {
+        const int ly = y - header;
+        const bool text_row = ly > 0 && (ly % pitch) >= line_px / 4 && (ly % pitch) < line_px;
+        uint8_t *p = rgba.data() + (size_t)y * w * 4;
+        for (int x = 0; x < w; ++x, p += 4) {
+            int v = 236 + noise(rng);
+            if (x < sidebar || y < header) v = 70 + noise(rng);
+            else if (text_row && x > sidebar + w / 40 && x < line_end[ly / pitch] &&
+                     ((x / (line_px / 2 + 1)) % 5) != 4 && glyph(rng) != 0) v = 40 + noise(rng);
+            p[0] = (uint8_t)std::clamp(v + 4, 0, 255);
+            p[1] = (uint8_t)std::clamp(v, 0, 255);
+            p[2] = (uint8_t)std::clamp(v - 6, 0, 255);
+            p[3] = 255;
+        }
+    }
+    return rgba;
+}
+
+// 跑 reps 次取最小值（比平均值更不受调度抖动影响）
+double time_min_ms(int reps, const std::function<void()> &setup, const std::function<void()> &fn) {
+    double best = 1e30;
+    for (int i = 0; i < reps; ++i) {
+        if (setup) setup();
+        auto t0 = Clock::now();
+        fn();
+        best = std::min(best, std::chrono::duration<double, std::milli>(Clock::now() - t0).count());
+    }
+    return best;
+}
+
+double us_since(Clock::time_point t0) {
+    return std::chrono::duration<double, std::micro>(Clock::now() - t0).count();
+}
+
+ws_ai::GrayImage to_gray(const std::vector<uint8_t> &rgba, int w, int h) {
+    ws_ai::GrayImage g;
+    ws_ai::rgba_to_luma(rgba.data(), w, h, (size_t)w * 4, false, g);
+    return g;
+}
+
+ws_ai::GrayImage crop(const ws_ai::GrayImage &in, int dx, int dy, int dw, int dh) {
+    ws_ai::GrayImage out;
+    out.width = in.width - dx - dw;
+    out.height = in.height - dy - dh;
+    out.pixels.resize((size_t)out.width * out.height);
+    for (int y = 0; y < out.height; ++y) std::copy_n(in.row(y + dy) + dx, out.width, out.row(y));
+    return out;
+}
+
+// 和上传时一样：先缩到长边 256 再算指纹
+ws_ai::ImageFingerprint fingerprint_of(const ws_ai::GrayImage &img) {
+    const double s = 256.0 / std::max(img.width, img.height);
+    ws_ai::GrayImage small;
+    ws_ai::downscale_area(img, std::max(1, (int)(img.width * s)), std::max(1, (int)(img.height * s)), small);
+    ws_ai::ImageFingerprint fp;
+    ws_ai::compute_fingerprint(small, fp);
+    return fp;
+}
+
+int bench_hash(int n) {
+    // 1) 指纹耗时 + 典型“近重复”变体的距离
+    const int w = 2560, h = 1600;
+    const ws_ai::GrayImage base = to_gray(make_screenshot(w, h, 48), w, h);
+    ws_ai::ImageFingerprint fp0;
+    const double t_fp = time_min_ms(5, nullptr, [&] { fp0 = fingerprint_of(base); });
+    std::printf("fingerprint (%dx%d luma -> 256 -> pHash+dHash): %.3f ms\n\n", w, h, t_fp);
+
+    ws_ai::GrayImage cursor = base;  // 加一个光标 / 通知角标大小的色块
+    for (int y = 300; y < 340; ++y) std::fill_n(cursor.row(y) + 1800, 28, 20);
+    ws_ai::GrayImage badge = base;  // 菜单栏上的未读红点
+    for (int y = 6; y < 46; ++y) std::fill_n(badge.row(y) + w - 160, 40, 110);
+
+    struct Variant {
+        const char *name;
+        ws_ai::GrayImage img;
+    };
+    const Variant variants[] = {
+        {"crop 8px left/top", crop(base, 8, 8, 0, 0)},
+        {"crop 30px right", crop(base, 0, 0, 30, 0)},
+        {"cursor", cursor},
+        {"notification badge", badge},
+        {"different page", to_gray(make_screenshot(w, h, 48, 43), w, h)},
+    };
+    std::printf("%-20s %8s %8s\n", "variant", "phash", "dhash");
+    for (const auto &v : variants) {
+        const auto fp = fingerprint_of(v.img);
+        std::printf("%-20s %8d %8d\n", v.name, ws_ai::hamming64(fp.phash, fp0.phash), ws_ai::hamming64(fp.dhash, fp0.dhash));
+    }
+
+    // 2) 索引：n 条随机指纹，查近邻（翻 <= 6 位）和随机未命中，对比线性扫描
+    std::mt19937_64 rng(7);
+    std::vector<ws_ai::ImageFingerprint> fps(n);
+    for (auto &f : fps) f = {rng(), rng()};
+
+    ws_ai::HammingIndex index((size_t)n);
+    auto t0 = Clock::now();
+    for (int i = 0; i < n; ++i) index.insert(fps[i], std::to_string(i));
+    const double insert_us = us_since(t0) / n;
+
+    const int max_dist = 6, n_q = 2000;
+    std::vector<ws_ai::ImageFingerprint> near_q, miss_q;
+    for (int i = 0; i < n_q; ++i) {
+        auto f = fps[rng() % n];
+        for (int k = 0, flips = (int)(rng() % (max_dist + 1)); k < flips; ++k) f.phash ^= 1ull << (rng() % 64);
+        near_q.push_back(f);
+        miss_q.push_back({rng(), rng()});
+    }
+
+    int hits = 0;
+    t0 = Clock::now();
+    for (const auto &q : near_q) hits += index.find(q, max_dist) ? 1 : 0;
+    const double near_us = us_since(t0) / n_q;
+    int false_hits = 0;
+    t0 = Clock::now();
+    for (const auto &q : miss_q) false_hits += index.find(q, max_dist) ? 1 : 0;
+    const double miss_us = us_since(t0) / n_q;
+
+    int scan_hits = 0;
+    t0 = Clock::now();
+    for (const auto &q : near_q) {
+        for (const auto &f : fps) {
+            if (ws_ai::hamming64(f.phash, q.phash) <= max_dist) { scan_hits++; break; }
+        }
+    }
+    const double scan_us = us_since(t0) / n_q;
+
+    std::printf("\nindex: %d entries, %.1f KiB (%.1f B/entry), insert %.2f us\n", n,
+                index.memory_bytes() / 1024.0, (double)index.memory_bytes() / n, insert_us);
+    std::printf("lookup (r=%d): near %.2f us (%d/%d found), miss %.2f us (%d false), linear scan %.2f us (%d found)\n",
+                max_dist, near_us, hits, n_q, miss_us, false_hits, scan_us, scan_hits);
+    return 0;
+}
+
+// 合成的 OCR 文本：常用字多、生僻字少（近似齐夫分布），每十来个字一个逗号、几十个字一个句号换行。
+// 所有文章共用同一段“网站导航 / 页脚”，模拟同一个站点上不同文章的截图
+std::string utf8_of(uint32_t cp) {
+    std::string s;
+    s += (char)(0xE0 | (cp >> 12));
+    s += (char)(0x80 | ((cp >> 6) & 0x3F));
+    s += (char)(0x80 | (cp & 0x3F));
+    return s;
+}
+
+std::vector<uint32_t> make_article(std::mt19937 &rng, int n_chars) {
+    std::uniform_real_distribution<double> u(0.0, 1.0);
+    std::vector<uint32_t> out;
+    for (int i = 0; i < n_chars; ++i) {
+        out.push_back(0x4E00 + (uint32_t)(3000 * std::pow(u(rng), 3.0)));
+        if (rng() % 12 == 0) out.push_back(0xFF0C);  // ，
+        if (rng() % 40 == 0) out.push_back(0x3002);  // 。
+    }
+    return out;
+}
+
+std::string render(const std::vector<uint32_t> &chrome, const std::vector<uint32_t> &body, int wrap) {
+    std::string s;
+    for (uint32_t c : chrome) s += utf8_of(c);
+    s += "\n";
+    for (size_t i = 0; i < body.size(); ++i) {
+        s += utf8_of(body[i]);
+        if ((int)(i % (size_t)wrap) == wrap - 1) s += "\n";
+    }
+    return s;
+}
+
+// 换个设备 / 缩放比例再截一次：换行宽度不同，开头结尾各少截一部分，识别错 noise 比例的字
+std::vector<uint32_t> ocr_variant(const std::vector<uint32_t> &body, std::mt19937 &rng, double crop_head,
+                                  double crop_tail, double noise) {
+    const size_t a = (size_t)(body.size() * crop_head), b = body.size() - (size_t)(body.size() * crop_tail);
+    std::vector<uint32_t> out(body.begin() + (std::ptrdiff_t)a, body.begin() + (std::ptrdiff_t)std::max(a, b));
+    std::uniform_real_distribution<double> u(0.0, 1.0);
+    for (auto &c : out) {
+        if (u(rng) < noise) c = 0x4E00 + (uint32_t)(rng() % 3000);
+    }
+    return out;
+}
+
+float cosine(const std::vector<float> &a, const std::vector<float> &b) {
+    double d = 0, na = 0, nb = 0;
+    for (size_t i = 0; i < a.size() && i < b.size(); ++i) {
+        d += (double)a[i] * b[i];
+        na += (double)a[i] * a[i];
+        nb += (double)b[i] * b[i];
+    }
+    return na > 0 && nb > 0 ? (float)(d / std::sqrt(na * nb)) : 0.f;
+}
+
+// semcache 的检查项：不对就打印 FAIL，bench_semcache 最后按失败数返回
+int g_failures = 0;
+
+void expect(bool ok, const std::string &what) {
+    if (ok) return;
+    std::printf("FAIL: %s\n", what.c_str());
+    g_failures++;
+}
+
+// int8 点积：SIMD 和标量都要等于逐个相乘累加。长度覆盖 16 / 32 的整数倍前后（尾巴走标量），
+// 指针错开一个字节看非对齐加载；取值 [-127, 127] 和量化的范围一致
+void check_dot_i8() {
+    std::mt19937 rng(3);
+    std::uniform_int_distribution<int> val(-127, 127);
+    const size_t lens[] = {0, 1, 7, 15, 16, 17, 31, 32, 33, 47, 63, 64, 65, 100, 255, 256, 257, 1000, 4099};
+    for (const size_t n : lens) {
+        for (int rep = 0; rep < 4; ++rep) {
+            std::vector<int8_t> a(n + 1), b(n + 1);
+            for (auto &x : a) x = (int8_t)val(rng);
+            for (auto &x : b) x = (int8_t)val(rng);
+            const int8_t *pa = a.data() + (rep & 1), *pb = b.data() + ((rep >> 1) & 1);
+            int32_t ref = 0;
+            for (size_t i = 0; i < n; ++i) ref += (int32_t)pa[i] * pb[i];
+            const int32_t simd = ws_ai::dot_i8(pa, pb, n);
+            ws_ai::embed_force_scalar(true);
+            const int32_t scalar = ws_ai::dot_i8(pa, pb, n);
+            ws_ai::embed_force_scalar(false);
+            expect(simd == ref, "dot_i8 " + std::string(ws_ai::embed_backend()) + " n=" + std::to_string(n) + ": " +
+                                    std::to_string(simd) + " != " + std::to_string(ref));
+            expect(scalar == ref, "dot_i8 scalar n=" + std::to_string(n));
+        }
+    }
+}
+
+// top-k：从高到低、都不低于阈值、不超过 k 条
+void check_top_k(const std::vector<ws_ai::EmbeddingIndex::Match> &ms, int k, float min_score, const char *what) {
+    expect((int)ms.size() <= k, std::string(what) + ": more than k results");
+    for (size_t i = 0; i < ms.size(); ++i) {
+        expect(ms[i].score >= min_score, std::string(what) + ": score below threshold");
+        if (i > 0) expect(ms[i - 1].score >= ms[i].score, std::string(what) + ": results out of order");
+    }
+}
+
+// 容量满了淘汰最旧的：容量 3 插 4 条，第一条查不到了，其余三条都还在
+void check_eviction(const std::vector<std::vector<float>> &vecs) {
+    ws_ai::EmbeddingIndex idx(3);
+    for (int i = 0; i < 4; ++i) idx.insert(vecs[(size_t)i], std::to_string(i));
+    expect(idx.size() == 3, "eviction: size " + std::to_string(idx.size()) + " != 3");
+    for (const auto &m : idx.top_k(vecs[0], 3, -1.f)) expect(m.key != "0", "eviction: oldest entry still present");
+    for (int i = 1; i < 4; ++i) {
+        const auto ms = idx.top_k(vecs[(size_t)i], 1, 0.9f);
+        expect(!ms.empty() && ms[0].key == std::to_string(i), "eviction: entry " + std::to_string(i) + " lost");
+    }
+}
+
+// 端到端：mock 流水线按 <图片>.txt 当 OCR 结果，先跑一篇，再提交同一篇换行 + 少量错字的截图，
+// 第二个任务应该直接复用第一个的结果（dup_of / dup_similarity），不同的文章不应该命中
+std::string wait_job(ws_ai::JobManager &jm, const std::string &id) {
+    for (int i = 0; i < 1000; ++i) {
+        const std::string s = jm.get_status_json(id);
+        if (s.find("\"state\":\"done\"") != std::string::npos || s.find("\"state\":\"error\"") != std::string::npos) return s;
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return jm.get_status_json(id);
+}
+
+void check_job_manager(const std::string &first, const std::string &near, const std::string &other, float threshold) {
+    const std::string dir = (std::filesystem::temp_directory_path() / ("ws_ai_bench_semcache_" + std::to_string(getpid()))).string();
+    std::filesystem::create_directories(dir);
+    ws_ai::Config cfg;
+    cfg.pipeline = "mock";
+    cfg.mock_ocr_ms = 1;
+    cfg.mock_prefill_ms = 1;
+    cfg.mock_tokens = 8;
+    cfg.mock_tok_per_sec = 10000;
+    cfg.semcache_threshold = threshold;
+    cfg.dedup_max_distance = -1;  // 三张图字节不同，但别让像素哈希抢先
+    cfg.job_dir = dir;
+    cfg.journal = false;
+    auto shot = [&](const char *name, const std::string &text) {
+        const std::string path = dir + "/" + name + ".png";
+        std::ofstream(path, std::ios::binary) << name;
+        std::ofstream(path + ".txt", std::ios::binary) << text;
+        return path;
+    };
+    const std::string a = shot("a", first), b = shot("b", near), c = shot("c", other);
+    {
+        ws_ai::JobManager jm(cfg);
+        const std::string id_a = jm.submit_image(a);
+        const std::string st_a = wait_job(jm, id_a);
+        expect(st_a.find("\"state\":\"done\"") != std::string::npos, "job manager: first job not done: " + st_a);
+        const std::string st_b = wait_job(jm, jm.submit_image(b));
+        expect(st_b.find("\"dup_of\":\"" + id_a + "\"") != std::string::npos, "job manager: near duplicate missed: " + st_b);
+        expect(st_b.find("\"dup_similarity\":") != std::string::npos, "job manager: no dup_similarity: " + st_b);
+        const std::string st_c = wait_job(jm, jm.submit_image(c));
+        expect(st_c.find("\"dup_of\"") == std::string::npos, "job manager: unrelated text hit: " + st_c);
+    }
+    std::error_code ec;
+    std::filesystem::remove_all(dir, ec);
+}
+
+int bench_semcache(int argc, char **argv) {
+    const int n = argc > 2 && argv[2][0] != '-' ? std::max(1, std::atoi(argv[2])) : 4096;
+    std::string model_path;
+    float threshold = 0.92f;
+    int n_articles = -1;
+    for (int i = 2; i + 1 < argc; ++i) {
+        const std::string a = argv[i];
+        if (a == "--model") model_path = argv[++i];
+        else if (a == "--threshold") threshold = (float)std::atof(argv[++i]);
+        else if (a == "--articles") n_articles = std::max(2, std::atoi(argv[++i]));
+    }
+    if (n_articles < 0) n_articles = model_path.empty() ? 200 : 32;
+
+    // 向量从哪来：默认字符 n-gram；给了 --model 用 GGUF（向量模型或生成模型的隐状态平均）
+    ws_ai::Config cfg;
+    std::unique_ptr<ws_ai::ModelRegistry> models;
+    ws_ai::ModelLease lease;
+    if (!model_path.empty()) {
+        cfg.models = {{"bench", model_path}};
+        cfg.default_model = "bench";
+        cfg.model_idle_sec = 0;
+        models = std::make_unique<ws_ai::ModelRegistry>(cfg);
+        std::string err;
+        lease = models->acquire("bench", err);
+        if (!lease) {
+            std::fprintf(stderr, "%s\n", err.c_str());
+            return 1;
+        }
+    }
+    double embed_ms = 0;
+    int n_embeds = 0;
+    auto embed = [&](const std::string &text, std::vector<float> &out) {
+        const auto t0 = Clock::now();
+        if (lease) {
+            std::string err;
+            if (!ws_ai::embed_text(lease->model, text, ws_ai::gen_params_from_config(cfg), cfg.embed_max_tokens, out,
+                                   err)) {
+                std::fprintf(stderr, "embed: %s\n", err.c_str());
+                out.clear();
+            }
+        } else {
+            ws_ai::ngram_embedding(text, ws_ai::kNgramEmbeddingDim, out);
+        }
+        embed_ms += us_since(t0) / 1000.0;
+        n_embeds++;
+    };
+
+    // 1) 相似度：每篇文章的原始截图 vs 几种变体，以及和其它文章的最大相似度
+    std::mt19937 rng(11);
+    const std::vector<uint32_t> chrome = make_article(rng, 60);
+    std::vector<std::vector<uint32_t>> bodies;
+    std::vector<std::vector<float>> base;
+    for (int i = 0; i < n_articles; ++i) {
+        bodies.push_back(make_article(rng, 300 + (int)(rng() % 600)));
+        base.emplace_back();
+        embed(render(chrome, bodies.back(), 40), base.back());
+    }
+
+    struct Variant {
+        const char *name;
+        int wrap;
+        double head, tail, noise;
+    };
+    const Variant variants[] = {
+        {"rewrap only", 27, 0, 0, 0},
+        {"rewrap + 2% ocr err", 33, 0, 0, 0.02},
+        {"crop 10%/10% + 2%", 27, 0.10, 0.10, 0.02},
+        {"crop 25%/15% + 3%", 52, 0.25, 0.15, 0.03},
+        {"crop 40%/20% + 5%", 33, 0.40, 0.20, 0.05},
+    };
+    std::printf("embedder: %s, %d articles, threshold %.2f\n\n", lease ? model_path.c_str() : "char n-gram",
+                n_articles, threshold);
+    std::printf("%-22s %8s %8s %8s\n", "variant", "mean cos", "min cos", "hit rate");
+    std::vector<int> hits;
+    for (const auto &v : variants) {
+        double sum = 0;
+        float mn = 1;
+        int hit = 0;
+        for (int i = 0; i < n_articles; ++i) {
+            std::vector<float> e;
+            embed(render(chrome, ocr_variant(bodies[i], rng, v.head, v.tail, v.noise), v.wrap), e);
+            const float c = cosine(e, base[i]);
+            sum += c;
+            mn = std::min(mn, c);
+            hit += c >= threshold ? 1 : 0;
+        }
+        std::printf("%-22s %8.3f %8.3f %7.1f%%\n", v.name, sum / n_articles, mn, 100.0 * hit / n_articles);
+        hits.push_back(hit);
+    }
+    float max_other = -1;
+    double sum_other = 0;
+    int n_other = 0, false_hits = 0;
+    for (int i = 0; i < n_articles; ++i) {
+        for (int j = i + 1; j < n_articles; ++j) {
+            const float c = cosine(base[i], base[j]);
+            max_other = std::max(max_other, c);
+            sum_other += c;
+            n_other++;
+            false_hits += c >= threshold ? 1 : 0;
+        }
+    }
+    std::printf("different articles: mean %.3f, max %.3f over %d pairs, %d above threshold\n", sum_other / n_other,
+                max_other, n_other, false_hits);
+    std::printf("embed: %.3f ms / text\n", embed_ms / std::max(1, n_embeds));
+    // 命中率的检查只对 n-gram 向量做（向量模型的相似度分布各不相同，阈值要自己调）：
+    // 只是换行 / 换行 + 2% 错字必须全部命中，不同文章一条都不能命中
+    if (!lease) {
+        expect(hits[0] == n_articles && hits[1] == n_articles, "near-duplicate texts did not all hit");
+        expect(false_hits == 0, std::to_string(false_hits) + " unrelated article pairs above threshold");
+        check_job_manager(render(chrome, bodies[0], 40), render(chrome, ocr_variant(bodies[0], rng, 0, 0, 0.02), 33),
+                          render(chrome, bodies[1], 40), threshold);
+    }
+
+    // 2) 索引：n 条随机单位向量（维度同上），查存过的向量加噪声（应命中）和随机向量（不应命中），
+    //    int8 SIMD vs int8 标量 vs float 暴力扫描
+    const int dim = (int)base.front().size();
+    std::mt19937 vrng(5);
+    std::normal_distribution<float> g(0.f, 1.f);
+    std::vector<std::vector<float>> vecs((size_t)n, std::vector<float>((size_t)dim));
+    for (auto &v : vecs) {
+        for (auto &x : v) x = g(vrng);
+        const float inv = 1.f / std::sqrt(std::inner_product(v.begin(), v.end(), v.begin(), 0.f));
+        for (auto &x : v) x *= inv;
+    }
+    ws_ai::EmbeddingIndex index((size_t)n);
+    auto t0 = Clock::now();
+    for (int i = 0; i < n; ++i) index.insert(vecs[(size_t)i], std::to_string(i));
+    const double insert_us = us_since(t0) / n;
+
+    const int n_q = 500;
+    std::vector<std::vector<float>> near_q, miss_q;
+    std::vector<int> near_of;
+    for (int i = 0; i < n_q; ++i) {
+        near_of.push_back((int)(vrng() % (unsigned)n));
+        auto q = vecs[(size_t)near_of.back()];
+        for (auto &x : q) x += 0.15f / std::sqrt((float)dim) * g(vrng);  // cos ≈ 0.99
+        near_q.push_back(q);
+        std::vector<float> m((size_t)dim);
+        for (auto &x : m) x = g(vrng);
+        miss_q.push_back(m);
+    }
+
+    auto run_queries = [&](const std::vector<std::vector<float>> &qs, int &found, int &correct) {
+        found = correct = 0;
+        const auto t = Clock::now();
+        for (size_t i = 0; i < qs.size(); ++i) {
+            auto ms = index.top_k(qs[i], 4, threshold);
+            found += ms.empty() ? 0 : 1;
+            correct += !ms.empty() && i < near_of.size() && ms[0].key == std::to_string(near_of[i]) ? 1 : 0;
+        }
+        return us_since(t) / (double)qs.size();
+    };
+    int near_found, near_ok, miss_found, dummy;
+    const double simd_us = run_queries(near_q, near_found, near_ok);
+    const double miss_us = run_queries(miss_q, miss_found, dummy);
+    ws_ai::embed_force_scalar(true);
+    int sc_found, sc_ok;
+    const double scalar_us = run_queries(near_q, sc_found, sc_ok);
+    ws_ai::embed_force_scalar(false);
+
+    // float 暴力扫描做对照（也用来看量化误差）
+    float max_err = 0, sink = 0;
+    t0 = Clock::now();
+    for (int i = 0; i < n_q; ++i) {
+        float best = -2;
+        for (const auto &v : vecs) best = std::max(best, std::inner_product(v.begin(), v.end(), near_q[(size_t)i].begin(), 0.f));
+        sink += best;
+    }
+    const double float_us = us_since(t0) / n_q;
+    for (int i = 0; i < n_q; ++i) {
+        auto ms = index.top_k(near_q[(size_t)i], 1, -1.f);
+        if (!ms.empty()) {
+            const float exact = cosine(near_q[(size_t)i], vecs[(size_t)std::atoi(ms[0].key.c_str())]);
+            max_err = std::max(max_err, std::fabs(exact - ms[0].score));
+        }
+    }
+
+    std::printf("\nindex: %d x %d-d, %.1f KiB int8 (float would be %.1f KiB), insert %.2f us\n", n, dim,
+                index.memory_bytes() / 1024.0, (double)n * dim * sizeof(float) / 1024.0, insert_us);
+    std::printf("top-4 lookup: %s %.1f us (%d/%d found, %d correct), miss %.1f us (%d false), scalar %.1f us, "
+                "float scan %.1f us\n",
+                ws_ai::embed_backend(), simd_us, near_found, n_q, near_ok, miss_us, miss_found, scalar_us, float_us);
+    std::printf("int8 cosine error: max %.4f (float best-score sum %.1f)\n", max_err, sink);
+
+    expect(near_found == n_q && near_ok == n_q, "index: noisy copies of stored vectors not all found");
+    expect(sc_found == near_found && sc_ok == near_ok, "index: scalar and SIMD lookups disagree");
+    expect(miss_found == 0, "index: random queries hit");
+    expect(max_err < 0.02f, "index: int8 cosine error too large");
+    for (int i = 0; i < 50; ++i) {
+        check_top_k(index.top_k(near_q[(size_t)i], 4, threshold), 4, threshold, "top_k near");
+        check_top_k(index.top_k(near_q[(size_t)i], 8, -1.f), 8, -1.f, "top_k all");
+        check_top_k(index.top_k(miss_q[(size_t)i], 4, 0.f), 4, 0.f, "top_k miss");
+    }
+    check_eviction(vecs);
+    check_dot_i8();
+    std::printf("\nchecks: %s\n", g_failures == 0 ? "all passed" : (std::to_string(g_failures) + " failed").c_str());
+    return g_failures == 0 ? 0 : 1;
+}
+
+std::vector<int> parse_int_list(const std::string &s) {
+    std::vector<int> out;
+    std::stringstream ss(s);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (!item.empty()) out.push_back(std::max(0, std::atoi(item.c_str())));
+    }
+    return out;
+}
+
+// 线程扫描：后台跑 o 个 OCR 线程（给了 --image 用真 OCR，否则用前处理 kernel 模拟同等 CPU 负载），
+// 同时用 t 个 llama 线程做一次 prefill + 固定长度 decode，看各组合下的吞吐
+int bench_threads(int argc, char **argv) {
+    if (argc < 3) {
+        std::fprintf(stderr, "用法: ws_ai_bench threads model.gguf [--threads 2,4,8] [--ocr 0,1,2] [--image shot.png]"
+                             " [--prompt-chars 2000] [--gen 128]\n");
+        return 2;
+    }
+    const std::string model_path = argv[2];
+    const ws_ai::CpuTopology topo = ws_ai::detect_cpu_topology();
+    const int fast = std::max(1, topo.n_perf > 0 ? topo.n_perf : topo.n_physical);
+
+    std::vector<int> thread_list, ocr_list = {0, 1, 2};
+    std::string image;
+    int prompt_chars = 2000, gen = 128;
+    for (int i = 3; i + 1 < argc; i += 2) {
+        const std::string a = argv[i];
+        if (a == "--threads") thread_list = parse_int_list(argv[i + 1]);
+        else if (a == "--ocr") ocr_list = parse_int_list(argv[i + 1]);
+        else if (a == "--image") image = argv[i + 1];
+        else if (a == "--prompt-chars") prompt_chars = std::max(100, std::atoi(argv[i + 1]));
+        else if (a == "--gen") gen = std::max(8, std::atoi(argv[i + 1]));
+    }
+    if (thread_list.empty()) {
+        for (int t = 1; t < fast; t *= 2) thread_list.push_back(t);
+        thread_list.push_back(fast);
+        if (topo.n_logical > fast) thread_list.push_back(topo.n_logical);
+    }
+
+    ws_ai::Config cfg;
+    cfg.models = {{"bench", model_path}};
+    cfg.default_model = "bench";
+    cfg.model_idle_sec = 0;
+    ws_ai::ModelRegistry models(cfg);
+    std::string err;
+    ws_ai::ModelLease lease = models.acquire("bench", err);
+    if (!lease) {
+        std::fprintf(stderr, "%s\n", err.c_str());
+        return 1;
+    }
+
+    std::string text;
+    for (int i = 0; (int)text.size() < prompt_chars; ++i) {
+        text += "第" + std::to_string(i) + "行：会议纪要里提到的下一步计划和负责人，deadline 在下周三。\n";
+    }
+    const std::string prompt = ws_ai::build_prompt(text);
+
+    const int w = 2560, h = 1600;
+    const ws_ai::GrayImage shot = to_gray(make_screenshot(w, h, 48), w, h);
+
+    std::printf("cpus: %d logical / %d physical, prompt %d chars, gen %d tokens%s\n\n", topo.n_logical,
+                topo.n_physical, (int)text.size(), gen, image.empty() ? ", OCR simulated by preprocess" : "");
+    std::printf("%6s %8s %14s %14s %10s\n", "ocr", "threads", "prefill tok/s", "decode tok/s", "ocr img/s");
+
+    for (int o : ocr_list) {
+        double best_decode = 0;
+        int best_t = 0;
+        for (int t : thread_list) {
+            std::atomic<bool> stop{false};
+            std::atomic<int> ocr_done{0};
+            std::vector<std::thread> ocr;
+            for (int k = 0; k < o; ++k) {
+                ocr.emplace_back([&] {
+                    while (!stop.load()) {
+                        if (!image.empty()) {
+                            ws_ai::ocr_with_vision(image, ws_ai::PreprocOptions{});
+                        } else {
+                            ws_ai::GrayImage g = shot;
+                            ws_ai::preprocess_for_ocr(g, ws_ai::PreprocOptions{});
+                        }
+                        ocr_done++;
+                    }
+                });
+            }
+
+            ws_ai::GenParams gp = ws_ai::gen_params_from_config(cfg);
+            gp.n_threads = t;
+            gp.n_threads_batch = t;
+            gp.min_new_tokens = gp.max_new_tokens = gen;
+            gp.max_resample_eos = 1 << 20;
+
+            const auto t0 = Clock::now();
+            ws_ai::LLMResult r;
+            {
+                ws_ai::LlmRunner runner(lease->model, gp, cfg.n_ctx, cfg.n_batch);
+                std::vector<ws_ai::GenRequest> reqs(1);
+                reqs[0].prompt = prompt;
+                r = runner.generate(std::move(reqs)).front();
+            }
+            const double secs = std::chrono::duration<double>(Clock::now() - t0).count();
+            stop = true;
+            for (auto &th : ocr) th.join();
+
+            const double prefill = r.prefill_ms > 0 ? r.n_prompt_tokens / (r.prefill_ms / 1000.0) : 0;
+            const double decode = r.decode_ms > 0 ? r.n_gen_tokens / (r.decode_ms / 1000.0) : 0;
+            std::printf("%6d %8d %14.1f %14.1f %10.2f%s\n", o, t, prefill, decode, ocr_done / secs,
+                        r.ok ? "" : "  (failed)");
+            if (decode > best_decode) {
+                best_decode = decode;
+                best_t = t;
+            }
+        }
+        std::printf("  -> ocr=%d: best decode with %d threads (WS_AI_OCR_WORKERS=%d WS_AI_THREADS=%d)\n\n", o,
+                    best_t, std::max(1, o), best_t);
+    }
+    return 0;
+}
+
+double ms_since(Clock::time_point t0) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+}
+
+// 约 3000 字节的合成 OCR 文本
+std::string synthetic_ocr_text() {
+    std::string text;
+    for (int i = 0; (int)text.size() < 3000; ++i) {
+        text += "第" + std::to_string(i) + "行：会议纪要里提到的下一步计划和负责人，deadline 在下周三。\n";
+    }
+    return text;
+}
+
+// 追问：先正常跑一遍（导出 KV 状态并落盘），再对同一个问题分别
+//   warm：读 KV 文件 + 解压 + 恢复，只 prefill 新一轮
+//   cold：重新 OCR（给了 --image 时）+ 整段对话重新 prefill
+// 比较首 token 延迟
+int bench_followup(int argc, char **argv) {
+    if (argc < 3) {
+        std::fprintf(stderr, "用法: ws_ai_bench followup model.gguf [--image shot.png | --text ocr.txt]"
+                             " [--question \"...\"] [--gen 32]\n");
+        return 2;
+    }
+    const std::string model_path = argv[2];
+    std::string image, text_file, question = "第二段再展开讲讲，举一个具体的例子。";
+    int gen = 32;
+    for (int i = 3; i + 1 < argc; i += 2) {
+        const std::string a = argv[i];
+        if (a == "--image") image = argv[i + 1];
+        else if (a == "--text") text_file = argv[i + 1];
+        else if (a == "--question") question = argv[i + 1];
+        else if (a == "--gen") gen = std::max(4, std::atoi(argv[i + 1]));
+    }
+
+    ws_ai::Config cfg;
+    cfg.models = {{"bench", model_path}};
+    cfg.default_model = "bench";
+    cfg.model_idle_sec = 0;
+    cfg.job_dir = (std::filesystem::temp_directory_path() / ("ws_ai_bench_kv_" + std::to_string((long)getpid()))).string();
+    cfg.kv_ttl_sec = 600;
+
+    // OCR 文本：真 OCR / 文件 / 合成
+    std::string text;
+    double ocr_ms = 0;
+    if (!image.empty()) {
+        const auto t0 = Clock::now();
+        text = ws_ai::ocr_with_vision(image, ws_ai::preproc_options_from_config(cfg));
+        ocr_ms = ms_since(t0);
+    } else if (!text_file.empty()) {
+        std::ifstream ifs(text_file);
+        text.assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+    } else {
+        text = synthetic_ocr_text();
+    }
+    if (text.empty()) {
+        std::fprintf(stderr, "没有 OCR 文本\n");
+        return 1;
+    }
+
+    ws_ai::ModelRegistry models(cfg);
+    std::string err;
+    ws_ai::ModelLease lease = models.acquire("bench", err);
+    if (!lease) {
+        std::fprintf(stderr, "%s\n", err.c_str());
+        return 1;
+    }
+    ws_ai::GenParams gp = ws_ai::gen_params_from_config(cfg);
+    gp.min_new_tokens = gp.max_new_tokens = gen;
+    gp.max_resample_eos = 1 << 20;
+
+    auto run_one = [&](ws_ai::GenRequest req) {
+        ws_ai::LlmRunner runner(lease->model, lease->take_context(), gp, cfg.n_ctx, cfg.n_batch);
+        std::vector<ws_ai::GenRequest> reqs;
+        reqs.push_back(std::move(req));
+        ws_ai::LLMResult r = runner.generate(std::move(reqs)).front();
+        lease->put_context(runner.release_context());
+        return r;
+    };
+
+    // 1) 第一轮：总结 + 导出状态
+    ws_ai::GenRequest first;
+    first.prompt = ws_ai::build_prompt(text);
+    first.save_state = true;
+    ws_ai::LLMResult r1 = run_one(first);
+    if (!r1.ok || r1.state.data.empty()) {
+        std::fprintf(stderr, "第一轮失败: %s\n", r1.error.c_str());
+        return 1;
+    }
+    const std::string transcript = first.prompt + r1.text;
+    const std::string turn = ws_ai::build_followup_prompt(question);
+    const size_t raw_bytes = r1.state.data.size();
+
+    ws_ai::KvStore kv(cfg);
+    kv.save("bench", lease->path, std::move(r1.state));
+    kv.flush();
+    const ws_ai::KvStore::Stats ks = kv.stats();
+
+    // 2) warm：从文件恢复
+    const auto tw = Clock::now();
+    ws_ai::SeqState st;
+    if (!kv.load("bench", lease->path, st, err)) {
+        std::fprintf(stderr, "读取 KV 失败: %s\n", err.c_str());
+        return 1;
+    }
+    const double load_ms = ms_since(tw);
+    ws_ai::GenRequest warm;
+    warm.prompt = turn;
+    warm.restore = &st;
+    ws_ai::LLMResult rw = run_one(warm);
+
+    // 3) cold：整段重新 prefill（+ OCR）
+    ws_ai::GenRequest cold;
+    cold.prompt = transcript + turn;
+    ws_ai::LLMResult rc = run_one(cold);
+
+    std::error_code ec;
+    std::filesystem::remove_all(cfg.job_dir, ec);
+
+    std::printf("first turn: %d prompt tokens, %d generated, KV %d tokens\n", r1.n_prompt_tokens, r1.n_gen_tokens,
+                st.n_past);
+    std::printf("KV state: %.1f MB raw -> %.1f MB on disk (%.0f%%), compress %.1f ms, load+inflate %.1f ms\n\n",
+                raw_bytes / 1048576.0, ks.stored_bytes / 1048576.0, 100.0 * ks.stored_bytes / std::max<size_t>(1, raw_bytes),
+                ks.compress_ms, load_ms);
+    std::printf("%-6s %14s %12s %12s %12s%s\n", "", "prefill tok", "ocr ms", "restore ms", "TTFT ms", rw.ok && rc.ok ? "" : "  (failed)");
+    std::printf("%-6s %14d %12.1f %12.1f %12.1f\n", "warm", rw.n_prompt_tokens, 0.0, load_ms + rw.restore_ms,
+                load_ms + rw.prefill_ms);
+    std::printf("%-6s %14d %12.1f %12.1f %12.1f\n", "cold", rc.n_prompt_tokens, ocr_ms, 0.0, ocr_ms + rc.prefill_ms);
+    if (!rw.ok) std::printf("warm error: %s\n", rw.error.c_str());
+    if (!rc.ok) std::printf("cold error: %s\n", rc.error.c_str());
+    return 0;
+}
+
+// 多候选：同一个 prompt 生成 n 个候选，三种做法
+//   serial：n 次独立 generate（每次都 prefill）
+//   batch ：n 条请求放进一个 n_seq 的 context 一起跑（prefill n 遍，decode 共享 batch）
+//   fork  ：generate_candidates，prefill 一遍后 seq_cp 出 n 个 sequence
+// 每个候选都固定生成 --gen 个 token，比较总耗时和 prefill 的 token 数
+int bench_candidates(int argc, char **argv) {
+    if (argc < 3) {
+        std::fprintf(stderr, "用法: ws_ai_bench candidates model.gguf [--n 4] [--gen 64] [--text ocr.txt]\n");
+        return 2;
+    }
+    const std::string model_path = argv[2];
+    std::string text_file;
+    int n = 4, gen = 64;
+    for (int i = 3; i + 1 < argc; i += 2) {
+        const std::string a = argv[i];
+        if (a == "--n") n = std::max(2, std::atoi(argv[i + 1]));
+        else if (a == "--gen") gen = std::max(4, std::atoi(argv[i + 1]));
+        else if (a == "--text") text_file = argv[i + 1];
+    }
+
+    std::string text;
+    if (!text_file.empty()) {
+        std::ifstream ifs(text_file);
+        text.assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+    } else {
+        text = synthetic_ocr_text();
+    }
+
+    ws_ai::Config cfg;
+    cfg.models = {{"bench", model_path}};
+    cfg.default_model = "bench";
+    cfg.model_idle_sec = 0;
+    ws_ai::ModelRegistry models(cfg);
+    std::string err;
+    ws_ai::ModelLease lease = models.acquire("bench", err);
+    if (!lease) {
+        std::fprintf(stderr, "%s\n", err.c_str());
+        return 1;
+    }
+    ws_ai::GenParams gp = ws_ai::gen_params_from_config(cfg);
+    gp.min_new_tokens = gp.max_new_tokens = gen;
+    gp.max_resample_eos = 1 << 20;
+
+    ws_ai::GenRequest req;
+    req.prompt = ws_ai::build_prompt(text);
+
+    struct Row {
+        explicit Row(const char *n) : name(n) {}
+        const char *name;
+        double ms = 0;
+        int prefill_tokens = 0;
+        int gen_tokens = 0;
+        bool ok = true;
+        std::string best;
+        double score = 0;
+    };
+    auto take = [](Row &row, const std::vector<ws_ai::LLMResult> &rs) {
+        for (const auto &r : rs) {
+            row.ok = row.ok && r.ok;
+            row.gen_tokens += r.n_gen_tokens;
+            const double s = ws_ai::score_summary_format(r.text);
+            if (row.best.empty() || s > row.score) row.best = r.text, row.score = s;
+        }
+    };
+
+    Row serial("serial"), batch("batch"), fork("fork");
+    {
+        const auto t0 = Clock::now();
+        for (int i = 0; i < n; ++i) {
+            ws_ai::LlmRunner runner(lease->model, gp, cfg.n_ctx, cfg.n_batch);
+            std::vector<ws_ai::GenRequest> reqs{req};
+            const auto rs = runner.generate(std::move(reqs));
+            serial.prefill_tokens += rs.front().n_prompt_tokens;
+            take(serial, rs);
+        }
+        serial.ms = ms_since(t0);
+    }
+    {
+        const auto t0 = Clock::now();
+        ws_ai::LlmRunner runner(lease->model, gp, cfg.n_ctx, cfg.n_batch, n);
+        const auto rs = runner.generate(std::vector<ws_ai::GenRequest>(n, req));
+        for (const auto &r : rs) batch.prefill_tokens += r.n_prompt_tokens;
+        take(batch, rs);
+        batch.ms = ms_since(t0);
+    }
+    {
+        const auto t0 = Clock::now();
+        ws_ai::LlmRunner runner(lease->model, gp, cfg.n_ctx, cfg.n_batch, n, true);
+        const auto rs = runner.generate_candidates(req, n, ws_ai::score_summary_format);
+        fork.prefill_tokens = rs.front().n_prompt_tokens;
+        take(fork, rs);
+        fork.ms = ms_since(t0);
+    }
+
+    std::printf("%d candidates x %d tokens, prompt %d tokens\n\n", n, gen, fork.prefill_tokens);
+    std::printf("%-8s %12s %12s %12s %10s %8s\n", "", "total ms", "prefill tok", "gen tok", "speedup", "best");
+    for (const Row *row : {&serial, &batch, &fork}) {
+        std::printf("%-8s %12.1f %12d %12d %9.2fx %8.2f%s\n", row->name, row->ms, row->prefill_tokens, row->gen_tokens,
+                    serial.ms / std::max(1e-3, row->ms), row->score, row->ok ? "" : "  (failed)");
+    }
+    std::printf("\nfork best:\n%s\n", fork.best.c_str());
+    return 0;
+}
+
+// 结构监控：同一个 prompt 监控关 / 开各跑 --runs 次（参数和服务一样：max_new_tokens、min_new_tokens 照常）。
+// 关的那组记下每个 token 的 piece，事后回放给 OutputMonitor，得到同一份输出上监控会停在第几个 token；
+// 采样是随机的，两组的输出不一样，所以节省量以回放为准，开的那组看实际 token 数、耗时和停止原因
+int bench_structure(int argc, char **argv) {
+    if (argc < 3) {
+        std::fprintf(stderr, "用法: ws_ai_bench structure model.gguf [--runs 5] [--text ocr.txt]\n");
+        return 2;
+    }
+    const std::string model_path = argv[2];
+    std::string text_file;
+    int runs = 5;
+    for (int i = 3; i + 1 < argc; i += 2) {
+        const std::string a = argv[i];
+        if (a == "--runs") runs = std::max(1, std::atoi(argv[i + 1]));
+        else if (a == "--text") text_file = argv[i + 1];
+    }
+
+    std::string text;
+    if (!text_file.empty()) {
+        std::ifstream ifs(text_file);
+        text.assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+    } else {
+        text = synthetic_ocr_text();
+    }
+
+    ws_ai::Config cfg;
+    cfg.models = {{"bench", model_path}};
+    cfg.default_model = "bench";
+    cfg.model_idle_sec = 0;
+    ws_ai::ModelRegistry models(cfg);
+    std::string err;
+    ws_ai::ModelLease lease = models.acquire("bench", err);
+    if (!lease) {
+        std::fprintf(stderr, "%s\n", err.c_str());
+        return 1;
+    }
+    const ws_ai::GenParams gp = ws_ai::gen_params_from_config(cfg);
+    ws_ai::MonitorOptions mon = ws_ai::monitor_options_from_config(cfg);
+    mon.enabled = true;
+
+    int off_tokens = 0, replay_tokens = 0, on_tokens = 0;
+    double off_ms = 0, on_ms = 0;
+    std::printf("%-4s %8s %12s %10s %14s | %8s %12s %10s\n", "run", "off tok", "off reason", "off ms", "replay stop",
+                "on tok", "on reason", "on ms");
+    for (int r = 0; r < runs; ++r) {
+        // 监控关：记下每个 piece
+        std::vector<std::string> pieces;
+        ws_ai::GenRequest req;
+        req.prompt = ws_ai::build_prompt(text);
+        req.on_token = [&](const std::string &piece, int) { pieces.push_back(piece); };
+        ws_ai::LLMResult off;
+        {
+            ws_ai::LlmRunner runner(lease->model, gp, cfg.n_ctx, cfg.n_batch);
+            std::vector<ws_ai::GenRequest> reqs{req};
+            off = std::move(runner.generate(std::move(reqs)).front());
+        }
+
+        // 回放：第几个 token 时监控会喊停
+        ws_ai::OutputMonitor m(mon);
+        std::string acc;
+        int stop_at = (int)pieces.size();
+        ws_ai::StopReason why = ws_ai::StopReason::none;
+        for (size_t i = 0; i < pieces.size(); ++i) {
+            acc += pieces[i];
+            size_t keep = 0;
+            why = m.feed(acc, keep);
+            if (why != ws_ai::StopReason::none) {
+                stop_at = (int)i + 1;
+                break;
+            }
+        }
+
+        // 监控开
+        req.on_token = nullptr;
+        req.monitor = mon;
+        ws_ai::LLMResult on;
+        {
+            ws_ai::LlmRunner runner(lease->model, gp, cfg.n_ctx, cfg.n_batch);
+            std::vector<ws_ai::GenRequest> reqs{req};
+            on = std::move(runner.generate(std::move(reqs)).front());
+        }
+
+        char replay[64];
+        std::snprintf(replay, sizeof(replay), "%d (%s)", stop_at,
+                      why == ws_ai::StopReason::none ? "-" : ws_ai::stop_reason_name(why));
+        std::printf("%-4d %8d %12s %10.1f %14s | %8d %12s %10.1f\n", r, off.n_gen_tokens,
+                    ws_ai::stop_reason_name(off.stop_reason), off.decode_ms, replay, on.n_gen_tokens,
+                    ws_ai::stop_reason_name(on.stop_reason), on.decode_ms);
+        off_tokens += off.n_gen_tokens;
+        replay_tokens += stop_at;
+        on_tokens += on.n_gen_tokens;
+        off_ms += off.decode_ms;
+        on_ms += on.decode_ms;
+    }
+
+    std::printf("\nmean: off %.1f tok / %.1f ms, replay stop %.1f tok (saves %.1f%%), on %.1f tok / %.1f ms\n",
+                (double)off_tokens / runs, off_ms / runs, (double)replay_tokens / runs,
+                100.0 * (off_tokens - replay_tokens) / std::max(1, off_tokens), (double)on_tokens / runs, on_ms / runs);
+    return 0;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    if (argc > 1 && std::string(argv[1]) == "hash") {
+        return bench_hash(argc > 2 ? std::max(1, std::atoi(argv[2])) : 10000);
+    }
+    if (argc > 1 && std::string(argv[1]) == "semcache") {
+        return bench_semcache(argc, argv);
+    }
+    if (argc > 1 && std::string(argv[1]) == "threads") {
+        return bench_threads(argc, argv);
+    }
+    if (argc > 1 && std::string(argv[1]) == "followup") {
+        return bench_followup(argc, argv);
+    }
+    if (argc > 1 && std::string(argv[1]) == "candidates") {
+        return bench_candidates(argc, argv);
+    }
+    if (argc > 1 && std::string(argv[1]) == "structure") {
+        return bench_structure(argc, argv);
+    }
+
+    const int w = argc > 1 ? std::max(16, std::atoi(argv[1])) : 2560;
+    const int h = argc > 2 ? std::max(16, std::atoi(argv[2])) : 1600;
+    const int reps = argc > 3 ? std::max(1, std::atoi(argv[3])) : 10;
+    const double mpix = (double)w * h / 1e6;
+
+    const int line_px = 48;
+    const std::vector<uint8_t> rgba = make_screenshot(w, h, line_px);
+    ws_ai::GrayImage base;
+    ws_ai::rgba_to_luma(rgba.data(), w, h, (size_t)w * 4, false, base);
+
+    std::printf("image %dx%d (%.2f MP), reps=%d, backend=%s\n\n", w, h, mpix, reps, ws_ai::preproc_backend());
+    std::printf("%-18s %12s %12s %12s %8s\n", "kernel", "scalar ms", "simd ms", "simd ms/MP", "speedup");
+
+    ws_ai::GrayImage work, small;
+    const int sw = w / 2, sh = h / 2;
+    int text_px = 0;
+
+    struct Case {
+        const char *name;
+        std::function<void()> setup;
+        std::function<void()> fn;
+    };
+    const Case cases[] = {
+        {"rgba_to_luma", nullptr, [&] { ws_ai::rgba_to_luma(rgba.data(), w, h, (size_t)w * 4, false, work); }},
+        {"autocontrast", [&] { work = base; }, [&] { ws_ai::autocontrast(work, 0.0f); }},
+        {"enhance_contrast", [&] { work = base; }, [&] { ws_ai::enhance_contrast(work, 1.6f); }},
+        {"downscale_area/2", nullptr, [&] { ws_ai::downscale_area(base, sw, sh, small); }},
+        {"text_height", nullptr, [&] { text_px = ws_ai::estimate_text_height(base); }},
+        {"preprocess_for_ocr", [&] { work = base; }, [&] { ws_ai::preprocess_for_ocr(work, ws_ai::PreprocOptions{}); }},
+    };
+
+    for (const auto &c : cases) {
+        ws_ai::preproc_force_scalar(true);
+        const double t_scalar = time_min_ms(reps, c.setup, c.fn);
+        ws_ai::preproc_force_scalar(false);
+        const double t_simd = time_min_ms(reps, c.setup, c.fn);
+        std::printf("%-18s %12.3f %12.3f %12.3f %7.2fx\n", c.name, t_scalar, t_simd, t_simd / mpix,
+                    t_simd > 0 ? t_scalar / t_simd : 0.0);
+    }
+
+    std::printf("\nestimated text height: %d px (synthetic: %d)\n", text_px, line_px - line_px / 4);
+    return 0;
+}
@@ -0,0 +1,139 @@
+#include "ws_ai/config.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <sstream>
+
+namespace ws_ai {
+
+// WS_AI_MODELS="fast=a.gguf;default=b.gguf;deep=c.gguf"（也接受逗号分隔）
+static std::vector<ModelSpec> parse_models(const std::string &spec) {
+    std::vector<ModelSpec> out;
+    std::string item;
+    std::istringstream iss(spec);
+    while (std::getline(iss, item, ';')) {
+        std::istringstream iss2(item);
+        std::string kv;
+        while (std::getline(iss2, kv, ',')) {
+            auto eq = kv.find('=');
+            if (eq == std::string::npos || eq == 0 || eq + 1 >= kv.size()) continue;
+            out.push_back({kv.substr(0, eq), kv.substr(eq + 1)});
+        }
+    }
+    return out;
+}
+
+void apply_env_overrides(Config &cfg) {
+    if (const char *p = std::getenv("WS_AI_PORT")) {
+        int v = std::atoi(p);
+        if (v > 0 && v < 65536) cfg.port = v;
+    }
+    if (const char *p = std::getenv("WS_AI_WATCH_PORT")) {
+        int v = std::atoi(p);
+        if (v >= 0 && v < 65536) cfg.watch_port = v;
+    }
+    if (const char *t = std::getenv("WS_AI_WATCH_THREADS")) cfg.watch_threads = std::max(1, std::atoi(t));
+    if (const char *p = std::getenv("WS_AI_UDS")) cfg.uds_path = p;
+    if (const char *t = std::getenv("WS_AI_UDS_MAX_CONNS")) cfg.uds_max_conns = std::max(1, std::atoi(t));
+    if (const char *f = std::getenv("WS_AI_FOLDERS")) {
+        cfg.folder_dirs.clear();
+        std::string item;
+        std::istringstream iss(f);
+        while (std::getline(iss, item, ',')) {
+            if (!item.empty()) cfg.folder_dirs.push_back(item);
+        }
+    }
+    if (const char *t = std::getenv("WS_AI_FOLDER_DEBOUNCE_MS")) cfg.folder_debounce_ms = std::max(0, std::atoi(t));
+    if (const char *t = std::getenv("WS_AI_FOLDER_INFLIGHT")) cfg.folder_inflight = std::max(0, std::atoi(t));
+    if (const char *w = std::getenv("WS_AI_WORKERS")) {
+        cfg.workers.clear();
+        std::string item;
+        std::istringstream iss(w);
+        while (std::getline(iss, item, ',')) {
+            if (!item.empty()) cfg.workers.push_back(item);
+        }
+    }
+    if (const char *v = std::getenv("WS_AI_SPAWN_WORKERS")) cfg.spawn_workers = std::max(0, std::atoi(v));
+    if (const char *v = std::getenv("WS_AI_WORKER_POLL_MS")) cfg.worker_poll_ms = std::max(20, std::atoi(v));
+    if (const char *v = std::getenv("WS_AI_WORKER_RETRIES")) cfg.worker_retries = std::max(0, std::atoi(v));
+    if (const char *h = std::getenv("WS_AI_HOST")) {
+        if (h && *h) cfg.host = h;   // 现在 Config 有 host 了
+    }
+    if (const char *m = std::getenv("WS_AI_MODEL")) {
+        if (m && *m) cfg.model_path = m;
+    }
+    if (const char *m = std::getenv("WS_AI_MODELS")) {
+        cfg.models = parse_models(m);
+    }
+    if (const char *d = std::getenv("WS_AI_DEFAULT_MODEL")) {
+        if (*d) cfg.default_model = d;
+    }
+    if (const char *b = std::getenv("WS_AI_MODEL_BUDGET_MB")) {
+        long v = std::atol(b);
+        if (v >= 0) cfg.model_budget_mb = (size_t)v;
+    }
+    if (const char *t = std::getenv("WS_AI_MODEL_IDLE_SEC")) {
+        cfg.model_idle_sec = std::max(0, std::atoi(t));
+    }
+    if (const char *t = std::getenv("WS_AI_THREADS")) {
+        cfg.n_threads = std::max(0, std::atoi(t));
+    }
+    if (const char *t = std::getenv("WS_AI_THREADS_BATCH")) {
+        cfg.n_threads_batch = std::max(0, std::atoi(t));
+    }
+    if (const char *t = std::getenv("WS_AI_OCR_WORKERS")) {
+        cfg.ocr_workers = std::max(0, std::atoi(t));
+    }
+    if (const char *t = std::getenv("WS_AI_HTTP_WORKERS")) {
+        cfg.http_workers = std::max(0, std::atoi(t));
+    }
+    if (const char *t = std::getenv("WS_AI_PIN_THREADS")) {
+        cfg.pin_threads = std::atoi(t) != 0;
+    }
+    if (const char *p = std::getenv("WS_AI_PIPELINE")) {
+        if (*p) cfg.pipeline = p;
+    }
+    if (const char *v = std::getenv("WS_AI_MOCK_OCR_MS")) cfg.mock_ocr_ms = std::max(0, std::atoi(v));
+    if (const char *v = std::getenv("WS_AI_MOCK_PREFILL_MS")) cfg.mock_prefill_ms = std::max(0, std::atoi(v));
+    if (const char *v = std::getenv("WS_AI_MOCK_TOK_S")) cfg.mock_tok_per_sec = (float)std::max(0.1, std::atof(v));
+    if (const char *v = std::getenv("WS_AI_MOCK_TOKENS")) cfg.mock_tokens = std::max(1, std::atoi(v));
+    if (const char *v = std::getenv("WS_AI_MOCK_ERROR_RATE")) cfg.mock_error_rate = (float)std::atof(v);
+    if (const char *v = std::getenv("WS_AI_MOCK_MEM_MB")) cfg.mock_mem_mb = std::max(0, std::atoi(v));
+    if (const char *v = std::getenv("WS_AI_JOB_WORKERS")) cfg.job_workers = std::max(0, std::atoi(v));
+    if (const char *v = std::getenv("WS_AI_MEM_BUDGET_MB")) {
+        long mb = std::atol(v);
+        if (mb >= 0) cfg.mem_budget_mb = (size_t)mb;
+    }
+    if (const char *v = std::getenv("WS_AI_KV_TYPE")) {
+        if (*v) cfg.kv_type = v;
+    }
+    if (const char *v = std::getenv("WS_AI_CTX_POOL")) cfg.ctx_pool_size = std::max(0, std::atoi(v));
+    if (const char *v = std::getenv("WS_AI_MAX_CANDIDATES")) cfg.max_candidates = std::max(1, std::atoi(v));
+    if (const char *v = std::getenv("WS_AI_KV_TTL_SEC")) cfg.kv_ttl_sec = std::max(0, std::atoi(v));
+    if (const char *v = std::getenv("WS_AI_KV_QUEUE_MB")) cfg.kv_queue_mb = std::max(0, std::atoi(v));
+    if (const char *d = std::getenv("WS_AI_JOB_DIR")) {
+        if (*d) cfg.job_dir = d;
+    }
+    if (const char *v = std::getenv("WS_AI_JOURNAL")) cfg.journal = std::atoi(v) != 0;
+    if (const char *v = std::getenv("WS_AI_JOURNAL_SYNC")) cfg.journal_sync = std::atoi(v) != 0;
+    if (const char *v = std::getenv("WS_AI_JOURNAL_COMPACT_MB")) cfg.journal_compact_mb = std::max(1, std::atoi(v));
+    if (const char *v = std::getenv("WS_AI_JOURNAL_RETAIN_SEC")) cfg.journal_retain_sec = std::max(0, std::atoi(v));
+    if (const char *v = std::getenv("WS_AI_STRUCTURE_STOP")) cfg.structure_stop = std::atoi(v) != 0;
+    if (const char *v = std::getenv("WS_AI_GRAMMAR")) cfg.structure_grammar = std::atoi(v) != 0;
+    if (const char *t = std::getenv("WS_AI_TRACE")) {
+        cfg.trace = std::atoi(t) != 0;
+    }
+    if (const char *d = std::getenv("WS_AI_DEDUP_DISTANCE")) {
+        if (*d) cfg.dedup_max_distance = std::min(32, std::atoi(d));
+    }
+    if (const char *v = std::getenv("WS_AI_SEMCACHE")) cfg.semcache_threshold = std::max(0.f, std::min(1.f, (float)std::atof(v)));
+    if (const char *v = std::getenv("WS_AI_SEMCACHE_CAPACITY")) {
+        long n = std::atol(v);
+        if (n > 0) cfg.semcache_capacity = (size_t)n;
+    }
+    if (const char *v = std::getenv("WS_AI_EMBED_MODEL")) cfg.embed_model = v;
+    if (const char *v = std::getenv("WS_AI_EMBED_MAX_TOKENS")) cfg.embed_max_tokens = std::max(16, std::atoi(v));
+    if (const char *v = std::getenv("WS_AI_DEADLINE_MIN_TOKENS")) cfg.deadline_min_tokens = std::max(1, std::atoi(v));
+}
+
+} // namespace ws_ai
@@ -0,0 +1,186 @@
+#include "ws_ai/deadline.h"
+#include "ws_ai/util.h"
+
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <iomanip>
+#include <sstream>
+
+namespace ws_ai {
+
+static constexpr double kAlpha  = 0.2;   // 滑动平均的权重：几个任务之后就跟上负载变化
+static constexpr double kSafety = 0.9;   // 估算只用剩余时间的 90%，给调度抖动和 OCR 长尾留余地
+
+static void ewma(double &v, double x, int samples) {
+    v = samples == 0 ? x : v + kAlpha * (x - v);
+}
+
+DeadlinePlanner::DeadlinePlanner(const Config &cfg)
+: max_new_tokens_(std::max(1, cfg.max_new_tokens)), min_new_tokens_(cfg.min_new_tokens),
+  floor_tokens_(std::max(1, cfg.deadline_min_tokens)) {
+    std::vector<ModelSpec> specs = cfg.models;
+    if (specs.empty()) specs.push_back({cfg.default_model.empty() ? "default" : cfg.default_model, cfg.model_path});
+    for (const auto &s : specs) {
+        std::error_code ec;
+        const auto n = std::filesystem::file_size(s.path, ec);
+        sizes_[s.name] = ec ? 0 : (uint64_t)n;
+    }
+}
+
+void DeadlinePlanner::observe(const std::string &model, double ocr_ms, double ttft_ms, int gen_tokens,
+                              double decode_ms, double run_ms) {
+    if (ocr_ms > 0) ewma(ocr_ms_, ocr_ms, ocr_samples_++);
+    if (gen_tokens <= 0) return;  // 缓存命中 / 没生成，不代表速率
+
+    Rate &r = rates_[model];
+    if (ocr_ms > 0 && ttft_ms > 0) ewma(r.ttft_ms, ttft_ms, r.samples);
+    if (gen_tokens > 1 && decode_ms > 0) ewma(r.decode_tok_s, (gen_tokens - 1) * 1000.0 / decode_ms, r.samples);
+    ewma(r.gen_tokens, std::min(gen_tokens, max_new_tokens_), r.samples);
+    ewma(r.run_ms, run_ms, r.samples);
+    r.samples++;
+}
+
+bool DeadlinePlanner::rate_of(const std::string &model, Rate &out) const {
+    auto it = rates_.find(model);
+    if (it != rates_.end() && it->second.decode_tok_s > 0) {
+        out = it->second;
+        return true;
+    }
+    // 没跑过：找一个跑过、文件大小已知的模型按大小比例推
+    auto sz = sizes_.find(model);
+    if (sz == sizes_.end() || sz->second == 0) return false;
+    for (const auto &kv : rates_) {
+        auto ref = sizes_.find(kv.first);
+        if (ref == sizes_.end() || ref->second == 0 || kv.second.decode_tok_s <= 0) continue;
+        const double ratio = (double)sz->second / (double)ref->second;
+        out = kv.second;
+        out.ttft_ms *= ratio;
+        out.decode_tok_s /= ratio;
+        out.run_ms *= ratio;
+        out.samples = 0;
+        return true;
+    }
+    return false;
+}
+
+double DeadlinePlanner::estimate_ms(const Rate &r, bool has_ocr, double tokens) const {
+    return (has_ocr ? ocr_ms_ : 0.0) + r.ttft_ms + tokens * 1000.0 / r.decode_tok_s;
+}
+
+int DeadlinePlanner::tokens_within(const Rate &r, bool has_ocr, double budget_ms) const {
+    const double left = budget_ms - (has_ocr ? ocr_ms_ : 0.0) - r.ttft_ms;
+    if (left <= 0) return 0;
+    return (int)std::min<double>(max_new_tokens_, std::floor(left * r.decode_tok_s / 1000.0));
+}
+
+std::vector<std::string> DeadlinePlanner::smaller_models(const std::string &model) const {
+    std::vector<std::pair<uint64_t, std::string>> v;
+    auto cur = sizes_.find(model);
+    if (cur == sizes_.end() || cur->second == 0) return {};
+    for (const auto &kv : sizes_) {
+        if (kv.second > 0 && kv.second < cur->second) v.push_back({kv.second, kv.first});
+    }
+    std::sort(v.begin(), v.end(), [](const auto &a, const auto &b) { return a.first > b.first; });
+    std::vector<std::string> out;
+    for (auto &p : v) out.push_back(std::move(p.second));
+    return out;
+}
+
+DeadlinePlan DeadlinePlanner::plan(const std::string &model, bool has_ocr, double remaining_ms, bool allow_switch) const {
+    DeadlinePlan p;
+    p.model = model;
+    Rate r;
+    if (!rate_of(model, r)) return p;  // 没有实测数据：照常跑
+
+    const double budget = remaining_ms * kSafety;
+    const double typical = r.samples > 0 ? r.gen_tokens : max_new_tokens_;
+    p.est_ms = estimate_ms(r, has_ocr, typical);
+    if (p.est_ms <= budget) return p;
+
+    auto shrink = [&](const std::string &m, const Rate &mr, int min_tokens) {
+        const int n = tokens_within(mr, has_ocr, budget);
+        if (n < min_tokens) return false;
+        p.model = m;
+        p.max_new_tokens = n;
+        p.min_new_tokens = std::min(min_new_tokens_, n / 2);
+        p.est_ms = estimate_ms(mr, has_ocr, n);
+        return true;
+    };
+
+    // 1) 输出稍微短一点就来得及：同一个模型，质量损失最小
+    if (shrink(model, r, std::max(floor_tokens_, (int)(typical / 2)))) return p;
+
+    // 2) 换更小的模型，完整长度
+    const std::vector<std::string> smaller = allow_switch ? smaller_models(model) : std::vector<std::string>{};
+    for (const auto &m : smaller) {
+        Rate mr;
+        if (!rate_of(m, mr)) continue;
+        const double t = mr.samples > 0 ? mr.gen_tokens : typical;
+        if (estimate_ms(mr, has_ocr, t) <= budget) {
+            p.model = m;
+            p.est_ms = estimate_ms(mr, has_ocr, t);
+            return p;
+        }
+    }
+
+    // 3) 同一个模型缩短到 floor，4) 更小的模型再缩短
+    if (shrink(model, r, floor_tokens_)) return p;
+    for (const auto &m : smaller) {
+        Rate mr;
+        if (rate_of(m, mr) && shrink(m, mr, floor_tokens_)) return p;
+    }
+
+    std::ostringstream why;
+    why << std::fixed << std::setprecision(0) << "deadline cannot be met: at least "
+        << estimate_ms(r, has_ocr, floor_tokens_) << " ms needed, " << std::max(0.0, remaining_ms) << " ms left";
+    p.feasible = false;
+    p.model = model;
+    p.max_new_tokens = 0;
+    p.min_new_tokens = -1;
+    p.why = why.str();
+    return p;
+}
+
+bool DeadlinePlanner::hopeless(const std::string &model, bool has_ocr, double remaining_ms, size_t ahead, size_t busy,
+                               size_t workers, std::string &why) const {
+    Rate r;
+    if (!rate_of(model, r) || r.samples == 0) return false;
+    workers = std::max<size_t>(1, workers);
+
+    // 最省的跑法：本模型或任意更小的模型只生成 floor 个 token
+    double fastest = estimate_ms(r, has_ocr, floor_tokens_);
+    for (const auto &m : smaller_models(model)) {
+        Rate mr;
+        if (rate_of(m, mr)) fastest = std::min(fastest, estimate_ms(mr, has_ocr, floor_tokens_));
+    }
+    // worker 都忙时至少还要等在跑的任务平均跑完一半；前面排着的按整批摊
+    double wait = (double)ahead / workers * r.run_ms;
+    if (busy >= workers) wait += r.run_ms / 2;
+    if (wait + fastest <= remaining_ms) return false;
+
+    std::ostringstream o;
+    o << std::fixed << std::setprecision(0) << "deadline cannot be met: ~" << wait << " ms queue wait + "
+      << fastest << " ms minimum run, " << std::max(0.0, remaining_ms) << " ms left";
+    why = o.str();
+    return true;
+}
+
+std::string DeadlinePlanner::rates_json() const {
+    std::ostringstream oss;
+    oss << std::fixed << std::setprecision(1) << "{\"ocr_ms\":" << ocr_ms_ << ",\"models\":{";
+    bool first = true;
+    for (const auto &kv : rates_) {
+        const Rate &r = kv.second;
+        oss << (first ? "" : ",") << "\"" << json_escape(kv.first) << "\":{\"samples\":" << r.samples
+            << ",\"ttft_ms\":" << r.ttft_ms
+            << ",\"decode_tok_s\":" << r.decode_tok_s
+            << ",\"gen_tokens\":" << r.gen_tokens
+            << ",\"run_ms\":" << r.run_ms << "}";
+        first = false;
+    }
+    oss << "}}";
+    return oss.str();
+}
+
+} // namespace ws_ai
@@ -0,0 +1,926 @@
+#include "ws_ai/dispatcher.h"
+#include "ws_ai/ocr_vision.h"
+#include "ws_ai/util.h"
+
+#include <httplib.h>
+#include <json.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <unordered_set>
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
+#ifdef __APPLE__
+#include <mach-o/dyld.h>
+#endif
+
+namespace ws_ai {
+
+using Clock = std::chrono::steady_clock;
+using nlohmann::json;
+
+static const char *kJson = "application/json; charset=utf-8";
+
+// 剪贴板 body 里的 deadline_ms 平时原样转发；过去这么久（换 worker 重跑）才改写成剩余时间
+static constexpr int64_t kDeadlineRewriteMs = 50;
+
+// 转给 worker 的原始请求：worker 挂掉时拿它换一个 worker 重新提交，任务结束后释放
+struct Dispatcher::Payload {
+    bool clipboard = false;  // true：bytes 是原样的 /api/clipboard JSON body
+    std::string bytes;
+    std::string filename;
+    std::string content_type;
+    std::string model;
+    std::string n_candidates;
+    std::string candidates;
+    int deadline_ms = 0;  // 客户端给的 deadline；转给 worker 时扣掉已经过去的时间（换 worker 重跑也不会重新计时）
+    Clock::time_point received = Clock::now();
+};
+
+struct Dispatcher::Worker {
+    std::string addr;  // host:port
+    std::string host;
+    int port = 0;
+    pid_t pid = 0;     // 本机起的 worker
+    std::atomic<int> watch_port{0};  // worker 报上来的 watch 端口，流式代理优先连它
+
+    // 以下受 mu_ 保护
+    bool healthy = false;  // 第一次健康检查通过前不分任务
+    int fails = 0;         // 连续失败次数
+    int64_t outstanding = 0;                 // 估计剩余 token
+    std::unordered_set<std::string> active;  // 在它上面还没结束的任务
+    uint64_t routed = 0;
+    uint64_t affinity = 0;
+    uint64_t errors = 0;
+    int queued = 0;   // worker 自己报的队列
+    int running = 0;
+    double rtt_ms = 0;
+};
+
+struct Dispatcher::Job {
+    std::string id;
+    std::shared_ptr<const Payload> payload;  // 追问没有（只能在原 worker 上跑，不重试）
+    ImageFingerprint fp;
+    std::string parent;  // 追问：原任务 id
+
+    int worker = -1;     // -1：还没分到 / 等重试 / 放弃了
+    std::string remote_id;
+    uint64_t epoch = 0;  // 每分配一次 +1，流式代理据此判断换过 worker
+    int attempts = 0;    // 因为 worker 挂掉重试了几次
+    int64_t est = 0;     // 估计生成 token 数
+    int64_t charged = 0; // 当前记在 worker.outstanding 上的量
+
+    std::string state = "queued";
+    int progress = 0;
+    bool finished = false;
+    std::string error;       // dispatcher 自己判定失败时的原因
+    std::string final_json;  // 结束后第一次查到的状态（rewrite 过），之后直接回
+    Clock::time_point finished_at;
+};
+
+static std::string remote_key(int worker, const std::string &remote_id) {
+    return std::to_string(worker) + "/" + remote_id;
+}
+
+// "http://127.0.0.1:9001" / "127.0.0.1:9001" / ":9001"
+static bool split_addr(std::string addr, std::string &host, int &port) {
+    if (addr.rfind("http://", 0) == 0) addr = addr.substr(7);
+    while (!addr.empty() && addr.back() == '/') addr.pop_back();
+    const size_t colon = addr.rfind(':');
+    if (colon == std::string::npos) return false;
+    host = colon == 0 ? "127.0.0.1" : addr.substr(0, colon);
+    port = std::atoi(addr.c_str() + colon + 1);
+    return port > 0 && port < 65536;
+}
+
+// 精确内容哈希（FNV-1a），没法解码算感知哈希时用；phash / dhash 放同一个值，只有距离 0 才会匹配上
+static ImageFingerprint content_fingerprint(const std::string &bytes) {
+    uint64_t h = 1469598103934665603ull;
+    for (unsigned char c : bytes) {
+        h ^= c;
+        h *= 1099511628211ull;
+    }
+    return ImageFingerprint{h, h};
+}
+
+// 上传的图片：能解码就和 JobManager 一样算感知哈希（近重复截图也能发到同一个 worker），否则退回内容哈希。
+// decode_image_luma 只有 macOS 上有实现，其它平台不写临时文件
+static ImageFingerprint upload_fingerprint(const std::string &bytes, const std::string &filename) {
+#ifdef __APPLE__
+    static std::atomic<uint64_t> seq{0};
+    const size_t dot = filename.find_last_of('.');
+    const std::string path = "/tmp/ws_ai_dispatch_" + std::to_string(getpid()) + "_" + std::to_string(seq++) +
+                             (dot == std::string::npos ? std::string(".bin") : filename.substr(dot));
+    ImageFingerprint fp;
+    GrayImage small;
+    const bool ok = write_file_binary(path, bytes) && decode_image_luma(path, 256, small) && compute_fingerprint(small, fp);
+    std::remove(path.c_str());
+    if (ok) return fp;
+#else
+    (void)filename;
+#endif
+    return content_fingerprint(bytes);
+}
+
+static std::string self_exe() {
+#ifdef __APPLE__
+    char buf[4096];
+    uint32_t n = sizeof(buf);
+    if (_NSGetExecutablePath(buf, &n) == 0) return buf;
+    return {};
+#else
+    char buf[4096];
+    const ssize_t n = readlink("/proc/self/exe", buf, sizeof(buf) - 1);
+    if (n <= 0) return {};
+    buf[n] = '\0';
+    return buf;
+#endif
+}
+
+Dispatcher::Dispatcher(const Config &cfg)
+: cfg_(cfg), affinity_(cfg.dedup_capacity), est_tokens_(std::max(1, cfg.max_new_tokens / 2)) {}
+
+Dispatcher::~Dispatcher() {
+    stop();
+}
+
+std::string Dispatcher::new_id() const {
+    static thread_local std::mt19937_64 rng{std::random_device{}()};
+    std::ostringstream oss;
+    oss << std::hex << (uint64_t)std::time(nullptr) << "_" << rng();
+    return oss.str();
+}
+
+bool Dispatcher::spawn_workers(std::string &err) {
+    const std::string exe = self_exe();
+    if (exe.empty()) {
+        err = "找不到自己的可执行文件路径，没法起本机 worker";
+        return false;
+    }
+    const int n = cfg_.spawn_workers;
+    // 几个 worker 分 CPU：没手动指定线程数时每个拿 1/n
+    const unsigned hw = std::max(1u, std::thread::hardware_concurrency());
+    const std::string threads = std::to_string(std::max(1u, hw / (unsigned)n));
+    for (int i = 0; i < n; ++i) {
+        const int port = cfg_.port + 1 + i;
+        const std::string port_s = std::to_string(port);
+        // 这时候还没起任何线程，fork 后直接 exec
+        const pid_t pid = fork();
+        if (pid < 0) {
+            err = "fork 失败";
+            return false;
+        }
+        if (pid == 0) {
+#ifdef __linux__
+            prctl(PR_SET_PDEATHSIG, SIGTERM);  // dispatcher 没了 worker 跟着退出
+#endif
+            setenv("WS_AI_PORT", port_s.c_str(), 1);
+            setenv("WS_AI_HOST", "127.0.0.1", 1);
+            setenv("WS_AI_WATCH_PORT", std::to_string(cfg_.port + 1 + n + i).c_str(), 1);
+            setenv("WS_AI_SPAWN_WORKERS", "0", 1);
+            unsetenv("WS_AI_WORKERS");
+            unsetenv("WS_AI_UDS");      // socket 文件只能有一个进程监听
+            unsetenv("WS_AI_FOLDERS");  // 同一个目录不能被几个 worker 同时监控
+            // 每个 worker 一份任务日志 / KV 目录：日志只能有一个进程追加
+            setenv("WS_AI_JOB_DIR", (cfg_.job_dir + "/worker-" + port_s).c_str(), 1);
+            if (!std::getenv("WS_AI_THREADS")) setenv("WS_AI_THREADS", threads.c_str(), 1);
+            execl(exe.c_str(), exe.c_str(), (char *)nullptr);
+            _exit(127);
+        }
+        auto w = std::make_unique<Worker>();
+        w->addr = "127.0.0.1:" + port_s;
+        w->host = "127.0.0.1";
+        w->port = port;
+        w->pid = pid;
+        workers_.push_back(std::move(w));
+    }
+    return true;
+}
+
+bool Dispatcher::start(std::string &err) {
+    if (cfg_.spawn_workers > 0 && !spawn_workers(err)) return false;
+    for (const std::string &a : cfg_.workers) {
+        auto w = std::make_unique<Worker>();
+        if (!split_addr(a, w->host, w->port)) {
+            err = "worker 地址不对: " + a;
+            return false;
+        }
+        w->addr = w->host + ":" + std::to_string(w->port);
+        workers_.push_back(std::move(w));
+    }
+    if (workers_.empty()) {
+        err = "没有 worker";
+        return false;
+    }
+
+    stop_.store(false);
+    poller_ = std::thread([this] { poll_loop(); });
+
+    // 本机刚起的 worker 要一会儿才开始监听：最多等 10 s 有一个可用再开始接请求
+    const auto deadline = Clock::now() + std::chrono::seconds(10);
+    for (;;) {
+        {
+            std::lock_guard<std::mutex> lk(mu_);
+            for (const auto &w : workers_) {
+                if (w->healthy) return true;
+            }
+        }
+        if (Clock::now() > deadline) break;
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    std::cerr << "[dispatch] 10 s 内没有可用的 worker，先开始接请求（提交会返回 503）\n";
+    return true;
+}
+
+void Dispatcher::stop() {
+    {
+        std::lock_guard<std::mutex> lk(stop_mu_);
+        stop_.store(true);
+    }
+    stop_cv_.notify_all();
+    if (poller_.joinable()) poller_.join();
+    for (auto &w : workers_) {
+        if (w->pid <= 0) continue;
+        kill(w->pid, SIGTERM);
+        waitpid(w->pid, nullptr, 0);
+        w->pid = 0;
+    }
+}
+
+// ---- 路由 ----
+
+void Dispatcher::charge(Job &job, int64_t tokens) {
+    if (job.worker < 0) return;
+    workers_[job.worker]->outstanding += tokens - job.charged;
+    job.charged = tokens;
+}
+
+void Dispatcher::detach(Job &job) {
+    if (job.worker < 0) return;
+    charge(job, 0);
+    workers_[job.worker]->active.erase(job.id);
+    by_remote_.erase(remote_key(job.worker, job.remote_id));
+    job.worker = -1;
+    job.remote_id.clear();
+    job.state = "queued";
+    job.progress = 0;
+}
+
+void Dispatcher::finish(Job &job, bool ok) {
+    charge(job, 0);
+    if (job.worker >= 0) workers_[job.worker]->active.erase(job.id);
+    job.finished = true;
+    job.finished_at = Clock::now();
+    job.payload.reset();
+    finished_.emplace_back(job.finished_at, job.id);
+    ok ? completed_++ : failed_++;
+}
+
+void Dispatcher::expire() {
+    if (cfg_.journal_retain_sec <= 0) return;
+    const auto cutoff = Clock::now() - std::chrono::seconds(cfg_.journal_retain_sec);
+    std::lock_guard<std::mutex> lk(mu_);
+    while (!finished_.empty() && finished_.front().first < cutoff) {
+        auto it = jobs_.find(finished_.front().second);
+        // 重复 finish 过的只认最后一次
+        if (it != jobs_.end() && it->second.finished && it->second.finished_at == finished_.front().first) {
+            if (it->second.worker >= 0) by_remote_.erase(remote_key(it->second.worker, it->second.remote_id));
+            jobs_.erase(it);
+            expired_++;
+        }
+        finished_.pop_front();
+    }
+}
+
+int Dispatcher::pick(const Job &job, const std::vector<int> &exclude, bool &affinity) const {
+    auto excluded = [&](int i) { return std::find(exclude.begin(), exclude.end(), i) != exclude.end(); };
+    affinity = false;
+
+    // 估计剩余 token 最少的；一样多时在跑任务少的优先
+    int best = -1;
+    for (int i = 0; i < (int)workers_.size(); ++i) {
+        const Worker &w = *workers_[i];
+        if (!w.healthy || excluded(i)) continue;
+        if (best < 0) {
+            best = i;
+            continue;
+        }
+        const Worker &b = *workers_[best];
+        if (w.outstanding < b.outstanding || (w.outstanding == b.outstanding && w.active.size() < b.active.size())) best = i;
+    }
+    if (best < 0) return -1;
+
+    // 缓存亲和：上次处理同一张（或近重复）图的 worker，只要没比最闲的多积压两个任务以上
+    if (auto m = affinity_.find(job.fp, std::max(0, cfg_.dedup_max_distance))) {
+        const int a = std::atoi(m->key.c_str());
+        if (a >= 0 && a < (int)workers_.size() && workers_[a]->healthy && !excluded(a) &&
+            workers_[a]->outstanding <= workers_[best]->outstanding + 2 * (int64_t)est_tokens_) {
+            affinity = true;
+            return a;
+        }
+    }
+    return best;
+}
+
+int Dispatcher::forward(const Worker &w, const Payload &p, std::string &body) const {
+    httplib::Client cli(w.host, w.port);
+    cli.set_connection_timeout(2, 0);
+    cli.set_read_timeout(30, 0);
+    cli.set_write_timeout(30, 0);
+
+    // 剩余时间至少给 1 ms：已经超时的交给 worker 判失败，结果和直接提交一样
+    const int64_t elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - p.received).count();
+    const std::string deadline = p.deadline_ms > 0 ? std::to_string(std::max<int64_t>(1, p.deadline_ms - elapsed)) : "";
+
+    httplib::Result r;
+    if (p.clipboard && !deadline.empty() && elapsed >= kDeadlineRewriteMs) {
+        // 重跑时才值得重新序列化整个 body（里面是 base64 图片）
+        json body = json::parse(p.bytes, nullptr, false);
+        body["deadline_ms"] = std::atoi(deadline.c_str());
+        r = cli.Post("/api/clipboard", body.dump(), "application/json");
+    } else if (p.clipboard) {
+        r = cli.Post("/api/clipboard", p.bytes, "application/json");
+    } else {
+        httplib::UploadFormDataItems items = {{"file", p.bytes, p.filename, p.content_type}};
+        if (!p.model.empty()) items.push_back({"model", p.model, "", ""});
+        if (!p.n_candidates.empty()) items.push_back({"n_candidates", p.n_candidates, "", ""});
+        if (!p.candidates.empty()) items.push_back({"candidates", p.candidates, "", ""});
+        if (!deadline.empty()) items.push_back({"deadline_ms", deadline, "", ""});
+        r = cli.Post("/api/upload", items);
+    }
+    if (!r) return -1;
+    body = r->body;
+    return r->status;
+}
+
+bool Dispatcher::place(const std::string &id, std::vector<int> exclude, int &status, std::string &body) {
+    status = 503;
+    body = "{\"ok\":false,\"error\":\"no healthy worker\"}";
+    for (int attempt = 0; attempt <= (int)workers_.size(); ++attempt) {
+        std::shared_ptr<const Payload> p;
+        int wi = -1;
+        bool aff = false;
+        int64_t est = 0;
+        {
+            std::lock_guard<std::mutex> lk(mu_);
+            auto it = jobs_.find(id);
+            if (it == jobs_.end() || !it->second.payload) return false;
+            p = it->second.payload;
+            wi = pick(it->second, exclude, aff);
+            if (wi < 0) return false;
+            // 提交的 HTTP 请求还没回来就先把 token 记上，并发的提交不会全挤到同一个 worker
+            est = it->second.est;
+            workers_[wi]->outstanding += est;
+        }
+
+        std::string resp;
+        const int st = forward(*workers_[wi], *p, resp);
+        const json j = st == 200 ? json::parse(resp, nullptr, false) : json();
+        const std::string remote = j.is_object() && j.value("ok", false) ? j.value("id", "") : "";
+
+        std::lock_guard<std::mutex> lk(mu_);
+        Worker &w = *workers_[wi];
+        w.outstanding -= est;
+        auto it = jobs_.find(id);
+        if (it == jobs_.end()) return false;
+        if (!remote.empty()) {
+            Job &job = it->second;
+            job.worker = wi;
+            job.remote_id = remote;
+            job.epoch++;
+            job.state = "queued";
+            job.progress = 0;
+            job.charged = 0;
+            charge(job, job.est);
+            w.active.insert(id);
+            w.routed++;
+            if (aff) {
+                w.affinity++;
+                affinity_hits_++;
+            }
+            by_remote_[remote_key(wi, remote)] = id;
+            affinity_.insert(job.fp, std::to_string(wi));
+            return true;
+        }
+        if (st >= 400 && st < 500) {
+            // 请求本身的问题（比如模型名不对），换 worker 也一样
+            status = st;
+            body = resp;
+            return false;
+        }
+        // 连不上 / 5xx：记一次失败，换下一个；判不判挂掉交给健康检查
+        w.fails++;
+        w.errors++;
+        exclude.push_back(wi);
+    }
+    return false;
+}
+
+// ---- 健康检查 + 进度同步 ----
+
+void Dispatcher::poll_loop() {
+    std::vector<std::unique_ptr<httplib::Client>> clients;
+    for (const auto &w : workers_) {
+        clients.push_back(std::make_unique<httplib::Client>(w->host, w->port));
+        clients.back()->set_connection_timeout(1, 0);
+        clients.back()->set_read_timeout(2, 0);
+        clients.back()->set_keep_alive(true);
+    }
+
+    while (!stop_.load()) {
+        const auto t0 = Clock::now();
+        for (int i = 0; i < (int)workers_.size() && !stop_.load(); ++i) {
+            std::vector<std::string> lost;
+            poll_worker(i, *clients[i], lost);
+            for (const std::string &id : lost) retry(id, i);
+        }
+        expire();
+        std::unique_lock<std::mutex> lk(stop_mu_);
+        stop_cv_.wait_until(lk, t0 + std::chrono::milliseconds(cfg_.worker_poll_ms), [&] { return stop_.load(); });
+    }
+}
+
+void Dispatcher::poll_worker(int wi, httplib::Client &cli, std::vector<std::string> &lost) {
+    Worker &w = *workers_[wi];
+    std::string ids;
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        for (const std::string &id : w.active) {
+            if (!ids.empty()) ids += ',';
+            ids += jobs_[id].remote_id;
+        }
+    }
+
+    const auto t0 = Clock::now();
+    auto r = cli.Post("/api/progress", ids, "text/plain");
+    const double rtt = std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+    const json j = r && r->status == 200 ? json::parse(r->body, nullptr, false) : json();
+    if (r && r->has_header("X-WS-AI-Watch-Port")) w.watch_port.store(std::atoi(r->get_header_value("X-WS-AI-Watch-Port").c_str()));
+
+    std::lock_guard<std::mutex> lk(mu_);
+    if (!j.is_object() || !j.contains("jobs") || !j["jobs"].is_array()) {
+        w.fails++;
+        if (w.healthy && w.fails >= cfg_.worker_fail_after) {
+            w.healthy = false;
+            std::cerr << "[dispatch] worker " << w.addr << " 连续 " << w.fails << " 次没响应，判为不可用，"
+                      << w.active.size() << " 个任务换 worker 重跑\n";
+            const std::vector<std::string> ids_on(w.active.begin(), w.active.end());
+            for (const std::string &id : ids_on) {
+                detach(jobs_[id]);
+                lost.push_back(id);
+            }
+        }
+        return;
+    }
+    if (!w.healthy) std::cerr << "[dispatch] worker " << w.addr << " 可用\n";
+    w.healthy = true;
+    w.fails = 0;
+    w.rtt_ms = rtt;
+    w.queued = j.value("queued", 0);
+    w.running = j.value("running", 0);
+
+    for (const json &e : j["jobs"]) {
+        auto m = by_remote_.find(remote_key(wi, e.value("id", "")));
+        if (m == by_remote_.end()) continue;
+        Job &job = jobs_[m->second];
+        if (job.worker != wi || job.finished) continue;
+
+        const std::string state = e.value("state", "");
+        if (state == "not_found") {
+            // worker 重启过，任务没了
+            detach(job);
+            lost.push_back(job.id);
+            continue;
+        }
+        job.state = state;
+        job.progress = e.value("progress", 0);
+        if (state == "done" || state == "error") {
+            const int gen = e.value("gen_tokens", 0);
+            if (state == "done" && gen > 0 && job.parent.empty()) est_tokens_ = 0.9 * est_tokens_ + 0.1 * gen;
+            finish(job, state == "done");
+        } else {
+            charge(job, job.est * (100 - std::min(100, std::max(0, job.progress))) / 100);
+        }
+    }
+}
+
+void Dispatcher::retry(const std::string &id, int failed_worker) {
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        auto it = jobs_.find(id);
+        if (it == jobs_.end()) return;
+        Job &job = it->second;
+        if (!job.payload || job.attempts >= cfg_.worker_retries) {
+            job.state = "error";
+            job.error = job.payload ? "worker 挂了，重试次数用完" : "worker 挂了（追问只能在原 worker 上跑）";
+            finish(job, false);
+            return;
+        }
+        job.attempts++;
+        retried_++;
+    }
+    int status = 0;
+    std::string body;
+    if (place(id, {failed_worker}, status, body)) return;
+
+    std::lock_guard<std::mutex> lk(mu_);
+    auto it = jobs_.find(id);
+    if (it == jobs_.end()) return;
+    it->second.state = "error";
+    it->second.error = "worker 挂了，没有可用的 worker 重试";
+    finish(it->second, false);
+}
+
+// ---- 状态 / 流式代理 ----
+
+std::string Dispatcher::local_status(const Job &job) const {
+    std::ostringstream oss;
+    oss << "{\"ok\":true,\"id\":\"" << json_escape(job.id) << "\",\"state\":\"" << json_escape(job.state) << "\"";
+    if (job.state == "error") {
+        oss << ",\"progress\":100,\"error\":\"" << json_escape(job.error) << "\"}";
+    } else {
+        oss << ",\"progress\":" << job.progress << ",\"partial\":\"\",\"result\":\"\"}";
+    }
+    return oss.str();
+}
+
+// worker 的状态 JSON 换成 dispatcher 的 id，带上 worker 地址
+std::string Dispatcher::rewrite_status(const std::string &body, const Job &job) const {
+    json j = json::parse(body, nullptr, false);
+    if (!j.is_object()) return body;
+    if (j.contains("id")) j["id"] = job.id;
+    if (job.worker >= 0) j["worker"] = workers_[job.worker]->addr;
+    if (j.contains("parent")) j["parent"] = job.parent;
+    if (j.contains("dup_of") && j["dup_of"].is_string()) {
+        std::lock_guard<std::mutex> lk(mu_);
+        auto m = by_remote_.find(remote_key(job.worker, j["dup_of"].get<std::string>()));
+        if (m != by_remote_.end()) j["dup_of"] = m->second;
+    }
+    return j.dump();
+}
+
+std::string Dispatcher::status_json(const std::string &id) {
+    Job job;
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        auto it = jobs_.find(id);
+        if (it == jobs_.end()) return "{\"ok\":false,\"error\":\"not found\"}";
+        if (!it->second.final_json.empty()) return it->second.final_json;
+        job = it->second;
+    }
+    if (job.worker < 0) return local_status(job);
+
+    const Worker &w = *workers_[job.worker];
+    httplib::Client cli(w.host, w.port);
+    cli.set_connection_timeout(1, 0);
+    cli.set_read_timeout(5, 0);
+    auto r = cli.Get("/api/status?id=" + job.remote_id);
+    if (!r || r->status != 200) return local_status(job);  // worker 暂时连不上：挂没挂交给健康检查
+
+    const std::string out = rewrite_status(r->body, job);
+    const json j = json::parse(r->body, nullptr, false);
+    const std::string state = j.is_object() ? j.value("state", "") : "";
+    if (state == "done" || state == "error") {
+        std::lock_guard<std::mutex> lk(mu_);
+        auto it = jobs_.find(id);
+        if (it != jobs_.end() && it->second.epoch == job.epoch) it->second.final_json = out;
+    }
+    return out;
+}
+
+// 把 worker 的 SSE 原样转给客户端（done / error 里的状态 JSON 换成 dispatcher 的 id）。
+// worker 中途断了就等健康检查把任务挪到别的 worker，先发 event: reset 再从新 worker 接着转
+bool Dispatcher::relay_stream(const std::string &id, httplib::DataSink &sink) {
+    uint64_t seen_epoch = 0;
+    auto last_write = Clock::now();
+    auto write = [&](const std::string &s) {
+        last_write = Clock::now();
+        return sink.write(s.data(), s.size());
+    };
+
+    while (!stop_.load()) {
+        Job job;
+        {
+            std::lock_guard<std::mutex> lk(mu_);
+            auto it = jobs_.find(id);
+            if (it == jobs_.end()) return write("event: error\ndata: {\"ok\":false,\"error\":\"not found\"}\n\n");
+            job = it->second;
+        }
+        if (job.worker < 0) {
+            if (job.finished) return write("event: error\ndata: " + local_status(job) + "\n\n");
+            // 等重新分配
+            if (Clock::now() - last_write > std::chrono::seconds(15) && !write(": keepalive\n\n")) return false;
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            continue;
+        }
+        if (seen_epoch != 0 && job.epoch != seen_epoch && !write("event: reset\ndata: {}\n\n")) return false;
+        seen_epoch = job.epoch;
+
+        // worker 的主端口线程池很小，长连接连它的 watch 端口（事件循环，同样的 SSE 格式）
+        const Worker &w = *workers_[job.worker];
+        const int wport = w.watch_port.load();
+        httplib::Client cli(w.host, wport > 0 ? wport : w.port);
+        cli.set_connection_timeout(2, 0);
+        cli.set_read_timeout(30, 0);  // worker 每 15 s 发一次 keepalive
+
+        std::string buf;
+        bool terminal = false, client_gone = false;
+        cli.Get("/api/stream?id=" + job.remote_id, [&](const char *data, size_t n) {
+            buf.append(data, n);
+            for (size_t p; (p = buf.find("\n\n")) != std::string::npos;) {
+                std::string ev = buf.substr(0, p + 2);
+                buf.erase(0, p + 2);
+                const bool done = ev.rfind("event: done\n", 0) == 0;
+                if (done || ev.rfind("event: error\n", 0) == 0) {
+                    const size_t d = ev.find("data: ");
+                    if (d != std::string::npos) {
+                        std::string data_json = ev.substr(d + 6);
+                        while (!data_json.empty() && data_json.back() == '\n') data_json.pop_back();
+                        ev = ev.substr(0, d + 6) + rewrite_status(data_json, job) + "\n\n";
+                    }
+                    terminal = true;
+                }
+                if (!write(ev)) {
+                    client_gone = true;
+                    return false;
+                }
+                if (terminal) return false;
+            }
+            return true;
+        });
+        if (client_gone) return false;
+        if (terminal) return true;
+
+        // worker 断了：等任务被挪走（epoch 变）或者判定失败
+        for (;;) {
+            if (stop_.load()) return false;
+            {
+                std::lock_guard<std::mutex> lk(mu_);
+                auto it = jobs_.find(id);
+                if (it == jobs_.end() || it->second.epoch != job.epoch || it->second.worker < 0) break;
+                if (it->second.finished && it->second.worker == job.worker) break;  // 其实已经结束了，再连一次拿 done
+            }
+            if (Clock::now() - last_write > std::chrono::seconds(15) && !write(": keepalive\n\n")) return false;
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+    }
+    return false;
+}
+
+std::string Dispatcher::stats_json() const {
+    std::lock_guard<std::mutex> lk(mu_);
+    int queued = 0, running = 0;
+    size_t active = 0;
+    for (const auto &w : workers_) {
+        queued += w->queued;
+        running += w->running;
+        active += w->active.size();
+    }
+    std::ostringstream oss;
+    oss << "{\"ok\":true,\"pipeline\":\"dispatcher\""
+        << ",\"jobs\":" << jobs_.size()
+        << ",\"active\":" << active
+        << ",\"queued\":" << queued
+        << ",\"running\":" << running
+        << ",\"submitted\":" << submitted_
+        << ",\"completed\":" << completed_
+        << ",\"retried\":" << retried_
+        << ",\"failed\":" << failed_
+        << ",\"expired\":" << expired_
+        << ",\"affinity_hits\":" << affinity_hits_
+        << ",\"est_tokens\":" << std::fixed << std::setprecision(1) << est_tokens_
+        << ",\"workers\":[";
+    for (size_t i = 0; i < workers_.size(); ++i) {
+        const Worker &w = *workers_[i];
+        oss << (i ? "," : "") << "{\"addr\":\"" << json_escape(w.addr) << "\""
+            << ",\"healthy\":" << (w.healthy ? "true" : "false")
+            << ",\"pid\":" << w.pid
+            << ",\"active\":" << w.active.size()
+            << ",\"outstanding_tokens\":" << w.outstanding
+            << ",\"routed\":" << w.routed
+            << ",\"affinity\":" << w.affinity
+            << ",\"errors\":" << w.errors
+            << ",\"queued\":" << w.queued
+            << ",\"running\":" << w.running
+            << ",\"rtt_ms\":" << w.rtt_ms << "}";
+    }
+    oss << "]}";
+    return oss.str();
+}
+
+// ---- 路由注册 ----
+
+void Dispatcher::install(httplib::Server &svr) {
+    // 新任务：登记、选 worker 提交；失败就不留记录
+    auto submit = [this](std::shared_ptr<Payload> p, const ImageFingerprint &fp, int n_candidates,
+                         httplib::Response &res) {
+        Job job;
+        job.id = new_id();
+        job.fp = fp;
+        job.payload = std::move(p);
+        {
+            std::lock_guard<std::mutex> lk(mu_);
+            job.est = (int64_t)est_tokens_ * std::max(1, std::min(n_candidates, cfg_.max_candidates));
+            submitted_++;
+            jobs_[job.id] = job;
+        }
+        int status = 0;
+        std::string body;
+        if (!place(job.id, {}, status, body)) {
+            std::lock_guard<std::mutex> lk(mu_);
+            jobs_.erase(job.id);
+            submitted_--;
+            res.status = status;
+            res.set_content(body, kJson);
+            return;
+        }
+        res.set_content("{\"ok\":true,\"id\":\"" + json_escape(job.id) + "\"}", kJson);
+    };
+
+    svr.Post("/api/upload",
+        [this, submit](const httplib::Request &, httplib::Response &res, const httplib::ContentReader &content_reader) {
+            auto p = std::make_shared<Payload>();
+            std::string deadline;
+            bool got_file = false;
+            std::string field;
+            const bool ok = content_reader(
+                [&](const httplib::FormData &header) {
+                    field = header.name;
+                    if (header.name == "file") {
+                        got_file = true;
+                        p->filename = header.filename;
+                        p->content_type = header.content_type;
+                        p->bytes.clear();
+                    }
+                    return true;
+                },
+                [&](const char *data, size_t n) {
+                    if (field == "file") p->bytes.append(data, n);
+                    else if (field == "model" && p->model.size() < 128) p->model.append(data, n);
+                    else if (field == "n_candidates" && p->n_candidates.size() < 8) p->n_candidates.append(data, n);
+                    else if (field == "candidates" && p->candidates.size() < 8) p->candidates.append(data, n);
+                    else if (field == "deadline_ms" && deadline.size() < 12) deadline.append(data, n);
+                    return true;
+                });
+            if (!ok || !got_file || p->bytes.empty()) {
+                res.status = 400;
+                res.set_content("{\"ok\":false,\"error\":\"missing file\"}", kJson);
+                return;
+            }
+            if (p->filename.empty()) p->filename = "upload.bin";
+            p->deadline_ms = std::atoi(deadline.c_str());
+            const ImageFingerprint fp = upload_fingerprint(p->bytes, p->filename);
+            const int n_candidates = std::atoi(p->n_candidates.c_str());
+            submit(std::move(p), fp, n_candidates, res);
+        });
+
+    // 剪贴板：body 原样转发；亲和用 data_url 的内容哈希（同一张图 base64 也一样）
+    svr.Post("/api/clipboard", [submit](const httplib::Request &req, httplib::Response &res) {
+        const json body = json::parse(req.body, nullptr, false);
+        if (!body.is_object() || !body.contains("data_url") || !body["data_url"].is_string()) {
+            res.status = 400;
+            res.set_content("{\"ok\":false,\"error\":\"missing data_url\"}", kJson);
+            return;
+        }
+        auto p = std::make_shared<Payload>();
+        p->clipboard = true;
+        p->bytes = req.body;
+        if (body.contains("deadline_ms") && body["deadline_ms"].is_number_integer()) p->deadline_ms = body["deadline_ms"].get<int>();
+        const int n_candidates = body.contains("n_candidates") && body["n_candidates"].is_number_integer()
+                                     ? body["n_candidates"].get<int>() : 1;
+        submit(std::move(p), content_fingerprint(body["data_url"].get<std::string>()), n_candidates, res);
+    });
+
+    svr.Get("/api/status", [this](const httplib::Request &req, httplib::Response &res) {
+        if (!req.has_param("id")) {
+            res.status = 400;
+            res.set_content("{\"ok\":false,\"error\":\"missing id\"}", kJson);
+            return;
+        }
+        res.set_content(status_json(req.get_param_value("id")), kJson);
+    });
+
+    svr.Get("/api/stream", [this](const httplib::Request &req, httplib::Response &res) {
+        if (!req.has_param("id")) {
+            res.status = 400;
+            res.set_content("{\"ok\":false,\"error\":\"missing id\"}", kJson);
+            return;
+        }
+        const std::string id = req.get_param_value("id");
+        res.set_header("Cache-Control", "no-cache");
+        res.set_chunked_content_provider("text/event-stream", [this, id](size_t, httplib::DataSink &sink) {
+            if (!relay_stream(id, sink)) return false;
+            sink.done();
+            return true;
+        });
+    });
+
+    // 追问：发到原任务所在的 worker（KV 状态在那边）
+    svr.Post("/api/followup", [this](const httplib::Request &req, httplib::Response &res) {
+        const std::string parent = req.get_param_value("id");
+        int wi = -1;
+        std::string remote;
+        {
+            std::lock_guard<std::mutex> lk(mu_);
+            auto it = jobs_.find(parent);
+            if (it != jobs_.end()) {
+                wi = it->second.worker;
+                remote = it->second.remote_id;
+            }
+            if (it == jobs_.end() || wi < 0 || !workers_[wi]->healthy) {
+                res.status = it == jobs_.end() ? 404 : 502;
+                res.set_content(it == jobs_.end() ? "{\"ok\":false,\"error\":\"not found\"}"
+                                                  : "{\"ok\":false,\"error\":\"原任务所在的 worker 不可用\"}",
+                                kJson);
+                return;
+            }
+        }
+        const Worker &w = *workers_[wi];
+        httplib::Client cli(w.host, w.port);
+        cli.set_connection_timeout(2, 0);
+        auto r = cli.Post("/api/followup?id=" + remote, req.body, "application/json");
+        if (!r) {
+            res.status = 502;
+            res.set_content("{\"ok\":false,\"error\":\"worker 没响应\"}", kJson);
+            return;
+        }
+        const json j = r->status == 200 ? json::parse(r->body, nullptr, false) : json();
+        if (!j.is_object() || !j.value("ok", false)) {
+            res.status = r->status == 200 ? 502 : r->status;
+            res.set_content(r->body, kJson);
+            return;
+        }
+
+        Job job;
+        job.id = new_id();
+        job.parent = parent;
+        std::lock_guard<std::mutex> lk(mu_);
+        job.worker = wi;
+        job.remote_id = j.value("id", "");
+        job.epoch = 1;
+        job.est = (int64_t)est_tokens_;
+        Job &stored = jobs_[job.id] = job;
+        charge(stored, stored.est);
+        workers_[wi]->active.insert(job.id);
+        workers_[wi]->routed++;
+        by_remote_[remote_key(wi, job.remote_id)] = job.id;
+        submitted_++;
+        res.set_content("{\"ok\":true,\"id\":\"" + json_escape(job.id) + "\"}", kJson);
+    });
+
+    // 单个任务的 trace 在它所在的 worker 上
+    svr.Get("/api/trace", [this](const httplib::Request &req, httplib::Response &res) {
+        int wi = -1;
+        std::string remote;
+        {
+            std::lock_guard<std::mutex> lk(mu_);
+            auto it = jobs_.find(req.get_param_value("id"));
+            if (it != jobs_.end()) {
+                wi = it->second.worker;
+                remote = it->second.remote_id;
+            }
+        }
+        auto r = wi < 0 ? httplib::Result() : httplib::Client(workers_[wi]->host, workers_[wi]->port).Get("/api/trace?id=" + remote);
+        if (!r) {
+            res.status = 404;
+            res.set_content("{\"ok\":false,\"error\":\"no trace for this id\"}", kJson);
+            return;
+        }
+        res.status = r->status;
+        res.set_content(r->body, kJson);
+    });
+
+    // 模型列表：各 worker 配置一样，问第一个可用的
+    svr.Get("/api/models", [this](const httplib::Request &, httplib::Response &res) {
+        for (const auto &w : workers_) {
+            {
+                std::lock_guard<std::mutex> lk(mu_);
+                if (!w->healthy) continue;
+            }
+            if (auto r = httplib::Client(w->host, w->port).Get("/api/models")) {
+                res.set_content(r->body, kJson);
+                return;
+            }
+        }
+        res.status = 503;
+        res.set_content("{\"ok\":false,\"error\":\"no healthy worker\"}", kJson);
+    });
+
+    svr.Get("/api/stats", [this](const httplib::Request &, httplib::Response &res) {
+        res.set_content(stats_json(), kJson);
+    });
+}
+
+} // namespace ws_ai
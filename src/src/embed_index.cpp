@@ -0,0 +1,269 @@
+#include "ws_ai/embed_index.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cmath>
+#include <unordered_set>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define WS_AI_SIMD_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define WS_AI_SIMD_SSE2 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define WS_AI_SIMD_NEON 1
+#endif
+
+namespace ws_ai {
+
+static constexpr size_t kRowAlign = 32;  // 一行补到 32 字节：AVX2 一次正好一块，没有尾巴
+
+static std::atomic<bool> g_force_scalar{false};
+
+void embed_force_scalar(bool on) { g_force_scalar.store(on); }
+
+static inline bool use_simd() { return !g_force_scalar.load(std::memory_order_relaxed); }
+
+const char *embed_backend() {
+#if defined(WS_AI_SIMD_AVX2)
+    return use_simd() ? "avx2" : "scalar";
+#elif defined(WS_AI_SIMD_SSE2)
+    return use_simd() ? "sse2" : "scalar";
+#elif defined(WS_AI_SIMD_NEON) && defined(__ARM_FEATURE_DOTPROD)
+    return use_simd() ? "neon-dotprod" : "scalar";
+#elif defined(WS_AI_SIMD_NEON)
+    return use_simd() ? "neon" : "scalar";
+#else
+    return "scalar";
+#endif
+}
+
+// -------------------------
+// int8 点积：量化值在 [-127, 127]，两两乘积加到 int16 对再累加到 int32，几千维也不会溢出
+// -------------------------
+static int32_t dot_i8_scalar(const int8_t *a, const int8_t *b, size_t n) {
+    int32_t s = 0;
+    for (size_t i = 0; i < n; ++i) s += (int32_t)a[i] * (int32_t)b[i];
+    return s;
+}
+
+// 处理到 16 / 32 的整数倍，返回处理了多少个，剩下的走标量
+static size_t dot_i8_simd(const int8_t *a, const int8_t *b, size_t n, int32_t &out) {
+    size_t i = 0;
+#if defined(WS_AI_SIMD_AVX2)
+    __m256i acc = _mm256_setzero_si256();
+    for (; i + 32 <= n; i += 32) {
+        const __m256i va = _mm256_loadu_si256((const __m256i *)(a + i));
+        const __m256i vb = _mm256_loadu_si256((const __m256i *)(b + i));
+        const __m256i a0 = _mm256_cvtepi8_epi16(_mm256_castsi256_si128(va));
+        const __m256i a1 = _mm256_cvtepi8_epi16(_mm256_extracti128_si256(va, 1));
+        const __m256i b0 = _mm256_cvtepi8_epi16(_mm256_castsi256_si128(vb));
+        const __m256i b1 = _mm256_cvtepi8_epi16(_mm256_extracti128_si256(vb, 1));
+        acc = _mm256_add_epi32(acc, _mm256_madd_epi16(a0, b0));
+        acc = _mm256_add_epi32(acc, _mm256_madd_epi16(a1, b1));
+    }
+    __m128i s = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2)));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 3, 0, 1)));
+    out = _mm_cvtsi128_si32(s);
+#elif defined(WS_AI_SIMD_SSE2)
+    // SSE2 没有 cvtepi8：和自己交错后算术右移 8 位做符号扩展
+    __m128i acc = _mm_setzero_si128();
+    for (; i + 16 <= n; i += 16) {
+        const __m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+        const __m128i vb = _mm_loadu_si128((const __m128i *)(b + i));
+        const __m128i a0 = _mm_srai_epi16(_mm_unpacklo_epi8(va, va), 8);
+        const __m128i a1 = _mm_srai_epi16(_mm_unpackhi_epi8(va, va), 8);
+        const __m128i b0 = _mm_srai_epi16(_mm_unpacklo_epi8(vb, vb), 8);
+        const __m128i b1 = _mm_srai_epi16(_mm_unpackhi_epi8(vb, vb), 8);
+        acc = _mm_add_epi32(acc, _mm_madd_epi16(a0, b0));
+        acc = _mm_add_epi32(acc, _mm_madd_epi16(a1, b1));
+    }
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+    out = _mm_cvtsi128_si32(acc);
+#elif defined(WS_AI_SIMD_NEON)
+    int32x4_t acc = vdupq_n_s32(0);
+    for (; i + 16 <= n; i += 16) {
+        const int8x16_t va = vld1q_s8(a + i), vb = vld1q_s8(b + i);
+#if defined(__ARM_FEATURE_DOTPROD)
+        acc = vdotq_s32(acc, va, vb);
+#else
+        acc = vpadalq_s16(acc, vmull_s8(vget_low_s8(va), vget_low_s8(vb)));
+        acc = vpadalq_s16(acc, vmull_s8(vget_high_s8(va), vget_high_s8(vb)));
+#endif
+    }
+    out = vaddvq_s32(acc);
+#else
+    (void)a; (void)b; (void)n;
+    out = 0;
+#endif
+    return i;
+}
+
+int32_t dot_i8(const int8_t *a, const int8_t *b, size_t n) {
+    int32_t s = 0;
+    const size_t i = use_simd() ? dot_i8_simd(a, b, n, s) : 0;
+    return s + dot_i8_scalar(a + i, b + i, n - i);
+}
+
+float quantize_unit_i8(const std::vector<float> &v, size_t stride, int8_t *out) {
+    double norm2 = 0;
+    float max_abs = 0;
+    for (float x : v) {
+        norm2 += (double)x * x;
+        max_abs = std::max(max_abs, std::fabs(x));
+    }
+    std::fill_n(out, stride, (int8_t)0);
+    if (norm2 <= 0 || !std::isfinite(norm2)) return 0;
+
+    // 单位向量的最大分量映射到 127
+    const float inv_norm = (float)(1.0 / std::sqrt(norm2));
+    const float scale = max_abs * inv_norm / 127.f;
+    const float k = inv_norm / scale;
+    for (size_t i = 0; i < v.size() && i < stride; ++i) {
+        out[i] = (int8_t)std::max(-127.f, std::min(127.f, std::nearbyint(v[i] * k)));
+    }
+    return scale;
+}
+
+// -------------------------
+// EmbeddingIndex
+// -------------------------
+EmbeddingIndex::EmbeddingIndex(size_t capacity)
+: scales_(std::max<size_t>(1, capacity), 0.f), keys_(std::max<size_t>(1, capacity)) {}
+
+bool EmbeddingIndex::insert(const std::vector<float> &v, const std::string &key) {
+    if (v.empty()) return false;
+    if (dim_ == 0) {
+        // 第一条定维度，行存储这时才分配
+        dim_ = (int)v.size();
+        stride_ = (v.size() + kRowAlign - 1) / kRowAlign * kRowAlign;
+        rows_.assign(keys_.size() * stride_, 0);
+    }
+    if ((int)v.size() != dim_) return false;
+
+    const size_t slot = next_;
+    const float scale = quantize_unit_i8(v, stride_, rows_.data() + slot * stride_);
+    if (scale <= 0) return false;
+    next_ = (next_ + 1) % keys_.size();
+    if (scales_[slot] <= 0) size_++;
+    scales_[slot] = scale;
+    keys_[slot] = key;
+    return true;
+}
+
+std::vector<EmbeddingIndex::Match> EmbeddingIndex::top_k(const std::vector<float> &q, int k, float min_score) const {
+    std::vector<Match> out;
+    if (k <= 0 || size_ == 0 || (int)q.size() != dim_) return out;
+
+    std::vector<int8_t> qq(stride_);
+    const float qs = quantize_unit_i8(q, stride_, qq.data());
+    if (qs <= 0) return out;
+
+    // k 很小（几个），按分数插入排序维护
+    std::vector<std::pair<float, size_t>> best;
+    best.reserve((size_t)k + 1);
+    for (size_t slot = 0; slot < keys_.size(); ++slot) {
+        if (scales_[slot] <= 0) continue;
+        const float s = (float)dot_i8(qq.data(), rows_.data() + slot * stride_, stride_) * qs * scales_[slot];
+        if (s < min_score || ((int)best.size() == k && s <= best.back().first)) continue;
+        auto pos = std::upper_bound(best.begin(), best.end(), s,
+                                    [](float v, const std::pair<float, size_t> &e) { return v > e.first; });
+        best.insert(pos, {s, slot});
+        if ((int)best.size() > k) best.pop_back();
+    }
+    out.reserve(best.size());
+    for (const auto &b : best) out.push_back({keys_[b.second], std::min(1.f, b.first)});
+    return out;
+}
+
+size_t EmbeddingIndex::erase(const std::vector<std::string> &keys) {
+    if (keys.empty() || size_ == 0) return 0;
+    const std::unordered_set<std::string> drop(keys.begin(), keys.end());
+    size_t n = 0;
+    for (size_t slot = 0; slot < keys_.size(); ++slot) {
+        if (scales_[slot] <= 0 || !drop.count(keys_[slot])) continue;
+        scales_[slot] = 0;
+        keys_[slot].clear();
+        size_--;
+        n++;
+    }
+    return n;
+}
+
+size_t EmbeddingIndex::memory_bytes() const {
+    size_t n = rows_.capacity() + scales_.capacity() * sizeof(float) + keys_.capacity() * sizeof(std::string);
+    for (const auto &k : keys_) n += k.capacity() > 15 ? k.capacity() + 1 : 0;  // SSO 之外的堆
+    return n;
+}
+
+// -------------------------
+// 字符 n-gram 向量
+// -------------------------
+
+// 解一个 UTF-8 字符；非法字节按单字节 Latin-1 处理
+static uint32_t next_codepoint(const std::string &s, size_t &i) {
+    const unsigned char c = (unsigned char)s[i];
+    int len = c < 0x80 ? 1 : (c >> 5) == 0x6 ? 2 : (c >> 4) == 0xE ? 3 : (c >> 3) == 0x1E ? 4 : 0;
+    if (len == 0 || i + len > s.size()) {
+        i++;
+        return c;
+    }
+    uint32_t cp = len == 1 ? c : len == 2 ? (c & 0x1F) : len == 3 ? (c & 0x0F) : (c & 0x07);
+    for (int k = 1; k < len; ++k) {
+        const unsigned char cc = (unsigned char)s[i + k];
+        if ((cc & 0xC0) != 0x80) {
+            i++;
+            return c;
+        }
+        cp = (cp << 6) | (cc & 0x3F);
+    }
+    i += len;
+    return cp;
+}
+
+// 空白、ASCII 标点、CJK 符号 / 全角标点、通用标点（引号、省略号）：OCR 最容易在这些上出错，也不带内容
+static bool skip_codepoint(uint32_t cp) {
+    if (cp < 0x80) return cp <= 0x20 || !std::isalnum((int)cp);
+    return (cp >= 0x2000 && cp <= 0x206F) || (cp >= 0x3000 && cp <= 0x303F) || (cp >= 0xFF00 && cp <= 0xFF0F) ||
+           (cp >= 0xFF1A && cp <= 0xFF20) || (cp >= 0xFF3B && cp <= 0xFF40) || (cp >= 0xFF5B && cp <= 0xFF65);
+}
+
+void ngram_embedding(const std::string &text, int dim, std::vector<float> &out) {
+    out.assign((size_t)std::max(1, dim), 0.f);
+    std::vector<uint32_t> cps;
+    cps.reserve(text.size());
+    for (size_t i = 0; i < text.size();) {
+        uint32_t cp = next_codepoint(text, i);
+        if (skip_codepoint(cp)) continue;
+        if (cp >= 'A' && cp <= 'Z') cp += 'a' - 'A';
+        cps.push_back(cp);
+    }
+
+    // FNV-1a；高位定符号（带符号的特征哈希，碰撞互相抵消而不是只往一个方向偏）
+    auto add = [&](size_t from, int n) {
+        uint64_t h = 1469598103934665603ull ^ (uint64_t)n;
+        for (int k = 0; k < n; ++k) {
+            h ^= cps[from + k];
+            h *= 1099511628211ull;
+        }
+        out[(size_t)(h % out.size())] += (h >> 63) ? -1.f : 1.f;
+    };
+    const int min_n = cps.size() >= 2 ? 2 : 1;  // 只有一个字时退回 1-gram
+    for (int n = min_n; n <= 3; ++n) {
+        for (size_t i = 0; i + (size_t)n <= cps.size(); ++i) add(i, n);
+    }
+
+    double norm2 = 0;
+    for (float x : out) norm2 += (double)x * x;
+    if (norm2 > 0) {
+        const float inv = (float)(1.0 / std::sqrt(norm2));
+        for (auto &x : out) x *= inv;
+    }
+}
+
+} // namespace ws_ai
@@ -0,0 +1,646 @@
+// ws_ai_eval：摘要质量 vs 速度。一组固定的 OCR 文本（不跑 Vision）按配置矩阵逐个生成，
+// 记录延迟、tok/s、输出长度、格式合规（正好两段中文、没有跑偏标记）和参考摘要的重合度，最后打一张对比表。
+//
+//   ws_ai_eval corpus/ -m fast.gguf,default.gguf --n-ctx 2048,4096 --temp 0.2,0.4 --max-new 400,800
+//   ws_ai_eval corpus/ --kv f16,q8_0 --min-new 0,160 --runs 3 --jsonl eval.jsonl
+//
+// 语料：目录里的每个 xxx.txt 是一份 OCR 文本，同目录的 xxx.ref.txt（有的话）是参考摘要（人写或挑出来的好输出）。
+// 每个矩阵参数都是逗号分隔的列表，没给的取 Config 默认值（环境变量照样生效）；所有列表做笛卡尔积。
+// 表里每个配置一行；第一个配置（--baseline 可换）是基线，合规率、格式分、重合度都不比基线差 --tolerance 以上的
+// 标 *，其中平均延迟最短的标 >，就是“质量不降的最快配置”。
+#include "ws_ai/config.h"
+#include "ws_ai/llm_runner.h"
+#include "ws_ai/model_registry.h"
+#include "ws_ai/output_monitor.h"
+#include "ws_ai/prompt.h"
+#include "ws_ai/thread_plan.h"
+
+#include <json.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace fs = std::filesystem;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+// 矩阵的各个轴（逗号分隔的原始字符串，空 = 用 Config 默认值）
+struct Options {
+    std::vector<std::string> inputs;
+    std::string refs_dir;       // 参考摘要单独放的目录（同名 .txt 或 .ref.txt）
+    std::string models, n_ctx, temp, top_k, top_p, min_new, max_new, kv, stop;
+    int runs = 1;
+    int limit = 0;
+    bool warmup = true;
+    int baseline = 0;
+    double tolerance = 0.05;
+    std::string jsonl_path;
+};
+
+struct Sample {
+    std::string id;
+    std::string text;
+    std::string ref;
+};
+
+// 矩阵里的一个点
+struct EvalConfig {
+    std::string model;
+    int n_ctx = 0;
+    float temp = 0, top_p = 0;
+    int top_k = 0;
+    int min_new = 0, max_new = 0;
+    std::string kv;
+    bool stop = true;
+    std::string label;  // 只列出有多个取值的轴
+};
+
+// 一次生成的结果
+struct Run {
+    bool ok = false;
+    std::string error;
+    std::string text;
+    double total_ms = 0, ttft_ms = 0, decode_ms = 0;
+    int n_gen = 0;
+    size_t chars = 0;
+    int paragraphs = 0;
+    bool compliant = false;
+    bool drift = false;
+    double fmt = 0;
+    double rouge2 = -1, rougel = -1;  // 没有参考摘要时 -1
+    std::string stop;
+};
+
+struct Summary {
+    int n = 0, n_ok = 0, n_compliant = 0, n_drift = 0, n_ref = 0;
+    double fmt = 0, rouge2 = 0, rougel = 0, chars = 0, n_gen = 0, ttft = 0, mean_ms = 0, p50 = 0, p95 = 0, tok_s = 0;
+    std::string error;  // 整个配置跑不起来（模型加载 / context 创建失败）
+    bool holds = false;
+};
+
+void usage() {
+    std::cerr <<
+        "用法: ws_ai_eval [选项] <语料目录|文件>...\n"
+        "  语料：xxx.txt 是 OCR 文本，同目录的 xxx.ref.txt 是参考摘要（可选）\n"
+        "      --refs DIR         参考摘要放在单独的目录（同名文件）\n"
+        "  矩阵（逗号分隔，做笛卡尔积；不给用默认配置）：\n"
+        "  -m, --model LIST       WS_AI_MODELS 里的模型名或 .gguf 路径\n"
+        "      --n-ctx LIST\n"
+        "      --temp LIST        --top-k LIST  --top-p LIST\n"
+        "      --min-new LIST     --max-new LIST\n"
+        "      --kv LIST          KV cache 精度：f16 / q8_0 / q4_0\n"
+        "      --stop LIST        结构监控 1 / 0（两段写完、跑偏时提前停）\n"
+        "  其它：\n"
+        "      --runs N           每个样本重复几次（采样是随机的，默认 1）\n"
+        "      --limit N          只用前 N 个样本\n"
+        "      --no-warmup        每个配置不先空跑一次\n"
+        "      --baseline I       基线配置的序号（默认 0）\n"
+        "      --tolerance X      质量指标允许比基线低多少（默认 0.05）\n"
+        "      --jsonl FILE       每次生成（含输出全文）和每个配置的汇总写成 JSONL\n";
+}
+
+bool parse_args(int argc, char **argv, Options &o) {
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        auto value = [&](int &idx) -> const char * { return idx + 1 < argc ? argv[++idx] : nullptr; };
+        auto list = [&](std::string &dst) { const char *v = value(i); if (!v) return false; dst = v; return true; };
+        if (a == "-h" || a == "--help") return false;
+        else if (a == "--refs") { if (!list(o.refs_dir)) return false; }
+        else if (a == "-m" || a == "--model") { if (!list(o.models)) return false; }
+        else if (a == "--n-ctx") { if (!list(o.n_ctx)) return false; }
+        else if (a == "--temp") { if (!list(o.temp)) return false; }
+        else if (a == "--top-k") { if (!list(o.top_k)) return false; }
+        else if (a == "--top-p") { if (!list(o.top_p)) return false; }
+        else if (a == "--min-new") { if (!list(o.min_new)) return false; }
+        else if (a == "--max-new") { if (!list(o.max_new)) return false; }
+        else if (a == "--kv") { if (!list(o.kv)) return false; }
+        else if (a == "--stop") { if (!list(o.stop)) return false; }
+        else if (a == "--runs") { const char *v = value(i); if (!v) return false; o.runs = std::max(1, std::atoi(v)); }
+        else if (a == "--limit") { const char *v = value(i); if (!v) return false; o.limit = std::max(0, std::atoi(v)); }
+        else if (a == "--no-warmup") o.warmup = false;
+        else if (a == "--baseline") { const char *v = value(i); if (!v) return false; o.baseline = std::max(0, std::atoi(v)); }
+        else if (a == "--tolerance") { const char *v = value(i); if (!v) return false; o.tolerance = std::max(0.0, std::atof(v)); }
+        else if (a == "--jsonl") { const char *v = value(i); if (!v) return false; o.jsonl_path = v; }
+        else if (!a.empty() && a[0] == '-') { std::cerr << "未知参数: " << a << "\n"; return false; }
+        else o.inputs.push_back(a);
+    }
+    return !o.inputs.empty();
+}
+
+std::vector<std::string> split_list(const std::string &s, const std::string &dflt) {
+    std::vector<std::string> out;
+    std::string cur;
+    std::istringstream iss(s);
+    while (std::getline(iss, cur, ',')) {
+        if (!cur.empty()) out.push_back(cur);
+    }
+    if (out.empty()) out.push_back(dflt);
+    return out;
+}
+
+std::string fmt_float(float v) {
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%g", v);
+    return buf;
+}
+
+bool read_text(const fs::path &p, std::string &out) {
+    std::ifstream ifs(p, std::ios::binary);
+    if (!ifs) return false;
+    out.assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+    return true;
+}
+
+bool ends_with(const std::string &s, const char *suffix) {
+    const size_t n = std::char_traits<char>::length(suffix);
+    return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+// 目录（不递归）或单个文件 -> 按文件名排序的样本；参考摘要按同名找
+std::vector<Sample> load_corpus(const Options &o) {
+    std::vector<fs::path> files;
+    std::error_code ec;
+    for (const auto &in : o.inputs) {
+        if (fs::is_directory(in, ec)) {
+            for (const auto &e : fs::directory_iterator(in, ec)) {
+                const std::string name = e.path().filename().string();
+                if (e.is_regular_file() && ends_with(name, ".txt") && !ends_with(name, ".ref.txt")) files.push_back(e.path());
+            }
+        } else {
+            files.push_back(in);
+        }
+    }
+    std::sort(files.begin(), files.end());
+
+    std::vector<Sample> out;
+    for (const auto &f : files) {
+        Sample s;
+        s.id = f.stem().string();
+        if (!read_text(f, s.text) || s.text.empty()) {
+            std::cerr << "跳过（读不到或为空）: " << f.string() << "\n";
+            continue;
+        }
+        const fs::path ref_dir = o.refs_dir.empty() ? f.parent_path() : fs::path(o.refs_dir);
+        if (!read_text(ref_dir / (s.id + ".ref.txt"), s.ref) && !o.refs_dir.empty()) read_text(ref_dir / f.filename(), s.ref);
+        out.push_back(std::move(s));
+        if (o.limit > 0 && (int)out.size() >= o.limit) break;
+    }
+    return out;
+}
+
+// ---- 指标 ----
+
+std::vector<uint32_t> utf8_codepoints(const std::string &s) {
+    std::vector<uint32_t> out;
+    for (size_t i = 0; i < s.size();) {
+        const unsigned char c = (unsigned char)s[i];
+        uint32_t cp = c;
+        size_t len = 1;
+        if ((c & 0xE0) == 0xC0) { len = 2; cp = c & 0x1F; }
+        else if ((c & 0xF0) == 0xE0) { len = 3; cp = c & 0x0F; }
+        else if ((c & 0xF8) == 0xF0) { len = 4; cp = c & 0x07; }
+        if (i + len > s.size()) break;
+        for (size_t k = 1; k < len; ++k) cp = (cp << 6) | ((unsigned char)s[i + k] & 0x3F);
+        out.push_back(cp);
+        i += len;
+    }
+    return out;
+}
+
+bool is_cjk(uint32_t cp) { return (cp >= 0x4E00 && cp <= 0x9FFF) || (cp >= 0x3400 && cp <= 0x4DBF); }
+bool is_latin(uint32_t cp) { return (cp >= 'a' && cp <= 'z') || (cp >= 'A' && cp <= 'Z'); }
+
+// 重合度只看汉字和字母数字（标点、空白、换行不算），英文统一小写
+std::vector<uint32_t> overlap_units(const std::string &s) {
+    std::vector<uint32_t> out;
+    for (uint32_t cp : utf8_codepoints(s)) {
+        if (is_cjk(cp) || (cp >= '0' && cp <= '9')) out.push_back(cp);
+        else if (is_latin(cp)) out.push_back(cp | 0x20);
+    }
+    return out;
+}
+
+double f1(double hit, double n_out, double n_ref) {
+    if (hit <= 0 || n_out <= 0 || n_ref <= 0) return 0;
+    const double p = hit / n_out, r = hit / n_ref;
+    return 2 * p * r / (p + r);
+}
+
+// 中文不分词，按字算：字 bigram 的 F1（ROUGE-2）
+double rouge2(const std::vector<uint32_t> &out, const std::vector<uint32_t> &ref) {
+    if (out.size() < 2 || ref.size() < 2) return 0;
+    std::unordered_map<uint64_t, int> counts;
+    for (size_t i = 0; i + 1 < ref.size(); ++i) counts[((uint64_t)ref[i] << 32) | ref[i + 1]]++;
+    double hit = 0;
+    for (size_t i = 0; i + 1 < out.size(); ++i) {
+        auto it = counts.find(((uint64_t)out[i] << 32) | out[i + 1]);
+        if (it != counts.end() && it->second > 0) {
+            it->second--;
+            hit += 1;
+        }
+    }
+    return f1(hit, (double)out.size() - 1, (double)ref.size() - 1);
+}
+
+// 最长公共子序列的 F1（ROUGE-L），两行滚动；太长的截到前 2000 字
+double rougel(std::vector<uint32_t> out, std::vector<uint32_t> ref) {
+    out.resize(std::min<size_t>(out.size(), 2000));
+    ref.resize(std::min<size_t>(ref.size(), 2000));
+    if (out.empty() || ref.empty()) return 0;
+    std::vector<int> prev(ref.size() + 1, 0), cur(ref.size() + 1, 0);
+    for (size_t i = 1; i <= out.size(); ++i) {
+        for (size_t j = 1; j <= ref.size(); ++j) {
+            cur[j] = out[i - 1] == ref[j - 1] ? prev[j - 1] + 1 : std::max(prev[j], cur[j - 1]);
+        }
+        std::swap(prev, cur);
+    }
+    return f1((double)prev[ref.size()], (double)out.size(), (double)ref.size());
+}
+
+// 严格的格式合规：正好两段（非空行就是一段），每段至少 24 个字、字母里汉字占七成以上，全文没有跑偏标记。
+// 比 score_summary_format 硬：那个是候选打分用的连续分，这里是“能不能直接给用户看”
+void check_format(const std::string &text, Run &r) {
+    std::vector<std::string> paras;
+    std::istringstream iss(text);
+    std::string line;
+    while (std::getline(iss, line)) {
+        if (line.find_first_not_of(" \t\r") != std::string::npos) paras.push_back(line);
+    }
+    r.paragraphs = (int)paras.size();
+    r.drift = ws_ai::find_drift_marker(text) != std::string::npos;
+
+    bool ok = paras.size() == 2 && !r.drift;
+    for (const auto &p : paras) {
+        int cjk = 0, latin = 0, chars = 0;
+        for (uint32_t cp : utf8_codepoints(p)) {
+            cjk += is_cjk(cp);
+            latin += is_latin(cp);
+            chars += cp > ' ';
+        }
+        if (chars < 24 || cjk < 0.7 * (cjk + latin)) ok = false;
+    }
+    r.compliant = ok;
+    r.fmt = ws_ai::score_summary_format(text);
+}
+
+double percentile(std::vector<double> v, double q) {
+    if (v.empty()) return 0;
+    std::sort(v.begin(), v.end());
+    const size_t i = (size_t)std::min<double>((double)v.size() - 1, q * (double)(v.size() - 1) + 0.5);
+    return v[i];
+}
+
+// ---- 矩阵 ----
+
+std::vector<EvalConfig> build_matrix(const Options &o, const ws_ai::Config &cfg) {
+    const auto models = split_list(o.models, cfg.default_model);
+    const auto n_ctx = split_list(o.n_ctx, std::to_string(cfg.n_ctx));
+    const auto temp = split_list(o.temp, fmt_float(cfg.temp));
+    const auto top_k = split_list(o.top_k, std::to_string(cfg.top_k));
+    const auto top_p = split_list(o.top_p, fmt_float(cfg.top_p));
+    const auto min_new = split_list(o.min_new, std::to_string(cfg.min_new_tokens));
+    const auto max_new = split_list(o.max_new, std::to_string(cfg.max_new_tokens));
+    const auto kv = split_list(o.kv, cfg.kv_type);
+    const auto stop = split_list(o.stop, cfg.structure_stop ? "1" : "0");
+
+    // 模型在最外层：一个模型的配置跑完再换下一个，每个模型只加载一次
+    std::vector<EvalConfig> out;
+    for (const auto &m : models)
+    for (const auto &c : n_ctx)
+    for (const auto &kt : kv)
+    for (const auto &t : temp)
+    for (const auto &k : top_k)
+    for (const auto &p : top_p)
+    for (const auto &mn : min_new)
+    for (const auto &mx : max_new)
+    for (const auto &s : stop) {
+        EvalConfig e;
+        e.model = m;
+        e.n_ctx = std::max(256, std::atoi(c.c_str()));
+        e.kv = kt;
+        e.temp = (float)std::atof(t.c_str());
+        e.top_k = std::max(0, std::atoi(k.c_str()));
+        e.top_p = (float)std::atof(p.c_str());
+        e.min_new = std::max(0, std::atoi(mn.c_str()));
+        e.max_new = std::max(1, std::atoi(mx.c_str()));
+        e.stop = std::atoi(s.c_str()) != 0;
+
+        std::ostringstream label;
+        auto add = [&](const char *name, size_t n_values, const std::string &v) {
+            if (n_values > 1) label << (label.tellp() > 0 ? " " : "") << name << "=" << v;
+        };
+        add("model", models.size(), fs::path(m).stem().string());
+        add("ctx", n_ctx.size(), c);
+        add("kv", kv.size(), kt);
+        add("temp", temp.size(), t);
+        add("top_k", top_k.size(), k);
+        add("top_p", top_p.size(), p);
+        add("min", min_new.size(), mn);
+        add("max", max_new.size(), mx);
+        add("stop", stop.size(), s);
+        e.label = label.tellp() > 0 ? label.str() : "default";
+        out.push_back(std::move(e));
+    }
+    return out;
+}
+
+ws_ai::GenParams params_for(const EvalConfig &e, const ws_ai::Config &cfg) {
+    ws_ai::GenParams gp = ws_ai::gen_params_from_config(cfg);
+    gp.temp = e.temp;
+    gp.top_k = e.top_k;
+    gp.top_p = e.top_p;
+    gp.min_new_tokens = e.min_new;
+    gp.max_new_tokens = e.max_new;
+    gp.kv_type = e.kv;
+    return gp;
+}
+
+Run run_one(ws_ai::LlmRunner &runner, const Sample &s, const ws_ai::MonitorOptions &mon) {
+    ws_ai::GenRequest req;
+    req.prompt = ws_ai::build_prompt(s.text);
+    req.monitor = mon;
+    std::vector<ws_ai::GenRequest> reqs{std::move(req)};
+
+    const auto t0 = Clock::now();
+    ws_ai::LLMResult res = std::move(runner.generate(std::move(reqs)).front());
+    Run r;
+    r.total_ms = std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+    r.ok = res.ok;
+    r.error = res.error;
+    r.ttft_ms = res.prefill_ms;
+    r.decode_ms = res.decode_ms;
+    r.n_gen = res.n_gen_tokens;
+    r.stop = ws_ai::stop_reason_name(res.stop_reason);
+    if (!r.ok) return r;
+
+    r.chars = utf8_codepoints(res.text).size();
+    check_format(res.text, r);
+    r.drift = r.drift || res.stop_reason == ws_ai::StopReason::drift;
+    if (!s.ref.empty()) {
+        const auto out = overlap_units(res.text), ref = overlap_units(s.ref);
+        r.rouge2 = rouge2(out, ref);
+        r.rougel = rougel(out, ref);
+    }
+    r.text = std::move(res.text);
+    return r;
+}
+
+Summary summarize(const std::vector<Run> &runs) {
+    Summary s;
+    std::vector<double> lat;
+    double decode_ms = 0, decode_tok = 0;
+    for (const Run &r : runs) {
+        s.n++;
+        if (!r.ok) continue;
+        s.n_ok++;
+        s.n_compliant += r.compliant;
+        s.n_drift += r.drift;
+        s.fmt += r.fmt;
+        s.chars += (double)r.chars;
+        s.n_gen += r.n_gen;
+        s.ttft += r.ttft_ms;
+        s.mean_ms += r.total_ms;
+        lat.push_back(r.total_ms);
+        decode_ms += r.decode_ms;
+        decode_tok += std::max(0, r.n_gen - 1);  // 第一个 token 算在 prefill 里
+        if (r.rougel >= 0) {
+            s.n_ref++;
+            s.rouge2 += r.rouge2;
+            s.rougel += r.rougel;
+        }
+    }
+    if (s.n_ok > 0) {
+        s.fmt /= s.n_ok;
+        s.chars /= s.n_ok;
+        s.n_gen /= s.n_ok;
+        s.ttft /= s.n_ok;
+        s.mean_ms /= s.n_ok;
+    }
+    if (s.n_ref > 0) {
+        s.rouge2 /= s.n_ref;
+        s.rougel /= s.n_ref;
+    }
+    s.p50 = percentile(lat, 0.5);
+    s.p95 = percentile(lat, 0.95);
+    s.tok_s = decode_ms > 0 ? decode_tok * 1000.0 / decode_ms : 0;
+    return s;
+}
+
+// 合规率按失败也算不合规（跑不出来本身就是质量问题）
+double compliance(const Summary &s) { return s.n > 0 ? (double)s.n_compliant / s.n : 0; }
+
+} // namespace
+
+int main(int argc, char **argv) {
+    Options opt;
+    if (!parse_args(argc, argv, opt)) {
+        usage();
+        return 2;
+    }
+
+    ws_ai::Config cfg;
+    ws_ai::apply_env_overrides(cfg);
+    cfg.model_idle_sec = 0;
+
+    // -m 里直接给的 .gguf 路径注册成以文件名为名的模型
+    std::vector<std::string> model_names;
+    for (const auto &m : split_list(opt.models, cfg.default_model)) {
+        if (ends_with(m, ".gguf")) {
+            cfg.models.push_back({m, m});
+        }
+        model_names.push_back(m);
+    }
+
+    // 一次只跑一个生成（延迟才可比），所有核都给它
+    cfg.job_workers = 1;
+    const ws_ai::ThreadPlan plan = ws_ai::make_thread_plan(cfg, /*overlap_ocr*/ false);
+    ws_ai::apply_thread_plan(plan, cfg);
+    std::cerr << plan.report();
+
+    const std::vector<Sample> samples = load_corpus(opt);
+    if (samples.empty()) {
+        std::cerr << "语料为空\n";
+        return 1;
+    }
+    size_t n_refs = 0;
+    for (const auto &s : samples) n_refs += !s.ref.empty();
+
+    const std::vector<EvalConfig> matrix = build_matrix(opt, cfg);
+    for (const auto &e : matrix) {
+        if (!ws_ai::kv_type_supported(e.kv)) {
+            std::cerr << "不认识的 KV 类型: " << e.kv << "（f16 / q8_0 / q4_0 / f32）\n";
+            return 2;
+        }
+    }
+    if (opt.baseline >= (int)matrix.size()) opt.baseline = 0;
+    std::cerr << "语料 " << samples.size() << " 条（" << n_refs << " 条有参考摘要），配置 " << matrix.size()
+              << " 个，每条 " << opt.runs << " 次\n";
+
+    std::ofstream jsonl;
+    if (!opt.jsonl_path.empty()) {
+        jsonl.open(opt.jsonl_path, std::ios::trunc);
+        if (!jsonl) {
+            std::cerr << "打不开输出文件: " << opt.jsonl_path << "\n";
+            return 1;
+        }
+    }
+    auto write_jsonl = [&](const nlohmann::json &j) {
+        if (jsonl) jsonl << j.dump(-1, ' ', false, nlohmann::json::error_handler_t::replace) << "\n";
+    };
+
+    ws_ai::ModelRegistry models(cfg);
+    std::vector<Summary> summaries(matrix.size());
+    ws_ai::ModelLease lease;
+    std::string lease_name;
+    for (size_t ci = 0; ci < matrix.size(); ++ci) {
+        const EvalConfig &e = matrix[ci];
+        std::cerr << "[" << ci + 1 << "/" << matrix.size() << "] " << e.label << "\n";
+        if (lease_name != e.model) {
+            lease.reset();  // 先放掉上一个模型，超过 WS_AI_MODEL_BUDGET_MB 时 registry 才能卸载它
+            std::string err;
+            lease = models.acquire(e.model, err);
+            lease_name = e.model;
+            if (!lease) std::cerr << "  模型加载失败: " << err << "\n";
+        }
+        if (!lease) {
+            summaries[ci].error = "模型加载失败";
+            continue;
+        }
+
+        const ws_ai::GenParams gp = params_for(e, cfg);
+        ws_ai::MonitorOptions mon = ws_ai::monitor_options_from_config(cfg);
+        mon.enabled = e.stop;
+        ws_ai::LlmRunner runner(lease->model, gp, e.n_ctx, cfg.n_batch);
+        if (!runner.ok()) {
+            std::cerr << "  " << runner.error() << "\n";
+            summaries[ci].error = runner.error();
+            continue;
+        }
+        // 第一次 decode 要分配计算图，不算进结果
+        if (opt.warmup) run_one(runner, samples.front(), mon);
+
+        std::vector<Run> runs;
+        for (const Sample &s : samples) {
+            for (int k = 0; k < opt.runs; ++k) {
+                Run r = run_one(runner, s, mon);
+                if (jsonl) {
+                    nlohmann::json j;
+                    j["config"] = e.label;
+                    j["model"] = e.model;
+                    j["n_ctx"] = e.n_ctx;
+                    j["kv"] = e.kv;
+                    j["temp"] = e.temp;
+                    j["top_k"] = e.top_k;
+                    j["top_p"] = e.top_p;
+                    j["min_new"] = e.min_new;
+                    j["max_new"] = e.max_new;
+                    j["stop"] = e.stop;
+                    j["id"] = s.id;
+                    j["run"] = k;
+                    j["ok"] = r.ok;
+                    if (!r.ok) {
+                        j["error"] = r.error;
+                    } else {
+                        j["total_ms"] = r.total_ms;
+                        j["ttft_ms"] = r.ttft_ms;
+                        j["decode_ms"] = r.decode_ms;
+                        j["n_gen"] = r.n_gen;
+                        j["chars"] = r.chars;
+                        j["paragraphs"] = r.paragraphs;
+                        j["compliant"] = r.compliant;
+                        j["drift"] = r.drift;
+                        j["format_score"] = r.fmt;
+                        if (r.rougel >= 0) {
+                            j["rouge2"] = r.rouge2;
+                            j["rougel"] = r.rougel;
+                        }
+                        j["stop_reason"] = r.stop;
+                        j["text"] = r.text;
+                    }
+                    write_jsonl(j);
+                }
+                r.text.clear();
+                runs.push_back(std::move(r));
+            }
+        }
+        summaries[ci] = summarize(runs);
+    }
+    lease.reset();
+
+    // 质量不降：合规率、格式分、（有参考时）ROUGE-L 都不比基线低 tolerance 以上
+    const Summary &base = summaries[opt.baseline];
+    int best = -1;
+    for (size_t ci = 0; ci < matrix.size(); ++ci) {
+        Summary &s = summaries[ci];
+        if (!s.error.empty() || s.n_ok == 0) continue;
+        s.holds = compliance(s) >= compliance(base) - opt.tolerance && s.fmt >= base.fmt - opt.tolerance &&
+                  (base.n_ref == 0 || s.rougel >= base.rougel - opt.tolerance);
+        if (s.holds && (best < 0 || s.mean_ms < summaries[best].mean_ms)) best = (int)ci;
+    }
+
+    size_t label_w = 6;
+    for (const auto &e : matrix) label_w = std::max(label_w, e.label.size());
+    std::printf("\n%-3s %-*s %6s %6s %5s %5s %5s %6s %5s %7s %8s %8s %8s %7s\n", "#", (int)label_w + 2, "config", "ok", "comply",
+                "drift", "fmt", "R-2", "R-L", "chars", "tok", "ttft ms", "mean ms", "p95 ms", "tok/s");
+    for (size_t ci = 0; ci < matrix.size(); ++ci) {
+        const Summary &s = summaries[ci];
+        const std::string mark = (int)ci == best ? "> " : s.holds ? "* " : "  ";
+        if (!s.error.empty()) {
+            std::printf("%-3zu %-*s %s\n", ci, (int)label_w + 2, (mark + matrix[ci].label).c_str(), s.error.c_str());
+            continue;
+        }
+        char r2[16] = "-", rl[16] = "-";
+        if (s.n_ref > 0) {
+            std::snprintf(r2, sizeof(r2), "%.3f", s.rouge2);
+            std::snprintf(rl, sizeof(rl), "%.3f", s.rougel);
+        }
+        std::printf("%-3zu %-*s %3d/%-2d %5.0f%% %4.0f%% %5.2f %5s %6s %5.0f %5.0f %7.0f %8.0f %8.0f %7.1f\n", ci, (int)label_w + 2,
+                    (mark + matrix[ci].label).c_str(), s.n_ok, s.n, 100 * compliance(s), 100.0 * s.n_drift / std::max(1, s.n_ok),
+                    s.fmt, r2, rl, s.chars, s.n_gen, s.ttft, s.mean_ms, s.p95, s.tok_s);
+
+        if (jsonl) {
+            nlohmann::json j;
+            j["summary"] = true;
+            j["config"] = matrix[ci].label;
+            j["runs"] = s.n;
+            j["ok"] = s.n_ok;
+            j["compliance"] = compliance(s);
+            j["drift_rate"] = (double)s.n_drift / std::max(1, s.n_ok);
+            j["format_score"] = s.fmt;
+            if (s.n_ref > 0) {
+                j["rouge2"] = s.rouge2;
+                j["rougel"] = s.rougel;
+            }
+            j["chars"] = s.chars;
+            j["n_gen"] = s.n_gen;
+            j["ttft_ms"] = s.ttft;
+            j["mean_ms"] = s.mean_ms;
+            j["p50_ms"] = s.p50;
+            j["p95_ms"] = s.p95;
+            j["tok_s"] = s.tok_s;
+            j["holds_quality"] = s.holds;
+            write_jsonl(j);
+        }
+    }
+
+    std::printf("\nok = 成功数/总数，comply = 正好两段中文且无跑偏标记，drift = 出现跑偏（含被监控截掉的），fmt = score_summary_format，\n"
+                "R-2 / R-L = 和参考摘要按字的 bigram / 最长公共子序列 F1；基线 #%d，* = 质量不低于基线 %.2f 以上\n",
+                opt.baseline, opt.tolerance);
+    if (best >= 0) {
+        std::printf("质量不降的最快配置: #%d %s（平均 %.0f ms，基线 %.0f ms）\n", best, matrix[best].label.c_str(),
+                    summaries[best].mean_ms, base.mean_ms);
+    } else {
+        std::printf("没有质量不低于基线的配置（基线本身失败？）\n");
+    }
+    return 0;
+}
@@ -0,0 +1,253 @@
+#include "ws_ai/folder_watcher.h"
+#include "ws_ai/util.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+
+#include <poll.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace ws_ai {
+
+static const int kTickMs = 100;  // 多久看一次 debounce 到期、任务结束
+
+static bool is_image_name(const std::string &name) {
+    if (name.empty() || name[0] == '.') return false;  // 隐藏文件：截图工具先写临时文件再改名
+    const size_t dot = name.find_last_of('.');
+    if (dot == std::string::npos) return false;
+    std::string ext = name.substr(dot);
+    for (auto &c : ext) c = (char)tolower((unsigned char)c);
+    static const char *kExts[] = {".png", ".jpg", ".jpeg", ".webp", ".heic", ".heif", ".tif", ".tiff", ".bmp", ".gif"};
+    for (const char *e : kExts) {
+        if (ext == e) return true;
+    }
+    return false;
+}
+
+static std::string expand_home(const std::string &p) {
+    if (p.size() >= 1 && p[0] == '~' && (p.size() == 1 || p[1] == '/')) {
+        if (const char *home = std::getenv("HOME")) return std::string(home) + p.substr(1);
+    }
+    return p;
+}
+
+FolderWatcher::FolderWatcher(const Config &cfg, std::shared_ptr<JobManager> jm) : cfg_(cfg), jm_(std::move(jm)) {
+    max_inflight_ = (size_t)(cfg_.folder_inflight > 0 ? cfg_.folder_inflight : 2 * std::max(1, cfg_.job_workers));
+}
+
+FolderWatcher::~FolderWatcher() { stop(); }
+
+bool FolderWatcher::start(std::string &err) {
+    if (!jm_) {
+        err = "job manager not ready";
+        return false;
+    }
+    std::error_code ec;
+    for (const auto &d : cfg_.folder_dirs) {
+        const std::string dir = expand_home(d);
+        if (!fs::is_directory(dir, ec)) {
+            std::cerr << "[folder] 不是目录，跳过: " << dir << "\n";
+            continue;
+        }
+        dirs_.push_back(fs::absolute(dir, ec).lexically_normal().string());
+    }
+    if (dirs_.empty()) {
+        err = "没有可监控的目录";
+        return false;
+    }
+
+#ifdef __linux__
+    inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd_ < 0) {
+        err = std::string("inotify_init1 失败: ") + std::strerror(errno);
+        return false;
+    }
+    std::vector<std::string> ok;
+    for (const auto &dir : dirs_) {
+        const int wd = inotify_add_watch(inotify_fd_, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_ONLYDIR);
+        if (wd < 0) {
+            std::cerr << "[folder] 监控 " << dir << " 失败: " << std::strerror(errno) << "\n";
+            continue;
+        }
+        wd_dirs_[wd] = dir;
+        ok.push_back(dir);
+    }
+    dirs_ = ok;
+    if (dirs_.empty()) {
+        ::close(inotify_fd_);
+        inotify_fd_ = -1;
+        err = "没有可监控的目录";
+        return false;
+    }
+#else
+    scan_dirs(Clock::now(), /*initial*/ true);  // 已经在的文件不处理
+#endif
+
+    stop_ = false;
+    th_ = std::thread([this] { loop(); });
+    return true;
+}
+
+void FolderWatcher::stop() {
+    stop_ = true;
+    if (th_.joinable()) th_.join();
+    if (inotify_fd_ >= 0) {
+        ::close(inotify_fd_);
+        inotify_fd_ = -1;
+    }
+}
+
+void FolderWatcher::loop() {
+#ifndef __linux__
+    const auto scan_every = std::chrono::milliseconds(std::max(kTickMs, cfg_.folder_debounce_ms / 2));
+    auto next_scan = Clock::now() + scan_every;
+#endif
+    const auto debounce = std::chrono::milliseconds(cfg_.folder_debounce_ms);
+    while (!stop_) {
+#ifdef __linux__
+        pollfd p{inotify_fd_, POLLIN, 0};
+        const int r = ::poll(&p, 1, kTickMs);
+        const auto now = Clock::now();
+        if (r > 0) read_events(now);
+#else
+        std::this_thread::sleep_for(std::chrono::milliseconds(kTickMs));
+        const auto now = Clock::now();
+        if (now >= next_scan) {
+            scan_dirs(now, false);
+            next_scan = now + scan_every;
+        }
+#endif
+        // 安静够久的文件按路径排好进 backlog（同一批拖进来的按文件名顺序处理）
+        std::vector<std::string> ready;
+        for (auto it = pending_.begin(); it != pending_.end();) {
+            if (now - it->second >= debounce) {
+                ready.push_back(it->first);
+                it = pending_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        std::sort(ready.begin(), ready.end());
+        for (auto &path : ready) {
+            // 还在排队 / 在跑的同一个文件又被写了一次：这次就不管了（结果以正在跑的为准）
+            if (queued_paths_.insert(path).second) backlog_.push_back(std::move(path));
+        }
+
+        collect();
+        admit();
+    }
+}
+
+void FolderWatcher::read_events(Clock::time_point now) {
+#ifdef __linux__
+    alignas(inotify_event) char buf[64 * 1024];
+    for (;;) {
+        const ssize_t n = ::read(inotify_fd_, buf, sizeof(buf));
+        if (n <= 0) return;  // EAGAIN：读完了
+        for (char *p = buf; p < buf + n;) {
+            const auto *ev = reinterpret_cast<const inotify_event *>(p);
+            p += sizeof(inotify_event) + ev->len;
+            if (ev->mask & IN_Q_OVERFLOW) {
+                std::cerr << "[folder] inotify 队列溢出，这段时间保存的部分文件会漏掉\n";
+                continue;
+            }
+            if (ev->mask & IN_IGNORED) {
+                auto it = wd_dirs_.find(ev->wd);
+                if (it != wd_dirs_.end()) {
+                    std::cerr << "[folder] 目录已不可用，停止监控: " << it->second << "\n";
+                    wd_dirs_.erase(it);
+                }
+                continue;
+            }
+            if (ev->len == 0 || (ev->mask & IN_ISDIR)) continue;
+            auto it = wd_dirs_.find(ev->wd);
+            if (it == wd_dirs_.end() || !is_image_name(ev->name)) continue;
+            touch(it->second + "/" + ev->name, now);
+        }
+    }
+#else
+    (void)now;
+#endif
+}
+
+void FolderWatcher::scan_dirs(Clock::time_point now, bool initial) {
+    std::error_code ec;
+    std::unordered_set<std::string> present;
+    for (const auto &dir : dirs_) {
+        for (const auto &e : fs::directory_iterator(dir, ec)) {
+            const std::string name = e.path().filename().string();
+            if (!is_image_name(name) || !e.is_regular_file(ec)) continue;
+            const std::string path = e.path().string();
+            const int64_t size = (int64_t)e.file_size(ec);
+            const int64_t mtime = (int64_t)e.last_write_time(ec).time_since_epoch().count();
+            present.insert(path);
+            auto &prev = seen_[path];
+            if (prev == std::make_pair(size, mtime)) continue;
+            prev = {size, mtime};
+            if (!initial) touch(path, now);
+        }
+    }
+    // 删掉的文件不再记着（同名文件再出现时按新文件算）
+    for (auto it = seen_.begin(); it != seen_.end();) {
+        if (present.count(it->first)) ++it;
+        else it = seen_.erase(it);
+    }
+}
+
+void FolderWatcher::touch(const std::string &path, Clock::time_point now) {
+    pending_[path] = now;
+}
+
+void FolderWatcher::collect() {
+    StreamSnapshot snap;
+    for (auto it = inflight_.begin(); it != inflight_.end();) {
+        // 只要状态：from 给到最后，不拷 partial
+        if (!jm_->stream_snapshot(it->first, (size_t)-1, snap)) {
+            queued_paths_.erase(it->second);
+            it = inflight_.erase(it);
+            continue;
+        }
+        if (snap.state != JobState::done && snap.state != JobState::error) {
+            ++it;
+            continue;
+        }
+        // 先写临时文件再改名，读旁路文件的程序不会看到写了一半的 JSON（.tmp / .json 都不是图片，不会再触发监控）
+        const std::string sidecar = it->second + ".ws_ai.json";
+        const std::string tmp = sidecar + ".tmp";
+        if (write_file_binary(tmp, snap.final_json + "\n") && std::rename(tmp.c_str(), sidecar.c_str()) == 0) {
+            written_++;
+        } else {
+            std::cerr << "[folder] 写结果失败: " << sidecar << "\n";
+            std::remove(tmp.c_str());
+        }
+        queued_paths_.erase(it->second);
+        it = inflight_.erase(it);
+    }
+}
+
+void FolderWatcher::admit() {
+    if (backlog_.empty() || inflight_.size() >= max_inflight_) return;
+    const size_t n = std::min(backlog_.size(), max_inflight_ - inflight_.size());
+    std::vector<std::string> paths(backlog_.begin(), backlog_.begin() + (std::ptrdiff_t)n);
+    backlog_.erase(backlog_.begin(), backlog_.begin() + (std::ptrdiff_t)n);
+
+    const std::vector<std::string> ids = jm_->submit_images(paths);
+    for (size_t i = 0; i < ids.size(); ++i) inflight_[ids[i]] = paths[i];
+    submitted_ += ids.size();
+    if (n > 1) {
+        std::cout << "[folder] 提交 " << n << " 个，还有 " << backlog_.size() << " 个排着（累计提交 " << submitted_
+                  << "，写回 " << written_ << "）\n";
+    }
+}
+
+} // namespace ws_ai
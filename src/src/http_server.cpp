@@ -2,10 +2,20 @@
 #include "ws_ai/http_server.h"   // 必须提供：class HttpServer { ... serve_forever(); ... }
 #include "ws_ai/job_manager.h"   // 必须提供：JobManager
 #include "ws_ai/config.h"        // 必须提供：Config
+#include "ws_ai/dispatcher.h"
+#include "ws_ai/folder_watcher.h"
+#include "ws_ai/local_server.h"
+#include "ws_ai/static_assets.h"
+#include "ws_ai/thread_plan.h"
+#include "ws_ai/util.h"
+#include "ws_ai/watch_server.h"
 
 #include <httplib.h>
+#include <json.hpp>
 
+#include <algorithm>
 #include <cstdio>
+#include <cstring>
 #include <cstdlib>
 #include <ctime>
 #include <fstream>
@@ -13,6 +23,7 @@
 #include <optional>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <utility>
 #include <memory>
 
@@ -24,31 +35,6 @@ static std::shared_ptr<JobManager> g_job_manager;
 // -------------------------
 // JSON/字符串工具
 // -------------------------
-static inline std::string json_escape(const std::string &s) {
-    std::string o;
-    o.reserve(s.size() + 16);
-    for (unsigned char c : s) {
-        switch (c) {
-            case '\"': o += "\\\""; break;
-            case '\\': o += "\\\\"; break;
-            case '\b': o += "\\b"; break;
-            case '\f': o += "\\f"; break;
-            case '\n': o += "\\n"; break;
-            case '\r': o += "\\r"; break;
-            case '\t': o += "\\t"; break;
-            default:
-                if (c < 0x20) {
-                    char buf[8];
-                    std::snprintf(buf, sizeof(buf), "\\u%04x", (int)c);
-                    o += buf;
-                } else {
-                    o.push_back((char)c);
-                }
-        }
-    }
-    return o;
-}
-
 static inline std::string make_tmp_path(const std::string &suffix) {
     std::ostringstream oss;
     oss << "/tmp/ws_ai_upload_" << (long long)time(nullptr)
@@ -80,6 +66,18 @@ static inline std::optional<std::string> json_get_string_field(const std::string
     return body.substr(q1 + 1, q2 - (q1 + 1));
 }
 
+// 同上，读数字字段："key":3
+static inline std::optional<int> json_get_int_field(const std::string &body, const std::string &key) {
+    std::string pat = "\"" + key + "\"";
+    size_t p = body.find(pat);
+    if (p == std::string::npos) return std::nullopt;
+    size_t c = body.find(':', p + pat.size());
+    if (c == std::string::npos) return std::nullopt;
+    size_t v = body.find_first_not_of(" \t\r\n", c + 1);
+    if (v == std::string::npos || !isdigit((unsigned char)body[v])) return std::nullopt;
+    return std::atoi(body.c_str() + v);
+}
+
 // data:image/png;base64,xxxx
 static inline std::optional<std::pair<std::string, std::string>> parse_data_url(const std::string &data_url) {
     auto p = data_url.find("base64,");
@@ -125,130 +123,99 @@ static inline std::optional<std::string> base64_decode(const std::string &in) {
 }
 
 // -------------------------
-// 前端页面（你也可以以后改成读静态文件）
+// 静态资源：内存里的预压缩副本 + ETag/304
 // -------------------------
-static const char *kIndexHtml = R"HTML(
-<!doctype html>
-<html>
-<head>
-<meta charset="utf-8"/>
-<meta name="viewport" content="width=device-width, initial-scale=1"/>
-<title>ws_ai_tool</title>
-<style>
-body{font-family:-apple-system,BlinkMacSystemFont,"Segoe UI",Arial;margin:18px;}
-.row{display:flex;gap:10px;flex-wrap:wrap;align-items:center;}
-.card{border:1px solid #ddd;border-radius:10px;padding:12px;margin-top:12px;}
-.btn{padding:8px 12px;border-radius:8px;border:1px solid #333;background:#fff;cursor:pointer;}
-.btn:disabled{opacity:.5;cursor:not-allowed;}
-.bar{width:100%;height:14px;background:#eee;border-radius:999px;overflow:hidden;}
-.bar>div{height:100%;width:0%;background:#111;transition:width .2s linear;}
-textarea{width:100%;min-height:260px;}
-#drop{border:2px dashed #bbb;border-radius:10px;padding:14px;color:#666;}
-img{max-width:360px;border-radius:10px;border:1px solid #ddd;}
-code{background:#f6f6f6;padding:2px 6px;border-radius:6px;}
-</style>
-</head>
-<body>
-<h3>ws_ai_tool 图片总结</h3>
-
-<div class="card">
-  <div class="row">
-    <input id="file" type="file" accept="image/*"/>
-    <button id="btnUpload" class="btn">上传并开始</button>
-    <button id="btnClear" class="btn">清空</button>
-  </div>
-  <p style="margin:10px 0 0 0;color:#666;">可 Ctrl+V 粘贴或拖拽图片。</p>
-  <div id="drop" class="card" style="margin-top:10px;">
-    粘贴 / 拖拽图片到这里
-    <div style="margin-top:10px;"><img id="preview" style="display:none;"/></div>
-  </div>
-</div>
-
-<div class="card">
-  <div class="row">
-    <div style="flex:1;"><div class="bar"><div id="barFill"></div></div></div>
-    <div style="min-width:70px;text-align:right;"><span id="pct">0%</span></div>
-  </div>
-  <p style="margin:8px 0 0 0;color:#666;">状态：<span id="state">idle</span>　任务：<code id="tid">-</code></p>
-</div>
-
-<div class="card">
-  <h4 style="margin:0 0 8px 0;">输出</h4>
-  <textarea id="out" placeholder="这里显示结果..."></textarea>
-</div>
-
-<script>
-let currentTaskId=null,pastedDataUrl=null,pollingTimer=null;
-function setProgress(p){p=Math.max(0,Math.min(100,p|0));barFill.style.width=p+'%';pct.textContent=p+'%';}
-function setState(s){state.textContent=s;}
-function setTaskId(id){tid.textContent=id||'-';}
-function stopPolling(){if(pollingTimer){clearInterval(pollingTimer);pollingTimer=null;}}
-function startPolling(taskId){
-  stopPolling();
-  pollingTimer=setInterval(async()=>{
-    try{
-      const r=await fetch('/api/status?id='+encodeURIComponent(taskId));
-      const j=await r.json();
-      setProgress(j.progress||0);
-      setState(j.state||'unknown');
-      if(j.state==='done'){stopPolling();out.value=j.result||'';}
-      else if(j.state==='error'){stopPolling();out.value=j.error||'error';}
-    }catch(e){}
-  },250);
+
+// Accept-Encoding 是否接受 enc（"br;q=0" 视为不接受）
+static inline bool accepts_encoding(const std::string &accept, const std::string &enc) {
+    size_t p = 0;
+    while (p < accept.size()) {
+        size_t comma = accept.find(',', p);
+        if (comma == std::string::npos) comma = accept.size();
+        std::string item = accept.substr(p, comma - p);
+        p = comma + 1;
+
+        size_t b = item.find_first_not_of(" \t");
+        if (b == std::string::npos) continue;
+        size_t semi = item.find(';', b);
+        std::string name = item.substr(b, semi == std::string::npos ? std::string::npos : semi - b);
+        while (!name.empty() && (name.back() == ' ' || name.back() == '\t')) name.pop_back();
+        if (name != enc && name != "*") continue;
+
+        if (semi != std::string::npos) {
+            size_t q = item.find("q=", semi);
+            if (q != std::string::npos && std::atof(item.c_str() + q + 2) <= 0.0) return false;
+        }
+        return true;
+    }
+    return false;
 }
-function showPreview(dataUrl){preview.src=dataUrl;preview.style.display='inline-block';}
-async function uploadFileAndStart(file){
-  const fd=new FormData(); fd.append('file',file);
-  setState('uploading'); setProgress(1);
-  const r=await fetch('/api/upload',{method:'POST',body:fd});
-  const j=await r.json(); if(!j.ok) throw new Error(j.error||'upload failed');
-  currentTaskId=j.id; setTaskId(currentTaskId); setState('queued'); setProgress(3); startPolling(currentTaskId);
+
+// If-None-Match 里有没有 etag 这个变体：按逗号拆开逐个整串比较（去掉 W/ 和引号），"*" 都算
+static inline bool if_none_match(const std::string &inm, const StaticAsset &a) {
+    size_t p = 0;
+    while (p < inm.size()) {
+        size_t comma = inm.find(',', p);
+        if (comma == std::string::npos) comma = inm.size();
+        size_t b = inm.find_first_not_of(" \t", p);
+        size_t e = comma;
+        p = comma + 1;
+        if (b == std::string::npos || b >= e) continue;
+        while (e > b && (inm[e - 1] == ' ' || inm[e - 1] == '\t')) --e;
+        std::string tag = inm.substr(b, e - b);
+        if (tag == "*") return true;
+        if (tag.rfind("W/", 0) == 0) tag.erase(0, 2);
+        if (tag.size() >= 2 && tag.front() == '"' && tag.back() == '"') tag = tag.substr(1, tag.size() - 2);
+        // 所有编码共用一个内容哈希，命中任意一个变体都算没变
+        if (tag == a.etag || tag == a.etag + "-br" || tag == a.etag + "-gz") return true;
+    }
+    return false;
 }
-async function uploadDataUrlAndStart(dataUrl){
-  setState('uploading'); setProgress(1);
-  const r=await fetch('/api/clipboard',{method:'POST',headers:{'Content-Type':'application/json'},body:JSON.stringify({data_url:dataUrl})});
-  const j=await r.json(); if(!j.ok) throw new Error(j.error||'clipboard upload failed');
-  currentTaskId=j.id; setTaskId(currentTaskId); setState('queued'); setProgress(3); startPolling(currentTaskId);
+
+static void serve_static(const StaticAsset &a, const httplib::Request &req, httplib::Response &res) {
+    // html 每次都要重新验证（拿 304）；带 ?v=hash 引用的资源内容永远不变
+    const bool versioned = a.immutable && req.has_param("v") && a.etag.rfind(req.get_param_value("v"), 0) == 0;
+    res.set_header("Cache-Control", versioned ? "public, max-age=31536000, immutable" : "no-cache");
+    res.set_header("Vary", "Accept-Encoding");
+
+    const std::string accept = req.get_header_value("Accept-Encoding");
+    std::shared_ptr<const std::string> body = a.identity;
+    std::string etag = a.etag;
+    const char *encoding = nullptr;
+    if (a.brotli && accepts_encoding(accept, "br")) {
+        body = a.brotli;
+        etag += "-br";
+        encoding = "br";
+    } else if (a.gzip && accepts_encoding(accept, "gzip")) {
+        body = a.gzip;
+        etag += "-gz";
+        encoding = "gzip";
+    }
+    // 304 带的 ETag 和这次会回的 200 一样（含 -br / -gz 后缀）
+    res.set_header("ETag", "\"" + etag + "\"");
+
+    const std::string inm = req.get_header_value("If-None-Match");
+    if (!inm.empty() && if_none_match(inm, a)) {
+        res.status = 304;
+        return;
+    }
+    if (encoding) res.set_header("Content-Encoding", encoding);
+
+    // 直接从常驻内存写 socket，不再每次请求拷贝一份页面
+    res.set_content_provider(body->size(), a.mime,
+        [body](size_t offset, size_t length, httplib::DataSink &sink) {
+            return sink.write(body->data() + offset, length);
+        });
 }
-btnUpload.onclick=async()=>{
-  try{
-    out.value='';
-    if(pastedDataUrl){await uploadDataUrlAndStart(pastedDataUrl);return;}
-    const f=file.files[0]; if(!f){alert('请选择文件或粘贴图片');return;}
-    await uploadFileAndStart(f);
-  }catch(e){setState('error');out.value=String(e);}
-};
-btnClear.onclick=()=>{
-  pastedDataUrl=null;currentTaskId=null;stopPolling();
-  setProgress(0);setState('idle');setTaskId(null);out.value='';
-  preview.style.display='none';preview.src='';file.value='';
-};
-window.addEventListener('paste',(ev)=>{
-  try{
-    const items=(ev.clipboardData||ev.originalEvent.clipboardData).items;
-    for(const it of items){
-      if(it.type&&it.type.startsWith('image/')){
-        const blob=it.getAsFile(); const reader=new FileReader();
-        reader.onload=()=>{pastedDataUrl=reader.result;showPreview(pastedDataUrl);};
-        reader.readAsDataURL(blob); ev.preventDefault(); return;
-      }
+
+static inline std::string regex_escape_path(const std::string &path) {
+    std::string o;
+    for (char c : path) {
+        if (std::strchr(".^$|()[]{}*+?\\", c)) o.push_back('\\');
+        o.push_back(c);
     }
-  }catch(e){}
-});
-drop.addEventListener('dragover',(e)=>{e.preventDefault();drop.style.borderColor='#111';});
-drop.addEventListener('dragleave',()=>{drop.style.borderColor='#bbb';});
-drop.addEventListener('drop',(e)=>{
-  e.preventDefault();drop.style.borderColor='#bbb';
-  const f=e.dataTransfer.files&&e.dataTransfer.files[0];
-  if(!f) return; if(!f.type.startsWith('image/')){alert('请拖拽图片文件');return;}
-  const reader=new FileReader();
-  reader.onload=()=>{pastedDataUrl=reader.result;showPreview(pastedDataUrl);};
-  reader.readAsDataURL(f);
-});
-</script>
-</body>
-</html>
-)HTML";
+    return o;
+}
 
 // -------------------------
 // 关键：补齐你链接缺的两个符号（必须与你头文件签名一致）
@@ -268,16 +235,39 @@ static inline bool ensure_job_manager(httplib::Response &res) {
     return true;
 }
 
+// 请求里带了 "model" 但没注册：直接 400，别等到 worker 里才失败
+static inline bool reject_unknown_model(const std::string &model, httplib::Response &res) {
+    if (model.empty() || g_job_manager->has_model(model)) return true;
+    res.status = 400;
+    res.set_content("{\"ok\":false,\"error\":\"unknown model: " + json_escape(model) + "\"}",
+                    "application/json; charset=utf-8");
+    return false;
+}
+
 // -------------------------
 // serve_forever：启动 8080 服务
 // -------------------------
 void HttpServer::serve_forever() {
+    if (dispatcher_mode(cfg_)) {
+        serve_dispatcher();
+        return;
+    }
     httplib::Server svr;
 
-    // 首页
-    svr.Get("/", [&](const httplib::Request &, httplib::Response &res) {
-        res.set_content(kIndexHtml, "text/html; charset=utf-8");
-    });
+    // httplib 默认线程池大小是 max(8, 核数-1)，和 llama 抢核；按线程规划来
+    const ThreadPlan plan = make_thread_plan(cfg_, /*overlap_ocr*/ false);
+    const size_t http_workers = (size_t)plan.http_workers;
+    svr.new_task_queue = [http_workers] { return new httplib::ThreadPool(http_workers); };
+
+    // 首页 + 静态资源：启动时一次性加载 web_root（或构建时嵌入的副本）并预压缩
+    StaticAssets assets;
+    assets.load(cfg_.web_root);
+    for (const auto &kv : assets.all()) {
+        const StaticAsset *a = &kv.second;
+        svr.Get(regex_escape_path(kv.first), [a](const httplib::Request &req, httplib::Response &res) {
+            serve_static(*a, req, res);
+        });
+    }
 
     // 查询状态：GET /api/status?id=xxx
     svr.Get("/api/status", [&](const httplib::Request &req, httplib::Response &res) {
@@ -294,7 +284,144 @@ void HttpServer::serve_forever() {
         res.set_content(json, "application/json; charset=utf-8");
     });
 
-    // 上传文件：POST /api/upload  multipart/form-data name="file"
+    // 模型列表：GET /api/models（是否常驻、占用内存、空闲时长）
+    svr.Get("/api/models", [&](const httplib::Request &, httplib::Response &res) {
+        if (!ensure_job_manager(res)) return;
+        res.set_content(g_job_manager->get_models_json(), "application/json; charset=utf-8");
+    });
+
+    // 近重复复用统计：GET /api/dedup（索引条数 / 内存 / 命中率）
+    svr.Get("/api/dedup", [&](const httplib::Request &, httplib::Response &res) {
+        if (!ensure_job_manager(res)) return;
+        res.set_content(g_job_manager->get_dedup_json(), "application/json; charset=utf-8");
+    });
+
+    // Chrome trace：GET /api/trace?id=xxx 单个 job；不带 id 导出全局滚动 trace（最近所有 job）
+    // 保存成 .json 后用 chrome://tracing 或 ui.perfetto.dev 打开
+    svr.Get("/api/trace", [&](const httplib::Request &req, httplib::Response &res) {
+        if (!ensure_job_manager(res)) return;
+        if (!req.has_param("id")) {
+            res.set_content(g_job_manager->get_global_trace_json(), "application/json; charset=utf-8");
+            return;
+        }
+        const std::string json = g_job_manager->get_trace_json(req.get_param_value("id"));
+        if (json.empty()) {
+            res.status = 404;
+            res.set_content("{\"ok\":false,\"error\":\"no trace for this id\"}", "application/json; charset=utf-8");
+            return;
+        }
+        res.set_content(json, "application/json; charset=utf-8");
+    });
+
+    // 流式输出：GET /api/stream?id=xxx（SSE）
+    // event: delta  data: {"text":"..."}   新生成的片段
+    // event: done / error  data: 和 /api/status 一样的 JSON，然后关闭
+    // 注意：每个连接在结束前会占住一个 httplib worker 线程；连接多时用 watch 端口上的同名接口（watch_server.h）
+    svr.Get("/api/stream", [&](const httplib::Request &req, httplib::Response &res) {
+        if (!ensure_job_manager(res)) return;
+        if (!req.has_param("id")) {
+            res.status = 400;
+            res.set_content("{\"ok\":false,\"error\":\"missing id\"}", "application/json; charset=utf-8");
+            return;
+        }
+        const std::string id = req.get_param_value("id");
+        std::shared_ptr<JobManager> jm = g_job_manager;
+        auto offset = std::make_shared<size_t>(0);
+
+        res.set_header("Cache-Control", "no-cache");
+        res.set_chunked_content_provider("text/event-stream",
+            [jm, id, offset](size_t, httplib::DataSink &sink) {
+                std::string chunk;
+                std::string out;
+                bool finished = false;
+                switch (jm->wait_stream(id, *offset, chunk, 15000)) {
+                case StreamEvent::delta:
+                    out = "event: delta\ndata: {\"text\":\"" + json_escape(chunk) + "\"}\n\n";
+                    break;
+                case StreamEvent::done:
+                    out = "event: done\ndata: " + chunk + "\n\n";
+                    finished = true;
+                    break;
+                case StreamEvent::error:
+                    out = "event: error\ndata: " + chunk + "\n\n";
+                    finished = true;
+                    break;
+                case StreamEvent::timeout:
+                    out = ": keepalive\n\n";
+                    break;
+                case StreamEvent::not_found:
+                    out = "event: error\ndata: {\"ok\":false,\"error\":\"not found\"}\n\n";
+                    finished = true;
+                    break;
+                }
+                if (!sink.write(out.data(), out.size())) return false;  // 客户端断开
+                if (finished) sink.done();
+                return true;
+            });
+    });
+
+    // 追问：POST /api/followup?id=xxx  JSON {"question":"第二段再展开讲讲"}
+    // 返回新的任务 id，照常用 /api/status 或 /api/stream 跟进；对追问再追问也可以
+    svr.Post("/api/followup", [&](const httplib::Request &req, httplib::Response &res) {
+        if (!ensure_job_manager(res)) return;
+        if (!req.has_param("id")) {
+            res.status = 400;
+            res.set_content("{\"ok\":false,\"error\":\"missing id\"}", "application/json; charset=utf-8");
+            return;
+        }
+        // 问题是用户随手打的字，可能带引号 / 换行：这里用完整的 JSON 解析
+        const nlohmann::json body = nlohmann::json::parse(req.body, nullptr, false);
+        std::string question;
+        if (body.is_object() && body.contains("question") && body["question"].is_string()) {
+            question = body["question"].get<std::string>();
+        }
+        if (question.empty()) {
+            res.status = 400;
+            res.set_content("{\"ok\":false,\"error\":\"missing question\"}", "application/json; charset=utf-8");
+            return;
+        }
+
+        std::string err;
+        const std::string id = g_job_manager->submit_followup(req.get_param_value("id"), question, err);
+        if (id.empty()) {
+            res.status = err == "not found" ? 404 : 409;
+            res.set_content("{\"ok\":false,\"error\":\"" + json_escape(err) + "\"}", "application/json; charset=utf-8");
+            return;
+        }
+
+        std::ostringstream oss;
+        oss << "{\"ok\":true,\"id\":\"" << json_escape(id) << "\"}";
+        res.set_content(oss.str(), "application/json; charset=utf-8");
+    });
+
+    // 一批任务的进度：POST /api/progress，body 为逗号分隔的 id（分发模式的 dispatcher 用它同步进度、顺便做健康检查；
+    // 在跑的任务可能上百个，放 body 里不受 URL 长度限制）。
+    // watch 端口开着时放在 X-WS-AI-Watch-Port 里，dispatcher 的流式代理连那边，不占这里的 worker 线程
+    int watch_port = 0;
+    svr.Post("/api/progress", [&](const httplib::Request &req, httplib::Response &res) {
+        if (!ensure_job_manager(res)) return;
+        std::vector<std::string> ids;
+        std::istringstream iss(req.body);
+        for (std::string id; std::getline(iss, id, ',');) {
+            if (!id.empty()) ids.push_back(id);
+        }
+        if (watch_port > 0) res.set_header("X-WS-AI-Watch-Port", std::to_string(watch_port));
+        res.set_content(g_job_manager->get_progress_json(ids), "application/json; charset=utf-8");
+    });
+
+    // 任务内存预算：GET /api/memory（预算、各阶段当前预订 / 峰值 / 排队统计、正在持有和排队的预订）
+    svr.Get("/api/memory", [&](const httplib::Request &, httplib::Response &res) {
+        if (!ensure_job_manager(res)) return;
+        res.set_content(g_job_manager->get_memory_json(), "application/json; charset=utf-8");
+    });
+
+    // 服务内部计数：GET /api/stats（队列深度、JobManager 锁的争用情况），压测前后各取一次做差
+    svr.Get("/api/stats", [&](const httplib::Request &, httplib::Response &res) {
+        if (!ensure_job_manager(res)) return;
+        res.set_content(g_job_manager->get_stats_json(), "application/json; charset=utf-8");
+    });
+
+    // 上传文件：POST /api/upload  multipart/form-data name="file"（可选 name="model"、"n_candidates"、"candidates"=all、"deadline_ms"）
     // 注意：你当前的 httplib 版本不支持 req.files/has_file/get_file_value，所以必须用 ContentReader 解析
     svr.Post("/api/upload",
         [&](const httplib::Request &req, httplib::Response &res, const httplib::ContentReader &content_reader) {
@@ -305,9 +432,15 @@ void HttpServer::serve_forever() {
             std::string filename;
             std::string content_type;
             std::string file_bytes;
+            std::string model;
+            std::string n_candidates;
+            std::string candidates;
+            std::string deadline_ms;
+            std::string current_field;
 
             bool ok = content_reader(
                 [&](const httplib::FormData &header) {
+                    current_field = header.name;
                     if (header.name == "file") {
                         got_file = true;
                         filename = header.filename;
@@ -317,7 +450,11 @@ void HttpServer::serve_forever() {
                     return true;
                 },
                 [&](const char *data, size_t data_length) {
-                    if (got_file) file_bytes.append(data, data_length);
+                    if (current_field == "file") file_bytes.append(data, data_length);
+                    else if (current_field == "model" && model.size() < 128) model.append(data, data_length);
+                    else if (current_field == "n_candidates" && n_candidates.size() < 8) n_candidates.append(data, data_length);
+                    else if (current_field == "candidates" && candidates.size() < 8) candidates.append(data, data_length);
+                    else if (current_field == "deadline_ms" && deadline_ms.size() < 12) deadline_ms.append(data, data_length);
                     return true;
                 }
             );
@@ -327,6 +464,7 @@ void HttpServer::serve_forever() {
                 res.set_content("{\"ok\":false,\"error\":\"missing file\"}", "application/json; charset=utf-8");
                 return;
             }
+            if (!reject_unknown_model(model, res)) return;
 
             std::string suffix = ".bin";
             auto dot = filename.find_last_of('.');
@@ -345,7 +483,8 @@ void HttpServer::serve_forever() {
             }
 
             // 你需要在 JobManager 实现这个函数（或改成你已有的接口）
-            const std::string id = g_job_manager->submit_image(save_path);
+            const std::string id = g_job_manager->submit_image(save_path, model, std::atoi(n_candidates.c_str()),
+                                                                candidates == "all", std::atoi(deadline_ms.c_str()));
 
             std::ostringstream oss;
             oss << "{\"ok\":true,\"id\":\"" << json_escape(id) << "\"}";
@@ -353,7 +492,7 @@ void HttpServer::serve_forever() {
         }
     );
 
-    // 剪贴板 dataURL：POST /api/clipboard  JSON {"data_url":"data:image/png;base64,..."}
+    // 剪贴板 dataURL：POST /api/clipboard  JSON {"data_url":"data:image/png;base64,...","model":"fast","n_candidates":4,"candidates":"all","deadline_ms":3000}
     svr.Post("/api/clipboard", [&](const httplib::Request &req, httplib::Response &res) {
         if (!ensure_job_manager(res)) return;
 
@@ -377,6 +516,9 @@ void HttpServer::serve_forever() {
             return;
         }
 
+        const std::string model = json_get_string_field(req.body, "model").value_or("");
+        if (!reject_unknown_model(model, res)) return;
+
         const std::string mime = parsed->first;
         const std::string b64  = parsed->second;
 
@@ -398,7 +540,10 @@ void HttpServer::serve_forever() {
             ofs.write(bin_opt->data(), (std::streamsize)bin_opt->size());
         }
 
-        const std::string id = g_job_manager->submit_image(save_path);
+        const int n_candidates = json_get_int_field(req.body, "n_candidates").value_or(1);
+        const bool all_candidates = json_get_string_field(req.body, "candidates").value_or("") == "all";
+        const int deadline_ms = json_get_int_field(req.body, "deadline_ms").value_or(0);
+        const std::string id = g_job_manager->submit_image(save_path, model, n_candidates, all_candidates, deadline_ms);
 
         std::ostringstream oss;
         oss << "{\"ok\":true,\"id\":\"" << json_escape(id) << "\"}";
@@ -419,8 +564,76 @@ void HttpServer::serve_forever() {
         if (v > 0 && v < 65536) port = v;
     }
 
+    // 线程池在 listen 里创建，先把当前线程绑到 HTTP 的核上让 worker 继承
+    pin_current_thread(plan, ThreadRole::http);
+
+    // 流式 / 进度观察的长连接交给单独端口上的事件循环
+    WatchServer watch(cfg_, g_job_manager);
+    if (cfg_.watch_port > 0) {
+        std::string err;
+        if (watch.start(host, cfg_.watch_port, err)) {
+            std::cout << "Watch (stream/progress) on http://" << host << ":" << cfg_.watch_port << "\n";
+            watch_port = cfg_.watch_port;
+        } else {
+            std::cerr << "[watch] " << err << "，流式接口只在主端口上可用\n";
+        }
+    }
+
+    // 本机客户端：Unix domain socket 上的二进制提交协议
+    LocalServer local(cfg_, g_job_manager);
+    if (!cfg_.uds_path.empty()) {
+        std::string err;
+        if (local.start(cfg_.uds_path, err)) {
+            std::cout << "Local submit on unix:" << cfg_.uds_path << "\n";
+        } else {
+            std::cerr << "[local] " << err << "\n";
+        }
+    }
+
+    // 截图文件夹：新保存的图片按原路径直接提交
+    FolderWatcher folders(cfg_, g_job_manager);
+    if (!cfg_.folder_dirs.empty()) {
+        std::string err;
+        if (folders.start(err)) {
+            std::cout << "Watching folders:";
+            for (const auto &d : cfg_.folder_dirs) std::cout << " " << d;
+            std::cout << "\n";
+        } else {
+            std::cerr << "[folder] " << err << "\n";
+        }
+    }
+
     std::cout << "Listening on http://" << host << ":" << port << "\n";
     svr.listen(host.c_str(), port);
 }
 
+void HttpServer::serve_dispatcher() {
+    httplib::Server svr;
+
+    // 这里只有转发，线程都在等 worker 的响应；流式代理每个连接占一个线程，池子给大一点
+    const size_t http_workers = std::max<size_t>(32, 4 * std::max(1u, std::thread::hardware_concurrency()));
+    svr.new_task_queue = [http_workers] { return new httplib::ThreadPool(http_workers); };
+
+    StaticAssets assets;
+    assets.load(cfg_.web_root);
+    for (const auto &kv : assets.all()) {
+        const StaticAsset *a = &kv.second;
+        svr.Get(regex_escape_path(kv.first), [a](const httplib::Request &req, httplib::Response &res) {
+            serve_static(*a, req, res);
+        });
+    }
+
+    Dispatcher dispatcher(cfg_);
+    std::string err;
+    if (!dispatcher.start(err)) {
+        std::cerr << "[dispatch] " << err << "\n";
+        return;
+    }
+    dispatcher.install(svr);
+
+    std::cout << "Dispatching on http://" << cfg_.host << ":" << cfg_.port << "\n";
+    svr.listen(cfg_.host.c_str(), cfg_.port);
+    dispatcher.stop();
+}
+
 } // namespace ws_ai
\ No newline at end of file
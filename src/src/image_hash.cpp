@@ -0,0 +1,158 @@
+#include "ws_ai/image_hash.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace ws_ai {
+
+// -------------------------
+// 指纹
+// -------------------------
+static uint64_t dhash_from(const GrayImage &img) {
+  GrayImage s;
+  downscale_area(img, 9, 8, s);
+  uint64_t h = 0;
+  for (int y = 0; y < 8; ++y) {
+    const uint8_t *r = s.row(y);
+    for (int x = 0; x < 8; ++x) h = (h << 1) | (r[x] < r[x + 1] ? 1u : 0u);
+  }
+  return h;
+}
+
+static uint64_t phash_from(const GrayImage &img) {
+  constexpr int N = 32, K = 8;
+  GrayImage s;
+  downscale_area(img, N, N, s);
+
+  // 只要左上 8x8 低频系数：先对行做 K 个频率，再对列做 K 个频率
+  static const auto cos_table = [] {
+    std::vector<float> t(K * N);
+    for (int u = 0; u < K; ++u)
+      for (int x = 0; x < N; ++x) t[u * N + x] = (float)std::cos((2 * x + 1) * u * M_PI / (2.0 * N));
+    return t;
+  }();
+
+  float rows[N][K];
+  for (int y = 0; y < N; ++y) {
+    const uint8_t *r = s.row(y);
+    for (int u = 0; u < K; ++u) {
+      float acc = 0;
+      for (int x = 0; x < N; ++x) acc += r[x] * cos_table[u * N + x];
+      rows[y][u] = acc;
+    }
+  }
+  float coef[K * K];
+  for (int v = 0; v < K; ++v)
+    for (int u = 0; u < K; ++u) {
+      float acc = 0;
+      for (int y = 0; y < N; ++y) acc += rows[y][u] * cos_table[v * N + y];
+      coef[v * K + u] = acc;
+    }
+
+  // 中位数不算直流分量（它只反映整体亮度）
+  float tmp[K * K - 1];
+  std::copy(coef + 1, coef + K * K, tmp);
+  std::nth_element(tmp, tmp + (K * K - 1) / 2, tmp + K * K - 1);
+  const float med = tmp[(K * K - 1) / 2];
+
+  uint64_t h = 0;
+  for (int i = 0; i < K * K; ++i) h = (h << 1) | (coef[i] > med ? 1u : 0u);
+  return h;
+}
+
+bool compute_fingerprint(const GrayImage &img, ImageFingerprint &out) {
+  if (img.width < 32 || img.height < 32) return false;
+  out.phash = phash_from(img);
+  out.dhash = dhash_from(img);
+  return true;
+}
+
+// -------------------------
+// HammingIndex
+// -------------------------
+HammingIndex::HammingIndex(size_t capacity) : entries_(std::max<size_t>(1, capacity)) {
+  for (auto &h : heads_) h.assign(1u << 16, kNone);
+}
+
+void HammingIndex::unlink(uint32_t slot) {
+  Entry &e = entries_[slot];
+  for (int i = 0; i < kParts; ++i) {
+    if (e.prev[i] != kNone) entries_[e.prev[i]].next[i] = e.next[i];
+    else heads_[i][part(e.fp.phash, i)] = e.next[i];
+    if (e.next[i] != kNone) entries_[e.next[i]].prev[i] = e.prev[i];
+  }
+  e.live = false;
+}
+
+void HammingIndex::insert(const ImageFingerprint &fp, const std::string &key) {
+  const uint32_t slot = (uint32_t)next_;
+  next_ = (next_ + 1) % entries_.size();
+
+  Entry &e = entries_[slot];
+  if (e.live) unlink(slot);
+  else size_++;
+
+  e.fp = fp;
+  e.key = key;
+  e.live = true;
+  for (int i = 0; i < kParts; ++i) {
+    uint32_t &head = heads_[i][part(fp.phash, i)];
+    e.prev[i] = kNone;
+    e.next[i] = head;
+    if (head != kNone) entries_[head].prev[i] = slot;
+    head = slot;
+  }
+}
+
+bool HammingIndex::erase(const ImageFingerprint &fp, const std::string &key) {
+  for (uint32_t slot = heads_[0][part(fp.phash, 0)]; slot != kNone; slot = entries_[slot].next[0]) {
+    if (entries_[slot].key != key) continue;
+    unlink(slot);
+    entries_[slot].key.clear();
+    size_--;
+    return true;
+  }
+  return false;
+}
+
+// 枚举 16 位值 v 的汉明半径 r 以内所有值（从 bit 位置 from 开始翻）
+template <class F>
+static void for_each_within(uint16_t v, int r, int from, F &&fn) {
+  fn(v);
+  if (r == 0) return;
+  for (int b = from; b < 16; ++b) for_each_within((uint16_t)(v ^ (1u << b)), r - 1, b + 1, fn);
+}
+
+std::optional<HammingIndex::Match> HammingIndex::find(const ImageFingerprint &fp, int max_dist) const {
+  if (max_dist < 0 || size_ == 0) return std::nullopt;
+
+  const int sub_r = std::min(max_dist / kParts, 16);
+  int best_d = max_dist + 1;
+  uint32_t best = 0;
+
+  for (int i = 0; i < kParts; ++i) {
+    for_each_within(part(fp.phash, i), sub_r, 0, [&](uint16_t probe) {
+      for (uint32_t slot = heads_[i][probe]; slot != kNone; slot = entries_[slot].next[i]) {
+        const Entry &e = entries_[slot];
+        const int d = hamming64(e.fp.phash, fp.phash);
+        if (d >= best_d) continue;
+        // dHash 对裁剪更敏感，只用来排除 pHash 碰巧接近但内容不同的图
+        if (hamming64(e.fp.dhash, fp.dhash) > 3 * max_dist) continue;
+        best_d = d;
+        best = slot;
+      }
+    });
+  }
+
+  if (best_d > max_dist) return std::nullopt;
+  return Match{entries_[best].key, best_d};
+}
+
+size_t HammingIndex::memory_bytes() const {
+  size_t n = entries_.capacity() * sizeof(Entry);
+  for (const auto &h : heads_) n += h.capacity() * sizeof(uint32_t);
+  for (const auto &e : entries_) n += e.key.capacity() > 15 ? e.key.capacity() + 1 : 0;  // SSO 之外的堆
+  return n;
+}
+
+} // namespace ws_ai
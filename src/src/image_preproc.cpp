@@ -0,0 +1,435 @@
+#include "ws_ai/image_preproc.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define WS_AI_SIMD_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define WS_AI_SIMD_SSE2 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define WS_AI_SIMD_NEON 1
+#endif
+
+namespace ws_ai {
+
+PreprocOptions preproc_options_from_config(const Config &cfg) {
+  PreprocOptions o;
+  o.enabled = cfg.ocr_preprocess;
+  o.contrast = cfg.ocr_contrast;
+  o.target_text_px = cfg.ocr_target_text_px;
+  o.max_side = cfg.ocr_max_side;
+  return o;
+}
+
+static std::atomic<bool> g_force_scalar{false};
+
+void preproc_force_scalar(bool on) { g_force_scalar.store(on); }
+
+static inline bool use_simd() { return !g_force_scalar.load(std::memory_order_relaxed); }
+
+const char *preproc_backend() {
+#if defined(WS_AI_SIMD_AVX2)
+  return use_simd() ? "avx2" : "scalar";
+#elif defined(WS_AI_SIMD_SSE2)
+  return use_simd() ? "sse2" : "scalar";
+#elif defined(WS_AI_SIMD_NEON)
+  return use_simd() ? "neon" : "scalar";
+#else
+  return "scalar";
+#endif
+}
+
+// -------------------------
+// kernel 1：RGBA -> luma，(77 R + 150 G + 29 B + 128) >> 8，所有后端结果逐位一致
+// -------------------------
+static void luma_row_scalar(const uint8_t *s, uint8_t *d, int n, bool bgr) {
+  const int wc0 = bgr ? 29 : 77, wc2 = bgr ? 77 : 29;
+  for (int x = 0; x < n; ++x, s += 4) d[x] = (uint8_t)((wc0 * s[0] + 150 * s[1] + wc2 * s[2] + 128) >> 8);
+}
+
+static int luma_row_simd(const uint8_t *s, uint8_t *d, int n, bool bgr) {
+  int x = 0;
+#if defined(WS_AI_SIMD_AVX2)
+  // 每个像素 32 位：(p & 0x00ff00ff) = [c0, c2] 两个 int16，(p >> 8) & 0x00ff00ff = [G, A]
+  const __m256i w02 = _mm256_set1_epi32(bgr ? ((77 << 16) | 29) : ((29 << 16) | 77));
+  const __m256i w1 = _mm256_set1_epi32(150);
+  const __m256i mask = _mm256_set1_epi32(0x00ff00ff);
+  const __m256i rnd = _mm256_set1_epi32(128);
+  auto y8 = [&](__m256i p) {
+    __m256i lo = _mm256_and_si256(p, mask);
+    __m256i hi = _mm256_and_si256(_mm256_srli_epi32(p, 8), mask);
+    __m256i v = _mm256_add_epi32(_mm256_madd_epi16(lo, w02), _mm256_madd_epi16(hi, w1));
+    return _mm256_srli_epi32(_mm256_add_epi32(v, rnd), 8);
+  };
+  for (; x + 16 <= n; x += 16) {
+    __m256i a = y8(_mm256_loadu_si256((const __m256i *)(s + 4 * x)));
+    __m256i b = y8(_mm256_loadu_si256((const __m256i *)(s + 4 * x + 32)));
+    __m256i w = _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), 0xD8);
+    __m128i out = _mm_packus_epi16(_mm256_castsi256_si128(w), _mm256_extracti128_si256(w, 1));
+    _mm_storeu_si128((__m128i *)(d + x), out);
+  }
+#elif defined(WS_AI_SIMD_SSE2)
+  const __m128i w02 = _mm_set1_epi32(bgr ? ((77 << 16) | 29) : ((29 << 16) | 77));
+  const __m128i w1 = _mm_set1_epi32(150);
+  const __m128i mask = _mm_set1_epi32(0x00ff00ff);
+  const __m128i rnd = _mm_set1_epi32(128);
+  auto y4 = [&](__m128i p) {
+    __m128i lo = _mm_and_si128(p, mask);
+    __m128i hi = _mm_and_si128(_mm_srli_epi32(p, 8), mask);
+    __m128i v = _mm_add_epi32(_mm_madd_epi16(lo, w02), _mm_madd_epi16(hi, w1));
+    return _mm_srli_epi32(_mm_add_epi32(v, rnd), 8);
+  };
+  for (; x + 8 <= n; x += 8) {
+    __m128i a = y4(_mm_loadu_si128((const __m128i *)(s + 4 * x)));
+    __m128i b = y4(_mm_loadu_si128((const __m128i *)(s + 4 * x + 16)));
+    __m128i w = _mm_packs_epi32(a, b);
+    _mm_storel_epi64((__m128i *)(d + x), _mm_packus_epi16(w, w));
+  }
+#elif defined(WS_AI_SIMD_NEON)
+  const uint8x8_t wc0 = vdup_n_u8(bgr ? 29 : 77), wc1 = vdup_n_u8(150), wc2 = vdup_n_u8(bgr ? 77 : 29);
+  for (; x + 16 <= n; x += 16) {
+    uint8x16x4_t p = vld4q_u8(s + 4 * x);
+    uint16x8_t lo = vmull_u8(vget_low_u8(p.val[0]), wc0);
+    lo = vmlal_u8(lo, vget_low_u8(p.val[1]), wc1);
+    lo = vmlal_u8(lo, vget_low_u8(p.val[2]), wc2);
+    uint16x8_t hi = vmull_u8(vget_high_u8(p.val[0]), wc0);
+    hi = vmlal_u8(hi, vget_high_u8(p.val[1]), wc1);
+    hi = vmlal_u8(hi, vget_high_u8(p.val[2]), wc2);
+    vst1q_u8(d + x, vcombine_u8(vrshrn_n_u16(lo, 8), vrshrn_n_u16(hi, 8)));
+  }
+#else
+  (void)s; (void)d; (void)n; (void)bgr;
+#endif
+  return x;
+}
+
+// -------------------------
+// kernel 2：逐像素仿射 + 饱和，out = clamp(round(v * scale + offset))
+// -------------------------
+static void affine_scalar(uint8_t *p, size_t n, float scale, float offset) {
+  for (size_t i = 0; i < n; ++i) {
+    float v = std::nearbyint(p[i] * scale + offset);
+    p[i] = (uint8_t)std::min(255.0f, std::max(0.0f, v));
+  }
+}
+
+static size_t affine_simd(uint8_t *p, size_t n, float scale, float offset) {
+  size_t i = 0;
+#if defined(WS_AI_SIMD_AVX2)
+  const __m256 vs = _mm256_set1_ps(scale), vo = _mm256_set1_ps(offset);
+  const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+  auto f8 = [&](__m128i b8) {
+    __m256 f = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(b8));
+    return _mm256_cvtps_epi32(_mm256_add_ps(_mm256_mul_ps(f, vs), vo));
+  };
+  for (; i + 32 <= n; i += 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(p + i));
+    __m128i lo = _mm256_castsi256_si128(v), hi = _mm256_extracti128_si256(v, 1);
+    __m256i a = _mm256_packs_epi32(f8(lo), f8(_mm_srli_si128(lo, 8)));
+    __m256i b = _mm256_packs_epi32(f8(hi), f8(_mm_srli_si128(hi, 8)));
+    __m256i out = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(a, b), order);
+    _mm256_storeu_si256((__m256i *)(p + i), out);
+  }
+#elif defined(WS_AI_SIMD_SSE2)
+  const __m128 vs = _mm_set1_ps(scale), vo = _mm_set1_ps(offset);
+  const __m128i zero = _mm_setzero_si128();
+  auto f4 = [&](__m128i w16, bool high) {
+    __m128i d = high ? _mm_unpackhi_epi16(w16, zero) : _mm_unpacklo_epi16(w16, zero);
+    return _mm_cvtps_epi32(_mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(d), vs), vo));
+  };
+  for (; i + 16 <= n; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+    __m128i lo = _mm_unpacklo_epi8(v, zero), hi = _mm_unpackhi_epi8(v, zero);
+    __m128i a = _mm_packs_epi32(f4(lo, false), f4(lo, true));
+    __m128i b = _mm_packs_epi32(f4(hi, false), f4(hi, true));
+    _mm_storeu_si128((__m128i *)(p + i), _mm_packus_epi16(a, b));
+  }
+#elif defined(WS_AI_SIMD_NEON)
+  const float32x4_t vs = vdupq_n_f32(scale), vo = vdupq_n_f32(offset);
+  auto f4 = [&](uint16x4_t w) {
+    float32x4_t f = vcvtq_f32_u32(vmovl_u16(w));
+    return vqmovn_s32(vcvtnq_s32_f32(vmlaq_f32(vo, f, vs)));
+  };
+  for (; i + 16 <= n; i += 16) {
+    uint8x16_t v = vld1q_u8(p + i);
+    uint16x8_t lo = vmovl_u8(vget_low_u8(v)), hi = vmovl_u8(vget_high_u8(v));
+    int16x8_t a = vcombine_s16(f4(vget_low_u16(lo)), f4(vget_high_u16(lo)));
+    int16x8_t b = vcombine_s16(f4(vget_low_u16(hi)), f4(vget_high_u16(hi)));
+    vst1q_u8(p + i, vcombine_u8(vqmovun_s16(a), vqmovun_s16(b)));
+  }
+#else
+  (void)p; (void)n; (void)scale; (void)offset;
+#endif
+  return i;
+}
+
+static void apply_affine(GrayImage &img, float scale, float offset) {
+  const size_t n = img.pixels.size();
+  size_t i = use_simd() ? affine_simd(img.pixels.data(), n, scale, offset) : 0;
+  affine_scalar(img.pixels.data() + i, n - i, scale, offset);
+}
+
+// -------------------------
+// kernel 3：acc[x] += w * src[x]（面积平均缩放的纵向累加）
+// -------------------------
+static int accum_row_simd(const uint8_t *s, float w, float *acc, int n) {
+  int x = 0;
+#if defined(WS_AI_SIMD_AVX2)
+  const __m256 vw = _mm256_set1_ps(w);
+  for (; x + 8 <= n; x += 8) {
+    __m256 f = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(s + x))));
+    _mm256_storeu_ps(acc + x, _mm256_add_ps(_mm256_loadu_ps(acc + x), _mm256_mul_ps(f, vw)));
+  }
+#elif defined(WS_AI_SIMD_SSE2)
+  const __m128 vw = _mm_set1_ps(w);
+  const __m128i zero = _mm_setzero_si128();
+  for (; x + 8 <= n; x += 8) {
+    __m128i w16 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(s + x)), zero);
+    __m128 f0 = _mm_cvtepi32_ps(_mm_unpacklo_epi16(w16, zero));
+    __m128 f1 = _mm_cvtepi32_ps(_mm_unpackhi_epi16(w16, zero));
+    _mm_storeu_ps(acc + x, _mm_add_ps(_mm_loadu_ps(acc + x), _mm_mul_ps(f0, vw)));
+    _mm_storeu_ps(acc + x + 4, _mm_add_ps(_mm_loadu_ps(acc + x + 4), _mm_mul_ps(f1, vw)));
+  }
+#elif defined(WS_AI_SIMD_NEON)
+  const float32x4_t vw = vdupq_n_f32(w);
+  for (; x + 8 <= n; x += 8) {
+    uint16x8_t w16 = vmovl_u8(vld1_u8(s + x));
+    float32x4_t f0 = vcvtq_f32_u32(vmovl_u16(vget_low_u16(w16)));
+    float32x4_t f1 = vcvtq_f32_u32(vmovl_u16(vget_high_u16(w16)));
+    vst1q_f32(acc + x, vmlaq_f32(vld1q_f32(acc + x), f0, vw));
+    vst1q_f32(acc + x + 4, vmlaq_f32(vld1q_f32(acc + x + 4), f1, vw));
+  }
+#else
+  (void)s; (void)w; (void)acc; (void)n;
+#endif
+  return x;
+}
+
+static void accum_row(const uint8_t *s, float w, float *acc, int n) {
+  int x = use_simd() ? accum_row_simd(s, w, acc, n) : 0;
+  for (; x < n; ++x) acc[x] += w * s[x];
+}
+
+// -------------------------
+// kernel 4：一行里和背景差超过 thr 的像素数（行高估计用）
+// -------------------------
+static int count_ink_simd(const uint8_t *s, int n, uint8_t bg, uint8_t thr, uint64_t &cnt) {
+  int x = 0;
+#if defined(WS_AI_SIMD_AVX2)
+  const __m256i vbg = _mm256_set1_epi8((char)bg), vthr = _mm256_set1_epi8((char)thr);
+  const __m256i one = _mm256_set1_epi8(1), zero = _mm256_setzero_si256();
+  __m256i acc = zero;
+  for (; x + 32 <= n; x += 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(s + x));
+    __m256i d = _mm256_or_si256(_mm256_subs_epu8(v, vbg), _mm256_subs_epu8(vbg, v));
+    __m256i m = _mm256_min_epu8(_mm256_subs_epu8(d, vthr), one);  // 0/1
+    acc = _mm256_add_epi64(acc, _mm256_sad_epu8(m, zero));
+  }
+  alignas(32) uint64_t lanes[4];
+  _mm256_store_si256((__m256i *)lanes, acc);
+  cnt += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#elif defined(WS_AI_SIMD_SSE2)
+  const __m128i vbg = _mm_set1_epi8((char)bg), vthr = _mm_set1_epi8((char)thr);
+  const __m128i one = _mm_set1_epi8(1), zero = _mm_setzero_si128();
+  __m128i acc = zero;
+  for (; x + 16 <= n; x += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(s + x));
+    __m128i d = _mm_or_si128(_mm_subs_epu8(v, vbg), _mm_subs_epu8(vbg, v));
+    __m128i m = _mm_min_epu8(_mm_subs_epu8(d, vthr), one);
+    acc = _mm_add_epi64(acc, _mm_sad_epu8(m, zero));
+  }
+  alignas(16) uint64_t lanes[2];
+  _mm_store_si128((__m128i *)lanes, acc);
+  cnt += lanes[0] + lanes[1];
+#elif defined(WS_AI_SIMD_NEON)
+  const uint8x16_t vbg = vdupq_n_u8(bg), vthr = vdupq_n_u8(thr);
+  uint64x2_t acc = vdupq_n_u64(0);
+  for (; x + 16 <= n; x += 16) {
+    uint8x16_t d = vabdq_u8(vld1q_u8(s + x), vbg);
+    uint8x16_t m = vshrq_n_u8(vcgtq_u8(d, vthr), 7);
+    acc = vpadalq_u32(acc, vpaddlq_u16(vpaddlq_u8(m)));
+  }
+  cnt += vgetq_lane_u64(acc, 0) + vgetq_lane_u64(acc, 1);
+#else
+  (void)s; (void)n; (void)bg; (void)thr; (void)cnt;
+#endif
+  return x;
+}
+
+static int count_ink(const uint8_t *s, int n, uint8_t bg, uint8_t thr) {
+  uint64_t cnt = 0;
+  int x = use_simd() ? count_ink_simd(s, n, bg, thr, cnt) : 0;
+  for (; x < n; ++x) cnt += (std::abs((int)s[x] - (int)bg) > thr);
+  return (int)cnt;
+}
+
+// 直方图本身不好向量化：4 份子直方图交错写，打断 store-to-load 依赖
+static void histogram(const GrayImage &img, uint32_t hist[256]) {
+  uint32_t h[4][256] = {};
+  const uint8_t *p = img.pixels.data();
+  const size_t n = img.pixels.size();
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    h[0][p[i]]++; h[1][p[i + 1]]++; h[2][p[i + 2]]++; h[3][p[i + 3]]++;
+  }
+  for (; i < n; ++i) h[0][p[i]]++;
+  for (int v = 0; v < 256; ++v) hist[v] = h[0][v] + h[1][v] + h[2][v] + h[3][v];
+}
+
+// -------------------------
+// public
+// -------------------------
+void rgba_to_luma(const uint8_t *rgba, int width, int height, size_t stride, bool bgr, GrayImage &out) {
+  out.width = width;
+  out.height = height;
+  out.pixels.resize((size_t)width * (size_t)height);
+  for (int y = 0; y < height; ++y) {
+    const uint8_t *s = rgba + (size_t)y * stride;
+    uint8_t *d = out.row(y);
+    int x = use_simd() ? luma_row_simd(s, d, width, bgr) : 0;
+    luma_row_scalar(s + 4 * x, d + x, width - x, bgr);
+  }
+}
+
+bool autocontrast(GrayImage &img, float cutoff_percent) {
+  if (img.empty()) return false;
+  uint32_t hist[256];
+  histogram(img, hist);
+
+  const uint64_t total = img.pixels.size();
+  const uint64_t cut = (uint64_t)(total * std::max(0.0f, cutoff_percent) / 100.0f);
+  int lo = 0, hi = 255;
+  for (uint64_t acc = 0; lo < 255; ++lo) {
+    acc += hist[lo];
+    if (acc > cut) break;
+  }
+  for (uint64_t acc = 0; hi > 0; --hi) {
+    acc += hist[hi];
+    if (acc > cut) break;
+  }
+  if (hi <= lo || (lo == 0 && hi == 255)) return false;
+
+  const float scale = 255.0f / (float)(hi - lo);
+  apply_affine(img, scale, -lo * scale);
+  return true;
+}
+
+void enhance_contrast(GrayImage &img, float factor) {
+  if (img.empty() || factor == 1.0f) return;
+  uint32_t hist[256];
+  histogram(img, hist);
+  uint64_t sum = 0;
+  for (int v = 0; v < 256; ++v) sum += (uint64_t)hist[v] * (uint64_t)v;
+  const float mean = std::floor((double)sum / (double)img.pixels.size() + 0.5);
+  // PIL: blend(灰色均值图, img, factor) = mean + factor * (v - mean)
+  apply_affine(img, factor, mean * (1.0f - factor));
+}
+
+void downscale_area(const GrayImage &in, int out_w, int out_h, GrayImage &out) {
+  out_w = std::max(1, std::min(out_w, in.width));
+  out_h = std::max(1, std::min(out_h, in.height));
+  GrayImage res;
+  res.width = out_w;
+  res.height = out_h;
+  res.pixels.resize((size_t)out_w * (size_t)out_h);
+
+  const double sx = (double)in.width / out_w, sy = (double)in.height / out_h;
+
+  // 每个输出列覆盖的输入区间 [x0, x1) 以及首尾两列的覆盖比例
+  struct Span { int x0, x1; float w0, w1; };
+  std::vector<Span> spans((size_t)out_w);
+  for (int ox = 0; ox < out_w; ++ox) {
+    const double a = ox * sx, b = (ox + 1) * sx;
+    Span sp;
+    sp.x0 = (int)a;
+    sp.x1 = std::min(in.width, (int)std::ceil(b - 1e-9));
+    sp.w0 = (float)(std::min(b, (double)sp.x0 + 1) - a);
+    sp.w1 = (float)(b - std::max(a, (double)sp.x1 - 1));
+    spans[ox] = sp;
+  }
+
+  std::vector<float> acc((size_t)in.width);
+  const float inv_area = (float)(1.0 / (sx * sy));
+  for (int oy = 0; oy < out_h; ++oy) {
+    std::fill(acc.begin(), acc.end(), 0.0f);
+    const double a = oy * sy, b = (oy + 1) * sy;
+    const int y0 = (int)a, y1 = std::min(in.height, (int)std::ceil(b - 1e-9));
+    for (int y = y0; y < y1; ++y) {
+      const float w = (float)(std::min(b, (double)y + 1) - std::max(a, (double)y));
+      accum_row(in.row(y), w, acc.data(), in.width);
+    }
+
+    uint8_t *d = res.row(oy);
+    for (int ox = 0; ox < out_w; ++ox) {
+      const Span &sp = spans[ox];
+      float sum;
+      if (sp.x1 - sp.x0 == 1) {
+        sum = acc[sp.x0] * (float)sx;
+      } else {
+        sum = acc[sp.x0] * sp.w0 + acc[sp.x1 - 1] * sp.w1;
+        for (int x = sp.x0 + 1; x < sp.x1 - 1; ++x) sum += acc[x];
+      }
+      d[ox] = (uint8_t)std::min(255.0f, sum * inv_area + 0.5f);
+    }
+  }
+  out = std::move(res);
+}
+
+int estimate_text_height(const GrayImage &img) {
+  if (img.width < 16 || img.height < 16) return 0;
+
+  // 背景 = 直方图众数（截图里一般是纯色底）；离背景足够远的像素算“墨迹”
+  uint32_t hist[256];
+  histogram(img, hist);
+  const int bg = (int)(std::max_element(hist, hist + 256) - hist);
+  const uint8_t thr = 48;
+  const int min_ink = std::max(2, img.width / 200);
+
+  // 侧栏 / 深色面板会让每一行都有一截“墨迹”：减去各行墨迹数的低分位作为基线
+  std::vector<int> counts(img.height);
+  for (int y = 0; y < img.height; ++y) counts[y] = count_ink(img.row(y), img.width, (uint8_t)bg, thr);
+  std::vector<int> sorted = counts;
+  std::nth_element(sorted.begin(), sorted.begin() + sorted.size() / 10, sorted.end());
+  const int base = sorted[sorted.size() / 10];
+
+  std::vector<int> runs;
+  int run = 0;
+  for (int y = 0; y <= img.height; ++y) {
+    const bool ink = y < img.height && counts[y] - base >= min_ink;
+    if (ink) {
+      run++;
+    } else if (run > 0) {
+      if (run >= 4) runs.push_back(run);
+      run = 0;
+    }
+  }
+  if (runs.size() < 3) return 0;
+
+  // 中位数：图片/大标题这类离群行不影响
+  std::nth_element(runs.begin(), runs.begin() + runs.size() / 2, runs.end());
+  return runs[runs.size() / 2];
+}
+
+void preprocess_for_ocr(GrayImage &img, const PreprocOptions &opt) {
+  if (!opt.enabled || img.empty()) return;
+
+  autocontrast(img, opt.autocontrast_cutoff);
+  enhance_contrast(img, opt.contrast);
+
+  if (opt.target_text_px <= 0) return;
+  const int text_h = estimate_text_height(img);
+  if (text_h <= 0) return;
+  const double scale = (double)opt.target_text_px / text_h;
+  if (scale >= 0.9) return;  // 差不多大就别动了
+
+  GrayImage small;
+  downscale_area(img, (int)std::lround(img.width * scale), (int)std::lround(img.height * scale), small);
+  img = std::move(small);
+}
+
+} // namespace ws_ai
@@ -0,0 +1,328 @@
+#include "ws_ai/job_journal.h"
+#include "ws_ai/util.h"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace ws_ai {
+
+using Clock = std::chrono::steady_clock;
+
+static const char kMagic[4] = {'W', 'S', 'J', 'L'};
+static const uint32_t kVersion = 1;
+static constexpr size_t kFileHeader = 8;         // magic + version
+static constexpr size_t kRecordHeader = 9;       // len + crc + type
+static constexpr uint32_t kMaxRecord = 256u << 20;  // 再大就是坏数据
+
+static uint32_t crc32_update(uint32_t crc, const void *data, size_t n) {
+    static const auto table = [] {
+        std::array<uint32_t, 256> t{};
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            t[i] = c;
+        }
+        return t;
+    }();
+    const uint8_t *p = static_cast<const uint8_t *>(data);
+    crc = ~crc;
+    for (size_t i = 0; i < n; ++i) crc = table[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+static bool write_all(int fd, const char *p, size_t n) {
+    while (n > 0) {
+        const ssize_t w = ::write(fd, p, n);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        p += w;
+        n -= (size_t)w;
+    }
+    return true;
+}
+
+// macOS 没有 fdatasync（F_FULLFSYNC 连磁盘缓存一起刷，慢一个数量级，这里不用）
+static bool sync_fd(int fd) {
+#ifdef __APPLE__
+    return ::fsync(fd) == 0;
+#else
+    return ::fdatasync(fd) == 0;
+#endif
+}
+
+JobJournal::JobJournal(const Config &cfg)
+: dir_(cfg.job_dir), path_(cfg.job_dir + "/journal.log"), enabled_(cfg.journal),
+  compact_bytes_((uint64_t)std::max(1, cfg.journal_compact_mb) << 20) {
+    if (!enabled_) return;
+    std::error_code ec;
+    fs::create_directories(dir_, ec);
+    if (ec) {
+        std::cerr << "[journal] 创建目录失败 " << dir_ << ": " << ec.message() << "，重启后任务不会恢复\n";
+        enabled_ = false;
+        return;
+    }
+    const std::string lock_path = dir_ + "/journal.lock";
+    lock_fd_ = ::open(lock_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (lock_fd_ < 0 || ::flock(lock_fd_, LOCK_EX | LOCK_NB) != 0) {
+        std::cerr << "[journal] " << dir_ << " 的日志已被另一个进程占用，本进程不记日志（换一个 WS_AI_JOB_DIR）\n";
+        if (lock_fd_ >= 0) ::close(lock_fd_);
+        lock_fd_ = -1;
+        enabled_ = false;
+    }
+}
+
+JobJournal::~JobJournal() {
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    if (writer_.joinable()) writer_.join();
+    if (fd_ >= 0) ::close(fd_);
+    if (lock_fd_ >= 0) ::close(lock_fd_);
+}
+
+void JobJournal::encode(std::string &out, char type, const std::string &payload) {
+    const uint32_t len = (uint32_t)payload.size();
+    uint32_t crc = crc32_update(0, &type, 1);
+    crc = crc32_update(crc, payload.data(), payload.size());
+    out.append(reinterpret_cast<const char *>(&len), 4);
+    out.append(reinterpret_cast<const char *>(&crc), 4);
+    out.push_back(type);
+    out += payload;
+}
+
+bool JobJournal::replay(const std::function<void(char, const std::string &)> &fn, ReplayStats &st, std::string &err) {
+    st = ReplayStats{};
+    if (!enabled_) return true;
+    const auto t0 = Clock::now();
+    std::string data;
+    if (!read_file_binary(path_, data) || data.empty()) return true;
+
+    uint32_t version = 0;
+    if (data.size() >= kFileHeader) std::memcpy(&version, data.data() + 4, 4);
+    if (data.size() < kFileHeader || std::memcmp(data.data(), kMagic, 4) != 0 || version != kVersion) {
+        std::error_code ec;
+        fs::rename(path_, path_ + ".bad", ec);
+        err = "日志文件头不对，已改名为 " + path_ + ".bad";
+        return false;
+    }
+
+    size_t pos = kFileHeader;
+    std::string payload;
+    while (pos + kRecordHeader <= data.size()) {
+        uint32_t len = 0, crc = 0;
+        std::memcpy(&len, data.data() + pos, 4);
+        std::memcpy(&crc, data.data() + pos + 4, 4);
+        if (len > kMaxRecord || pos + kRecordHeader + len > data.size()) break;
+        const char type = data[pos + 8];
+        const char *p = data.data() + pos + kRecordHeader;
+        if (crc32_update(crc32_update(0, &type, 1), p, len) != crc) break;
+        payload.assign(p, len);
+        fn(type, payload);
+        st.records++;
+        pos += kRecordHeader + len;
+    }
+    st.bytes = pos;
+    st.dropped_bytes = data.size() - pos;
+    st.ms = std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+    std::lock_guard<std::mutex> lk(mu_);
+    replay_ = st;
+    return true;
+}
+
+bool JobJournal::start(SnapshotFn snapshot, std::string &err) {
+    if (!enabled_) return true;
+    snapshot_ = std::move(snapshot);
+    if (!compact(err)) {
+        fail(err);
+        return false;
+    }
+    writer_ = std::thread([this] { writer_loop(); });
+    return true;
+}
+
+bool JobJournal::open_append(std::string &err) {
+    fd_ = ::open(path_.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+    if (fd_ < 0) {
+        err = "打开日志失败 " + path_ + ": " + std::strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+bool JobJournal::compact(std::string &err) {
+    const auto t0 = Clock::now();
+    const std::string snap = snapshot_();
+    uint64_t covered;
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        covered = snapshot_seq_;
+    }
+
+    // 写临时文件再 rename：任何时刻磁盘上都是一份完整的日志（旧的或新的）
+    const std::string tmp = path_ + ".tmp";
+    const int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        err = "写日志快照失败 " + tmp + ": " + std::strerror(errno);
+        return false;
+    }
+    std::string head(kMagic, 4);
+    head.append(reinterpret_cast<const char *>(&kVersion), 4);
+    const bool ok = write_all(fd, head.data(), head.size()) && write_all(fd, snap.data(), snap.size()) && sync_fd(fd);
+    ::close(fd);
+    if (!ok || ::rename(tmp.c_str(), path_.c_str()) != 0) {
+        err = "写日志快照失败 " + tmp + ": " + std::strerror(errno);
+        ::unlink(tmp.c_str());
+        return false;
+    }
+    // rename 本身也要落盘
+    const int dfd = ::open(dir_.c_str(), O_RDONLY | O_CLOEXEC);
+    if (dfd >= 0) {
+        ::fsync(dfd);
+        ::close(dfd);
+    }
+
+    if (fd_ >= 0) ::close(fd_);
+    fd_ = -1;
+    if (!open_append(err)) return false;
+
+    const double ms = std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        durable_ = std::max(durable_, covered);
+        file_bytes_ = snapshot_bytes_ = head.size() + snap.size();
+        compactions_++;
+        compact_ms_ = ms;
+    }
+    durable_cv_.notify_all();
+    return true;
+}
+
+void JobJournal::writer_loop() {
+    std::string batch;
+    for (;;) {
+        uint64_t hi = 0, n = 0;
+        {
+            std::unique_lock<std::mutex> lk(mu_);
+            cv_.wait(lk, [&] { return stop_ || !buf_.empty(); });
+            if (buf_.empty()) return;  // 退出且已经写完
+            batch.swap(buf_);
+            buf_.clear();
+            n = buf_records_;
+            buf_records_ = 0;
+            hi = next_seq_ - 1;
+        }
+
+        const auto t0 = Clock::now();
+        if (!write_all(fd_, batch.data(), batch.size()) || !sync_fd(fd_)) {
+            fail(std::string("写日志失败: ") + std::strerror(errno));
+            return;
+        }
+        const double ms = std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+
+        bool need_compact;
+        {
+            std::lock_guard<std::mutex> lk(mu_);
+            durable_ = hi;
+            commits_++;
+            max_batch_ = std::max(max_batch_, n);
+            sync_ms_ += ms;
+            max_sync_ms_ = std::max(max_sync_ms_, ms);
+            file_bytes_ += batch.size();
+            // 存活任务本身就很多时快照也大：至少涨到上次快照的 2 倍才再压，不然每批都在压
+            need_compact = !stop_ && file_bytes_ > compact_bytes_ && file_bytes_ > 2 * snapshot_bytes_;
+        }
+        durable_cv_.notify_all();
+        batch.clear();
+
+        if (need_compact) {
+            std::string err;
+            if (!compact(err)) {
+                fail(err);
+                return;
+            }
+        }
+    }
+}
+
+void JobJournal::fail(const std::string &why) {
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        if (failed_) return;
+        failed_ = true;
+        buf_.clear();
+        buf_records_ = 0;
+    }
+    durable_cv_.notify_all();
+    std::cerr << "[journal] " << why << "，之后不再记日志（重启后最近的任务不会恢复）\n";
+}
+
+uint64_t JobJournal::append(char type, const std::string &payload) {
+    if (!enabled_) return 0;
+    uint64_t seq;
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        if (failed_) return 0;
+        encode(buf_, type, payload);
+        buf_records_++;
+        appended_++;
+        seq = next_seq_++;
+    }
+    cv_.notify_one();
+    return seq;
+}
+
+void JobJournal::wait_durable(uint64_t seq) {
+    if (seq == 0) return;
+    std::unique_lock<std::mutex> lk(mu_);
+    durable_cv_.wait(lk, [&] { return durable_ >= seq || failed_; });
+}
+
+uint64_t JobJournal::discard_pending() {
+    std::lock_guard<std::mutex> lk(mu_);
+    buf_.clear();
+    buf_records_ = 0;
+    snapshot_seq_ = next_seq_ - 1;
+    return snapshot_seq_;
+}
+
+std::string JobJournal::stats_json() const {
+    std::lock_guard<std::mutex> lk(mu_);
+    std::ostringstream oss;
+    oss << "{\"enabled\":" << (enabled_ && !failed_ ? "true" : "false")
+        << ",\"file_bytes\":" << file_bytes_
+        << ",\"snapshot_bytes\":" << snapshot_bytes_
+        << ",\"records\":" << appended_
+        << ",\"commits\":" << commits_
+        << std::fixed << std::setprecision(2)
+        << ",\"records_per_commit\":" << (commits_ ? (double)(appended_ - buf_records_) / commits_ : 0.0)
+        << ",\"max_batch\":" << max_batch_
+        << std::setprecision(3)
+        << ",\"sync_ms_avg\":" << (commits_ ? sync_ms_ / commits_ : 0.0)
+        << ",\"sync_ms_max\":" << max_sync_ms_
+        << ",\"compactions\":" << compactions_
+        << ",\"compact_ms\":" << compact_ms_
+        << ",\"replay\":{\"records\":" << replay_.records
+        << ",\"bytes\":" << replay_.bytes
+        << ",\"dropped_bytes\":" << replay_.dropped_bytes
+        << ",\"ms\":" << replay_.ms << "}}";
+    return oss.str();
+}
+
+} // namespace ws_ai
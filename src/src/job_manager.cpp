@@ -1,8 +1,18 @@
 #include "ws_ai/job_manager.h"
+#include "ws_ai/mock_pipeline.h"
+#include "ws_ai/model_registry.h"
+#include "ws_ai/ocr_vision.h"
 #include "ws_ai/pipeline.h" // 只放一个薄头，里面声明 make_pipeline
+#include "ws_ai/util.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
 #include <ctime>
 #include <iomanip>
+#include <iterator>
 #include <random>
 #include <sstream>
 #include <thread>
@@ -12,15 +22,329 @@ namespace ws_ai {
 // 把 Pipeline 工厂声明放到单独头里更干净；这里直接 include 也行
 // std::unique_ptr<Pipeline> make_pipeline(const Config &cfg);
 
-JobManager::JobManager(Config cfg) : cfg_(std::move(cfg)) {
-    // 先做单 worker，稳定；需要并发再扩成线程池
-    worker_ = std::thread([this] { worker_loop(); });
+// 算指纹只需要很小的图：缩略图解码到 256 就够，比完整解码快得多
+static constexpr int kFingerprintDecodeSide = 256;
+
+// 语义缓存取相似度最高的几个：最像的那个可能换了模型或者没成功
+static constexpr int kSemanticTopK = 4;
+
+// ---- 任务日志的记录（job_journal.h） ----
+// 'J'：整个任务（提交、结束、压缩快照），回放时后来的覆盖先前的；'R'：开始执行，只有 id。
+// 字段按固定顺序、本机字节序排，前面带版本号，字段有增减时改版本
+static constexpr char kRecJob = 'J';
+static constexpr char kRecRunning = 'R';
+static constexpr uint32_t kJobRecordVersion = 1;
+
+template <class T>
+static void put(std::string &o, const T &v) {
+    o.append(reinterpret_cast<const char *>(&v), sizeof(T));
+}
+
+static void put_str(std::string &o, const std::string &s) {
+    put(o, (uint32_t)s.size());
+    o += s;
+}
+
+struct RecordReader {
+    const std::string &s;
+    size_t pos = 0;
+    bool ok = true;
+
+    template <class T>
+    T get() {
+        T v{};
+        if (!ok || pos + sizeof(T) > s.size()) {
+            ok = false;
+            return v;
+        }
+        std::memcpy(&v, s.data() + pos, sizeof(T));
+        pos += sizeof(T);
+        return v;
+    }
+    std::string str() {
+        const uint32_t n = get<uint32_t>();
+        if (!ok || pos + n > s.size()) {
+            ok = false;
+            return {};
+        }
+        std::string r = s.substr(pos, n);
+        pos += n;
+        return r;
+    }
+};
+
+// 不存 partial / trace / 排队时刻：恢复后没跑完的任务从头跑
+static void encode_job(const JobInfo &j, std::string &o) {
+    o.clear();
+    put(o, kJobRecordVersion);
+    put_str(o, j.id);
+    put_str(o, j.image_path);
+    put_str(o, j.model);
+    put(o, (int32_t)j.n_candidates);
+    put(o, (uint8_t)j.all_candidates);
+    put(o, (uint8_t)j.state);
+    put(o, (int32_t)j.progress);
+    put_str(o, j.result);
+    put_str(o, j.error);
+    put_str(o, j.ocr_text);
+    put(o, (uint8_t)j.has_fingerprint);
+    put(o, j.fingerprint.phash);
+    put(o, j.fingerprint.dhash);
+    put_str(o, j.dup_of);
+    put(o, (int32_t)j.dup_distance);
+    put(o, j.dup_similarity);
+    put_str(o, j.parent);
+    put_str(o, j.question);
+    put_str(o, j.transcript);
+    put(o, (int32_t)j.prompt_tokens);
+    put(o, j.ttft_ms);
+    put(o, j.restore_ms);
+    put(o, (uint8_t)j.kv_restored);
+    put_str(o, j.stop_reason);
+    put(o, (int32_t)j.gen_tokens);
+    put(o, (int32_t)j.tokens_saved);
+    put(o, (int32_t)j.tokens_cut);
+    put(o, (int64_t)std::chrono::duration_cast<std::chrono::milliseconds>(j.created_at.time_since_epoch()).count());
+    put(o, (int32_t)j.deadline_ms);
+    put(o, (uint32_t)j.degraded.size());
+    for (const auto &d : j.degraded) put_str(o, d);
+    put(o, (int32_t)j.max_new_tokens);
+    put(o, (int32_t)j.min_new_tokens);
+    put(o, j.elapsed_ms);
+    put(o, (uint32_t)j.candidates.size());
+    for (const auto &c : j.candidates) {
+        put_str(o, c.text);
+        put(o, c.score);
+        put(o, (int32_t)c.n_tokens);
+    }
+}
+
+static bool decode_job(const std::string &payload, JobInfo &j) {
+    RecordReader r{payload};
+    if (r.get<uint32_t>() != kJobRecordVersion) return false;
+    j.id = r.str();
+    j.image_path = r.str();
+    j.model = r.str();
+    j.n_candidates = r.get<int32_t>();
+    j.all_candidates = r.get<uint8_t>() != 0;
+    const uint8_t state = r.get<uint8_t>();
+    if (state > (uint8_t)JobState::error) return false;
+    j.state = (JobState)state;
+    j.progress = r.get<int32_t>();
+    j.result = r.str();
+    j.error = r.str();
+    j.ocr_text = r.str();
+    j.has_fingerprint = r.get<uint8_t>() != 0;
+    j.fingerprint.phash = r.get<uint64_t>();
+    j.fingerprint.dhash = r.get<uint64_t>();
+    j.dup_of = r.str();
+    j.dup_distance = r.get<int32_t>();
+    j.dup_similarity = r.get<float>();
+    j.parent = r.str();
+    j.question = r.str();
+    j.transcript = r.str();
+    j.prompt_tokens = r.get<int32_t>();
+    j.ttft_ms = r.get<double>();
+    j.restore_ms = r.get<double>();
+    j.kv_restored = r.get<uint8_t>() != 0;
+    j.stop_reason = r.str();
+    j.gen_tokens = r.get<int32_t>();
+    j.tokens_saved = r.get<int32_t>();
+    j.tokens_cut = r.get<int32_t>();
+    j.created_at = std::chrono::system_clock::time_point(std::chrono::milliseconds(r.get<int64_t>()));
+    j.deadline_ms = r.get<int32_t>();
+    const uint32_t n_degraded = r.get<uint32_t>();
+    for (uint32_t i = 0; r.ok && i < n_degraded; ++i) j.degraded.push_back(r.str());
+    j.max_new_tokens = r.get<int32_t>();
+    j.min_new_tokens = r.get<int32_t>();
+    j.elapsed_ms = r.get<double>();
+    const uint32_t n_cand = r.get<uint32_t>();
+    for (uint32_t i = 0; r.ok && i < n_cand; ++i) {
+        Candidate c;
+        c.text = r.str();
+        c.score = r.get<double>();
+        c.n_tokens = r.get<int32_t>();
+        j.candidates.push_back(std::move(c));
+    }
+    return r.ok && !j.id.empty();
+}
+
+JobManager::JobManager(Config cfg) : JobManager(std::move(cfg), nullptr) {}
+
+JobManager::JobManager(Config cfg, std::unique_ptr<Pipeline> pipeline)
+: cfg_(std::move(cfg)), plan_(make_thread_plan(cfg_, /*overlap_ocr*/ false)), planner_(cfg_), dedup_(cfg_.dedup_capacity),
+  semcache_(cfg_.semcache_threshold > 0 ? cfg_.semcache_capacity : 1), memory_(memory_budget_from_config(cfg_)), journal_(cfg_) {
+    models_ = std::make_shared<ModelRegistry>(cfg_);
+    if (pipeline) pipeline_ = std::move(pipeline);
+    else if (cfg_.pipeline == "mock") pipeline_ = make_mock_pipeline(cfg_);
+    else pipeline_ = make_pipeline(cfg_, models_);
+
+    // worker 起来之前把上次没跑完的任务放回队列
+    recover();
+
+    // 多个 worker 并发取任务；OCR / 生成的内存峰值由 memory_ 按预算兜住，放不下的在预订处排队
+    const int n = std::max(1, plan_.job_workers);
+    for (int i = 0; i < n; ++i) workers_.emplace_back([this] { worker_loop(); });
+    std::cout << "[memory] " << n << " job worker(s), task budget "
+              << (memory_.budget() ? std::to_string(memory_.budget() >> 20) + " MB" : std::string("unlimited")) << "\n";
 }
 
 JobManager::~JobManager() {
     stop_.store(true);
+    memory_.shutdown();  // 在预订处排队的 worker 直接失败退出
     cv_.notify_all();
-    if (worker_.joinable()) worker_.join();
+    stream_cv_.notify_all();
+    for (auto &w : workers_) {
+        if (w.joinable()) w.join();
+    }
+}
+
+void JobManager::recover() {
+    if (!journal_.enabled()) return;
+    std::unordered_map<std::string, JobInfo> jobs;
+    std::vector<std::string> order;  // 第一次出现的顺序 = 提交顺序
+    size_t bad = 0;
+    JobJournal::ReplayStats st;
+    std::string err;
+    const bool ok = journal_.replay(
+        [&](char type, const std::string &payload) {
+            if (type == kRecJob) {
+                JobInfo job;
+                if (!decode_job(payload, job)) {
+                    bad++;
+                    return;
+                }
+                auto it = jobs.find(job.id);
+                if (it == jobs.end()) {
+                    order.push_back(job.id);
+                    jobs.emplace(job.id, std::move(job));
+                } else {
+                    it->second = std::move(job);
+                }
+            } else if (type == kRecRunning) {
+                auto it = jobs.find(payload);
+                if (it != jobs.end()) it->second.state = JobState::running;
+            }
+        },
+        st, err);
+    if (!ok) std::cerr << "[journal] " << err << "\n";
+
+    {
+        std::lock_guard<StatMutex> lk(mu_);
+        const auto now = std::chrono::system_clock::now();
+        const auto cutoff = now - std::chrono::seconds(cfg_.journal_retain_sec);
+        std::error_code ec;
+        for (const auto &id : order) {
+            JobInfo &job = jobs[id];
+            // 停机前已经该过期、还没来得及压缩掉的，和在线时一样查不到
+            const bool finished = job.state == JobState::done || job.state == JobState::error;
+            if (finished && cfg_.journal_retain_sec > 0 && job.created_at < cutoff) {
+                expired_++;
+                continue;
+            }
+            if (job.state == JobState::queued || job.state == JobState::running) {
+                // 跑到一半的从头再跑；deadline 按提交时刻算，停机期间已经过了的直接失败
+                const double age_ms = std::chrono::duration<double, std::milli>(now - job.created_at).count();
+                job.state = JobState::queued;
+                job.progress = 0;
+                // 按 fd 提交的任务记的是 /proc/self/fd/N 这种路径的话，重启后 N 是别的文件了，不能拿来跑
+                if (job.parent.empty() && (job.image_path.rfind("/proc/self/fd/", 0) == 0 ||
+                                           job.image_path.rfind("/dev/fd/", 0) == 0)) {
+                    job.state = JobState::error;
+                    job.error = "image fd lost after restart";
+                } else if (job.parent.empty() && !std::filesystem::exists(job.image_path, ec)) {
+                    job.state = JobState::error;
+                    job.error = "image file missing after restart";
+                } else if (job.deadline_ms > 0 && age_ms >= job.deadline_ms) {
+                    job.state = JobState::error;
+                    job.error = "deadline passed while the server was down";
+                    job.elapsed_ms = age_ms;
+                } else if (job.deadline_ms > 0) {
+                    job.deadline = std::chrono::steady_clock::now() +
+                                   std::chrono::microseconds((int64_t)((job.deadline_ms - age_ms) * 1000));
+                }
+                if (job.state == JobState::error) {
+                    job.progress = 100;
+                } else {
+                    job.queued_us = trace_now_us();
+                    if (cfg_.trace) job.trace = std::make_shared<JobTrace>(job.id, cfg_.trace_decode_every);
+                    // 和 admit_locked 一样按 deadline 插队（前面的任务都已经在 jobs_ 里）
+                    queue_.insert(queue_position_locked(job), id);
+                    requeued_++;
+                }
+            }
+            if (job.state == JobState::done && job.has_fingerprint) {
+                dedup_.insert(job.fingerprint, id);
+            }
+            if (job.state == JobState::done || job.state == JobState::error) finished_.push_back(id);
+            jobs_.emplace(id, std::move(job));
+        }
+        recovered_ = jobs_.size();
+    }
+
+    // 用回放出来的状态压缩一次：坏掉的尾巴和重复的记录都不要了
+    if (!journal_.start([this] { return journal_snapshot(); }, err)) std::cerr << "[journal] " << err << "\n";
+    if (st.records > 0 || bad > 0) {
+        std::cout << "[journal] 回放 " << st.records << " 条记录（" << (st.bytes >> 10) << " KB，" << std::fixed
+                  << std::setprecision(1) << st.ms << " ms），恢复 " << recovered_ << " 个任务，重新排队 " << requeued_;
+        if (st.dropped_bytes > 0) std::cout << "，丢弃损坏的尾部 " << st.dropped_bytes << " 字节";
+        if (bad > 0) std::cout << "，" << bad << " 条无法解析";
+        std::cout << "\n";
+    }
+}
+
+std::string JobManager::journal_snapshot() {
+    std::string out, payload;
+    std::lock_guard<StatMutex> lk(mu_);
+    const auto cutoff = std::chrono::system_clock::now() - std::chrono::seconds(cfg_.journal_retain_sec);
+    // 已结束 / 在跑的先写，排队的最后按队列顺序写（回放时按第一次出现的顺序重新排队）
+    for (const auto &kv : jobs_) {
+        const JobInfo &job = kv.second;
+        if (job.state == JobState::queued) continue;
+        if (job.state != JobState::running && cfg_.journal_retain_sec > 0 && job.created_at < cutoff) continue;
+        encode_job(job, payload);
+        JobJournal::encode(out, kRecJob, payload);
+    }
+    for (const auto &id : queue_) {
+        auto it = jobs_.find(id);
+        if (it == jobs_.end()) continue;
+        encode_job(it->second, payload);
+        JobJournal::encode(out, kRecJob, payload);
+    }
+    journal_.discard_pending();
+    return out;
+}
+
+void JobManager::expire_locked(std::vector<std::string> &sem_out) {
+    if (cfg_.journal_retain_sec <= 0) return;
+    const auto cutoff = std::chrono::system_clock::now() - std::chrono::seconds(cfg_.journal_retain_sec);
+    // 按结束顺序删：先结束的不一定先提交，排在前面、还没到期的会让后面的晚删一会儿（最多一个任务的排队 + 运行时间）
+    while (!finished_.empty()) {
+        auto it = jobs_.find(finished_.front());
+        if (it != jobs_.end()) {
+            if (it->second.created_at >= cutoff) break;
+            if (it->second.state == JobState::done) {
+                if (it->second.has_fingerprint) dedup_.erase(it->second.fingerprint, it->first);
+                if (cfg_.semcache_threshold > 0) sem_out.push_back(it->first);
+            }
+            jobs_.erase(it);
+            expired_++;
+        }
+        finished_.pop_front();
+    }
+}
+
+void JobManager::expire_semantic(const std::vector<std::string> &ids) {
+    if (ids.empty()) return;
+    std::lock_guard<std::mutex> lk(sem_mu_);
+    semcache_.erase(ids);
+}
+
+uint64_t JobManager::journal_job_locked(const JobInfo &job) {
+    if (!journal_.enabled()) return 0;
+    std::string payload;
+    encode_job(job, payload);
+    return journal_.append(kRecJob, payload);
 }
 
 std::string JobManager::new_id() const {
@@ -44,53 +368,320 @@ const char *JobManager::state_to_cstr(JobState s) {
     return "unknown";
 }
 
-std::string JobManager::json_escape(const std::string &s) {
-    std::string o;
-    o.reserve(s.size() + 16);
-    for (unsigned char c : s) {
-        switch (c) {
-            case '\"': o += "\\\""; break;
-            case '\\': o += "\\\\"; break;
-            case '\b': o += "\\b"; break;
-            case '\f': o += "\\f"; break;
-            case '\n': o += "\\n"; break;
-            case '\r': o += "\\r"; break;
-            case '\t': o += "\\t"; break;
-            default:
-                if (c < 0x20) {
-                    char buf[8];
-                    std::snprintf(buf, sizeof(buf), "\\u%04x", (int)c);
-                    o += buf;
-                } else {
-                    o.push_back((char)c);
-                }
-        }
-    }
-    return o;
+bool JobManager::has_model(const std::string &model) const {
+    return models_->has(model);
+}
+
+std::string JobManager::get_models_json() const {
+    return models_->status_json();
 }
 
-std::string JobManager::submit_image(const std::string &image_path) {
+static double ms_until(std::chrono::steady_clock::time_point t) {
+    return std::chrono::duration<double, std::milli>(t - std::chrono::steady_clock::now()).count();
+}
+
+JobInfo JobManager::make_image_job(const std::string &image_path, const std::string &model,
+                                   int n_candidates, bool all_candidates, int deadline_ms) const {
     JobInfo job;
     job.id = new_id();
     job.image_path = image_path;
+    job.model = models_->resolve(model);
+    job.n_candidates = std::max(1, std::min(n_candidates, cfg_.max_candidates));
+    job.all_candidates = all_candidates && job.n_candidates > 1;
     job.state = JobState::queued;
     job.progress = 0;
     job.created_at = std::chrono::system_clock::now();
+    if (deadline_ms > 0) {
+        job.deadline_ms = deadline_ms;
+        job.deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(deadline_ms);
+    }
+    if (cfg_.trace) job.trace = std::make_shared<JobTrace>(job.id, cfg_.trace_decode_every);
+
+    // 解码 + 哈希不持锁
+    if (cfg_.dedup_max_distance >= 0) {
+        TraceSpan span(job.trace.get(), "fingerprint");
+        GrayImage small;
+        job.has_fingerprint = decode_image_luma(image_path, kFingerprintDecodeSide, small) &&
+                              compute_fingerprint(small, job.fingerprint);
+    }
+    return job;
+}
 
+bool JobManager::admit_locked(JobInfo &job) {
+    if (job.has_fingerprint && reuse_near_duplicate(job)) {
+        if (job.deadline_ms > 0) {
+            dl_jobs_++;
+            dl_met_++;
+        }
+        jobs_.emplace(job.id, job);
+        finished_.push_back(job.id);
+        return false;
+    }
+    job.queued_us = trace_now_us();
+    auto pos = queue_position_locked(job);
+    if (job.deadline_ms > 0) {
+        dl_jobs_++;
+        // 前面的任务按实测耗时排完、再用最省的跑法都来不及：直接失败，不进队列
+        std::string why;
+        if (planner_.hopeless(job.model, true, ms_until(job.deadline), (size_t)std::distance(queue_.begin(), pos),
+                              running_, workers_.size(), why)) {
+            job.state = JobState::error;
+            job.error = why;
+            job.progress = 100;
+            dl_rejected_++;
+            jobs_.emplace(job.id, job);
+            finished_.push_back(job.id);
+            return false;
+        }
+        if (pos != queue_.end()) {
+            job.degraded.push_back("priority");
+            dl_prioritized_++;
+        }
+    }
+    jobs_.emplace(job.id, job);
+    queue_.insert(pos, job.id);
+    return true;
+}
+
+std::deque<std::string>::iterator JobManager::queue_position_locked(const JobInfo &job) {
+    if (job.deadline_ms <= 0) return queue_.end();
+    for (auto it = queue_.begin(); it != queue_.end(); ++it) {
+        auto j = jobs_.find(*it);
+        if (j == jobs_.end()) continue;
+        if (j->second.deadline_ms <= 0 || j->second.deadline > job.deadline) return it;
+    }
+    return queue_.end();
+}
+
+bool JobManager::plan_deadline_locked(JobInfo &job) {
+    const double left = ms_until(job.deadline);
+    const DeadlinePlan p = planner_.plan(job.model, job.parent.empty(), left, job.parent.empty());
+    if (!p.feasible) {
+        job.state = JobState::error;
+        job.error = p.why;
+        job.progress = 100;
+        job.elapsed_ms = job.deadline_ms - left;
+        dl_rejected_++;
+        return false;
+    }
+    if (p.model != job.model) {
+        job.degraded.push_back("model=" + p.model);
+        job.model = p.model;
+        dl_switched_++;
+    }
+    if (p.max_new_tokens > 0) {
+        job.degraded.push_back("max_new_tokens=" + std::to_string(p.max_new_tokens));
+        job.max_new_tokens = p.max_new_tokens;
+        job.min_new_tokens = p.min_new_tokens;
+        dl_shrunk_++;
+    }
+    return true;
+}
+
+std::string JobManager::submit_image(const std::string &image_path, const std::string &model,
+                                     int n_candidates, bool all_candidates, int deadline_ms) {
+    const uint64_t t0 = trace_now_us();
+    JobInfo job = make_image_job(image_path, model, n_candidates, all_candidates, deadline_ms);
+    bool queued;
+    uint64_t seq;
+    {
+        std::lock_guard<StatMutex> lk(mu_);
+        queued = admit_locked(job);
+        seq = journal_job_locked(job);
+    }
+    if (queued) cv_.notify_one();
+    // 返回 id 之前等这条提交落盘（组提交，和同一时刻的其它提交共用一次 fsync）
+    if (cfg_.journal_sync) journal_.wait_durable(seq);
+    if (job.trace) {
+        job.trace->span("submit", t0, trace_now_us() - t0);
+        if (!queued) freeze_trace(job.id);
+    }
+    return job.id;
+}
+
+std::vector<std::string> JobManager::submit_images(const std::vector<std::string> &image_paths, const std::string &model) {
+    const uint64_t t0 = trace_now_us();
+    std::vector<JobInfo> jobs;
+    jobs.reserve(image_paths.size());
+    for (const auto &p : image_paths) jobs.push_back(make_image_job(p, model, 1, false));
+
+    std::vector<std::string> ids;
+    ids.reserve(jobs.size());
+    std::vector<bool> admitted(jobs.size());
+    size_t queued = 0;
+    uint64_t seq = 0;
     {
-        std::lock_guard<std::mutex> lk(mu_);
+        std::lock_guard<StatMutex> lk(mu_);
+        for (size_t i = 0; i < jobs.size(); ++i) {
+            admitted[i] = admit_locked(jobs[i]);
+            queued += admitted[i] ? 1 : 0;
+            seq = journal_job_locked(jobs[i]);
+            ids.push_back(jobs[i].id);
+        }
+    }
+    if (queued > 1) cv_.notify_all();
+    else if (queued == 1) cv_.notify_one();
+    if (cfg_.journal_sync) journal_.wait_durable(seq);
+    const uint64_t now = trace_now_us();
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        if (!jobs[i].trace) continue;
+        jobs[i].trace->span("submit", t0, now - t0, (int64_t)jobs.size());
+        if (!admitted[i]) freeze_trace(jobs[i].id);
+    }
+    return ids;
+}
+
+std::string JobManager::submit_followup(const std::string &parent_id, const std::string &question, std::string &err) {
+    JobInfo job;
+    job.id = new_id();
+    job.question = question;
+    job.state = JobState::queued;
+    job.created_at = std::chrono::system_clock::now();
+    if (cfg_.trace) job.trace = std::make_shared<JobTrace>(job.id, cfg_.trace_decode_every);
+    uint64_t seq;
+    {
+        std::lock_guard<StatMutex> lk(mu_);
+        auto it = jobs_.find(parent_id);
+        if (it == jobs_.end()) {
+            err = "not found";
+            return "";
+        }
+        if (it->second.state != JobState::done) {
+            err = "job not done";
+            return "";
+        }
+        // 近重复复用的任务没有自己的 KV 状态，用被复用那个任务的
+        job.parent = it->second.dup_of.empty() ? parent_id : it->second.dup_of;
+        job.model = it->second.model;
+        job.ocr_text = it->second.ocr_text;
+        job.transcript = it->second.transcript;
+        job.queued_us = trace_now_us();
         jobs_.emplace(job.id, job);
-        queue_.push(job.id);
+        queue_.push_back(job.id);
+        seq = journal_job_locked(job);
     }
     cv_.notify_one();
+    if (cfg_.journal_sync) journal_.wait_durable(seq);
     return job.id;
 }
 
+void JobManager::freeze_trace(const std::string &id) {
+    std::lock_guard<StatMutex> lk(mu_);
+    auto it = jobs_.find(id);
+    if (it != jobs_.end() && it->second.trace) it->second.trace = it->second.trace->frozen();
+}
+
+// 调用方持 mu_。命中同模型、已完成的近重复任务时把结果拷过来
+bool JobManager::reuse_near_duplicate(JobInfo &job) {
+    dedup_lookups_++;
+    auto m = dedup_.find(job.fingerprint, cfg_.dedup_max_distance);
+    if (!m) return false;
+
+    auto it = jobs_.find(m->key);
+    if (it == jobs_.end() || it->second.state != JobState::done || it->second.model != job.model) return false;
+
+    const JobInfo &src = it->second;
+    job.state = JobState::done;
+    job.progress = 100;
+    job.result = src.result;
+    job.ocr_text = src.ocr_text;
+    job.transcript = src.transcript;
+    job.candidates = src.candidates;
+    job.dup_of = src.dup_of.empty() ? src.id : src.dup_of;
+    job.dup_distance = m->distance;
+    dedup_hits_++;
+    return true;
+}
+
+bool JobManager::find_semantic_match(const std::string &model, const std::vector<float> &embedding, std::string &src,
+                                     float &score, std::string &result) {
+    std::vector<EmbeddingIndex::Match> ms;
+    {
+        std::lock_guard<std::mutex> lk(sem_mu_);
+        const auto t0 = std::chrono::steady_clock::now();
+        ms = semcache_.top_k(embedding, kSemanticTopK, cfg_.semcache_threshold);
+        const double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
+        sem_lookups_++;
+        sem_lookup_us_ += us;
+        sem_lookup_max_us_ = std::max(sem_lookup_max_us_, us);
+    }
+    if (ms.empty()) return false;
+
+    bool hit = false;
+    {
+        std::lock_guard<StatMutex> lk(mu_);
+        for (const auto &m : ms) {
+            auto it = jobs_.find(m.key);
+            if (it == jobs_.end() || it->second.state != JobState::done || it->second.model != model) continue;
+            src = it->second.dup_of.empty() ? it->second.id : it->second.dup_of;
+            score = m.score;
+            result = it->second.result;
+            hit = true;
+            break;
+        }
+    }
+    if (hit) {
+        std::lock_guard<std::mutex> lk(sem_mu_);
+        sem_hits_++;
+    }
+    return hit;
+}
+
+std::string JobManager::get_dedup_json() const {
+    std::ostringstream oss;
+    {
+        std::lock_guard<StatMutex> lk(mu_);
+        oss << "{\"ok\":true"
+            << ",\"enabled\":" << (cfg_.dedup_max_distance >= 0 ? "true" : "false")
+            << ",\"max_distance\":" << cfg_.dedup_max_distance
+            << ",\"entries\":" << dedup_.size()
+            << ",\"capacity\":" << dedup_.capacity()
+            << ",\"index_bytes\":" << dedup_.memory_bytes()
+            << ",\"lookups\":" << dedup_lookups_
+            << ",\"hits\":" << dedup_hits_;
+    }
+
+    // 语义缓存：embedder 是向量从哪来（mock 流水线固定 ngram）
+    const std::string embedder = cfg_.pipeline == "mock" ? "ngram" : cfg_.embed_model.empty() ? "job_model" : cfg_.embed_model;
+    std::lock_guard<std::mutex> lk(sem_mu_);
+    oss << ",\"semantic\":{\"enabled\":" << (cfg_.semcache_threshold > 0 ? "true" : "false")
+        << ",\"threshold\":" << cfg_.semcache_threshold
+        << ",\"embedder\":\"" << json_escape(embedder) << "\""
+        << ",\"backend\":\"" << embed_backend() << "\""
+        << ",\"dim\":" << semcache_.dim()
+        << ",\"entries\":" << semcache_.size()
+        << ",\"capacity\":" << semcache_.capacity()
+        << ",\"index_bytes\":" << semcache_.memory_bytes()
+        << ",\"lookups\":" << sem_lookups_
+        << ",\"hits\":" << sem_hits_
+        << std::fixed << std::setprecision(3)
+        << ",\"hit_rate\":" << (sem_lookups_ ? (double)sem_hits_ / sem_lookups_ : 0.0)
+        << std::setprecision(1)
+        << ",\"lookup_us_avg\":" << (sem_lookups_ ? sem_lookup_us_ / sem_lookups_ : 0.0)
+        << ",\"lookup_us_max\":" << sem_lookup_max_us_
+        << "}}";
+    return oss.str();
+}
+
+std::string JobManager::get_trace_json(const std::string &id) const {
+    std::shared_ptr<JobTrace> t;
+    {
+        std::lock_guard<StatMutex> lk(mu_);
+        auto it = jobs_.find(id);
+        if (it != jobs_.end()) t = it->second.trace;
+    }
+    return t ? t->chrome_json() : std::string();
+}
+
+std::string JobManager::get_global_trace_json() const {
+    return global_trace_json();
+}
+
 std::string JobManager::get_status_json(const std::string &id) const {
     JobInfo job;
     bool found = false;
     {
-        std::lock_guard<std::mutex> lk(mu_);
+        std::lock_guard<StatMutex> lk(mu_);
         auto it = jobs_.find(id);
         if (it != jobs_.end()) {
             job = it->second; // 拷贝一份，避免锁持有太久
@@ -101,59 +692,327 @@ std::string JobManager::get_status_json(const std::string &id) const {
     if (!found) {
         return "{\"ok\":false,\"error\":\"not found\"}";
     }
+    return status_json(job);
+}
 
+std::string JobManager::status_json(const JobInfo &job) const {
     std::ostringstream oss;
     oss << "{"
         << "\"ok\":true,"
         << "\"id\":\"" << json_escape(job.id) << "\","
         << "\"state\":\"" << state_to_cstr(job.state) << "\","
+        << "\"model\":\"" << json_escape(job.model) << "\","
         << "\"progress\":" << job.progress << ",";
 
+    if (job.deadline_ms > 0) {
+        oss << "\"deadline_ms\":" << job.deadline_ms << ",";
+        if (!job.degraded.empty()) {
+            oss << "\"degraded\":[";
+            for (size_t i = 0; i < job.degraded.size(); ++i) {
+                oss << (i ? "," : "") << "\"" << json_escape(job.degraded[i]) << "\"";
+            }
+            oss << "],";
+        }
+        if (job.state == JobState::done || job.state == JobState::error) {
+            const bool met = job.state == JobState::done && job.elapsed_ms <= job.deadline_ms;
+            oss << "\"elapsed_ms\":" << std::fixed << std::setprecision(1) << job.elapsed_ms << ","
+                << "\"deadline_met\":" << (met ? "true" : "false") << ",";
+        }
+    }
+
+    if (!job.dup_of.empty()) {
+        oss << "\"dup_of\":\"" << json_escape(job.dup_of) << "\",";
+        if (job.dup_similarity > 0) {
+            oss << "\"dup_similarity\":" << std::fixed << std::setprecision(3) << job.dup_similarity << ",";
+        } else {
+            oss << "\"dup_distance\":" << job.dup_distance << ",";
+        }
+    }
+    if (!job.parent.empty()) {
+        oss << "\"parent\":\"" << json_escape(job.parent) << "\","
+            << "\"question\":\"" << json_escape(job.question) << "\","
+            << "\"kv_restored\":" << (job.kv_restored ? "true" : "false") << ",";
+    }
+    if (job.ttft_ms > 0) {
+        oss << "\"prompt_tokens\":" << job.prompt_tokens << ","
+            << "\"ttft_ms\":" << std::fixed << std::setprecision(1) << job.ttft_ms << ",";
+        if (job.kv_restored) oss << "\"restore_ms\":" << job.restore_ms << ",";
+    }
+
+    if (job.state == JobState::done && !job.stop_reason.empty()) {
+        oss << "\"gen_tokens\":" << job.gen_tokens << ","
+            << "\"stop_reason\":\"" << job.stop_reason << "\","
+            << "\"tokens_saved\":" << job.tokens_saved << ","
+            << "\"tokens_cut\":" << job.tokens_cut << ",";
+    }
+    if (job.state == JobState::done && !job.candidates.empty()) {
+        oss << "\"n_candidates\":" << job.candidates.size() << ","
+            << "\"score\":" << std::fixed << std::setprecision(3) << job.candidates.front().score << ",";
+        if (job.all_candidates) {
+            oss << "\"candidates\":[";
+            for (size_t i = 0; i < job.candidates.size(); ++i) {
+                const Candidate &c = job.candidates[i];
+                oss << (i ? "," : "") << "{\"score\":" << c.score << ",\"tokens\":" << c.n_tokens
+                    << ",\"text\":\"" << json_escape(c.text) << "\"}";
+            }
+            oss << "],";
+        }
+    }
+
     if (job.state == JobState::done) {
-        oss << "\"result\":\"" << json_escape(job.result) << "\"";
+        oss << "\"ocr\":\"" << json_escape(job.ocr_text) << "\","
+            << "\"result\":\"" << json_escape(job.result) << "\"";
     } else if (job.state == JobState::error) {
         oss << "\"error\":\"" << json_escape(job.error) << "\"";
     } else {
-        oss << "\"result\":\"\"";
+        oss << "\"partial\":\"" << json_escape(job.partial) << "\","
+            << "\"result\":\"\"";
     }
     oss << "}";
     return oss.str();
 }
 
+StreamEvent JobManager::wait_stream(const std::string &id, size_t &offset, std::string &chunk, int timeout_ms) const {
+    std::unique_lock<StatMutex> lk(mu_);
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    for (;;) {
+        auto it = jobs_.find(id);
+        if (it == jobs_.end()) return StreamEvent::not_found;
+        const JobInfo &job = it->second;
+
+        // 先把还没发出去的 partial 发完，再报结束
+        if (job.partial.size() > offset) {
+            chunk = job.partial.substr(offset);
+            offset = job.partial.size();
+            return StreamEvent::delta;
+        }
+        if (job.state == JobState::done || job.state == JobState::error) {
+            chunk = status_json(job);
+            return job.state == JobState::done ? StreamEvent::done : StreamEvent::error;
+        }
+        if (stop_.load()) return StreamEvent::timeout;
+        if (stream_cv_.wait_until(lk, deadline) == std::cv_status::timeout) return StreamEvent::timeout;
+    }
+}
+
+bool JobManager::stream_snapshot(const std::string &id, size_t from, StreamSnapshot &out) const {
+    std::lock_guard<StatMutex> lk(mu_);
+    auto it = jobs_.find(id);
+    if (it == jobs_.end()) return false;
+    const JobInfo &job = it->second;
+    out.from = std::min(from, job.partial.size());
+    out.text = job.partial.substr(out.from);
+    out.progress = job.progress;
+    out.state = job.state;
+    out.final_json.clear();
+    if (job.state == JobState::done || job.state == JobState::error) out.final_json = status_json(job);
+    return true;
+}
+
+void JobManager::set_update_listener(UpdateListener fn) {
+    std::lock_guard<std::mutex> lk(listener_mu_);
+    listener_ = std::move(fn);
+}
+
+void JobManager::notify_update(const std::string &id) {
+    stream_cv_.notify_all();
+    std::lock_guard<std::mutex> lk(listener_mu_);
+    if (listener_) listener_(id);
+}
+
+std::string JobManager::get_stats_json() const {
+    size_t n_jobs = 0, n_queued = 0, n_running = 0, early_stops = 0;
+    uint64_t tokens_saved = 0, tokens_cut = 0;
+    std::ostringstream dl;
+    std::string journal_json = journal_.stats_json();
+    {
+        std::lock_guard<StatMutex> lk(mu_);
+        journal_json.insert(journal_json.size() - 1, ",\"recovered\":" + std::to_string(recovered_) +
+                                                         ",\"requeued\":" + std::to_string(requeued_) +
+                                                         ",\"expired\":" + std::to_string(expired_));
+        dl << "{\"jobs\":" << dl_jobs_
+           << ",\"met\":" << dl_met_
+           << ",\"missed\":" << dl_missed_
+           << ",\"rejected\":" << dl_rejected_
+           << ",\"prioritized\":" << dl_prioritized_
+           << ",\"shrunk\":" << dl_shrunk_
+           << ",\"model_switched\":" << dl_switched_
+           << ",\"rates\":" << planner_.rates_json() << "}";
+        n_jobs = jobs_.size();
+        early_stops = early_stops_;
+        tokens_saved = tokens_saved_;
+        tokens_cut = tokens_cut_;
+        n_queued = queue_.size();
+        for (const auto &kv : jobs_) n_running += kv.second.state == JobState::running ? 1 : 0;
+    }
+    const StatMutex::Stats ls = mu_.stats();
+
+    std::ostringstream oss;
+    oss << "{\"ok\":true"
+        << ",\"pipeline\":\"" << json_escape(cfg_.pipeline) << "\""
+        << ",\"job_workers\":" << workers_.size()
+        << ",\"jobs\":" << n_jobs
+        << ",\"queued\":" << n_queued
+        << ",\"running\":" << n_running
+        << ",\"early_stop\":{\"jobs\":" << early_stops
+        << ",\"tokens_saved\":" << tokens_saved
+        << ",\"tokens_cut\":" << tokens_cut << "}"
+        << ",\"deadline\":" << dl.str()
+        << ",\"journal\":" << journal_json
+        << ",\"memory\":{\"budget_bytes\":" << memory_.budget()
+        << ",\"reserved_bytes\":" << memory_.reserved() << "}"
+        << ",\"lock\":{\"acquisitions\":" << ls.acquisitions
+        << ",\"contended\":" << ls.contended
+        << ",\"wait_ms\":" << std::fixed << std::setprecision(3) << ls.wait_ns / 1e6
+        << ",\"max_wait_us\":" << ls.max_wait_ns / 1e3
+        << "}}";
+    return oss.str();
+}
+
+std::string JobManager::get_progress_json(const std::vector<std::string> &ids) const {
+    std::lock_guard<StatMutex> lk(mu_);
+    size_t n_running = 0;
+    for (const auto &kv : jobs_) n_running += kv.second.state == JobState::running ? 1 : 0;
+
+    std::ostringstream oss;
+    oss << "{\"ok\":true,\"queued\":" << queue_.size() << ",\"running\":" << n_running << ",\"jobs\":[";
+    for (size_t i = 0; i < ids.size(); ++i) {
+        oss << (i ? "," : "") << "{\"id\":\"" << json_escape(ids[i]) << "\"";
+        auto it = jobs_.find(ids[i]);
+        if (it == jobs_.end()) {
+            oss << ",\"state\":\"not_found\"}";
+            continue;
+        }
+        const JobInfo &job = it->second;
+        oss << ",\"state\":\"" << state_to_cstr(job.state) << "\""
+            << ",\"progress\":" << job.progress
+            << ",\"gen_tokens\":" << job.gen_tokens << "}";
+    }
+    oss << "]}";
+    return oss.str();
+}
+
+std::string JobManager::get_memory_json() const {
+    return memory_.status_json();
+}
+
 void JobManager::worker_loop() {
+    // worker 里创建的 llama context 的计算线程会继承这里的亲和性
+    pin_current_thread(plan_, ThreadRole::llm);
+
     // 每次循环只取一个任务执行
     while (!stop_.load()) {
         std::string id;
+        bool rejected = false;
+        std::vector<std::string> expired;
         {
-            std::unique_lock<std::mutex> lk(mu_);
-            cv_.wait(lk, [&] { return stop_.load() || !queue_.empty(); });
+            std::unique_lock<StatMutex> lk(mu_);
+            // 空闲时每秒醒一次清掉过期的任务；语义缓存有自己的锁，放开 mu_ 再删
+            while (!cv_.wait_for(lk, std::chrono::seconds(1), [&] { return stop_.load() || !queue_.empty(); })) {
+                expire_locked(expired);
+                if (expired.empty()) continue;
+                lk.unlock();
+                expire_semantic(expired);
+                expired.clear();
+                lk.lock();
+            }
             if (stop_.load()) break;
             id = queue_.front();
-            queue_.pop();
+            queue_.pop_front();
 
             auto it = jobs_.find(id);
             if (it == jobs_.end()) continue;
-            it->second.state = JobState::running;
-            it->second.progress = 5;
+            expire_locked(expired);
+            // 有 deadline 的任务这时才定计划：排队等了多久已经知道了
+            rejected = it->second.deadline_ms > 0 && !plan_deadline_locked(it->second);
+            if (!rejected) {
+                it->second.state = JobState::running;
+                it->second.progress = 5;
+                running_++;
+                journal_.append(kRecRunning, id);
+            } else {
+                journal_job_locked(it->second);
+                finished_.push_back(id);
+                if (it->second.trace) it->second.trace = it->second.trace->frozen();
+            }
         }
+        expire_semantic(expired);
+        notify_update(id);
+        if (rejected) continue;
+        const auto t_run = std::chrono::steady_clock::now();
 
         // 任务执行（不持锁）
         std::atomic<int> progress{5};
         std::atomic<bool> cancel{false};
         std::string err;
 
-        std::unique_ptr<Pipeline> pipe = make_pipeline(cfg_);
-        std::string result = pipe->run(
-            /*image_path*/[&]{
-                std::lock_guard<std::mutex> lk(mu_);
-                return jobs_[id].image_path;
-            }(),
-            progress, cancel, err
-        );
+        JobOptions opts;
+        RunStats stats;
+        std::string image_path;
+        FollowupRequest freq;
+        std::shared_ptr<JobTrace> trace;
+        {
+            std::lock_guard<StatMutex> lk(mu_);
+            const JobInfo &job = jobs_[id];
+            image_path = job.image_path;
+            freq.parent_id = job.parent;
+            freq.question = job.question;
+            freq.transcript = job.transcript;
+            opts.job_id = id;
+            opts.model = job.model;
+            opts.n_candidates = job.n_candidates;
+            opts.max_new_tokens = job.max_new_tokens;
+            opts.min_new_tokens = job.min_new_tokens;
+            trace = job.trace;
+            if (trace) {
+                const uint64_t now = trace_now_us();
+                trace->span("queue", job.queued_us, now - job.queued_us);
+            }
+        }
+        std::string ocr_text;
+        opts.on_ocr = [&](const std::string &t) { ocr_text = t; };
+        // 语义缓存：新图片任务才查（追问没有 OCR）；没命中的向量等任务成功后再放进索引
+        std::vector<float> embedding;
+        std::string sem_src;
+        float sem_score = 0;
+        if (cfg_.semcache_threshold > 0 && freq.parent_id.empty()) {
+            opts.on_embedding = [&](const std::vector<float> &e, std::string &cached) {
+                embedding = e;
+                return find_semantic_match(opts.model, e, sem_src, sem_score, cached);
+            };
+        }
+        opts.on_delta = [&](const std::string &piece) {
+            {
+                std::lock_guard<StatMutex> lk(mu_);
+                auto it = jobs_.find(id);
+                if (it == jobs_.end()) return;
+                it->second.partial += piece;
+                it->second.progress = std::max(it->second.progress, std::min(100, progress.load()));
+            }
+            notify_update(id);
+        };
+        opts.trace = trace.get();
+        opts.stats = &stats;
+        opts.memory = &memory_;
+
+        // pipeline 只建一次：模型常驻在 registry 里，不再每个 job 重新加载
+        std::string result;
+        {
+            TraceSpan span(trace.get(), "run");
+            if (freq.parent_id.empty()) result = pipeline_->run(image_path, opts, progress, cancel, err);
+            else result = pipeline_->followup(freq, opts, progress, cancel, err);
+        }
 
         // 写回结果
         {
-            std::lock_guard<std::mutex> lk(mu_);
+            TraceSpan span(trace.get(), "writeback");
+            std::lock_guard<StatMutex> lk(mu_);
+            running_--;
+            // 实测速率：多候选一起 decode 的速率和单条不一样，缓存命中没有生成，都不算
+            if (err.empty() && sem_src.empty() && opts.n_candidates == 1) {
+                const double run_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t_run).count();
+                planner_.observe(opts.model, stats.ocr_ms, stats.ttft_ms, stats.gen_tokens, stats.decode_ms, run_ms);
+            }
             auto it = jobs_.find(id);
             if (it == jobs_.end()) continue;
 
@@ -168,8 +1027,49 @@ void JobManager::worker_loop() {
                 it->second.state = JobState::done;
                 it->second.result = result;
                 it->second.progress = 100;
+                if (it->second.has_fingerprint) dedup_.insert(it->second.fingerprint, id);
+            }
+            if (freq.parent_id.empty()) it->second.ocr_text = std::move(ocr_text);
+            it->second.transcript = std::move(stats.transcript);
+            it->second.prompt_tokens = stats.prompt_tokens;
+            it->second.ttft_ms = stats.ttft_ms;
+            it->second.restore_ms = stats.restore_ms;
+            it->second.kv_restored = stats.kv_restored;
+            it->second.candidates = std::move(stats.candidates);
+            it->second.stop_reason = std::move(stats.stop_reason);
+            it->second.gen_tokens = stats.gen_tokens;
+            it->second.tokens_saved = stats.tokens_saved;
+            it->second.tokens_cut = stats.tokens_cut;
+            if (stats.tokens_saved > 0 || stats.tokens_cut > 0) {
+                early_stops_++;
+                tokens_saved_ += (uint64_t)stats.tokens_saved;
+                tokens_cut_ += (uint64_t)stats.tokens_cut;
+            }
+            if (it->second.deadline_ms > 0) {
+                it->second.elapsed_ms = it->second.deadline_ms - ms_until(it->second.deadline);
+                if (err.empty() && it->second.elapsed_ms <= it->second.deadline_ms) dl_met_++;
+                else dl_missed_++;
             }
+            if (!sem_src.empty() && err.empty()) {
+                // 语义缓存命中：和近重复复用一样记来源，追问接着用来源任务的 KV / 对话
+                it->second.dup_of = sem_src;
+                it->second.dup_similarity = sem_score;
+                auto src = jobs_.find(sem_src);
+                if (src != jobs_.end()) {
+                    it->second.transcript = src->second.transcript;
+                    it->second.candidates = src->second.candidates;
+                }
+            }
+            // 结果不等落盘：丢了的话重启后这个任务重跑一遍
+            journal_job_locked(it->second);
+            finished_.push_back(id);
+        }
+        if (err.empty() && sem_src.empty() && !embedding.empty()) {
+            std::lock_guard<std::mutex> lk(sem_mu_);
+            semcache_.insert(embedding, id);
         }
+        if (trace) freeze_trace(id);
+        notify_update(id);
     }
 }
 
@@ -0,0 +1,286 @@
+#include "ws_ai/kv_store.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+#ifdef WS_AI_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace ws_ai {
+
+using Clock = std::chrono::steady_clock;
+
+// 文件格式（本机字节序，只给同一台机器读）：
+//   "WSKV" u32 version, u32 flags(bit0 = zlib), u32 key_len, key,
+//   i32 n_past, u32 n_tail, i32 tail[n_tail], u64 raw_size, u64 stored_size, data[stored_size]
+static const char kMagic[4] = {'W', 'S', 'K', 'V'};
+static const uint32_t kVersion = 1;
+static const uint32_t kFlagZlib = 1;
+
+template <class T>
+static void put(std::ostream &os, const T &v) {
+    os.write(reinterpret_cast<const char *>(&v), sizeof(T));
+}
+
+template <class T>
+static bool get(std::istream &is, T &v) {
+    return (bool)is.read(reinterpret_cast<char *>(&v), sizeof(T));
+}
+
+KvStore::KvStore(const Config &cfg)
+: dir_(cfg.job_dir + "/kv"), ttl_sec_(cfg.kv_ttl_sec), level_(cfg.kv_compress_level),
+  queue_cap_((uint64_t)cfg.kv_queue_mb << 20) {
+    if (!enabled()) return;
+    std::error_code ec;
+    fs::create_directories(dir_, ec);
+    if (ec) {
+        std::cerr << "[kv] 创建目录失败 " << dir_ << ": " << ec.message() << "，追问只能冷启动\n";
+        ttl_sec_ = 0;
+        return;
+    }
+    writer_ = std::thread([this] { writer_loop(); });
+}
+
+KvStore::~KvStore() {
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    if (writer_.joinable()) writer_.join();
+}
+
+std::string KvStore::path_of(const std::string &id) const {
+    // id 来自请求参数：只接受 new_id 生成的字符
+    if (id.empty() || id.size() > 64) return {};
+    for (char c : id) {
+        if (!isalnum((unsigned char)c) && c != '_' && c != '-') return {};
+    }
+    return dir_ + "/" + id + ".kv";
+}
+
+void KvStore::save(const std::string &id, const std::string &key, SeqState st) {
+    if (!enabled() || st.data.empty() || path_of(id).empty()) return;
+    auto p = std::make_shared<Pending>();
+    p->id = id;
+    p->key = key;
+    p->st = std::move(st);
+    const uint64_t bytes = p->st.data.size();
+    bool queued;
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        // 队列是空的时总要收下（单个状态比上限还大也照样走后台），否则超了就自己写
+        queued = queued_bytes_ == 0 || queued_bytes_ + bytes <= queue_cap_;
+        if (queued) {
+            queued_bytes_ += bytes;
+            queue_.push_back(p);
+        } else {
+            stats_.sync_saves++;
+        }
+    }
+    if (queued) cv_.notify_all();
+    else write_file(*p);
+}
+
+bool KvStore::load(const std::string &id, const std::string &key, SeqState &out, std::string &err) {
+    if (!enabled()) {
+        err = "KV 状态保存未开启";
+        return false;
+    }
+    const std::string path = path_of(id);
+    if (path.empty()) {
+        err = "invalid id";
+        return false;
+    }
+
+    std::shared_ptr<Pending> hit;
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        stats_.loads++;
+        if (writing_ && writing_->id == id) hit = writing_;
+        for (auto &p : queue_) if (p->id == id) hit = p;
+    }
+    if (hit) {
+        if (hit->key != key) {
+            err = "KV 状态来自另一个模型";
+            return false;
+        }
+        out = hit->st;  // Pending 不会被改，拷贝不用持锁
+        std::lock_guard<std::mutex> lk(mu_);
+        stats_.load_hits++;
+        return true;
+    }
+
+    std::error_code ec;
+    const auto mtime = fs::last_write_time(path, ec);
+    if (ec) {
+        err = "没有保存的 KV 状态";
+        return false;
+    }
+    if (fs::file_time_type::clock::now() - mtime > std::chrono::seconds(ttl_sec_)) {
+        fs::remove(path, ec);
+        err = "KV 状态已过期";
+        return false;
+    }
+    if (!read_file(path, key, out, err)) return false;
+
+    std::lock_guard<std::mutex> lk(mu_);
+    stats_.load_hits++;
+    return true;
+}
+
+void KvStore::flush() {
+    std::unique_lock<std::mutex> lk(mu_);
+    cv_.wait(lk, [&] { return (queue_.empty() && !writing_) || !writer_.joinable(); });
+}
+
+KvStore::Stats KvStore::stats() const {
+    std::lock_guard<std::mutex> lk(mu_);
+    return stats_;
+}
+
+void KvStore::writer_loop() {
+    std::unique_lock<std::mutex> lk(mu_);
+    for (;;) {
+        cv_.wait(lk, [&] { return stop_ || !queue_.empty(); });
+        if (queue_.empty()) break;  // stop_ 且写完
+
+        writing_ = queue_.front();
+        queue_.pop_front();
+        lk.unlock();
+
+        write_file(*writing_);
+        if (Clock::now() - last_sweep_ > std::chrono::seconds(60)) {
+            sweep();
+            last_sweep_ = Clock::now();
+        }
+
+        lk.lock();
+        queued_bytes_ -= writing_->st.data.size();
+        writing_.reset();
+        cv_.notify_all();  // flush()
+    }
+}
+
+bool KvStore::write_file(const Pending &p) {
+    const std::string path = path_of(p.id);
+    const std::vector<uint8_t> &raw = p.st.data;
+    const auto t0 = Clock::now();
+
+    uint32_t flags = 0;
+    std::vector<uint8_t> packed;
+    const uint8_t *data = raw.data();
+    uint64_t stored = raw.size();
+#ifdef WS_AI_HAVE_ZLIB
+    if (level_ > 0) {
+        uLongf n = compressBound((uLong)raw.size());
+        packed.resize(n);
+        if (compress2(packed.data(), &n, raw.data(), (uLong)raw.size(), std::min(level_, 9)) == Z_OK && n < raw.size()) {
+            flags |= kFlagZlib;
+            data = packed.data();
+            stored = n;
+        }
+    }
+#endif
+    const double ms = std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+
+    // 先写临时文件再 rename，读端不会看到半个文件
+    const std::string tmp = path + ".tmp";
+    {
+        std::ofstream ofs(tmp, std::ios::binary | std::ios::trunc);
+        if (!ofs) return false;
+        ofs.write(kMagic, 4);
+        put(ofs, kVersion);
+        put(ofs, flags);
+        put(ofs, (uint32_t)p.key.size());
+        ofs.write(p.key.data(), (std::streamsize)p.key.size());
+        put(ofs, (int32_t)p.st.n_past);
+        put(ofs, (uint32_t)p.st.tail.size());
+        for (int32_t t : p.st.tail) put(ofs, t);
+        put(ofs, (uint64_t)raw.size());
+        put(ofs, stored);
+        ofs.write(reinterpret_cast<const char *>(data), (std::streamsize)stored);
+        if (!ofs) {
+            std::error_code ec;
+            fs::remove(tmp, ec);
+            return false;
+        }
+    }
+    std::error_code ec;
+    fs::rename(tmp, path, ec);
+    if (ec) return false;
+
+    std::lock_guard<std::mutex> lk(mu_);
+    stats_.saved++;
+    stats_.raw_bytes += raw.size();
+    stats_.stored_bytes += stored;
+    stats_.compress_ms += ms;
+    return true;
+}
+
+bool KvStore::read_file(const std::string &path, const std::string &key, SeqState &out, std::string &err) {
+    std::ifstream ifs(path, std::ios::binary);
+    char magic[4] = {};
+    uint32_t version = 0, flags = 0, key_len = 0, n_tail = 0;
+    int32_t n_past = 0;
+    uint64_t raw_size = 0, stored = 0;
+
+    err = "KV 文件损坏";
+    if (!ifs.read(magic, 4) || std::memcmp(magic, kMagic, 4) != 0) return false;
+    if (!get(ifs, version) || version != kVersion) return false;
+    if (!get(ifs, flags) || !get(ifs, key_len) || key_len > 4096) return false;
+    std::string file_key(key_len, '\0');
+    if (!ifs.read(&file_key[0], key_len)) return false;
+    if (file_key != key) {
+        err = "KV 状态来自另一个模型";
+        return false;
+    }
+    if (!get(ifs, n_past) || !get(ifs, n_tail) || n_tail > 1024) return false;
+    std::vector<int32_t> tail(n_tail);
+    for (auto &t : tail) if (!get(ifs, t)) return false;
+    if (!get(ifs, raw_size) || !get(ifs, stored) || stored > raw_size + 1024) return false;
+
+    std::vector<uint8_t> buf(stored);
+    if (!ifs.read(reinterpret_cast<char *>(buf.data()), (std::streamsize)stored)) return false;
+
+    if (flags & kFlagZlib) {
+#ifdef WS_AI_HAVE_ZLIB
+        std::vector<uint8_t> raw(raw_size);
+        uLongf n = (uLongf)raw_size;
+        if (uncompress(raw.data(), &n, buf.data(), (uLong)stored) != Z_OK || n != raw_size) return false;
+        buf.swap(raw);
+#else
+        err = "KV 文件是 zlib 压缩的，但这个构建没有 zlib";
+        return false;
+#endif
+    } else if (stored != raw_size) {
+        return false;
+    }
+
+    err.clear();
+    out.data = std::move(buf);
+    out.n_past = n_past;
+    out.tail = std::move(tail);
+    return true;
+}
+
+void KvStore::sweep() {
+    std::error_code ec;
+    const auto now = fs::file_time_type::clock::now();
+    const auto ttl = std::chrono::seconds(ttl_sec_);
+    for (auto it = fs::directory_iterator(dir_, ec); !ec && it != fs::directory_iterator(); it.increment(ec)) {
+        if (it->path().extension() != ".kv") continue;
+        std::error_code ec2;
+        const auto mtime = fs::last_write_time(it->path(), ec2);
+        if (!ec2 && now - mtime > ttl) fs::remove(it->path(), ec2);
+    }
+}
+
+} // namespace ws_ai
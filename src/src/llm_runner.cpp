@@ -1,6 +1,8 @@
 #include "ws_ai/llm_runner.h"
+#include "ws_ai/trace.h"
 
 #include <algorithm>
+#include <chrono>
 #include <string>
 #include <vector>
 
@@ -63,136 +65,723 @@ static void batch_add(llama_batch& b, llama_token tok, int32_t pos, int32_t seq,
     b.n_tokens++;
 }
 
-LLMResult run_llm_summarize(const std::string& model_path,
-                            const std::string& prompt,
-                            const GenParams& params,
-                            const std::function<void(const std::string&)>& on_delta) {
-    LLMResult R;
+GenParams gen_params_from_config(const Config &cfg) {
+    GenParams p;
+    p.max_new_tokens   = cfg.max_new_tokens;
+    p.min_new_tokens   = cfg.min_new_tokens;
+    p.max_resample_eos = cfg.max_resample_eos;
+    p.top_k = cfg.top_k;
+    p.top_p = cfg.top_p;
+    p.temp  = cfg.temp;
+    p.kv_type = cfg.kv_type;
+    p.n_threads = cfg.n_threads;
+    p.n_threads_batch = cfg.n_threads_batch;
+    return p;
+}
 
-    llama_backend_init();
+using Clock = std::chrono::steady_clock;
 
-    llama_model_params mp = llama_model_default_params();
-    llama_model* model = llama_model_load_from_file(model_path.c_str(), mp);
-    if (!model) {
-        R.ok = false;
-        R.error = "模型加载失败: " + model_path;
-        llama_backend_free();
-        return R;
+static inline double ms_between(Clock::time_point a, Clock::time_point b) {
+    return std::chrono::duration<double, std::milli>(b - a).count();
+}
+
+static inline int max_new_of(const GenParams &p, const GenRequest &r) {
+    return r.max_new_tokens > 0 ? r.max_new_tokens : p.max_new_tokens;
+}
+static inline int min_new_of(const GenParams &p, const GenRequest &r) {
+    return r.min_new_tokens >= 0 ? r.min_new_tokens : p.min_new_tokens;
+}
+
+static llama_sampler *make_sampler(const GenParams &params, const llama_vocab *vocab, const std::string &grammar) {
+    // sampler chain（避免使用你版本里不存在的 repeat_penalty）
+    llama_sampler *s = llama_sampler_chain_init(llama_sampler_chain_default_params());
+    // grammar 放在最前面，后面的 top_k / top_p 只在语法允许的 token 里挑；解析失败就当没有
+    if (!grammar.empty()) {
+        if (llama_sampler *g = llama_sampler_init_grammar(vocab, grammar.c_str(), "root")) llama_sampler_chain_add(s, g);
+    }
+    llama_sampler_chain_add(s, llama_sampler_init_top_k(params.top_k));
+    llama_sampler_chain_add(s, llama_sampler_init_top_p(params.top_p, 1));
+    llama_sampler_chain_add(s, llama_sampler_init_temp(params.temp));
+    llama_sampler_chain_add(s, llama_sampler_init_dist(LLAMA_DEFAULT_SEED));
+    return s;
+}
+
+// 模型跑偏时常见的 ChatML 结束标记：出现就截断并结束
+static const char *kStopStrings[] = {"<|im_end|>", "<|endoftext|>"};
+
+struct LlmRunner::Slot {
+    int seq = 0;
+    bool active = false;
+    bool done = false;
+
+    GenRequest req;
+    LLMResult res;
+
+    std::vector<llama_token> prompt;
+    size_t n_prefilled = 0;   // prompt 已送进 batch 的 token 数
+    int32_t n_past = 0;
+    int32_t i_batch = -1;     // 本轮 batch 里要采样的 logits 下标
+    llama_token last = 0;
+    bool pending = false;     // last 已采样、还没 decode
+    bool has_tail = false;    // 因长度上限结束时 last 没进 KV（导出状态时带上）
+    int eos_resample_left = 0;
+
+    llama_sampler *sampler = nullptr;
+    std::string sampler_grammar;  // sampler 是按哪个 grammar 建的（请求换了 grammar 就重建）
+    Clock::time_point t_start, t_first;
+
+    // 结构监控；tok_start[i] 为第 i 个生成 token 在 res.text 里的起点，截断时用来回退 KV
+    OutputMonitor monitor;
+    std::vector<uint32_t> tok_start;
+    int32_t gen_pos0 = 0;     // 第一个生成 token 的位置
+
+    // trace：本批里这个 slot 送了多少 prompt token；上一个 decode span 的起点
+    int n_prefill_batch = 0;
+    uint64_t trace_mark_us = 0;
+    int trace_mark_n = 0;
+};
+
+// KV cache 精度：名字 -> ggml 类型，以及每 32 个元素占的字节（q8_0 / q4_0 是 32 个一块、带一个 f16 scale）
+struct KvType {
+    const char *name;
+    ggml_type type;
+    uint32_t bytes_per_32;
+};
+static const KvType kKvTypes[] = {
+    {"f16", GGML_TYPE_F16, 64}, {"q8_0", GGML_TYPE_Q8_0, 34}, {"q4_0", GGML_TYPE_Q4_0, 18}, {"f32", GGML_TYPE_F32, 128},
+};
+
+static const KvType &kv_type_of(const std::string &name) {
+    for (const KvType &t : kKvTypes) {
+        if (name == t.name) return t;
+    }
+    return kKvTypes[0];
+}
+
+bool kv_type_supported(const std::string &kv_type) {
+    for (const KvType &t : kKvTypes) {
+        if (kv_type == t.name) return true;
     }
+    return false;
+}
 
+static llama_context *make_context(llama_model *model, const GenParams &params, int n_ctx, int n_batch, int n_seq,
+                                   bool unified_kv = false) {
     llama_context_params cp = llama_context_default_params();
-    cp.n_ctx = 4096;
-    cp.n_batch = 1024;
+    // 每个 sequence 都要能放下 n_ctx 个 token；统一 KV 时 prompt 只占一份，每多一个 sequence 多留一段生成的位置
+    cp.n_ctx     = (uint32_t)(unified_kv ? n_ctx + (n_seq - 1) * std::max(1, params.max_new_tokens) : n_ctx * n_seq);
+    cp.kv_unified = unified_kv;
+    cp.n_batch   = (uint32_t)n_batch;
+    cp.n_seq_max = (uint32_t)n_seq;
+    if (params.n_threads > 0) cp.n_threads = params.n_threads;
+    if (params.n_threads_batch > 0) cp.n_threads_batch = params.n_threads_batch;
+    // 量化的 V cache 需要 flash attention（默认 auto，后端不支持时 context 会创建失败）
+    cp.type_k = kv_type_of(params.kv_type).type;
+    cp.type_v = kv_type_of(params.kv_type).type;
     // 注意：不要写 cp.flash_attn（你现在版本里已改名/不存在）
-    llama_context* ctx = llama_init_from_model(model, cp);
-    if (!ctx) {
-        R.ok = false;
-        R.error = "llama_context 创建失败";
-        llama_model_free(model);
-        llama_backend_free();
-        return R;
+    return llama_init_from_model(model, cp);
+}
+
+uint64_t estimate_context_bytes(const llama_model *model, const GenParams &params, int n_ctx, int n_batch, int n_seq,
+                                bool unified_kv) {
+    n_seq = std::max(1, n_seq);
+    // 和 make_context 一样的 cell 数
+    const uint64_t cells = unified_kv ? (uint64_t)n_ctx + (uint64_t)(n_seq - 1) * std::max(1, params.max_new_tokens)
+                                      : (uint64_t)n_ctx * n_seq;
+    const uint64_t n_layer = (uint64_t)std::max(1, llama_model_n_layer(model));
+    const uint64_t n_embd = (uint64_t)std::max(1, llama_model_n_embd(model));
+    const uint64_t n_head = (uint64_t)std::max(1, llama_model_n_head(model));
+    const uint64_t n_head_kv = (uint64_t)std::max(1, llama_model_n_head_kv(model));
+    const uint64_t n_vocab = (uint64_t)std::max(1, llama_vocab_n_tokens(llama_model_get_vocab(model)));
+
+    // K + V，GQA 时每层 n_embd * n_head_kv / n_head，每个元素按 kv_type 的字节数
+    const uint64_t kv = cells * n_layer * (n_embd * n_head_kv / n_head) * 2 * kv_type_of(params.kv_type).bytes_per_32 / 32;
+    const uint64_t logits = n_vocab * sizeof(float) * (uint64_t)n_seq;
+    // 计算图：一个 batch 的激活（FFN 约 4 倍宽，留 8 倍余量）+ 一层的注意力分数（n_head x batch x 每个 sequence 的 cell）
+    const uint64_t batch = (uint64_t)std::max(1, n_batch);
+    const uint64_t compute = batch * n_embd * sizeof(float) * 8 + n_head * batch * std::min<uint64_t>(cells, n_ctx) * sizeof(float);
+    return kv + logits + compute;
+}
+
+LlmRunner::LlmRunner(llama_model *model, const GenParams &params, int n_ctx, int n_batch, int n_seq, bool unified_kv)
+: model_(model), params_(params), n_ctx_seq_(n_ctx), n_batch_(n_batch), n_seq_(std::max(1, n_seq)) {
+    ctx_ = make_context(model, params, n_ctx, n_batch, n_seq_, unified_kv);
+    if (!ctx_) error_ = "llama context 创建失败";
+}
+
+LlmRunner::LlmRunner(llama_model *model, llama_context *reuse, const GenParams &params, int n_ctx, int n_batch)
+: model_(model), params_(params), n_ctx_seq_(n_ctx), n_batch_(n_batch), n_seq_(1), reused_(reuse != nullptr) {
+    ctx_ = reuse ? reuse : make_context(model, params, n_ctx, n_batch, 1);
+    if (!ctx_) error_ = "llama context 创建失败";
+}
+
+LlmRunner::~LlmRunner() {
+    if (ctx_) llama_free(ctx_);
+}
+
+llama_context *LlmRunner::release_context() {
+    llama_context *c = ctx_;
+    ctx_ = nullptr;
+    if (c) llama_memory_clear(llama_get_memory(c), true);
+    return c;
+}
+
+void LlmRunner::save_slot_state(Slot &s) {
+    TraceSpan span(s.req.trace, "kv_save");
+    SeqState &st = s.res.state;
+    const size_t n = llama_state_seq_get_size(ctx_, s.seq);
+    st.data.resize(n);
+    if (n > 0 && llama_state_seq_get_data(ctx_, st.data.data(), n, s.seq) == n) {
+        st.n_past = s.n_past;
+        if (s.has_tail) st.tail.push_back(s.last);
+    } else {
+        st = SeqState{};
     }
+    span.set_arg((int64_t)n);
+}
 
-    const llama_vocab* vocab = llama_model_get_vocab(model);
-    auto prompt_tokens = tokenize(vocab, prompt);
-    if (prompt_tokens.empty()) {
-        R.ok = false;
-        R.error = "prompt tokenize 失败";
-        llama_free(ctx);
-        llama_model_free(model);
-        llama_backend_free();
-        return R;
+// 收尾：补最后一段 decode span、trim、算耗时（不动 KV）
+void LlmRunner::finalize_result(Slot &s) {
+    const auto now = Clock::now();
+    if (s.req.trace && s.res.n_gen_tokens > s.trace_mark_n) {
+        const uint64_t t = trace_now_us();
+        s.req.trace->span("decode", s.trace_mark_us, t - s.trace_mark_us, s.res.n_gen_tokens - s.trace_mark_n);
     }
 
-    // sampler chain（避免使用你版本里不存在的 repeat_penalty）
-    llama_sampler* sampler =
-        llama_sampler_chain_init(llama_sampler_chain_default_params());
-    llama_sampler_chain_add(sampler, llama_sampler_init_top_k(params.top_k));
-    llama_sampler_chain_add(sampler, llama_sampler_init_top_p(params.top_p, 1));
-    llama_sampler_chain_add(sampler, llama_sampler_init_temp(params.temp));
-    llama_sampler_chain_add(sampler, llama_sampler_init_dist(LLAMA_DEFAULT_SEED));
-
-    // 1) 先 decode prompt，一次性喂入
-    // 关键：只把“最后一个 token”的 logits 标记为 true，这样 n_outputs=1
-    llama_batch b0 = llama_batch_init((int32_t)prompt_tokens.size(), 0, 1);
-    b0.n_tokens = 0;
-    for (int32_t i = 0; i < (int32_t)prompt_tokens.size(); ++i) {
-        bool want_logits = (i == (int32_t)prompt_tokens.size() - 1);
-        batch_add(b0, prompt_tokens[i], /*pos*/ i, /*seq*/ 0, want_logits);
-    }
-
-    if (llama_decode(ctx, b0) != 0) {
-        llama_batch_free(b0);
-        R.ok = false;
-        R.error = "llama_decode(prompt) 失败";
-        llama_sampler_free(sampler);
-        llama_free(ctx);
-        llama_model_free(model);
-        llama_backend_free();
-        return R;
+    trim_inplace(s.res.text);
+    s.res.ok = s.res.error.empty();
+    if (!s.res.ok) s.res.stop_reason = s.res.error == "cancelled" ? StopReason::cancelled : StopReason::error;
+    if (stopped_by_monitor(s.res.stop_reason)) {
+        s.res.n_saved_tokens = std::max(0, max_new_of(params_, s.req) - s.res.n_gen_tokens);
+    }
+    if (s.res.n_gen_tokens > 0) {
+        s.res.prefill_ms = ms_between(s.t_start, s.t_first);
+        s.res.decode_ms  = ms_between(s.t_first, now);
+    } else {
+        s.res.prefill_ms = ms_between(s.t_start, now);
     }
-    llama_batch_free(b0);
+}
 
-    // 重要修复：采样用 logits_id=0（因为本次 decode 只有 1 个 logits 输出）
-    // 之前你用 token index 当 logits id，会触发 invalid logits id
-    int32_t n_past = (int32_t)prompt_tokens.size();
-    llama_token tok_eos = llama_vocab_eos(vocab);
+void LlmRunner::finish_slot(Slot &s, const DoneFn &on_done) {
+    if (s.req.save_state && s.res.error.empty()) save_slot_state(s);
+    llama_memory_seq_rm(llama_get_memory(ctx_), s.seq, -1, -1);
+    finalize_result(s);
+    on_done(s.req, s.res);
 
-    std::string out;
-    out.reserve(8192);
+    s.active = false;
+    s.done = false;
+    s.pending = false;
+    s.req = GenRequest{};
+    s.res = LLMResult{};
+    s.prompt.clear();
+    s.tok_start.clear();
+}
+
+// 结构监控要求停下、只保留 res.text 的前 keep 字节：整个落在截断点之后的 token 从 KV 里删掉，
+// 这样导出的状态（追问用）和返回的文本对得上
+void LlmRunner::cut_slot(Slot &s, size_t keep) {
+    const int n = s.res.n_gen_tokens;
+    const int c = (int)(std::lower_bound(s.tok_start.begin(), s.tok_start.end(), (uint32_t)keep) - s.tok_start.begin());
+    s.res.n_cut_tokens = n - c;
+    // 前 n-1 个已经进了 KV，最后一个（刚采样的）还没 decode
+    if (c < n - 1) {
+        llama_memory_seq_rm(llama_get_memory(ctx_), s.seq, s.gen_pos0 + c, -1);
+        s.n_past = s.gen_pos0 + c;
+    }
+    s.has_tail = c == n;  // 最后一个 token 保留下来了，但还不在 KV 里
+    s.res.text.resize(keep);
+    s.done = true;
+}
+
+// 用 s.i_batch 处的 logits 采样一个 token：接受 / 结束（EOS、stop string、长度上限）
+void LlmRunner::sample_slot(Slot &s, const llama_vocab *vocab) {
+    if (s.res.n_gen_tokens == 0) {
+        s.t_first = Clock::now();
+        s.gen_pos0 = s.n_past;
+    }
+
+    llama_token tok = llama_sampler_sample(s.sampler, ctx_, s.i_batch);
+
+    // 早 eos：在 min_new_tokens 前尽量重采样，避免“越来越短”。
+    // 段落已经写够了就不再硬拖；有 grammar 时 EOS 只会在语法走完后出现，重采样也没用
+    while (llama_vocab_is_eog(vocab, tok) && s.res.n_gen_tokens < min_new_of(params_, s.req) &&
+           s.eos_resample_left > 0 && !s.monitor.complete() && s.sampler_grammar.empty()) {
+        s.eos_resample_left--;
+        tok = llama_sampler_sample(s.sampler, ctx_, s.i_batch);
+    }
+    if (llama_vocab_is_eog(vocab, tok)) {
+        s.res.stop_reason = StopReason::eos;
+        s.done = true;
+        return;
+    }
+
+    llama_sampler_accept(s.sampler, tok);
+    const std::string piece = token_to_piece(vocab, tok);
+    const size_t before = s.res.text.size();
+    s.tok_start.push_back((uint32_t)before);
+    s.res.text += piece;
+    s.res.n_gen_tokens++;
+
+    // stop strings：只需要看新增部分附近
+    size_t cut = std::string::npos;
+    for (const char *st : kStopStrings) {
+        const size_t len = std::char_traits<char>::length(st);
+        size_t p = s.res.text.find(st, before > len ? before - len : 0);
+        if (p != std::string::npos) cut = std::min(cut, p);
+    }
+    if (cut != std::string::npos) {
+        s.res.text.resize(cut);
+        s.res.stop_reason = StopReason::stop_string;
+        s.done = true;
+        return;
+    }
 
-    int eos_resample_used = 0;
+    // 结构监控：两段写完 / 跑偏 / 换语言，马上停，截掉的部分不推给 on_token
+    size_t keep = s.res.text.size();
+    const StopReason why = s.monitor.feed(s.res.text, keep);
+    if (why != StopReason::none) {
+        if (s.req.on_token && keep > before) s.req.on_token(s.res.text.substr(before, keep - before), s.res.n_gen_tokens);
+        s.last = tok;
+        s.res.stop_reason = why;
+        cut_slot(s, keep);
+        return;
+    }
+
+    if (s.req.on_token && !piece.empty()) s.req.on_token(piece, s.res.n_gen_tokens);
+
+    // decode 采样记录：每 N 个 token 一段，span 覆盖这 N 个 token 的墙钟时间
+    if (s.req.trace && s.res.n_gen_tokens - s.trace_mark_n >= s.req.trace->decode_every()) {
+        const uint64_t t = trace_now_us();
+        s.req.trace->span("decode", s.trace_mark_us, t - s.trace_mark_us, s.res.n_gen_tokens - s.trace_mark_n);
+        s.trace_mark_us = t;
+        s.trace_mark_n = s.res.n_gen_tokens;
+    }
 
-    for (int step = 0; step < params.max_new_tokens; ++step) {
-        // 本轮可采样的 logits 槽位：永远是 0（因为我们每轮 decode 也只请求一个 logits）
-        llama_token tok = llama_sampler_sample(sampler, ctx, /*logits_id*/ 0);
+    s.last = tok;
+    if (s.res.n_gen_tokens >= max_new_of(params_, s.req) || s.n_past + 1 >= n_ctx_seq_) {
+        s.res.stop_reason = StopReason::max_tokens;
+        s.has_tail = true;
+        s.done = true;
+        return;
+    }
+    s.pending = true;
+}
 
-        // 早停控制：太早 EOS -> 拒绝 EOS 重采样
-        if (tok == tok_eos && step < params.min_new_tokens) {
-            if (eos_resample_used < params.max_resample_eos) {
-                eos_resample_used++;
-                // 不 accept，直接再 sample 一次（注意：这会改变采样轨迹，但能显著减少“越来越短”）
+void LlmRunner::run(const NextFn &next, const DoneFn &on_done) {
+    if (!ctx_) {
+        // context 都没有：把所有请求直接以失败结束
+        while (auto r = next(true)) {
+            LLMResult res;
+            res.error = error_;
+            on_done(*r, res);
+        }
+        return;
+    }
+
+    const llama_vocab *vocab = llama_model_get_vocab(model_);
+    llama_memory_t mem = llama_get_memory(ctx_);
+
+    std::vector<Slot> slots((size_t)n_seq_);
+    for (int i = 0; i < n_seq_; ++i) {
+        slots[i].seq = i;
+        slots[i].sampler = make_sampler(params_, vocab, "");
+    }
+
+    llama_batch batch = llama_batch_init(n_batch_, 0, 1);
+    bool input_done = false;
+
+    for (;;) {
+        // 1) 空闲 slot 接新请求；没有任何在跑的 sequence 时才阻塞等
+        for (auto &s : slots) {
+            if (s.active || input_done) continue;
+            bool any_active = false;
+            for (auto &o : slots) any_active = any_active || o.active;
+
+            std::optional<GenRequest> r = next(!any_active);
+            if (!r) {
+                if (!any_active) input_done = true;
+                break;
+            }
+
+            s.req = std::move(*r);
+            s.res = LLMResult{};
+            s.t_start = Clock::now();
+            {
+                TraceSpan span(s.req.trace, "tokenize");
+                s.prompt = tokenize(vocab, s.req.prompt);
+                span.set_arg((int64_t)s.prompt.size());
+            }
+            s.n_prefilled = 0;
+            s.n_past = 0;
+            s.i_batch = -1;
+            s.pending = false;
+            s.has_tail = false;
+            s.eos_resample_left = params_.max_resample_eos;
+            s.trace_mark_n = 0;
+            s.res.n_prompt_tokens = (int)s.prompt.size();
+            if (s.req.grammar != s.sampler_grammar) {
+                llama_sampler_free(s.sampler);
+                s.sampler = make_sampler(params_, vocab, s.req.grammar);
+                s.sampler_grammar = s.req.grammar;
+            }
+            llama_sampler_reset(s.sampler);
+            s.monitor = OutputMonitor(s.req.monitor);
+            s.tok_start.clear();
+            s.active = true;
+
+            // 追问：恢复上一轮的 KV，新 prompt 接在后面
+            bool restored = true;
+            if (s.req.restore && !s.prompt.empty()) {
+                TraceSpan span(s.req.trace, "kv_restore");
+                const SeqState &st = *s.req.restore;
+                const auto t0 = Clock::now();
+                restored = !st.data.empty() &&
+                           llama_state_seq_set_data(ctx_, st.data.data(), st.data.size(), s.seq) == st.data.size();
+                s.res.restore_ms = ms_between(t0, Clock::now());
+                span.set_arg((int64_t)st.data.size());
+                if (restored) {
+                    s.n_past = st.n_past;
+                    s.prompt.insert(s.prompt.begin(), st.tail.begin(), st.tail.end());
+                    s.res.n_prompt_tokens = (int)s.prompt.size();
+                }
+            }
+
+            if (s.prompt.empty()) {
+                s.res.error = "prompt tokenize 失败";
+                finish_slot(s, on_done);
+            } else if (!restored) {
+                s.res.error = "KV 状态恢复失败";
+                finish_slot(s, on_done);
+            } else if (s.n_past + (int)s.prompt.size() >= n_ctx_seq_) {
+                s.res.error = "prompt 过长（超过 n_ctx）";
+                finish_slot(s, on_done);
+            }
+        }
+
+        bool any_active = false;
+        for (auto &s : slots) any_active = any_active || s.active;
+        if (!any_active) {
+            if (input_done) break;
+            continue;
+        }
+
+        // 2) 组 batch：先放 decode 中的单 token，剩余容量给 prefill（长 prompt 分块）
+        batch.n_tokens = 0;
+        for (auto &s : slots) {
+            s.i_batch = -1;
+            s.n_prefill_batch = 0;
+            if (!s.active || !s.pending) continue;
+            if (s.req.cancel && s.req.cancel->load()) {
+                s.res.error = "cancelled";
+                finish_slot(s, on_done);
                 continue;
             }
-            // 重采样次数耗尽：允许结束，避免死循环
+            batch_add(batch, s.last, s.n_past, s.seq, /*logits*/ true);
+            s.i_batch = batch.n_tokens - 1;
+            s.n_past++;
+            s.pending = false;
+        }
+        for (auto &s : slots) {
+            if (!s.active || s.n_prefilled >= s.prompt.size()) continue;
+            if (s.req.cancel && s.req.cancel->load()) {
+                s.res.error = "cancelled";
+                finish_slot(s, on_done);
+                continue;
+            }
+            const int32_t room = n_batch_ - batch.n_tokens;
+            if (room <= 0) break;
+            const size_t take = std::min((size_t)room, s.prompt.size() - s.n_prefilled);
+            for (size_t k = 0; k < take; ++k) {
+                const bool is_last = (s.n_prefilled + 1 == s.prompt.size());
+                // 只给 prompt 最后一个 token 要 logits
+                batch_add(batch, s.prompt[s.n_prefilled], s.n_past, s.seq, is_last);
+                if (is_last) s.i_batch = batch.n_tokens - 1;
+                s.n_prefilled++;
+                s.n_past++;
+            }
+            s.n_prefill_batch = (int)take;
+        }
+        if (batch.n_tokens == 0) continue;
+
+        const uint64_t t_decode = trace_now_us();
+        const int rc = llama_decode(ctx_, batch);
+        for (auto &s : slots) {
+            if (!s.active || !s.req.trace || s.n_prefill_batch == 0) continue;
+            const uint64_t t = trace_now_us();
+            s.req.trace->span("prefill", t_decode, t - t_decode, s.n_prefill_batch);
+            if (s.n_prefilled == s.prompt.size()) {
+                s.trace_mark_us = t;
+                s.trace_mark_n = 0;
+            }
+        }
+        if (rc != 0) {
+            // 本批涉及的 sequence 全部失败，其它的下一轮继续
+            for (auto &s : slots) {
+                if (!s.active) continue;
+                bool in_batch = false;
+                for (int32_t i = 0; i < batch.n_tokens && !in_batch; ++i) in_batch = (batch.seq_id[i][0] == s.seq);
+                if (!in_batch) continue;
+                s.res.error = s.res.n_gen_tokens == 0 ? "llama_decode(prompt) 失败" : "llama_decode(next) 失败";
+                finish_slot(s, on_done);
+            }
+            continue;
         }
 
-        // 正常接受 token
-        llama_sampler_accept(sampler, tok);
+        // 3) 各 sequence 独立采样
+        for (auto &s : slots) {
+            if (!s.active || s.i_batch < 0) continue;
+            sample_slot(s, vocab);
+        }
 
-        // 输出 piece
-        std::string piece = token_to_piece(vocab, tok);
-        out += piece;
-        if (!piece.empty()) on_delta(piece);
+        for (auto &s : slots) {
+            if (s.active && s.done) finish_slot(s, on_done);
+        }
+    }
 
-        // 达到最短长度后，遇到 eos 才结束
-        if (tok == tok_eos && step >= params.min_new_tokens) {
-            break;
+    llama_batch_free(batch);
+    for (auto &s : slots) llama_sampler_free(s.sampler);
+    llama_memory_clear(mem, true);
+}
+
+std::vector<LLMResult> LlmRunner::generate_candidates(GenRequest req, int n, const ScoreFn &score) {
+    n = std::max(1, std::min(n, n_seq_));
+    std::vector<LLMResult> out((size_t)n);
+    if (!ctx_) {
+        for (auto &r : out) r.error = error_;
+        return out;
+    }
+
+    const llama_vocab *vocab = llama_model_get_vocab(model_);
+    llama_memory_t mem = llama_get_memory(ctx_);
+
+    std::vector<Slot> slots((size_t)n);
+    Slot &s0 = slots[0];
+    s0.req = req;
+    s0.t_start = Clock::now();
+    {
+        TraceSpan span(req.trace, "tokenize");
+        s0.prompt = tokenize(vocab, req.prompt);
+        span.set_arg((int64_t)s0.prompt.size());
+    }
+    if (s0.prompt.empty() || (int)s0.prompt.size() >= n_ctx_seq_) {
+        for (auto &r : out) r.error = s0.prompt.empty() ? "prompt tokenize 失败" : "prompt 过长（超过 n_ctx）";
+        return out;
+    }
+
+    // 1) prompt 只在 seq 0 上 prefill 一次（分块）
+    const int32_t n_batch = std::max(n_batch_, n);
+    llama_batch batch = llama_batch_init(n_batch, 0, 1);
+    int rc = 0;
+    for (size_t i = 0; i < s0.prompt.size() && rc == 0;) {
+        batch.n_tokens = 0;
+        const size_t take = std::min((size_t)n_batch_, s0.prompt.size() - i);
+        for (size_t k = 0; k < take; ++k, ++i) batch_add(batch, s0.prompt[i], (int32_t)i, 0, i + 1 == s0.prompt.size());
+        const uint64_t t0 = trace_now_us();
+        rc = llama_decode(ctx_, batch);
+        if (req.trace) req.trace->span("prefill", t0, trace_now_us() - t0, (int64_t)take);
+    }
+    if (rc != 0) {
+        llama_batch_free(batch);
+        llama_memory_clear(mem, true);
+        for (auto &r : out) r.error = "llama_decode(prompt) 失败";
+        return out;
+    }
+
+    // 2) fork：其它 sequence 共享 prompt 的 KV（统一 KV cache 下只是给 cell 加 seq id，不拷数据），
+    //    都从同一份最后位置的 logits 开始各自采样
+    {
+        TraceSpan span(req.trace, "fork", n);
+        for (int k = 1; k < n; ++k) llama_memory_seq_cp(mem, 0, k, -1, -1);
+    }
+    const uint64_t t_fork = trace_now_us();
+    for (int k = 0; k < n; ++k) {
+        Slot &s = slots[k];
+        s.seq = k;
+        if (k > 0) {
+            s.req = req;
+            s.req.trace = nullptr;  // 只记 seq 0 的 decode，免得 N 条重叠的 span
+            s.t_start = s0.t_start;
         }
+        s.sampler = make_sampler(params_, vocab, req.grammar);
+        s.sampler_grammar = req.grammar;
+        s.monitor = OutputMonitor(req.monitor);
+        s.n_past = (int32_t)s0.prompt.size();
+        s.n_prefilled = s0.prompt.size();
+        s.i_batch = batch.n_tokens - 1;
+        s.eos_resample_left = params_.max_resample_eos;
+        s.res.n_prompt_tokens = (int)s0.prompt.size();
+        s.trace_mark_us = t_fork;
+        s.active = true;
+    }
 
-        // 2) decode 单 token，并且请求 logits（n_outputs=1）
-        llama_batch b1 = llama_batch_init(1, 0, 1);
-        b1.n_tokens = 0;
-        batch_add(b1, tok, /*pos*/ n_past, /*seq*/ 0, /*logits*/ true);
-        n_past++;
+    // 3) N 条一起 decode：每轮每个还在跑的 sequence 一个 token
+    for (;;) {
+        for (auto &s : slots) {
+            if (!s.active || s.i_batch < 0) continue;
+            sample_slot(s, vocab);
+            if (s.done) {
+                finalize_result(s);
+                s.active = false;
+            }
+        }
 
-        if (llama_decode(ctx, b1) != 0) {
-            llama_batch_free(b1);
+        batch.n_tokens = 0;
+        const bool cancelled = req.cancel && req.cancel->load();
+        for (auto &s : slots) {
+            s.i_batch = -1;
+            if (!s.active || !s.pending) continue;
+            if (cancelled) {
+                s.res.error = "cancelled";
+                finalize_result(s);
+                s.active = false;
+                continue;
+            }
+            batch_add(batch, s.last, s.n_past, s.seq, true);
+            s.i_batch = batch.n_tokens - 1;
+            s.n_past++;
+            s.pending = false;
+        }
+        if (batch.n_tokens == 0) break;
+
+        if (llama_decode(ctx_, batch) != 0) {
+            for (auto &s : slots) {
+                if (!s.active) continue;
+                s.res.error = "llama_decode(next) 失败";
+                finalize_result(s);
+                s.active = false;
+            }
             break;
         }
-        llama_batch_free(b1);
     }
 
-    trim_inplace(out);
+    // 4) 打分，最好的排第一；需要的话只导出它的 KV（给追问）
+    for (auto &s : slots) s.res.score = s.res.ok && score ? score(s.res.text) : 0.0;
+    size_t best = 0;
+    for (size_t k = 1; k < slots.size(); ++k) {
+        const LLMResult &a = slots[k].res, &b = slots[best].res;
+        if (a.ok > b.ok || (a.ok == b.ok && a.score > b.score)) best = k;
+    }
+    if (req.save_state && slots[best].res.ok) save_slot_state(slots[best]);
+
+    std::swap(slots[0], slots[best]);
+    for (size_t k = 0; k < slots.size(); ++k) out[k] = std::move(slots[k].res);
+    std::stable_sort(out.begin() + 1, out.end(), [](const LLMResult &a, const LLMResult &b) {
+        return a.ok != b.ok ? a.ok : a.score > b.score;
+    });
+
+    llama_batch_free(batch);
+    for (auto &s : slots) llama_sampler_free(s.sampler);
+    llama_memory_clear(mem, true);
+    return out;
+}
+
+std::vector<LLMResult> LlmRunner::generate(std::vector<GenRequest> reqs) {
+    // 这里借用 GenRequest::user 记录下标，调用方传入的 user 不会带回
+    std::vector<LLMResult> out(reqs.size());
+    size_t next_i = 0;
+    run(
+        [&](bool) -> std::optional<GenRequest> {
+            if (next_i >= reqs.size()) return std::nullopt;
+            GenRequest r = std::move(reqs[next_i]);
+            r.user = reinterpret_cast<void *>(next_i);
+            next_i++;
+            return r;
+        },
+        [&](GenRequest &req, LLMResult &res) {
+            out[reinterpret_cast<size_t>(req.user)] = std::move(res);
+        });
+    return out;
+}
+
+bool embed_text(llama_model *model, const std::string &text, const GenParams &params, int max_tokens,
+                std::vector<float> &out, std::string &err) {
+    out.clear();
+    const llama_vocab *vocab = llama_model_get_vocab(model);
+    std::vector<llama_token> toks = tokenize(vocab, text);
+    if (toks.empty()) {
+        err = "embedding tokenize 失败";
+        return false;
+    }
+    if (max_tokens > 0 && (int)toks.size() > max_tokens) toks.resize((size_t)max_tokens);
+    const int32_t n = (int32_t)toks.size();
+
+    // 一段文本一个 ubatch 算完（编码器模型不能分块）；context 只有这么大，建一次几毫秒
+    llama_context_params cp = llama_context_default_params();
+    cp.n_ctx = (uint32_t)std::max(n, 64);
+    cp.n_batch = (uint32_t)n;
+    cp.n_ubatch = (uint32_t)n;
+    cp.n_seq_max = 1;
+    cp.embeddings = true;
+    if (params.n_threads_batch > 0) cp.n_threads_batch = params.n_threads_batch;
+    if (params.n_threads > 0) cp.n_threads = params.n_threads;
+    llama_context *ctx = llama_init_from_model(model, cp);
+    if (!ctx) {
+        err = "embedding context 创建失败";
+        return false;
+    }
 
-    R.ok = true;
-    R.text = out;
+    llama_batch batch = llama_batch_init(n, 0, 1);
+    for (int32_t i = 0; i < n; ++i) batch_add(batch, toks[(size_t)i], i, 0, true);
+    const bool encoder_only = llama_model_has_encoder(model) && !llama_model_has_decoder(model);
+    const int rc = encoder_only ? llama_encode(ctx, batch) : llama_decode(ctx, batch);
 
-    llama_sampler_free(sampler);
+    const int n_embd = llama_model_n_embd(model);
+    if (rc != 0) {
+        err = "embedding decode 失败";
+    } else if (llama_pooling_type(ctx) != LLAMA_POOLING_TYPE_NONE) {
+        // 专门的向量模型（GGUF 里带 pooling）：直接取 sequence 的池化结果
+        if (const float *e = llama_get_embeddings_seq(ctx, 0)) out.assign(e, e + n_embd);
+    } else {
+        // 生成模型没有 pooling：最后一层各 token 的隐状态取平均
+        out.assign((size_t)n_embd, 0.f);
+        for (int32_t i = 0; i < n; ++i) {
+            const float *e = llama_get_embeddings_ith(ctx, i);
+            if (!e) {
+                out.clear();
+                break;
+            }
+            for (int k = 0; k < n_embd; ++k) out[(size_t)k] += e[k];
+        }
+    }
+    llama_batch_free(batch);
     llama_free(ctx);
+    if (out.empty()) {
+        if (err.empty()) err = "取不到 embedding";
+        return false;
+    }
+    return true;
+}
+
+LLMResult run_llm_summarize(const std::string& model_path,
+                            const std::string& prompt,
+                            const GenParams& params,
+                            const std::function<void(const std::string&)>& on_delta) {
+    LLMResult R;
+
+    llama_backend_init();
+
+    llama_model_params mp = llama_model_default_params();
+    llama_model* model = llama_model_load_from_file(model_path.c_str(), mp);
+    if (!model) {
+        R.ok = false;
+        R.error = "模型加载失败: " + model_path;
+        llama_backend_free();
+        return R;
+    }
+
+    {
+        LlmRunner runner(model, params, /*n_ctx*/ 4096, /*n_batch*/ 1024);
+        GenRequest req;
+        req.prompt = prompt;
+        req.on_token = [&](const std::string &piece, int) { on_delta(piece); };
+        std::vector<GenRequest> reqs;
+        reqs.push_back(std::move(req));
+        R = std::move(runner.generate(std::move(reqs)).front());
+    }
+
     llama_model_free(model);
     llama_backend_free();
     return R;
 }
 
-} // namespace ws_ai
\ No newline at end of file
+} // namespace ws_ai
@@ -0,0 +1,1033 @@
+// ws_ai_loadgen：HTTP 层压测，固定到达率（open-loop）打 /api/upload、/api/clipboard，
+// 再用 /api/status 轮询或 /api/stream 跟到结束。
+//
+//   WS_AI_PIPELINE=mock ./ws_ai_server &
+//   ws_ai_loadgen --rate 20 --duration 30 --mode mixed --watch stream
+//
+// 请求按计划时间发出，延迟从“计划时间”算起：服务端变慢、客户端 worker 排队的时间都会算进去，
+// 不会因为发不出去就少测（coordinated omission）。开始和结束各取一次 /api/stats，报告锁争用的增量。
+//
+//   WS_AI_PIPELINE=mock WS_AI_WATCH_PORT=8081 ./ws_ai_server &
+//   ws_ai_loadgen --watchers 10000 --watch-jobs 8 --rate 5 --duration 20
+//
+// --watchers 时先提交几个目标任务，再往 watch 端口挂 N 个 SSE 长连接（单线程 poll）平均订阅它们，
+// 连接都建好之后才开始正常发压：看上传延迟会不会被这些空闲连接拖慢，以及 done 事件推到所有连接花多久。
+//
+//   WS_AI_PIPELINE=mock WS_AI_UDS=/tmp/ws_ai.sock ./ws_ai_server &
+//   ws_ai_loadgen --mode uds-fd --uds /tmp/ws_ai.sock --rate 50 --watch none
+//
+// --mode uds / uds-fd 走本机 Unix socket 上的二进制提交协议（local_proto.h）：uds 把图片字节放在帧里，
+// uds-fd 每次把图片写进一个 memfd（非 Linux 用临时文件）只传 fd。流式输出在同一个连接上回来（--watch status 也按 stream 算）。
+// 和 --mode upload / clipboard 对比 submit 延迟。
+//
+//   ws_ai_loadgen --crash-test "WS_AI_PIPELINE=mock ./ws_ai_server" --crash-after 5 --rate 50
+//
+// --crash-test 时由 loadgen 自己启动服务端（sh -c，单独的进程组），照常发压 crash-after 秒后 SIGKILL 整个进程组、
+// 再用同一条命令重启：报告重启到 /api/stats 能访问的耗时和任务日志回放统计，然后逐个查崩溃前拿到 id 的任务，
+// 查不到的算丢失，崩溃前已经 done 的结果变了算不一致，有任何一种就返回非 0。
+// 加 --expire-after SEC（和服务端的 WS_AI_JOURNAL_RETAIN_SEC 一样）时再等过期：已结束的任务应该查不到，
+// 再 kill -9 重启一次（日志还没压缩，回放时要跳过）也应该查不到，查得到的算没过期，同样返回非 0。
+#include "ws_ai/local_proto.h"
+
+#include <httplib.h>
+#include <json.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using json = nlohmann::json;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+struct Options {
+    std::string host = "127.0.0.1";
+    int port = 8080;
+    double rate = 10;          // 每秒提交数
+    double duration = 10;      // 秒
+    std::string mode = "upload";   // upload | clipboard | mixed | uds | uds-fd
+    std::string uds = "/tmp/ws_ai.sock";
+    std::string watch = "status";  // status | stream | none
+    int poll_ms = 100;
+    int workers = 64;
+    double timeout = 60;       // 单个 job 从提交到结束的上限（秒）
+    bool poisson = false;
+    std::string image;
+    std::string model;
+    int watchers = 0;          // 额外挂在 watch 端口上的长连接数
+    int watch_port = 8081;
+    int watch_jobs = 8;        // 长连接订阅的目标任务数
+    std::string watch_path = "stream";  // stream | watch
+    int distinct = 0;          // 轮流提交 N 张不同的图（0 = 每次都是同一张）
+    std::string crash_cmd;     // 非空：崩溃恢复测试，用这条命令启动 / 重启服务端
+    double crash_after = 5;    // 发压多少秒后 kill -9
+    double expire_after = 0;   // >0：恢复检查完再等这么久（服务端的 WS_AI_JOURNAL_RETAIN_SEC），查过期
+};
+
+// 1x1 白色 PNG，mock 流水线不看图片内容
+const unsigned char kTinyPng[] = {
+    0x89, 0x50, 0x4e, 0x47, 0x0d, 0x0a, 0x1a, 0x0a, 0x00, 0x00, 0x00, 0x0d, 0x49, 0x48, 0x44, 0x52,
+    0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01, 0x08, 0x00, 0x00, 0x00, 0x00, 0x3a, 0x7e, 0x9b,
+    0x55, 0x00, 0x00, 0x00, 0x0a, 0x49, 0x44, 0x41, 0x54, 0x78, 0x9c, 0x63, 0xf8, 0x0f, 0x00, 0x01,
+    0x01, 0x01, 0x00, 0x1b, 0xb6, 0xee, 0x56, 0x00, 0x00, 0x00, 0x00, 0x49, 0x45, 0x4e, 0x44, 0xae,
+    0x42, 0x60, 0x82,
+};
+
+void usage() {
+    std::cerr <<
+        "用法: ws_ai_loadgen [选项]\n"
+        "      --host H          默认 127.0.0.1\n"
+        "      --port P          默认 8080\n"
+        "  -r, --rate N          每秒提交数（默认 10）\n"
+        "  -d, --duration SEC    发压时长（默认 10）\n"
+        "      --mode M          upload | clipboard | mixed | uds | uds-fd（默认 upload）\n"
+        "      --uds PATH        uds / uds-fd 模式的 socket 文件（默认 /tmp/ws_ai.sock）\n"
+        "      --watch W         status（轮询）| stream（SSE）| none（默认 status）\n"
+        "      --poll-ms N       status 轮询间隔（默认 100）\n"
+        "  -w, --workers N       客户端并发上限（默认 64，不够时排队时间会算进延迟）\n"
+        "      --timeout SEC     单个 job 超时（默认 60）\n"
+        "      --poisson         到达间隔按指数分布（默认等间隔）\n"
+        "      --image FILE      上传的图片（默认内置 1x1 PNG）\n"
+        "  -m, --model NAME      请求里带的 model 字段\n"
+        "      --watchers N      另外挂 N 个 SSE 长连接到 watch 端口（默认 0）\n"
+        "      --watch-port P    服务端的 WS_AI_WATCH_PORT（默认 8081）\n"
+        "      --watch-jobs K    长连接订阅的目标任务数（默认 8）\n"
+        "      --watch-path P    stream（delta）| watch（进度），默认 stream\n"
+        "      --distinct N      轮流提交 N 张字节不同的图（默认 0：同一张；看分发模式的亲和路由）\n"
+        "      --crash-test CMD  用 CMD 启动服务端，发压中途 kill -9 再重启，检查拿到 id 的任务有没有丢\n"
+        "      --crash-after SEC 发压多少秒后 kill（默认 5）\n"
+        "      --expire-after SEC 恢复检查完等 SEC 秒（= 服务端 WS_AI_JOURNAL_RETAIN_SEC），已结束的任务在重启前后都应查不到\n";
+}
+
+bool parse_args(int argc, char **argv, Options &o) {
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        auto value = [&](int &idx) -> const char * { return idx + 1 < argc ? argv[++idx] : nullptr; };
+        if (a == "-h" || a == "--help") return false;
+        else if (a == "--host") { const char *v = value(i); if (!v) return false; o.host = v; }
+        else if (a == "--port") { const char *v = value(i); if (!v) return false; o.port = std::atoi(v); }
+        else if (a == "-r" || a == "--rate") { const char *v = value(i); if (!v) return false; o.rate = std::max(0.01, std::atof(v)); }
+        else if (a == "-d" || a == "--duration") { const char *v = value(i); if (!v) return false; o.duration = std::max(0.1, std::atof(v)); }
+        else if (a == "--mode") { const char *v = value(i); if (!v) return false; o.mode = v; }
+        else if (a == "--uds") { const char *v = value(i); if (!v) return false; o.uds = v; }
+        else if (a == "--watch") { const char *v = value(i); if (!v) return false; o.watch = v; }
+        else if (a == "--poll-ms") { const char *v = value(i); if (!v) return false; o.poll_ms = std::max(1, std::atoi(v)); }
+        else if (a == "-w" || a == "--workers") { const char *v = value(i); if (!v) return false; o.workers = std::max(1, std::atoi(v)); }
+        else if (a == "--timeout") { const char *v = value(i); if (!v) return false; o.timeout = std::max(0.1, std::atof(v)); }
+        else if (a == "--poisson") o.poisson = true;
+        else if (a == "--image") { const char *v = value(i); if (!v) return false; o.image = v; }
+        else if (a == "-m" || a == "--model") { const char *v = value(i); if (!v) return false; o.model = v; }
+        else if (a == "--watchers") { const char *v = value(i); if (!v) return false; o.watchers = std::max(0, std::atoi(v)); }
+        else if (a == "--watch-port") { const char *v = value(i); if (!v) return false; o.watch_port = std::atoi(v); }
+        else if (a == "--watch-jobs") { const char *v = value(i); if (!v) return false; o.watch_jobs = std::max(1, std::atoi(v)); }
+        else if (a == "--watch-path") { const char *v = value(i); if (!v) return false; o.watch_path = v; }
+        else if (a == "--distinct") { const char *v = value(i); if (!v) return false; o.distinct = std::max(0, std::atoi(v)); }
+        else if (a == "--crash-test") { const char *v = value(i); if (!v) return false; o.crash_cmd = v; }
+        else if (a == "--crash-after") { const char *v = value(i); if (!v) return false; o.crash_after = std::max(0.1, std::atof(v)); }
+        else if (a == "--expire-after") { const char *v = value(i); if (!v) return false; o.expire_after = std::max(0.0, std::atof(v)); }
+        else { std::cerr << "未知参数: " << a << "\n"; return false; }
+    }
+    if (o.mode != "upload" && o.mode != "clipboard" && o.mode != "mixed" && o.mode != "uds" && o.mode != "uds-fd") return false;
+    if (o.watch != "status" && o.watch != "stream" && o.watch != "none") return false;
+    if (o.watch_path != "stream" && o.watch_path != "watch") return false;
+    return true;
+}
+
+double ms_since(Clock::time_point a, Clock::time_point b = Clock::now()) {
+    return std::chrono::duration<double, std::milli>(b - a).count();
+}
+
+std::string base64_encode(const std::string &in) {
+    static const char *tbl = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string out;
+    out.reserve((in.size() + 2) / 3 * 4);
+    size_t i = 0;
+    for (; i + 2 < in.size(); i += 3) {
+        uint32_t v = ((uint8_t)in[i] << 16) | ((uint8_t)in[i + 1] << 8) | (uint8_t)in[i + 2];
+        out += tbl[(v >> 18) & 63]; out += tbl[(v >> 12) & 63]; out += tbl[(v >> 6) & 63]; out += tbl[v & 63];
+    }
+    if (i + 1 == in.size()) {
+        uint32_t v = (uint8_t)in[i] << 16;
+        out += tbl[(v >> 18) & 63]; out += tbl[(v >> 12) & 63]; out += "==";
+    } else if (i + 2 == in.size()) {
+        uint32_t v = ((uint8_t)in[i] << 16) | ((uint8_t)in[i + 1] << 8);
+        out += tbl[(v >> 18) & 63]; out += tbl[(v >> 12) & 63]; out += tbl[(v >> 6) & 63]; out += '=';
+    }
+    return out;
+}
+
+std::string mime_of(const std::string &path) {
+    std::string ext = path.substr(path.find_last_of('.') == std::string::npos ? path.size() : path.find_last_of('.'));
+    for (auto &c : ext) c = (char)tolower((unsigned char)c);
+    if (ext == ".jpg" || ext == ".jpeg") return "image/jpeg";
+    if (ext == ".webp") return "image/webp";
+    if (ext == ".heic") return "image/heic";
+    return "image/png";
+}
+
+// 所有 worker 共用的结果收集
+struct Results {
+    std::mutex mu;
+    std::vector<double> submit_ms;
+    std::vector<double> first_delta_ms;
+    std::vector<double> complete_ms;
+    int sent = 0;
+    int submit_errors = 0;
+    int job_errors = 0;
+    int timeouts = 0;
+    int done = 0;
+    int dup_hits = 0;
+    std::vector<std::string> ids;  // 提交成功拿到的 id（--crash-test 用）
+};
+
+struct Shot {
+    Clock::time_point intended;
+    bool clipboard = false;
+    int variant = -1;  // --distinct：第几张图
+};
+
+class Runner {
+public:
+    Runner(const Options &o, std::string image_bytes, std::string mime)
+    : o_(o), image_(std::move(image_bytes)), mime_(std::move(mime)) {
+        clipboard_body_ = clipboard_body(image_);
+    }
+
+    void run() {
+        std::vector<std::thread> workers;
+        for (int i = 0; i < o_.workers; ++i) workers.emplace_back([this] { worker(); });
+
+        // 调度线程：按计划时间把请求放进队列，worker 忙不过来就在队列里排着（延迟照算）
+        std::mt19937_64 rng(std::random_device{}());
+        std::exponential_distribution<double> expo(o_.rate);
+        std::uniform_int_distribution<int> coin(0, 1);
+        const auto t0 = Clock::now();
+        const auto t_end = t0 + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(o_.duration));
+        double t = 0;
+        for (long k = 1;; ++k) {
+            const auto when = t0 + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(t));
+            if (when >= t_end) break;
+            std::this_thread::sleep_until(when);
+            Shot s;
+            s.intended = when;
+            s.clipboard = o_.mode == "clipboard" || (o_.mode == "mixed" && coin(rng));
+            s.variant = o_.distinct > 0 ? (int)((k - 1) % o_.distinct) : -1;
+            {
+                std::lock_guard<std::mutex> lk(qmu_);
+                queue_.push_back(s);
+                max_backlog_ = std::max(max_backlog_, queue_.size());
+            }
+            qcv_.notify_one();
+            t = o_.poisson ? t + expo(rng) : (double)k / o_.rate;
+        }
+        {
+            std::lock_guard<std::mutex> lk(qmu_);
+            closed_ = true;
+        }
+        qcv_.notify_all();
+        for (auto &th : workers) th.join();
+        wall_s_ = ms_since(t0) / 1000.0;
+    }
+
+    Results &results() { return res_; }
+    size_t max_backlog() const { return max_backlog_; }
+    double wall_s() const { return wall_s_; }
+
+private:
+    std::string clipboard_body(const std::string &img) const {
+        json body = {{"data_url", "data:" + mime_ + ";base64," + base64_encode(img)}};
+        if (!o_.model.empty()) body["model"] = o_.model;
+        return body.dump();
+    }
+
+    void worker() {
+        httplib::Client cli(o_.host, o_.port);
+        cli.set_connection_timeout(5, 0);
+        cli.set_read_timeout((time_t)o_.timeout + 5, 0);
+        // 不开 keep-alive：空闲长连接会一直占着服务端的 worker 线程，测出来的是客户端连接数而不是服务
+        for (;;) {
+            Shot s;
+            {
+                std::unique_lock<std::mutex> lk(qmu_);
+                qcv_.wait(lk, [&] { return closed_ || !queue_.empty(); });
+                if (queue_.empty()) return;
+                s = queue_.front();
+                queue_.pop_front();
+            }
+            one(cli, s);
+        }
+    }
+
+    void one(httplib::Client &cli, const Shot &s) {
+        {
+            std::lock_guard<std::mutex> lk(res_.mu);
+            res_.sent++;
+        }
+
+        // 不同的图：末尾加几个字节（解码器忽略 IEND 之后的内容，内容哈希不同）
+        const std::string image = s.variant < 0 ? image_ : image_ + "#" + std::to_string(s.variant);
+        if (o_.mode == "uds" || o_.mode == "uds-fd") {
+            one_uds(s, image);
+            return;
+        }
+
+        httplib::Result r;
+        if (s.clipboard) {
+            r = cli.Post("/api/clipboard", s.variant < 0 ? clipboard_body_ : clipboard_body(image), "application/json");
+        } else {
+            httplib::UploadFormDataItems items = {{"file", image, "shot.png", mime_}};
+            if (!o_.model.empty()) items.push_back({"model", o_.model, "", ""});
+            r = cli.Post("/api/upload", items);
+        }
+        const double submit_ms = ms_since(s.intended);
+
+        std::string id;
+        if (r && r->status == 200) {
+            json j = json::parse(r->body, nullptr, false);
+            if (!j.is_discarded() && j.value("ok", false)) id = j.value("id", "");
+        }
+        {
+            std::lock_guard<std::mutex> lk(res_.mu);
+            if (id.empty()) { res_.submit_errors++; return; }
+            res_.submit_ms.push_back(submit_ms);
+            res_.ids.push_back(id);
+        }
+        if (o_.watch == "none") return;
+
+        const auto deadline = s.intended + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(o_.timeout));
+        if (o_.watch == "stream") watch_stream(cli, id, s.intended, deadline);
+        else watch_status(cli, id, s.intended, deadline);
+    }
+
+    // 图片放进一个 fd：Linux 用 memfd（截图守护进程可以直接往里画），其它平台用临时文件（等任务结束再删）
+    int image_fd(const std::string &image, std::string &tmp_path) {
+#ifdef __linux__
+        (void)tmp_path;
+        const int fd = memfd_create("ws_ai_shot", MFD_CLOEXEC);
+#else
+        char tmpl[] = "/tmp/ws_ai_loadgen_XXXXXX";
+        const int fd = mkstemp(tmpl);
+        if (fd >= 0) tmp_path = tmpl;
+#endif
+        if (fd < 0) return -1;
+        if (::write(fd, image.data(), image.size()) != (ssize_t)image.size()) {
+            ::close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    void one_uds(const Shot &s, const std::string &image) {
+        namespace lp = ws_ai::local_proto;
+        const int sock = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        std::snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", o_.uds.c_str());
+#ifdef SO_NOSIGPIPE
+        int one = 1;
+        setsockopt(sock, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+        std::string tmp_path;
+        auto fail_submit = [&] {
+            if (sock >= 0) ::close(sock);
+            if (!tmp_path.empty()) ::unlink(tmp_path.c_str());
+            std::lock_guard<std::mutex> lk(res_.mu);
+            res_.submit_errors++;
+        };
+        if (sock < 0 || ::connect(sock, (const sockaddr *)&addr, sizeof(addr)) != 0) return fail_submit();
+
+        std::string opts;
+        if (!o_.model.empty()) opts = "model=" + o_.model + "&";
+        if (o_.watch == "none") opts += "stream=0";
+        bool sent;
+        if (o_.mode == "uds-fd") {
+            const int fd = image_fd(image, tmp_path);
+            if (fd < 0) return fail_submit();
+            sent = lp::send_frame(sock, lp::kSubmit, opts + "\n", fd);
+            ::close(fd);  // 服务端拿到的是自己的一份
+        } else {
+            sent = lp::send_frame(sock, lp::kSubmit, opts + "\n" + image);
+        }
+
+        const size_t kMax = 16 << 20;
+        char type = 0;
+        std::string payload;
+        if (!sent || !lp::recv_frame(sock, type, payload, nullptr, kMax) || type != lp::kId) return fail_submit();
+        {
+            std::lock_guard<std::mutex> lk(res_.mu);
+            res_.submit_ms.push_back(ms_since(s.intended));
+            res_.ids.push_back(payload);
+        }
+        // 非 Linux 的临时文件：服务端按路径读，不看结果时没法知道什么时候能删，留着
+        if (o_.watch == "none") {
+            ::close(sock);
+            return;
+        }
+
+        const auto deadline = s.intended + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(o_.timeout));
+        double first_delta = -1;
+        for (;;) {
+            const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count();
+            pollfd p{sock, POLLIN, 0};
+            if (left <= 0 || ::poll(&p, 1, (int)left) <= 0) {
+                timed_out();
+                break;
+            }
+            if (!lp::recv_frame(sock, type, payload, nullptr, kMax)) {
+                finish(json::object(), s.intended, first_delta);
+                break;
+            }
+            if (type == lp::kDelta) {
+                if (first_delta < 0) first_delta = ms_since(s.intended);
+            } else {
+                json j = type == lp::kFinal ? json::parse(payload, nullptr, false) : json::object();
+                finish(j.is_discarded() ? json::object() : j, s.intended, first_delta);
+                break;
+            }
+        }
+        ::close(sock);
+        if (!tmp_path.empty()) ::unlink(tmp_path.c_str());
+    }
+
+    void finish(const json &status, Clock::time_point intended, double first_delta_ms) {
+        const double total = ms_since(intended);
+        std::lock_guard<std::mutex> lk(res_.mu);
+        if (first_delta_ms >= 0) res_.first_delta_ms.push_back(first_delta_ms);
+        if (status.value("state", "") == "done") {
+            res_.done++;
+            res_.complete_ms.push_back(total);
+            if (status.contains("dup_of")) res_.dup_hits++;
+        } else {
+            res_.job_errors++;
+        }
+    }
+
+    void timed_out() {
+        std::lock_guard<std::mutex> lk(res_.mu);
+        res_.timeouts++;
+    }
+
+    void watch_status(httplib::Client &cli, const std::string &id, Clock::time_point intended, Clock::time_point deadline) {
+        double first_delta = -1;
+        while (Clock::now() < deadline) {
+            auto r = cli.Get("/api/status?id=" + id);
+            if (r && r->status == 200) {
+                json j = json::parse(r->body, nullptr, false);
+                if (!j.is_discarded()) {
+                    const std::string state = j.value("state", "");
+                    if (state == "done" || state == "error") { finish(j, intended, first_delta); return; }
+                    if (first_delta < 0 && !j.value("partial", "").empty()) first_delta = ms_since(intended);
+                }
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(o_.poll_ms));
+        }
+        timed_out();
+    }
+
+    // 简单的 SSE 解析：按空行切事件，只认 event: / data: 两种行
+    void watch_stream(httplib::Client &cli, const std::string &id, Clock::time_point intended, Clock::time_point deadline) {
+        std::string buf;
+        std::string event;
+        std::string data;
+        double first_delta = -1;
+        bool ended = false;
+        json final_status;
+
+        auto r = cli.Get("/api/stream?id=" + id, [&](const char *p, size_t n) {
+            buf.append(p, n);
+            size_t pos;
+            while ((pos = buf.find('\n')) != std::string::npos) {
+                std::string line = buf.substr(0, pos);
+                buf.erase(0, pos + 1);
+                if (line.empty()) {
+                    if (event == "delta" && first_delta < 0) first_delta = ms_since(intended);
+                    if (event == "done" || event == "error") {
+                        final_status = json::parse(data, nullptr, false);
+                        ended = true;
+                        return false;
+                    }
+                    event.clear();
+                    data.clear();
+                } else if (line.rfind("event: ", 0) == 0) {
+                    event = line.substr(7);
+                } else if (line.rfind("data: ", 0) == 0) {
+                    data += line.substr(6);
+                }
+            }
+            return Clock::now() < deadline;
+        });
+        (void)r;  // 主动中断时 r 是 Canceled，结果以解析到的事件为准
+
+        if (!ended) { timed_out(); return; }
+        if (final_status.is_discarded()) final_status = json::object();
+        finish(final_status, intended, first_delta);
+    }
+
+    const Options &o_;
+    std::string image_;
+    std::string mime_;
+    std::string clipboard_body_;
+
+    std::mutex qmu_;
+    std::condition_variable qcv_;
+    std::deque<Shot> queue_;
+    bool closed_ = false;
+    size_t max_backlog_ = 0;
+
+    Results res_;
+    double wall_s_ = 0;
+};
+
+double percentile(std::vector<double> v, double p) {
+    if (v.empty()) return 0;
+    std::sort(v.begin(), v.end());
+    const size_t idx = std::min(v.size() - 1, (size_t)(p / 100.0 * (double)(v.size() - 1) + 0.5));
+    return v[idx];
+}
+
+void print_latency(const char *name, const std::vector<double> &v) {
+    if (v.empty()) {
+        std::cout << "  " << std::left << std::setw(12) << name << "(无样本)\n";
+        return;
+    }
+    std::cout << "  " << std::left << std::setw(12) << name << std::right << std::fixed << std::setprecision(1)
+              << "p50 " << std::setw(8) << percentile(v, 50)
+              << "  p95 " << std::setw(8) << percentile(v, 95)
+              << "  p99 " << std::setw(8) << percentile(v, 99)
+              << "  max " << std::setw(8) << percentile(v, 100) << " ms  (n=" << v.size() << ")\n";
+}
+
+// --watchers：N 个非阻塞 SSE 连接放在一个线程里 poll，连接 i 订阅 jobs[i % K]。
+// 同时在途的 connect 限制在 256 个，免得把服务端的 accept 队列冲满
+class Swarm {
+public:
+    Swarm(const Options &o, std::vector<std::string> jobs)
+    : o_(o), jobs_(std::move(jobs)), first_done_(jobs_.size()), last_done_(jobs_.size()) {}
+
+    ~Swarm() {
+        stop_ = true;
+        if (th_.joinable()) th_.join();
+    }
+
+    void start() {
+        t0_ = Clock::now();
+        th_ = std::thread([this] { loop(); });
+    }
+
+    // 等到所有连接都建立（或失败）；超时返回 false
+    bool wait_established(double timeout_s) {
+        const auto until = Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(timeout_s));
+        while (Clock::now() < until) {
+            if (established_ + failed_ >= o_.watchers) return true;
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+        return false;
+    }
+
+    // 等所有连接收到 done / error（或断开）
+    void wait_finished(double timeout_s) {
+        const auto until = Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(timeout_s));
+        while (Clock::now() < until && !finished_) std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        stop_ = true;
+        if (th_.joinable()) th_.join();
+    }
+
+    double established_s() const { return established_s_; }
+    int failed() const { return failed_; }
+    int incomplete() const { return o_.watchers - done_ - failed_; }
+
+    void report() const {
+        std::cout << "\n长连接 " << o_.watchers << " 个（/api/" << o_.watch_path << "，" << jobs_.size() << " 个目标任务）："
+                  << "建立 " << established_.load() << "，失败 " << failed_.load()
+                  << "，收到结束事件 " << done_ << "，提前断开 " << closed_early_
+                  << "，未结束 " << incomplete() << "\n";
+        std::cout << "  收到事件 " << events_ << "，" << std::fixed << std::setprecision(1) << bytes_ / 1048576.0 << " MB"
+                  << "，全部建立用时 " << std::setprecision(2) << established_s_ << " s\n";
+        print_latency("connect", connect_ms_);
+        std::vector<double> spread;
+        for (size_t j = 0; j < jobs_.size(); ++j) {
+            if (first_done_[j] > 0) spread.push_back(last_done_[j] - first_done_[j]);
+        }
+        // 同一个任务的 done 事件，第一个连接和最后一个连接收到的时间差：fan-out 推完一轮要多久
+        print_latency("done spread", spread);
+    }
+
+private:
+    enum class St { idle, connecting, open, finished };
+    struct W {
+        int fd = -1;
+        St st = St::idle;
+        bool header = false;
+        std::string tail;  // 上一块末尾，防止事件名被切开
+        Clock::time_point t0;
+    };
+
+    void loop() {
+        std::vector<W> ws(o_.watchers);
+        std::vector<pollfd> pfds;
+        std::vector<int> idx;
+        int next = 0, connecting = 0, live = 0;
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons((uint16_t)o_.watch_port);
+        inet_pton(AF_INET, o_.host.c_str(), &addr.sin_addr);
+
+        while (!stop_) {
+            while (next < o_.watchers && connecting < 256) {
+                W &w = ws[next++];
+                w.t0 = Clock::now();
+                w.fd = ::socket(AF_INET, SOCK_STREAM, 0);
+                if (w.fd >= 0) fcntl(w.fd, F_SETFL, fcntl(w.fd, F_GETFL, 0) | O_NONBLOCK);
+                if (w.fd < 0 || (::connect(w.fd, (sockaddr *)&addr, sizeof(addr)) != 0 && errno != EINPROGRESS)) {
+                    fail(w);
+                    continue;
+                }
+                w.st = St::connecting;
+                connecting++;
+                live++;
+            }
+
+            pfds.clear();
+            idx.clear();
+            for (int i = 0; i < next; ++i) {
+                if (ws[i].st != St::connecting && ws[i].st != St::open) continue;
+                pfds.push_back({ws[i].fd, (short)(ws[i].st == St::connecting ? POLLOUT : POLLIN), 0});
+                idx.push_back(i);
+            }
+            if (pfds.empty() && next >= o_.watchers) break;
+            if (::poll(pfds.data(), (nfds_t)pfds.size(), 100) <= 0) continue;
+
+            for (size_t k = 0; k < pfds.size(); ++k) {
+                if (!pfds[k].revents) continue;
+                const int i = idx[k];
+                W &w = ws[i];
+                if (w.st == St::connecting) {
+                    connecting--;
+                    int err = 0;
+                    socklen_t len = sizeof(err);
+                    getsockopt(w.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+                    const std::string req = "GET /api/" + o_.watch_path + "?id=" + jobs_[i % jobs_.size()] +
+                                            " HTTP/1.1\r\nHost: " + o_.host + "\r\nAccept: text/event-stream\r\n\r\n";
+                    if (err != 0 || ::send(w.fd, req.data(), req.size(), 0) != (ssize_t)req.size()) {
+                        fail(w);
+                        live--;
+                        continue;
+                    }
+                    w.st = St::open;
+                    continue;
+                }
+                if (!read_some(w, i % jobs_.size())) live--;
+            }
+        }
+        for (W &w : ws) {
+            if (w.fd >= 0) ::close(w.fd);
+        }
+        finished_ = live == 0 && next >= o_.watchers;
+    }
+
+    // 读一块并数事件；连接结束返回 false
+    bool read_some(W &w, size_t job) {
+        char buf[16384];
+        const ssize_t n = ::recv(w.fd, buf, sizeof(buf), 0);
+        if (n < 0 && (errno == EAGAIN || errno == EINTR)) return true;
+        if (n <= 0) {
+            if (!w.header) failed_++;
+            else closed_early_++;
+            close(w);
+            return false;
+        }
+        bytes_ += (size_t)n;
+        std::string s = w.tail + std::string(buf, (size_t)n);
+        if (!w.header) {
+            const size_t eoh = s.find("\r\n\r\n");
+            if (eoh == std::string::npos) {
+                w.tail = s;
+                return true;
+            }
+            if (s.compare(0, 12, "HTTP/1.1 200") != 0) {
+                fail(w);
+                return false;
+            }
+            w.header = true;
+            const double ms = ms_since(w.t0);
+            connect_ms_.push_back(ms);
+            if (++established_ == o_.watchers - failed_) established_s_ = ms_since(t0_) / 1000.0;
+            s.erase(0, eoh + 4);
+        }
+        for (size_t p = 0; (p = s.find("event: ", p)) != std::string::npos; p += 7) events_++;
+        const bool ended = s.find("event: done") != std::string::npos || s.find("event: error") != std::string::npos;
+        if (ended) {
+            const double t = ms_since(t0_);
+            if (first_done_[job] <= 0 || t < first_done_[job]) first_done_[job] = t;
+            last_done_[job] = std::max(last_done_[job], t);
+            done_++;
+            close(w);
+            return false;
+        }
+        // 留下不足一个事件名的尾巴，下一块拼上再找；不会重复计数
+        w.tail = s.size() > 10 ? s.substr(s.size() - 10) : s;
+        return true;
+    }
+
+    void fail(W &w) {
+        failed_++;
+        close(w);
+        if (established_ + failed_ == o_.watchers && established_s_ == 0) established_s_ = ms_since(t0_) / 1000.0;
+    }
+
+    void close(W &w) {
+        if (w.fd >= 0) ::close(w.fd);
+        w.fd = -1;
+        w.st = St::finished;
+    }
+
+    const Options &o_;
+    std::vector<std::string> jobs_;
+    std::thread th_;
+    std::atomic<bool> stop_{false};
+    std::atomic<bool> finished_{false};
+    Clock::time_point t0_;
+
+    std::atomic<int> established_{0};
+    std::atomic<int> failed_{0};
+    double established_s_ = 0;
+    // 下面只在 poll 线程里写，wait_finished 之后才读
+    int done_ = 0;
+    int closed_early_ = 0;
+    uint64_t events_ = 0;
+    uint64_t bytes_ = 0;
+    std::vector<double> connect_ms_;
+    std::vector<double> first_done_;
+    std::vector<double> last_done_;
+};
+
+// 一万个连接需要把 fd 软上限提上去
+void raise_fd_limit(size_t want) {
+    rlimit rl{};
+    if (getrlimit(RLIMIT_NOFILE, &rl) != 0 || rl.rlim_cur >= want) return;
+    rl.rlim_cur = rl.rlim_max == RLIM_INFINITY ? want : std::min<rlim_t>(rl.rlim_max, want);
+    setrlimit(RLIMIT_NOFILE, &rl);
+}
+
+json fetch_stats(const Options &o, int port = 0, const char *path = "/api/stats") {
+    httplib::Client cli(o.host, port ? port : o.port);
+    cli.set_connection_timeout(5, 0);
+    auto r = cli.Get(path);
+    if (!r || r->status != 200) return json();
+    json j = json::parse(r->body, nullptr, false);
+    return j.is_discarded() ? json() : j;
+}
+
+// --crash-test：sh -c 启动服务端，setsid 让它（以及 sh 派生的进程）自成一个进程组，kill 时整组一起杀
+pid_t spawn_server(const std::string &cmd) {
+    const pid_t pid = fork();
+    if (pid == 0) {
+        setsid();
+        execl("/bin/sh", "sh", "-c", cmd.c_str(), (char *)nullptr);
+        _exit(127);
+    }
+    return pid;
+}
+
+void kill_server(pid_t pid) {
+    if (pid <= 0) return;
+    ::kill(-pid, SIGKILL);
+    waitpid(pid, nullptr, 0);
+}
+
+// 等 /api/stats 能访问，返回耗时（ms）；超时或进程已经退出返回 -1
+double wait_up(const Options &o, pid_t pid, double timeout_s) {
+    const auto t0 = Clock::now();
+    while (ms_since(t0) < timeout_s * 1000) {
+        if (!fetch_stats(o).is_null()) return ms_since(t0);
+        if (waitpid(pid, nullptr, WNOHANG) == pid) return -1;
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return -1;
+}
+
+json fetch_status(httplib::Client &cli, const std::string &id) {
+    auto r = cli.Get("/api/status?id=" + id);
+    if (!r || r->status != 200) return json();
+    json j = json::parse(r->body, nullptr, false);
+    if (j.is_discarded()) return json();
+    if (!j.value("ok", true) && j.value("error", "") == "not found") return json::object();  // 不存在
+    return j;
+}
+
+// 等过了保留时间，数 ids 里还查得到的（返回 -1 表示服务端访问不了）
+int count_unexpired(const Options &o, const std::vector<std::string> &ids) {
+    httplib::Client cli(o.host, o.port);
+    cli.set_connection_timeout(5, 0);
+    int found = 0;
+    for (const auto &id : ids) {
+        const json j = fetch_status(cli, id);
+        if (j.is_null()) return -1;
+        if (!j.empty()) {
+            found++;
+            if (found <= 5) std::cout << "  没过期 " << id << "\n";
+        }
+    }
+    return found;
+}
+
+int crash_test(Options o, const std::string &image, const std::string &mime) {
+    // 提交成功就算数，不等结果；每次的图都不同，避免近重复检测把任务合并掉
+    o.watch = "none";
+    o.duration = o.crash_after * 2;
+    if (o.distinct == 0) o.distinct = 1 << 30;
+
+    pid_t pid = spawn_server(o.crash_cmd);
+    if (wait_up(o, pid, 30) < 0) {
+        std::cerr << "服务端没起来: " << o.crash_cmd << "\n";
+        kill_server(pid);
+        return 1;
+    }
+    std::cout << "崩溃恢复测试：rate=" << o.rate << "/s，" << o.crash_after << " s 后 kill -9  (" << o.crash_cmd << ")\n";
+
+    // 发压线程跑 2 倍时长，主线程到点直接杀：kill 时正在提交的请求失败（拿不到 id 的不算）
+    Runner runner(o, image, mime);
+    std::thread load([&] { runner.run(); });
+    std::this_thread::sleep_for(std::chrono::duration<double>(o.crash_after));
+    std::vector<std::string> ids;
+    {
+        Results &r = runner.results();
+        std::lock_guard<std::mutex> lk(r.mu);
+        ids = r.ids;
+    }
+    // 杀之前看一眼哪些已经有结果
+    std::map<std::string, std::string> done_before;
+    {
+        httplib::Client cli(o.host, o.port);
+        cli.set_connection_timeout(1, 0);
+        for (const auto &id : ids) {
+            const json j = fetch_status(cli, id);
+            if (j.is_object() && j.value("state", "") == "done") done_before[id] = j.value("result", "");
+        }
+    }
+    kill_server(pid);
+    load.join();
+    {
+        Results &r = runner.results();
+        std::lock_guard<std::mutex> lk(r.mu);
+        ids = r.ids;  // kill 前一刻拿到的 id 也算
+    }
+    std::cout << "kill 前拿到 id " << ids.size() << " 个，其中已完成 " << done_before.size() << "\n";
+
+    pid = spawn_server(o.crash_cmd);
+    const double up_ms = wait_up(o, pid, 60);
+    if (up_ms < 0) {
+        std::cerr << "重启失败\n";
+        kill_server(pid);
+        return 1;
+    }
+    const json stats = fetch_stats(o);
+    std::cout << std::fixed << std::setprecision(1) << "重启到可用 " << up_ms << " ms";
+    if (stats.contains("journal")) {
+        const json &jn = stats["journal"];
+        const json rp = jn.value("replay", json::object());
+        std::cout << "，日志回放 " << rp.value("records", 0) << " 条 / " << (rp.value("bytes", 0) >> 10) << " KB，"
+                  << rp.value("ms", 0.0) << " ms，恢复 " << jn.value("recovered", 0) << " 个任务，重新排队 "
+                  << jn.value("requeued", 0);
+        if (rp.value("dropped_bytes", 0) > 0) std::cout << "，丢弃损坏的尾部 " << rp.value("dropped_bytes", 0) << " 字节";
+    } else {
+        std::cout << "（服务端没有 journal 统计）";
+    }
+    std::cout << "\n";
+
+    // 逐个等到结束
+    std::vector<std::string> finished;
+    int lost = 0, mismatched = 0, done = 0, failed = 0, unfinished = 0;
+    httplib::Client cli(o.host, o.port);
+    cli.set_connection_timeout(5, 0);
+    const auto t_end = Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(o.timeout));
+    for (const auto &id : ids) {
+        json j;
+        for (;;) {
+            j = fetch_status(cli, id);
+            const std::string state = j.is_object() ? j.value("state", "") : "";
+            if ((j.is_object() && j.empty()) || state == "done" || state == "error" || Clock::now() >= t_end) break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(o.poll_ms));
+        }
+        const std::string state = j.is_object() ? j.value("state", "") : "";
+        if (j.is_object() && j.empty()) {
+            lost++;
+            if (lost <= 5) std::cout << "  丢失 " << id << "\n";
+        } else if (state == "done") {
+            done++;
+            finished.push_back(id);
+            auto it = done_before.find(id);
+            if (it != done_before.end() && it->second != j.value("result", "")) {
+                mismatched++;
+                if (mismatched <= 5) std::cout << "  结果不一致 " << id << "\n";
+            }
+        } else if (state == "error") {
+            failed++;
+            finished.push_back(id);
+        } else {
+            unfinished++;
+        }
+    }
+    std::cout << "重启后：完成 " << done << "，失败 " << failed << "，超时未结束 " << unfinished << "，丢失 " << lost
+              << "，结果不一致 " << mismatched << "\n";
+    if (o.expire_after <= 0 || finished.empty()) {
+        kill_server(pid);
+        return lost == 0 && mismatched == 0 ? 0 : 1;
+    }
+
+    // 过期：保留时间按提交时刻算，最后一个任务提交后再等够；服务端空闲时每秒清一次，多等 2 s
+    std::this_thread::sleep_for(std::chrono::duration<double>(o.expire_after + 2));
+    const int live = count_unexpired(o, finished);
+    kill_server(pid);
+    pid = spawn_server(o.crash_cmd);
+    const int live_restart = wait_up(o, pid, 60) < 0 ? -1 : count_unexpired(o, finished);
+    kill_server(pid);
+    std::cout << "过期（" << o.expire_after << " s）：" << finished.size() << " 个已结束的任务，仍查得到 " << live
+              << "，kill -9 重启后仍查得到 " << live_restart << "\n";
+    return lost == 0 && mismatched == 0 && live == 0 && live_restart == 0 ? 0 : 1;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    Options o;
+    if (!parse_args(argc, argv, o)) {
+        usage();
+        return 2;
+    }
+
+    std::string image(reinterpret_cast<const char *>(kTinyPng), sizeof(kTinyPng));
+    std::string mime = "image/png";
+    if (!o.image.empty()) {
+        std::ifstream ifs(o.image, std::ios::binary);
+        if (!ifs) {
+            std::cerr << "读不了图片: " << o.image << "\n";
+            return 1;
+        }
+        std::ostringstream oss;
+        oss << ifs.rdbuf();
+        image = oss.str();
+        mime = mime_of(o.image);
+    }
+    if (!o.crash_cmd.empty()) return crash_test(o, image, mime);
+
+    const json before = fetch_stats(o);
+    if (before.is_null()) {
+        std::cerr << "连不上 http://" << o.host << ":" << o.port << "/api/stats\n";
+        return 1;
+    }
+
+    std::cout << "压测 http://" << o.host << ":" << o.port
+              << "  rate=" << o.rate << "/s" << (o.poisson ? "(poisson)" : "")
+              << "  duration=" << o.duration << "s  mode=" << o.mode << "  watch=" << o.watch
+              << "  workers=" << o.workers << "  pipeline=" << before.value("pipeline", "?") << "\n";
+
+    // 长连接：先提交目标任务，连接全部建好再开始发压
+    std::unique_ptr<Swarm> swarm;
+    if (o.watchers > 0) {
+        raise_fd_limit((size_t)o.watchers + 1024);
+        httplib::Client cli(o.host, o.port);
+        std::vector<std::string> jobs;
+        for (int k = 0; k < o.watch_jobs; ++k) {
+            // 每个目标任务的图片字节不同，避免被近重复检测直接复用
+            std::string img = image;
+            img += std::to_string(k) + "-" + std::to_string((long long)Clock::now().time_since_epoch().count());
+            auto r = cli.Post("/api/upload", httplib::UploadFormDataItems{{"file", img, "target.png", mime}});
+            json j = r && r->status == 200 ? json::parse(r->body, nullptr, false) : json();
+            if (j.is_object() && j.value("ok", false)) jobs.push_back(j.value("id", ""));
+        }
+        if (jobs.empty()) {
+            std::cerr << "提交目标任务失败\n";
+            return 1;
+        }
+        swarm = std::make_unique<Swarm>(o, jobs);
+        swarm->start();
+        if (!swarm->wait_established(60)) std::cerr << "60 s 内没能建立全部长连接\n";
+        std::cout << "长连接已建立（" << swarm->failed() << " 个失败），用时 " << std::fixed << std::setprecision(2)
+                  << swarm->established_s() << " s，开始发压\n";
+    }
+
+    Runner runner(o, image, mime);
+    runner.run();
+    const json after = fetch_stats(o);
+
+    Results &r = runner.results();
+    const int finished = r.done + r.job_errors;
+    std::cout << "\n发送 " << r.sent << "，提交失败 " << r.submit_errors
+              << "，完成 " << r.done << "（近重复复用 " << r.dup_hits << "）"
+              << "，job 失败 " << r.job_errors << "，超时 " << r.timeouts << "\n";
+    std::cout << std::fixed << std::setprecision(2)
+              << "实际提交速率 " << (r.sent / o.duration) << "/s，完成吞吐 " << (finished / runner.wall_s()) << "/s"
+              << "，错误率 " << (r.sent ? 100.0 * (r.submit_errors + r.job_errors + r.timeouts) / r.sent : 0.0) << "%"
+              << "，客户端最大排队 " << runner.max_backlog() << "\n\n";
+
+    std::cout << "延迟（从计划发送时间算起）\n";
+    print_latency("submit", r.submit_ms);
+    print_latency("first delta", r.first_delta_ms);
+    print_latency("complete", r.complete_ms);
+
+    if (!after.is_null() && after.contains("lock") && before.contains("lock")) {
+        const json &a = after["lock"];
+        const json &b = before["lock"];
+        const double acq = a.value("acquisitions", 0.0) - b.value("acquisitions", 0.0);
+        const double cont = a.value("contended", 0.0) - b.value("contended", 0.0);
+        const double wait_ms = a.value("wait_ms", 0.0) - b.value("wait_ms", 0.0);
+        std::cout << "\n服务端 JobManager 锁：获取 " << (long long)acq << " 次，争用 " << (long long)cont
+                  << " 次（" << std::setprecision(2) << (acq > 0 ? 100.0 * cont / acq : 0.0) << "%）"
+                  << "，累计等待 " << std::setprecision(3) << wait_ms << " ms"
+                  << "，单次最长（进程累计）" << std::setprecision(1) << a.value("max_wait_us", 0.0) << " us\n";
+        std::cout << "服务端队列：queued=" << after.value("queued", 0) << " running=" << after.value("running", 0)
+                  << " jobs=" << after.value("jobs", 0) << "\n";
+    }
+    // 分发模式：各 worker 分到的任务数（累计）
+    if (!after.is_null() && after.contains("workers") && after["workers"].is_array()) {
+        std::cout << "\n分发：重试 " << after.value("retried", 0) << "，亲和命中 " << after.value("affinity_hits", 0) << "\n";
+        for (const json &w : after["workers"]) {
+            std::cout << "  " << std::left << std::setw(22) << w.value("addr", "?") << std::right
+                      << (w.value("healthy", false) ? "up  " : "down") << "  routed " << w.value("routed", 0)
+                      << "  affinity " << w.value("affinity", 0) << "  errors " << w.value("errors", 0) << "\n";
+        }
+    }
+    int swarm_errors = 0;
+    if (swarm) {
+        swarm->wait_finished(o.timeout);
+        swarm->report();
+        swarm_errors = swarm->failed() + swarm->incomplete();
+        const json ws = fetch_stats(o, o.watch_port, "/api/watch/stats");
+        if (!ws.is_null()) {
+            std::cout << "服务端 watch（" << ws.value("backend", "?") << "，" << ws.value("threads", 0) << " 线程）："
+                      << "推送事件 " << ws.value("events", 0) << "，唤醒 " << ws.value("wakeups", 0)
+                      << "，拒绝 " << ws.value("rejected", 0) << "，慢连接断开 " << ws.value("dropped_slow", 0) << "\n";
+        }
+    }
+    return (r.submit_errors + r.job_errors + r.timeouts + swarm_errors) == 0 ? 0 : 1;
+}
@@ -0,0 +1,276 @@
+#include "ws_ai/local_server.h"
+#include "ws_ai/local_proto.h"
+#include "ws_ai/util.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace ws_ai {
+
+static const int kPollMs = 500;  // 空闲连接 / accept 多久醒一次看 stop_
+
+// 按文件头猜后缀（Vision 不看后缀，只是让临时文件好认）
+static const char *sniff_suffix(const std::string &b) {
+    if (b.size() >= 8 && b.compare(0, 8, "\x89PNG\r\n\x1a\n", 8) == 0) return ".png";
+    if (b.size() >= 3 && b.compare(0, 3, "\xFF\xD8\xFF", 3) == 0) return ".jpg";
+    if (b.size() >= 12 && b.compare(0, 4, "RIFF") == 0 && b.compare(8, 4, "WEBP") == 0) return ".webp";
+    if (b.size() >= 12 && b.compare(4, 4, "ftyp") == 0) return ".heic";
+    return ".bin";
+}
+
+static std::string tmp_image_path(const char *suffix) {
+    return "/tmp/ws_ai_upload_" + uuid4() + suffix;
+}
+
+static std::string error_json(const std::string &msg) {
+    return "{\"ok\":false,\"error\":\"" + json_escape(msg) + "\"}";
+}
+
+// 收到的图片 fd -> 流水线能按路径打开的文件（指纹、内存估算、OCR 都按路径各自打开，读位置互不影响）。
+// 只认 fd 背后有名字的普通文件（Linux readlink /proc/self/fd/N，macOS F_GETPATH），而且按路径 stat 出来还得是同一个文件，
+// fd 可以马上关。/proc/self/fd/N 本身不能当路径交出去：任务会记进日志，重启后 N 指向的是别的文件，
+// fd 提前关掉（连接断开 / 退出）时编号还会被复用。memfd、已删除的文件拿不到路径，返回空，调用方拷一份
+static std::string fd_image_path(int fd, const struct stat &st) {
+    char buf[PATH_MAX];
+#if defined(__linux__)
+    const std::string link = "/proc/self/fd/" + std::to_string(fd);
+    const ssize_t n = ::readlink(link.c_str(), buf, sizeof(buf) - 1);
+    if (n <= 0) return "";
+    buf[n] = '\0';
+#elif defined(F_GETPATH)
+    if (fcntl(fd, F_GETPATH, buf) != 0) return "";
+#else
+    (void)fd;
+    return "";
+#endif
+    struct stat named{};
+    if (buf[0] != '/' || ::stat(buf, &named) != 0 || named.st_dev != st.st_dev || named.st_ino != st.st_ino) return "";
+    return buf;
+}
+
+// 按 fd 读出全部内容写到临时文件（fd_image_path 拿不到路径时）
+static bool copy_fd_to_file(int fd, uint64_t size, std::string &path) {
+    std::string bytes;
+    bytes.resize((size_t)size);
+    size_t got = 0;
+    while (got < bytes.size()) {
+        const ssize_t r = ::pread(fd, &bytes[got], bytes.size() - got, (off_t)got);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) break;
+        got += (size_t)r;
+    }
+    bytes.resize(got);
+    if (bytes.empty()) return false;
+    path = tmp_image_path(sniff_suffix(bytes));
+    return write_file_binary(path, bytes);
+}
+
+// "a=1&b=2" 里取一个值
+static std::string option(const std::string &opts, const char *key) {
+    const std::string k = std::string(key) + "=";
+    size_t pos = 0;
+    while (pos <= opts.size()) {
+        size_t end = opts.find('&', pos);
+        if (end == std::string::npos) end = opts.size();
+        if (opts.compare(pos, k.size(), k) == 0) return opts.substr(pos + k.size(), end - pos - k.size());
+        pos = end + 1;
+    }
+    return "";
+}
+
+LocalServer::LocalServer(const Config &cfg, std::shared_ptr<JobManager> jm) : cfg_(cfg), jm_(std::move(jm)) {}
+
+LocalServer::~LocalServer() { stop(); }
+
+bool LocalServer::start(const std::string &path, std::string &err) {
+    if (!jm_) {
+        err = "job manager not ready";
+        return false;
+    }
+    sockaddr_un addr{};
+    if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+        err = "socket 路径为空或太长: " + path;
+        return false;
+    }
+    addr.sun_family = AF_UNIX;
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+
+    // 上次没清掉的 socket 文件（进程被杀）：是 socket 才删，别误删普通文件
+    struct stat st{};
+    if (::lstat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) ::unlink(path.c_str());
+
+    const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        err = std::string("创建 socket 失败: ") + std::strerror(errno);
+        return false;
+    }
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    if (::bind(fd, (const sockaddr *)&addr, sizeof(addr)) != 0 || ::listen(fd, SOMAXCONN) != 0) {
+        err = "监听 " + path + " 失败: " + std::strerror(errno);
+        ::close(fd);
+        return false;
+    }
+    ::chmod(path.c_str(), 0600);
+
+    listen_fd_ = fd;
+    path_ = path;
+    stop_ = false;
+    accept_th_ = std::thread([this] { accept_loop(); });
+    return true;
+}
+
+void LocalServer::stop() {
+    if (listen_fd_ < 0) return;
+    stop_ = true;
+    if (accept_th_.joinable()) accept_th_.join();
+    {
+        std::lock_guard<std::mutex> lk(conns_mu_);
+        for (auto &c : conns_) ::shutdown(c->fd, SHUT_RDWR);
+    }
+    // 连接线程最多等一个 kPollMs / wait_stream 超时就会看到 stop_
+    for (auto &c : conns_) {
+        if (c->th.joinable()) c->th.join();
+        ::close(c->fd);
+    }
+    conns_.clear();
+    ::close(listen_fd_);
+    listen_fd_ = -1;
+    ::unlink(path_.c_str());
+}
+
+void LocalServer::accept_loop() {
+    while (!stop_) {
+        pollfd p{listen_fd_, POLLIN, 0};
+        if (::poll(&p, 1, kPollMs) <= 0) continue;
+        const int fd = ::accept(listen_fd_, nullptr, nullptr);
+        if (fd < 0) continue;
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+#ifdef SO_NOSIGPIPE
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+
+        std::lock_guard<std::mutex> lk(conns_mu_);
+        // 顺手回收已经结束的连接线程
+        for (auto it = conns_.begin(); it != conns_.end();) {
+            if ((*it)->finished) {
+                (*it)->th.join();
+                ::close((*it)->fd);
+                it = conns_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        if ((int)conns_.size() >= cfg_.uds_max_conns) {
+            local_proto::send_frame(fd, local_proto::kError, error_json("too many connections"));
+            ::close(fd);
+            continue;
+        }
+        auto c = std::make_unique<Conn>();
+        c->fd = fd;
+        Conn *raw = c.get();
+        c->th = std::thread([this, raw] { serve(raw); });
+        conns_.push_back(std::move(c));
+    }
+}
+
+void LocalServer::serve(Conn *c) {
+    const int sock = c->fd;
+    const size_t max_frame = cfg_.uds_max_image_mb * 1024 * 1024 + 4096;
+
+    while (!stop_) {
+        pollfd p{sock, POLLIN, 0};
+        const int r = ::poll(&p, 1, kPollMs);
+        if (r == 0 || (r < 0 && errno == EINTR)) continue;
+        if (r < 0) break;
+
+        char type = 0;
+        std::string payload;
+        int image_fd = -1;
+        if (!local_proto::recv_frame(sock, type, payload, &image_fd, max_frame)) {
+            if (image_fd >= 0) ::close(image_fd);
+            break;
+        }
+        if (type != local_proto::kSubmit) {
+            if (image_fd >= 0) ::close(image_fd);
+            local_proto::send_frame(sock, local_proto::kError, error_json("unknown frame type"));
+            break;
+        }
+        if (!submit(sock, payload, image_fd)) break;
+    }
+
+    // 只 shutdown 让客户端读到 EOF；fd 等 join 之后再关，免得 stop() 碰到被复用的 fd
+    ::shutdown(sock, SHUT_RDWR);
+    c->finished = true;
+}
+
+bool LocalServer::submit(int sock, const std::string &payload, int image_fd) {
+    const size_t nl = payload.find('\n');
+    const std::string opts = payload.substr(0, nl);
+    auto reject = [&](const std::string &msg) {
+        if (image_fd >= 0) ::close(image_fd);
+        return local_proto::send_frame(sock, local_proto::kError, error_json(msg));
+    };
+
+    const std::string model = option(opts, "model");
+    if (!model.empty() && !jm_->has_model(model)) return reject("unknown model: " + model);
+
+    std::string path;
+    if (image_fd >= 0) {
+        struct stat st{};
+        if (::fstat(image_fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0) return reject("bad image fd");
+        if ((uint64_t)st.st_size > cfg_.uds_max_image_mb * 1024 * 1024) return reject("image too large");
+        path = fd_image_path(image_fd, st);
+        if (path.empty() && !copy_fd_to_file(image_fd, (uint64_t)st.st_size, path)) return reject("failed to read image fd");
+        ::close(image_fd);
+        image_fd = -1;
+    } else {
+        if (nl == std::string::npos || nl + 1 >= payload.size()) return reject("missing image");
+        const std::string bytes = payload.substr(nl + 1);
+        path = tmp_image_path(sniff_suffix(bytes));
+        if (!write_file_binary(path, bytes)) return reject("failed to write temp file");
+    }
+
+    const std::string n_candidates = option(opts, "n_candidates");
+    const std::string id = jm_->submit_image(path, model, n_candidates.empty() ? 1 : std::atoi(n_candidates.c_str()),
+                                             option(opts, "candidates") == "all",
+                                             std::atoi(option(opts, "deadline_ms").c_str()));
+
+    if (!local_proto::send_frame(sock, local_proto::kId, id)) return false;
+    if (option(opts, "stream") == "0") return true;
+    return stream_job(sock, id);
+}
+
+bool LocalServer::stream_job(int sock, const std::string &id) {
+    size_t offset = 0;
+    std::string chunk;
+    while (!stop_) {
+        switch (jm_->wait_stream(id, offset, chunk, 1000)) {
+        case StreamEvent::delta:
+            if (!local_proto::send_frame(sock, local_proto::kDelta, chunk)) return false;
+            break;
+        case StreamEvent::done:
+        case StreamEvent::error:
+            return local_proto::send_frame(sock, local_proto::kFinal, chunk);
+        case StreamEvent::not_found:
+            return local_proto::send_frame(sock, local_proto::kError, error_json("not found"));
+        case StreamEvent::timeout:
+            break;
+        }
+    }
+    return false;
+}
+
+} // namespace ws_ai
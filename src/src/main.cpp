@@ -1,6 +1,8 @@
 #include "ws_ai/config.h"
+#include "ws_ai/dispatcher.h"
 #include "ws_ai/http_server.h"
 #include "ws_ai/job_manager.h"
+#include "ws_ai/thread_plan.h"
 
 #include <cstdlib>
 #include <iostream>
@@ -10,21 +12,24 @@ int main() {
     ws_ai::Config cfg;
 
     // 环境变量覆盖（可选）
-    if (const char *p = std::getenv("WS_AI_PORT")) {
-        int v = std::atoi(p);
-        if (v > 0 && v < 65536) cfg.port = v;
-    }
-    if (const char *h = std::getenv("WS_AI_HOST")) {
-        if (h && *h) cfg.host = h;   // 现在 Config 有 host 了
-    }
-    if (const char *m = std::getenv("WS_AI_MODEL")) {
-        if (m && *m) cfg.model_path = m;
+    ws_ai::apply_env_overrides(cfg);
+
+    // 分发模式：模型在 worker 进程里，这里不建 JobManager
+    if (ws_ai::dispatcher_mode(cfg)) {
+        ws_ai::HttpServer server(cfg, nullptr);
+        server.serve_forever();
+        return 0;
     }
 
+    // 线程布局：服务端 OCR 和生成在同一个 worker 里串行，不需要给 OCR 单独留核
+    const ws_ai::ThreadPlan plan = ws_ai::make_thread_plan(cfg, /*overlap_ocr*/ false);
+    ws_ai::apply_thread_plan(plan, cfg);
+    std::cout << plan.report();
+
     auto jm = std::make_shared<ws_ai::JobManager>(cfg);
     ws_ai::HttpServer server(cfg, jm);
 
     std::cout << "Listening on http://" << cfg.host << ":" << cfg.port << "\n";
     server.serve_forever();
     return 0;
-}
\ No newline at end of file
+}
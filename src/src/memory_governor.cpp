@@ -0,0 +1,305 @@
+#include "ws_ai/memory_governor.h"
+#include "ws_ai/pipeline.h"
+#include "ws_ai/trace.h"
+#include "ws_ai/util.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+
+#include <unistd.h>
+
+namespace ws_ai {
+
+using Clock = std::chrono::steady_clock;
+
+const char *mem_stage_name(MemStage s) {
+    switch (s) {
+    case MemStage::ocr: return "ocr";
+    case MemStage::llm: return "llm";
+    }
+    return "";
+}
+
+// ---- Reservation ----
+
+MemoryGovernor::Reservation::Reservation(Reservation &&o) noexcept
+: gov_(o.gov_), stage_(o.stage_), bytes_(o.bytes_), ticket_(o.ticket_), wait_ms_(o.wait_ms_) {
+    o.gov_ = nullptr;
+}
+
+MemoryGovernor::Reservation &MemoryGovernor::Reservation::operator=(Reservation &&o) noexcept {
+    if (this != &o) {
+        release();
+        gov_ = o.gov_;
+        stage_ = o.stage_;
+        bytes_ = o.bytes_;
+        ticket_ = o.ticket_;
+        wait_ms_ = o.wait_ms_;
+        o.gov_ = nullptr;
+    }
+    return *this;
+}
+
+void MemoryGovernor::Reservation::release() {
+    if (!gov_) return;
+    gov_->release(stage_, ticket_, bytes_);
+    gov_ = nullptr;
+}
+
+// ---- MemoryGovernor ----
+
+MemoryGovernor::MemoryGovernor(uint64_t budget_bytes) : budget_(budget_bytes) {}
+
+MemoryGovernor::~MemoryGovernor() {
+    shutdown();
+}
+
+void MemoryGovernor::shutdown() {
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+}
+
+uint64_t MemoryGovernor::reserved() const {
+    std::lock_guard<std::mutex> lk(mu_);
+    return reserved_;
+}
+
+bool MemoryGovernor::can_grant_locked(const Entry &e) const {
+    // 先来先放：前面还有没放行的就等
+    for (const Entry &x : entries_) {
+        if (&x == &e) break;
+        if (!x.granted) return false;
+    }
+    if (budget_ == 0 || reserved_ + e.bytes <= budget_) return true;
+    return e.bytes > budget_ && reserved_ == 0;  // 超大的单独跑
+}
+
+MemoryGovernor::Reservation MemoryGovernor::reserve(MemStage stage, const std::string &job_id, uint64_t bytes,
+                                                    const std::atomic<bool> *cancel, std::string &err) {
+    const auto t0 = Clock::now();
+    std::unique_lock<std::mutex> lk(mu_);
+    Entry e;
+    e.ticket = next_ticket_++;
+    e.job_id = job_id;
+    e.stage = stage;
+    e.bytes = bytes;
+    e.since = t0;
+    auto it = entries_.insert(entries_.end(), e);
+    StageStats &st = stages_[(int)stage];
+
+    bool waited = false;
+    while (!can_grant_locked(*it)) {
+        if (stop_ || (cancel && cancel->load())) {
+            entries_.erase(it);
+            st.cancelled++;
+            lk.unlock();
+            cv_.notify_all();  // 后面排着的可能因此能放行了
+            err = stop_ ? "服务正在退出" : "cancelled";
+            return Reservation();
+        }
+        waited = true;
+        // cancel 是别人直接改的 atomic，没有通知：定时醒来看一眼
+        cv_.wait_for(lk, std::chrono::milliseconds(50));
+    }
+
+    it->granted = true;
+    it->since = Clock::now();
+    reserved_ += bytes;
+    peak_ = std::max(peak_, reserved_);
+    st.reserved += bytes;
+    st.active++;
+    st.peak = std::max(st.peak, st.reserved);
+    st.granted++;
+    if (budget_ > 0 && bytes > budget_) st.oversized++;
+
+    Reservation r;
+    r.gov_ = this;
+    r.stage_ = stage;
+    r.bytes_ = bytes;
+    r.ticket_ = it->ticket;
+    r.wait_ms_ = std::chrono::duration<double, std::milli>(it->since - t0).count();
+    if (waited) {
+        st.waited++;
+        st.wait_ms += r.wait_ms_;
+        st.max_wait_ms = std::max(st.max_wait_ms, r.wait_ms_);
+    }
+    lk.unlock();
+    cv_.notify_all();  // 排在后面的、放得下的也可以走了
+    return r;
+}
+
+void MemoryGovernor::release(MemStage stage, uint64_t ticket, uint64_t bytes) {
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+            if (it->ticket == ticket) {
+                entries_.erase(it);
+                break;
+            }
+        }
+        StageStats &st = stages_[(int)stage];
+        reserved_ -= std::min(reserved_, bytes);
+        st.reserved -= std::min(st.reserved, bytes);
+        st.active = std::max(0, st.active - 1);
+    }
+    cv_.notify_all();
+}
+
+std::string MemoryGovernor::status_json() const {
+    std::lock_guard<std::mutex> lk(mu_);
+    const auto now = Clock::now();
+    size_t waiting = 0;
+    for (const Entry &e : entries_) waiting += e.granted ? 0 : 1;
+
+    std::ostringstream oss;
+    oss << std::fixed << std::setprecision(1);
+    oss << "{\"ok\":true"
+        << ",\"budget_bytes\":" << budget_
+        << ",\"reserved_bytes\":" << reserved_
+        << ",\"peak_bytes\":" << peak_
+        << ",\"waiting\":" << waiting
+        << ",\"stages\":{";
+    for (int i = 0; i < kMemStageCount; ++i) {
+        const StageStats &st = stages_[i];
+        oss << (i ? "," : "") << "\"" << mem_stage_name((MemStage)i) << "\":{"
+            << "\"reserved_bytes\":" << st.reserved
+            << ",\"active\":" << st.active
+            << ",\"peak_bytes\":" << st.peak
+            << ",\"granted\":" << st.granted
+            << ",\"waited\":" << st.waited
+            << ",\"wait_ms\":" << st.wait_ms
+            << ",\"max_wait_ms\":" << st.max_wait_ms
+            << ",\"oversized\":" << st.oversized
+            << ",\"cancelled\":" << st.cancelled << "}";
+    }
+    oss << "},\"reservations\":[";
+    bool first = true;
+    for (const Entry &e : entries_) {
+        oss << (first ? "" : ",") << "{\"job\":\"" << json_escape(e.job_id) << "\""
+            << ",\"stage\":\"" << mem_stage_name(e.stage) << "\""
+            << ",\"bytes\":" << e.bytes
+            << ",\"granted\":" << (e.granted ? "true" : "false")
+            << ",\"age_ms\":" << std::chrono::duration<double, std::milli>(now - e.since).count() << "}";
+        first = false;
+    }
+    oss << "]}";
+    return oss.str();
+}
+
+bool reserve_stage_memory(const JobOptions &opts, MemStage stage, uint64_t bytes,
+                          const std::atomic<bool> &cancel_flag, MemoryGovernor::Reservation &out, std::string &err) {
+    if (!opts.memory) return true;
+    TraceSpan span(opts.trace, "mem_wait");
+    span.set_arg((int64_t)(bytes >> 20));
+    out = opts.memory->reserve(stage, opts.job_id, bytes, &cancel_flag, err);
+    return (bool)out;
+}
+
+uint64_t memory_budget_from_config(const Config &cfg) {
+    if (cfg.mem_budget_mb > 0) return (uint64_t)cfg.mem_budget_mb << 20;
+    const long pages = sysconf(_SC_PHYS_PAGES);
+    const long page_size = sysconf(_SC_PAGE_SIZE);
+    if (pages <= 0 || page_size <= 0) return 0;
+    const uint64_t phys = (uint64_t)pages * (uint64_t)page_size;
+    const uint64_t models = (uint64_t)cfg.model_budget_mb << 20;
+    const uint64_t share = phys / 10 * 6;
+    // 模型权重另算；至少留 256 MB 给任务
+    return std::max<uint64_t>(share > models ? share - models : 0, 256ull << 20);
+}
+
+// ---- 图片尺寸（只读文件头）----
+
+static uint32_t be16(const unsigned char *p) { return (uint32_t)p[0] << 8 | p[1]; }
+static uint32_t be32(const unsigned char *p) { return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3]; }
+static uint32_t le16(const unsigned char *p) { return (uint32_t)p[1] << 8 | p[0]; }
+static uint32_t le24(const unsigned char *p) { return (uint32_t)p[2] << 16 | (uint32_t)p[1] << 8 | p[0]; }
+static uint32_t le32(const unsigned char *p) { return (uint32_t)p[3] << 24 | (uint32_t)p[2] << 16 | (uint32_t)p[1] << 8 | p[0]; }
+
+// JPEG：跳过各个段找 SOFn（EXIF 缩略图在 APP1 段里，整段跳过不会误读）
+static bool jpeg_size(std::ifstream &f, uint32_t &w, uint32_t &h) {
+    f.seekg(2);
+    unsigned char m[2], len[2], sof[5];
+    for (int guard = 0; guard < 256 && f.read((char *)m, 2); ++guard) {
+        if (m[0] != 0xFF) return false;
+        if (m[1] == 0xFF) {  // 填充字节
+            f.seekg(-1, std::ios::cur);
+            continue;
+        }
+        if (m[1] == 0xD8 || (m[1] >= 0xD0 && m[1] <= 0xD7) || m[1] == 0x01) continue;
+        if (!f.read((char *)len, 2)) return false;
+        const uint32_t n = be16(len);
+        if (n < 2) return false;
+        const bool is_sof = m[1] >= 0xC0 && m[1] <= 0xCF && m[1] != 0xC4 && m[1] != 0xC8 && m[1] != 0xCC;
+        if (is_sof) {
+            if (!f.read((char *)sof, 5)) return false;
+            h = be16(sof + 1);
+            w = be16(sof + 3);
+            return w > 0 && h > 0;
+        }
+        f.seekg(n - 2, std::ios::cur);
+    }
+    return false;
+}
+
+static bool image_size(const std::string &path, uint32_t &w, uint32_t &h) {
+    std::ifstream f(path, std::ios::binary);
+    unsigned char b[32] = {0};
+    if (!f.read((char *)b, sizeof(b)) && f.gcount() < 12) return false;
+
+    if (b[0] == 0x89 && b[1] == 'P' && b[2] == 'N' && b[3] == 'G') {
+        w = be32(b + 16);
+        h = be32(b + 20);
+    } else if (b[0] == 0xFF && b[1] == 0xD8) {
+        f.clear();
+        return jpeg_size(f, w, h);
+    } else if (b[0] == 'G' && b[1] == 'I' && b[2] == 'F') {
+        w = le16(b + 6);
+        h = le16(b + 8);
+    } else if (b[0] == 'B' && b[1] == 'M') {
+        w = le32(b + 18);
+        h = (uint32_t)std::abs((int32_t)le32(b + 22));
+    } else if (std::equal(b, b + 4, "RIFF") && std::equal(b + 8, b + 12, "WEBP")) {
+        if (std::equal(b + 12, b + 16, "VP8 ")) {
+            w = le16(b + 26) & 0x3FFF;
+            h = le16(b + 28) & 0x3FFF;
+        } else if (std::equal(b + 12, b + 16, "VP8L")) {
+            const uint32_t v = le32(b + 21);
+            w = (v & 0x3FFF) + 1;
+            h = ((v >> 14) & 0x3FFF) + 1;
+        } else if (std::equal(b + 12, b + 16, "VP8X")) {
+            w = le24(b + 24) + 1;
+            h = le24(b + 27) + 1;
+        } else {
+            return false;
+        }
+    } else {
+        return false;  // HEIC 之类：盒子结构太深，按上限估
+    }
+    return w > 0 && h > 0 && w < (1u << 20) && h < (1u << 20);
+}
+
+uint64_t estimate_image_bytes(const std::string &path, int max_side) {
+    const uint64_t side = (uint64_t)std::max(1, max_side);
+    uint32_t w = 0, h = 0;
+    uint64_t pw = side, ph = side;
+    if (image_size(path, w, h)) {
+        pw = w;
+        ph = h;
+        // 解码时长边限制在 max_side（缩略图解码）
+        const uint64_t longest = std::max(pw, ph);
+        if (longest > side) {
+            pw = std::max<uint64_t>(1, pw * side / longest);
+            ph = std::max<uint64_t>(1, ph * side / longest);
+        }
+    }
+    return pw * ph * 8 + (1ull << 20);  // RGBA + 灰度 + 前处理副本 + Vision；再加 1 MB 固定开销
+}
+
+} // namespace ws_ai
@@ -0,0 +1,195 @@
+#include "ws_ai/mock_pipeline.h"
+#include "ws_ai/embed_index.h"
+#include "ws_ai/prompt.h"
+#include "ws_ai/trace.h"
+#include "ws_ai/util.h"
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace ws_ai {
+
+using Clock = std::chrono::steady_clock;
+
+// 吐出来的 token 片段（循环使用）
+static const char *kMockPieces[] = {
+    "这张", "截图", "主要", "是", "一份", "会议", "纪要", "，", "列出", "了", "下周", "的",
+    "三个", "待办", "事项", "和", "各自", "的", "负责人", "。", "\n\n", "建议", "先", "确认",
+    "排期", "，", "再", "把", "接口", "文档", "补齐", "，", "最后", "统一", "验收", "。",
+};
+
+class MockPipeline final : public Pipeline {
+public:
+    explicit MockPipeline(const Config &cfg) : cfg_(cfg) {}
+
+    std::string run(const std::string &image_path,
+                    const JobOptions &opts,
+                    std::atomic<int> &progress,
+                    std::atomic<bool> &cancel_flag,
+                    std::string &err_out) override {
+        err_out.clear();
+        progress.store(1);
+
+        thread_local std::mt19937 rng{std::random_device{}()};
+        std::uniform_real_distribution<double> jitter(0.75, 1.25), coin(0.0, 1.0);
+
+        // 1) OCR：平均 mock_ocr_ms，±25% 抖动；内存按真实图片尺寸预订（和 Vision 流水线一样）
+        const auto t_ocr = Clock::now();
+        {
+            MemoryGovernor::Reservation mem;
+            if (!reserve_stage_memory(opts, MemStage::ocr, estimate_image_bytes(image_path, cfg_.ocr_max_side),
+                                      cancel_flag, mem, err_out)) {
+                progress.store(100);
+                return "";
+            }
+            TraceSpan span(opts.trace, "ocr");
+            if (!sleep_for_ms(cfg_.mock_ocr_ms * jitter(rng), cancel_flag)) {
+                err_out = "cancelled";
+                return "";
+            }
+        }
+        // 图片旁边有 <图片>.txt 时拿它当识别结果（压测语义缓存用），否则是一行占位文本
+        std::string ocr;
+        if (!read_file_binary(image_path + ".txt", ocr) || ocr.empty()) ocr = "[mock ocr] " + image_path;
+        if (opts.stats) opts.stats->ocr_ms = std::chrono::duration<double, std::milli>(Clock::now() - t_ocr).count();
+        if (opts.on_ocr) opts.on_ocr(ocr);
+        progress.store(10);
+
+        // 语义缓存：mock 没有模型，固定用字符 n-gram 向量
+        if (opts.on_embedding) {
+            std::vector<float> emb;
+            {
+                TraceSpan span(opts.trace, "embed");
+                ngram_embedding(ocr, kNgramEmbeddingDim, emb);
+            }
+            std::string cached;
+            if (opts.on_embedding(emb, cached)) {
+                progress.store(100);
+                return cached;
+            }
+        }
+
+        if (coin(rng) < cfg_.mock_error_rate) {
+            err_out = "mock error";
+            progress.store(100);
+            return "";
+        }
+
+        // 2) prefill + 3) decode
+        const std::string prompt = "[mock prompt] " + image_path;
+        return generate(prompt, cfg_.mock_prefill_ms * jitter(rng), opts, progress, cancel_flag, err_out);
+    }
+
+    // 追问：假装 KV 恢复成功，prefill 只有正常的 1/8
+    std::string followup(const FollowupRequest &req,
+                         const JobOptions &opts,
+                         std::atomic<int> &progress,
+                         std::atomic<bool> &cancel_flag,
+                         std::string &err_out) override {
+        err_out.clear();
+        if (req.transcript.empty()) {
+            err_out = "找不到原任务的上下文";
+            progress.store(100);
+            return "";
+        }
+        if (opts.stats) opts.stats->kv_restored = true;
+        return generate(req.transcript + "\n[mock followup] " + req.question, cfg_.mock_prefill_ms / 8.0, opts,
+                        progress, cancel_flag, err_out);
+    }
+
+private:
+    // prefill 睡 prefill_ms，然后按固定速率吐 token（按计划时间点睡，不累积误差）。
+    // 多候选时按同样的速率走（一起 decode 时每步耗时差不多），候选 i 从片段表的不同位置开始，
+    // 最后按 score_summary_format 排序、只推出最好的那个
+    std::string generate(const std::string &prompt, double prefill_ms, const JobOptions &opts,
+                         std::atomic<int> &progress, std::atomic<bool> &cancel_flag, std::string &err_out) {
+        const int n_cand = std::max(1, std::min(opts.n_candidates, cfg_.max_candidates));
+        MemoryGovernor::Reservation mem;
+        if (!reserve_stage_memory(opts, MemStage::llm, ((uint64_t)cfg_.mock_mem_mb << 20) * n_cand, cancel_flag, mem,
+                                  err_out)) {
+            progress.store(100);
+            return "";
+        }
+
+        const auto t_start = Clock::now();
+        {
+            TraceSpan span(opts.trace, "prefill");
+            if (!sleep_for_ms(prefill_ms, cancel_flag)) {
+                err_out = "cancelled";
+                return "";
+            }
+        }
+        progress.store(15);
+
+        const int n = std::max(1, opts.max_new_tokens > 0 ? std::min(cfg_.mock_tokens, opts.max_new_tokens) : cfg_.mock_tokens);
+        const auto step = std::chrono::duration<double>(1.0 / std::max(0.1f, cfg_.mock_tok_per_sec));
+        const size_t n_pieces = sizeof(kMockPieces) / sizeof(kMockPieces[0]);
+
+        std::vector<std::string> cands(n_cand);
+
+        TraceSpan span(opts.trace, "decode", n);
+        std::string &out = cands[0];
+        auto next = Clock::now();
+        for (int i = 0; i < n; ++i) {
+            if (cancel_flag.load()) {
+                err_out = "cancelled";
+                return out;
+            }
+            next += std::chrono::duration_cast<Clock::duration>(step);
+            std::this_thread::sleep_until(next);
+
+            const std::string piece = kMockPieces[i % n_pieces];
+            out += piece;
+            for (int c = 1; c < n_cand; ++c) cands[c] += kMockPieces[(i + 7 * c) % n_pieces];
+            if (i == 0 && opts.stats) {
+                opts.stats->ttft_ms = std::chrono::duration<double, std::milli>(Clock::now() - t_start).count();
+            }
+            if (opts.on_delta && n_cand == 1) opts.on_delta(piece);
+            progress.store(std::min(95, 15 + (int)((double)(i + 1) / n * 80.0)));
+        }
+        if (n_cand > 1) {
+            std::vector<Candidate> scored;
+            for (auto &c : cands) scored.push_back({c, score_summary_format(c), n});
+            std::stable_sort(scored.begin(), scored.end(),
+                             [](const Candidate &a, const Candidate &b) { return a.score > b.score; });
+            out = scored.front().text;
+            if (opts.on_delta) opts.on_delta(out);
+            if (opts.stats) opts.stats->candidates = std::move(scored);
+        }
+        if (opts.stats) {
+            opts.stats->transcript = prompt + "\n" + out;
+            opts.stats->gen_tokens = n * n_cand;
+            opts.stats->stop_reason = "max_tokens";
+            if (opts.stats->ttft_ms > 0) {
+                opts.stats->decode_ms =
+                    std::chrono::duration<double, std::milli>(Clock::now() - t_start).count() - opts.stats->ttft_ms;
+            }
+        }
+
+        progress.store(100);
+        return out;
+    }
+
+    // 分段睡，期间能响应 cancel；被取消返回 false
+    static bool sleep_for_ms(double ms, const std::atomic<bool> &cancel) {
+        const auto until = Clock::now() + std::chrono::microseconds((int64_t)(ms * 1000));
+        while (Clock::now() < until) {
+            if (cancel.load()) return false;
+            std::this_thread::sleep_for(std::min<Clock::duration>(std::chrono::milliseconds(10), until - Clock::now()));
+        }
+        return !cancel.load();
+    }
+
+private:
+    Config cfg_;
+};
+
+std::unique_ptr<Pipeline> make_mock_pipeline(const Config &cfg) {
+    return std::make_unique<MockPipeline>(cfg);
+}
+
+} // namespace ws_ai
@@ -0,0 +1,239 @@
+#include "ws_ai/model_registry.h"
+#include "ws_ai/util.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+#include <sstream>
+
+extern "C" {
+#include "llama.h"
+}
+
+namespace ws_ai {
+
+LoadedModel::~LoadedModel() {
+    for (llama_context *c : idle_ctx_) llama_free(c);
+    if (model) llama_model_free(model);
+}
+
+llama_context *LoadedModel::take_context() {
+    std::lock_guard<std::mutex> lk(ctx_mu_);
+    if (idle_ctx_.empty()) return nullptr;
+    llama_context *c = idle_ctx_.back();
+    idle_ctx_.pop_back();
+    return c;
+}
+
+void LoadedModel::put_context(llama_context *ctx) {
+    if (!ctx) return;
+    {
+        std::lock_guard<std::mutex> lk(ctx_mu_);
+        if (idle_ctx_.size() < ctx_pool_cap) {
+            idle_ctx_.push_back(ctx);
+            return;
+        }
+    }
+    llama_free(ctx);
+}
+
+ModelRegistry::ModelRegistry(const Config &cfg)
+: default_model_(cfg.default_model),
+  budget_bytes_((uint64_t)cfg.model_budget_mb * 1024 * 1024),
+  idle_sec_(cfg.model_idle_sec),
+  ctx_pool_cap_((size_t)std::max(0, cfg.ctx_pool_size)) {
+    std::vector<ModelSpec> specs = cfg.models;
+    if (specs.empty()) specs.push_back({cfg.default_model.empty() ? "default" : cfg.default_model, cfg.model_path});
+    for (auto &s : specs) {
+        Entry e;
+        e.spec = s;
+        entries_.push_back(std::move(e));
+    }
+    if (default_model_.empty() || !find_locked(default_model_)) default_model_ = entries_.front().spec.name;
+
+    // 整个进程只 init 一次（之前每个 job 都 init/free）
+    llama_backend_init();
+
+    if (idle_sec_ > 0) reaper_ = std::thread([this] { reaper_loop(); });
+}
+
+ModelRegistry::~ModelRegistry() {
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    if (reaper_.joinable()) reaper_.join();
+
+    for (auto &e : entries_) e.loaded.reset();
+    llama_backend_free();
+}
+
+ModelRegistry::Entry *ModelRegistry::find_locked(const std::string &name) {
+    for (auto &e : entries_) if (e.spec.name == name) return &e;
+    return nullptr;
+}
+
+const ModelRegistry::Entry *ModelRegistry::find_locked(const std::string &name) const {
+    for (auto &e : entries_) if (e.spec.name == name) return &e;
+    return nullptr;
+}
+
+std::string ModelRegistry::resolve(const std::string &name) const {
+    const std::string &n = name.empty() ? default_model_ : name;
+    std::lock_guard<std::mutex> lk(mu_);
+    return find_locked(n) ? n : std::string();
+}
+
+uint64_t ModelRegistry::resident_bytes_locked() const {
+    uint64_t sum = 0;
+    for (auto &e : entries_) if (e.loaded) sum += e.loaded->size_bytes;
+    return sum;
+}
+
+std::vector<std::shared_ptr<LoadedModel>> ModelRegistry::evict_for_locked(uint64_t need, const Entry *keep) {
+    std::vector<std::shared_ptr<LoadedModel>> victims;
+    if (budget_bytes_ == 0) return victims;
+
+    while (resident_bytes_locked() + need > budget_bytes_) {
+        Entry *lru = nullptr;
+        for (auto &e : entries_) {
+            if (&e == keep || !e.loaded || e.active > 0) continue;
+            if (!lru || e.last_used < lru->last_used) lru = &e;
+        }
+        if (!lru) break;  // 剩下的都在用：只能超预算运行
+        std::cout << "[models] evict " << lru->spec.name << " (" << (lru->loaded->size_bytes >> 20) << " MB)\n";
+        victims.push_back(std::move(lru->loaded));
+    }
+    return victims;
+}
+
+ModelLease ModelRegistry::acquire(const std::string &name, std::string &err) {
+    const std::string n = name.empty() ? default_model_ : name;
+
+    std::vector<std::shared_ptr<LoadedModel>> victims;  // 出锁后再释放（llama_model_free 较慢）
+    std::unique_lock<std::mutex> lk(mu_);
+    Entry *e = find_locked(n);
+    if (!e) {
+        err = "unknown model: " + n;
+        return nullptr;
+    }
+
+    // 别的线程正在加载同一个模型：等它
+    cv_.wait(lk, [&] { return !e->loading || stop_; });
+
+    if (!e->loaded) {
+        std::error_code ec;
+        uint64_t est = (uint64_t)std::filesystem::file_size(e->spec.path, ec);
+        if (ec) est = 0;
+        victims = evict_for_locked(est, e);
+
+        e->loading = true;
+        const std::string path = e->spec.path;
+        lk.unlock();
+        victims.clear();
+
+        llama_model_params mp = llama_model_default_params();
+        llama_model *m = llama_model_load_from_file(path.c_str(), mp);
+
+        lk.lock();
+        e->loading = false;
+        cv_.notify_all();
+        if (!m) {
+            err = "模型加载失败: " + path;
+            return nullptr;
+        }
+        auto lm = std::make_shared<LoadedModel>();
+        lm->name = n;
+        lm->path = path;
+        lm->model = m;
+        lm->size_bytes = llama_model_size(m);
+        lm->ctx_pool_cap = ctx_pool_cap_;
+        e->loaded = lm;
+        e->loads++;
+        std::cout << "[models] loaded " << n << " (" << (lm->size_bytes >> 20) << " MB)\n";
+
+        // 实际大小可能和文件大小不一致：加载后再检查一次预算
+        victims = evict_for_locked(0, e);
+    }
+
+    e->active++;
+    e->last_used = std::chrono::steady_clock::now();
+
+    // 租约：和 loaded 共享所有权，归还时记账（last_used 从归还时刻算起）
+    std::shared_ptr<LoadedModel> hold = e->loaded;
+    lk.unlock();
+    victims.clear();
+    return ModelLease(hold.get(), [this, n, hold](LoadedModel *) mutable {
+        release(n);
+        hold.reset();
+    });
+}
+
+void ModelRegistry::release(const std::string &name) {
+    std::lock_guard<std::mutex> lk(mu_);
+    if (Entry *e = find_locked(name)) {
+        if (e->active > 0) e->active--;
+        e->last_used = std::chrono::steady_clock::now();
+    }
+}
+
+void ModelRegistry::reaper_loop() {
+    const auto idle = std::chrono::seconds(idle_sec_);
+    const auto tick = std::chrono::seconds(std::max(1, std::min(idle_sec_, 30)));
+
+    std::unique_lock<std::mutex> lk(mu_);
+    while (!stop_) {
+        cv_.wait_for(lk, tick, [&] { return stop_; });
+        if (stop_) break;
+
+        std::vector<std::shared_ptr<LoadedModel>> victims;
+        const auto now = std::chrono::steady_clock::now();
+        for (auto &e : entries_) {
+            if (!e.loaded || e.active > 0 || e.loading) continue;
+            if (now - e.last_used < idle) continue;
+            std::cout << "[models] unload idle " << e.spec.name << "\n";
+            victims.push_back(std::move(e.loaded));
+        }
+        if (victims.empty()) continue;
+        lk.unlock();
+        victims.clear();
+        lk.lock();
+    }
+}
+
+std::string ModelRegistry::status_json() const {
+    std::lock_guard<std::mutex> lk(mu_);
+    const auto now = std::chrono::steady_clock::now();
+
+    std::ostringstream oss;
+    oss << "{\"ok\":true,"
+        << "\"default\":\"" << json_escape(default_model_) << "\","
+        << "\"budget_bytes\":" << budget_bytes_ << ","
+        << "\"resident_bytes\":" << resident_bytes_locked() << ","
+        << "\"idle_unload_sec\":" << idle_sec_ << ","
+        << "\"models\":[";
+    bool first = true;
+    for (auto &e : entries_) {
+        if (!first) oss << ",";
+        first = false;
+        oss << "{\"name\":\"" << json_escape(e.spec.name) << "\","
+            << "\"path\":\"" << json_escape(e.spec.path) << "\","
+            << "\"resident\":" << (e.loaded ? "true" : "false") << ","
+            << "\"loading\":" << (e.loading ? "true" : "false") << ","
+            << "\"bytes\":" << (e.loaded ? e.loaded->size_bytes : 0) << ","
+            << "\"active\":" << e.active << ","
+            << "\"loads\":" << e.loads << ",";
+        if (e.loaded) {
+            auto idle = std::chrono::duration_cast<std::chrono::seconds>(now - e.last_used).count();
+            oss << "\"idle_sec\":" << idle;
+        } else {
+            oss << "\"idle_sec\":null";
+        }
+        oss << "}";
+    }
+    oss << "]}";
+    return oss.str();
+}
+
+} // namespace ws_ai
@@ -0,0 +1,19 @@
+// 非 macOS 平台没有 Vision / ImageIO：OCR 直接返回空（真流水线会报“未识别到文字”），
+// 服务和压测用 WS_AI_PIPELINE=mock 跑
+#include "ws_ai/ocr_vision.h"
+
+namespace ws_ai {
+
+std::string ocr_with_vision(const std::string&) {
+    return {};
+}
+
+std::string ocr_with_vision(const std::string&, const PreprocOptions&, JobTrace*) {
+    return {};
+}
+
+bool decode_image_luma(const std::string&, int, GrayImage&) {
+    return false;
+}
+
+} // namespace ws_ai
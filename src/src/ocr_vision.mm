@@ -4,8 +4,10 @@
 #import <Vision/Vision.h>
 
 #include "ws_ai/ocr_vision.h"
+#include "ws_ai/trace.h"
 
 #include <string>
+#include <vector>
 
 namespace ws_ai {
 
@@ -19,10 +21,55 @@ static CGImageRef load_cgimage(const std::string& path_utf8) {
     return img;
 }
 
-std::string ocr_with_vision(const std::string& image_path) {
-    CGImageRef img = load_cgimage(image_path);
-    if (!img) return {};
+// 缩略图解码：长边超过 max_side 时解码器直接按比例降采样，不会先铺出全分辨率位图
+static CGImageRef load_cgimage_bounded(const std::string& path_utf8, int max_side) {
+    NSString* p = [NSString stringWithUTF8String:path_utf8.c_str()];
+    NSURL* url = [NSURL fileURLWithPath:p];
+    CGImageSourceRef src = CGImageSourceCreateWithURL((__bridge CFURLRef)url, NULL);
+    if (!src) return nil;
+    NSDictionary* opts = @{
+        (id)kCGImageSourceCreateThumbnailFromImageAlways : @YES,
+        (id)kCGImageSourceCreateThumbnailWithTransform : @YES,
+        (id)kCGImageSourceShouldCacheImmediately : @YES,
+        (id)kCGImageSourceThumbnailMaxPixelSize : @(max_side > 0 ? max_side : 16384),
+    };
+    CGImageRef img = CGImageSourceCreateThumbnailAtIndex(src, 0, (__bridge CFDictionaryRef)opts);
+    CFRelease(src);
+    return img;
+}
+
+// CGImage -> RGBX（透明部分垫白底）-> 灰度
+static bool cgimage_to_luma(CGImageRef img, GrayImage& out) {
+    const size_t w = CGImageGetWidth(img), h = CGImageGetHeight(img);
+    if (w == 0 || h == 0) return false;
+
+    std::vector<uint8_t> rgba(w * h * 4);
+    CGColorSpaceRef cs = CGColorSpaceCreateDeviceRGB();
+    CGContextRef ctx = CGBitmapContextCreate(rgba.data(), w, h, 8, w * 4, cs,
+                                             kCGImageAlphaNoneSkipLast | kCGBitmapByteOrder32Big);
+    CGColorSpaceRelease(cs);
+    if (!ctx) return false;
+    CGContextSetRGBFillColor(ctx, 1, 1, 1, 1);
+    CGContextFillRect(ctx, CGRectMake(0, 0, w, h));
+    CGContextDrawImage(ctx, CGRectMake(0, 0, w, h), img);
+    CGContextRelease(ctx);
+
+    rgba_to_luma(rgba.data(), (int)w, (int)h, w * 4, /*bgr*/ false, out);
+    return true;
+}
+
+// 灰度缓冲区包成 CGImage（不拷贝；调用方保证 img 活到 CGImageRelease 之后）
+static CGImageRef luma_to_cgimage(const GrayImage& img) {
+    CGDataProviderRef provider = CGDataProviderCreateWithData(NULL, img.pixels.data(), img.pixels.size(), NULL);
+    CGColorSpaceRef gray = CGColorSpaceCreateDeviceGray();
+    CGImageRef out = CGImageCreate(img.width, img.height, 8, 8, img.width, gray, kCGImageAlphaNone,
+                                   provider, NULL, false, kCGRenderingIntentDefault);
+    CGColorSpaceRelease(gray);
+    CGDataProviderRelease(provider);
+    return out;
+}
 
+static std::string recognize(CGImageRef img) {
     __block NSMutableString* acc = [NSMutableString string];
 
     VNRecognizeTextRequest* req = [[VNRecognizeTextRequest alloc]
@@ -52,11 +99,68 @@ std::string ocr_with_vision(const std::string& image_path) {
     NSError* err = nil;
     [handler performRequests:@[ req ] error:&err];
 
-    CGImageRelease(img);
+#if !__has_feature(objc_arc)
+    [handler release];
+    [req release];
+#endif
     if (err) return {};
 
     const char* c = [acc UTF8String];
     return c ? std::string(c) : std::string();
 }
 
-} // namespace ws_ai
\ No newline at end of file
+std::string ocr_with_vision(const std::string& image_path) {
+  // 会在 worker / 批处理线程里反复调用：每次自带 autorelease pool，避免临时对象堆积
+  @autoreleasepool {
+    CGImageRef img = load_cgimage(image_path);
+    if (!img) return {};
+    std::string out = recognize(img);
+    CGImageRelease(img);
+    return out;
+  }
+}
+
+std::string ocr_with_vision(const std::string& image_path, const PreprocOptions& opt, JobTrace* trace) {
+  @autoreleasepool {
+    CGImageRef img = nil;
+    {
+        TraceSpan span(trace, "decode");
+        img = load_cgimage_bounded(image_path, opt.max_side);
+    }
+    if (!img) return {};
+    if (!opt.enabled) {
+        TraceSpan span(trace, "vision");
+        std::string out = recognize(img);
+        CGImageRelease(img);
+        return out;
+    }
+
+    GrayImage gray;
+    {
+        TraceSpan span(trace, "preprocess");
+        const bool ok = cgimage_to_luma(img, gray);
+        CGImageRelease(img);  // 彩色位图到这里就可以释放了
+        if (!ok) return {};
+        preprocess_for_ocr(gray, opt);
+    }
+
+    TraceSpan span(trace, "vision", (int64_t)gray.width * gray.height);
+    CGImageRef gimg = luma_to_cgimage(gray);
+    if (!gimg) return {};
+    std::string out = recognize(gimg);
+    CGImageRelease(gimg);
+    return out;
+  }
+}
+
+bool decode_image_luma(const std::string& image_path, int max_side, GrayImage& out) {
+  @autoreleasepool {
+    CGImageRef img = load_cgimage_bounded(image_path, max_side);
+    if (!img) return false;
+    const bool ok = cgimage_to_luma(img, out);
+    CGImageRelease(img);
+    return ok;
+  }
+}
+
+} // namespace ws_ai
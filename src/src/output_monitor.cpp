@@ -0,0 +1,177 @@
+#include "ws_ai/output_monitor.h"
+
+#include <algorithm>
+
+namespace ws_ai {
+
+const char *stop_reason_name(StopReason r) {
+    switch (r) {
+    case StopReason::none: return "";
+    case StopReason::eos: return "eos";
+    case StopReason::max_tokens: return "max_tokens";
+    case StopReason::stop_string: return "stop_string";
+    case StopReason::paragraphs: return "paragraphs";
+    case StopReason::drift: return "drift";
+    case StopReason::language: return "language";
+    case StopReason::cancelled: return "cancelled";
+    case StopReason::error: return "error";
+    }
+    return "";
+}
+
+MonitorOptions monitor_options_from_config(const Config &cfg) {
+    MonitorOptions o;
+    o.enabled = cfg.structure_stop;
+    return o;
+}
+
+const char *two_paragraph_grammar() {
+    return "root ::= para \"\\n\\n\" para\n"
+           "para ::= lead [^\\n]+\n"
+           "lead ::= [^\\n#*>•0-9 \\t-]\n";
+}
+
+// 小模型写完两段后常见的跑偏：开始出题、列编号、复述任务指令（test/main.mm 事后截的就是这些）
+static const char *kDriftMarkers[] = {
+    "问题：", "问题:", "Questions:", "Question:", "\nQ1", "\nQ:", "\n1.", "\n1、", "\n（1）",
+    "Answer the following", "Generate one question", "<|im_start|>", "\n#", "\nHuman:", "\nUser:",
+};
+
+static const size_t kMaxMarkerLen = 24;  // 最长的标记（"Answer the following" 等）不超过这个字节数
+
+size_t find_drift_marker(const std::string &text, size_t from) {
+    size_t cut = std::string::npos;
+    for (const char *m : kDriftMarkers) {
+        const size_t p = text.find(m, from);
+        if (p != std::string::npos) cut = std::min(cut, p);
+    }
+    return cut;
+}
+
+// 解一个 UTF-8 字符；不完整返回 0（等下一个 piece），非法字节按 1 字节算
+static size_t utf8_next(const std::string &s, size_t i, uint32_t &cp) {
+    const unsigned char c = (unsigned char)s[i];
+    size_t len = 1;
+    if (c < 0x80) {
+        cp = c;
+        return 1;
+    } else if ((c & 0xE0) == 0xC0) {
+        len = 2;
+        cp = c & 0x1F;
+    } else if ((c & 0xF0) == 0xE0) {
+        len = 3;
+        cp = c & 0x0F;
+    } else if ((c & 0xF8) == 0xF0) {
+        len = 4;
+        cp = c & 0x07;
+    } else {
+        cp = 0xFFFD;
+        return 1;
+    }
+    if (i + len > s.size()) return 0;
+    for (size_t k = 1; k < len; ++k) {
+        const unsigned char d = (unsigned char)s[i + k];
+        if ((d & 0xC0) != 0x80) {
+            cp = 0xFFFD;
+            return 1;
+        }
+        cp = (cp << 6) | (d & 0x3F);
+    }
+    return len;
+}
+
+static bool is_cjk(uint32_t cp) {
+    return (cp >= 0x4E00 && cp <= 0x9FFF) || (cp >= 0x3400 && cp <= 0x4DBF) || (cp >= 0xF900 && cp <= 0xFAFF);
+}
+
+static bool is_space(uint32_t cp) {
+    return cp == ' ' || cp == '\t' || cp == '\r' || cp == 0x3000;
+}
+
+// 句末标点（。！？… !?）
+static bool ends_sentence(uint32_t cp) {
+    return cp == 0x3002 || cp == 0xFF01 || cp == 0xFF1F || cp == 0x2026 || cp == '!' || cp == '?';
+}
+
+// 一段的最后一个字：句末标点，或者句末标点后面的引号 / 括号
+static bool ends_paragraph(uint32_t cp) {
+    return ends_sentence(cp) || cp == '.' || cp == 0xFF1B || cp == 0x201D || cp == 0x300D || cp == 0x300F ||
+           cp == 0xFF09 || cp == ')';
+}
+
+static size_t utf8_count(const std::string &s, size_t n) {
+    size_t k = 0;
+    for (size_t i = 0; i < n; ++i) k += ((unsigned char)s[i] & 0xC0) != 0x80;
+    return k;
+}
+
+bool OutputMonitor::line_is_paragraph() const {
+    // 没有句末标点的长行也算（模型偶尔漏掉句号）
+    return line_chars_ >= o_.min_paragraph_chars &&
+           (ends_paragraph(line_last_) || line_chars_ >= 3 * o_.min_paragraph_chars);
+}
+
+bool OutputMonitor::complete() const {
+    return o_.enabled && o_.paragraphs > 0 && paras_ + (line_is_paragraph() ? 1 : 0) >= o_.paragraphs;
+}
+
+StopReason OutputMonitor::feed(const std::string &text, size_t &keep) {
+    keep = text.size();
+    if (!o_.enabled) return StopReason::none;
+    if (window_.empty()) window_.assign((size_t)std::max(1, o_.lang_window), 0);
+
+    // 1) 逐字：段落计数、语言窗口
+    size_t i = scanned_;
+    while (i < text.size()) {
+        uint32_t cp = 0;
+        const size_t len = utf8_next(text, i, cp);
+        if (len == 0) break;
+
+        if (cp == '\n') {
+            if (line_is_paragraph()) {
+                paras_++;
+                if (o_.paragraphs > 0 && paras_ >= o_.paragraphs) {
+                    keep = i;
+                    scanned_ = i + len;
+                    return StopReason::paragraphs;
+                }
+            }
+            line_chars_ = 0;
+            line_last_ = 0;
+        } else if (!is_space(cp)) {
+            line_chars_++;
+            line_last_ = cp;
+        }
+        if (ends_sentence(cp)) sentence_end_ = i + len;
+
+        const bool latin = cp < 0x80 && ((cp | 0x20) >= 'a' && (cp | 0x20) <= 'z');
+        if (o_.language_switch && (latin || is_cjk(cp))) {
+            seen_cjk_ = seen_cjk_ || !latin;
+            win_latin_ += (int)latin - (int)window_[win_pos_];
+            window_[win_pos_] = latin ? 1 : 0;
+            win_pos_ = (win_pos_ + 1) % window_.size();
+            // 窗口里几乎全是英文字母（几个英文术语不会触发），截到换语言前的最后一个句末
+            if (seen_cjk_ && win_latin_ >= o_.max_latin_ratio * (float)window_.size() && sentence_end_ > 0) {
+                keep = sentence_end_;
+                scanned_ = i + len;
+                return StopReason::language;
+            }
+        }
+        i += len;
+    }
+    const size_t before = scanned_;
+    scanned_ = i;
+
+    // 2) 跑偏标记：只在新增部分附近找（标记可能跨 piece）
+    if (o_.drift_markers) {
+        const size_t cut = find_drift_marker(text, before > kMaxMarkerLen ? before - kMaxMarkerLen : 0);
+        // 开头就是这些（前面没什么可留的）不算跑偏，交给打分
+        if (cut != std::string::npos && utf8_count(text, cut) >= (size_t)o_.min_paragraph_chars) {
+            keep = cut;
+            return StopReason::drift;
+        }
+    }
+    return StopReason::none;
+}
+
+} // namespace ws_ai
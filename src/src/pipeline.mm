@@ -1,14 +1,26 @@
+#if defined(__APPLE__)
 #import <Foundation/Foundation.h>
-#import <locale.h>
+#endif
+#include <locale.h>
 
 #include "ws_ai/pipeline.h"
 #include "ws_ai/config.h"
+#include "ws_ai/embed_index.h"
+#include "ws_ai/kv_store.h"
+#include "ws_ai/llm_runner.h"
+#include "ws_ai/model_registry.h"
+#include "ws_ai/output_monitor.h"
 #include "ws_ai/ocr_vision.h"   // 正确函数：ocr_with_vision
 #include "ws_ai/prompt.h"       // 正确函数：build_prompt
+#include "ws_ai/trace.h"
 #include "ws_ai/util.h"
 
 #include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <optional>
 #include <sstream>
 #include <string>
 #include <vector>
@@ -41,97 +53,62 @@ static inline void trim_inplace(std::string &s) {
   ltrim_inplace(s);
 }
 
-// 把输出截断到 stop 字符串之前
-static inline void cut_after_any_stop(std::string &s,
-                                      const std::vector<std::string> &stops) {
-  size_t best = std::string::npos;
-  for (const auto &st : stops) {
-    size_t p = s.find(st);
-    if (p != std::string::npos) best = std::min(best, p);
-  }
-  if (best != std::string::npos) s.resize(best);
-}
-
-// llama token -> piece
-static std::string token_to_piece(const llama_vocab *vocab, llama_token tok) {
-  std::string out;
-  out.resize(256);
-  int32_t n = llama_token_to_piece(vocab, tok, out.data(), (int32_t)out.size(),
-                                   /*lstrip*/0, /*special*/true);
-  if (n < 0) {
-    out.resize((size_t)(-n));
-    n = llama_token_to_piece(vocab, tok, out.data(), (int32_t)out.size(),
-                             /*lstrip*/0, /*special*/true);
-    if (n < 0) return {};
-  }
-  out.resize((size_t)n);
-  return out;
-}
-
-static std::vector<llama_token> tokenize(const llama_vocab *vocab,
-                                         const std::string &text) {
-  int32_t n = llama_tokenize(vocab, text.c_str(), (int32_t)text.size(),
-                             nullptr, 0,
-                             /*add_special*/false,
-                             /*parse_special*/true);
-  if (n < 0) n = -n;
-  std::vector<llama_token> toks(n);
-  int32_t n2 = llama_tokenize(vocab, text.c_str(), (int32_t)text.size(),
-                              toks.data(), (int32_t)toks.size(),
-                              /*add_special*/false,
-                              /*parse_special*/true);
-  if (n2 < 0) toks.clear();
-  return toks;
-}
-
-// -------------------------
-// llama batch helper (不用 llama_batch_add，兼容你当前版本)
-// -------------------------
-static void batch_add_token(llama_batch &batch, llama_token token, int32_t pos,
-                            int32_t seq_id, bool logits) {
-  const int32_t i = batch.n_tokens;
-  batch.token[i]    = token;
-  batch.pos[i]      = pos;
-  batch.n_seq_id[i] = 1;
-  batch.seq_id[i][0]= seq_id;
-  batch.logits[i]   = logits ? 1 : 0;
-  batch.n_tokens++;
-}
-
 // -------------------------
 // Pipeline impl
 // -------------------------
 class PipelineImpl final : public Pipeline {
 public:
-  explicit PipelineImpl(const Config &cfg) : cfg_(cfg) {}
+  PipelineImpl(const Config &cfg, std::shared_ptr<ModelRegistry> models)
+  : cfg_(cfg), models_(std::move(models)), kv_(cfg) {
+    // locale（避免中文乱码）；setenv 不是线程安全的，多个 job worker 并发 run 之前设一次
+    setenv("LC_ALL", "zh_CN.UTF-8", 1);
+    setenv("LANG", "zh_CN.UTF-8", 1);
+    setlocale(LC_ALL, "");
+  }
+
+  ~PipelineImpl() override {
+    if (embed_model_) llama_model_free(embed_model_);
+  }
 
-  // 必须和 pipeline.h 完全一致：run(image_path, progress, cancel_flag, err_out)
+  // 必须和 pipeline.h 完全一致：run(image_path, opts, progress, cancel_flag, err_out)
   std::string run(const std::string &image_path,
+                  const JobOptions &opts,
                   std::atomic<int> &progress,
                   std::atomic<bool> &cancel_flag,
                   std::string &err_out) override {
     err_out.clear();
     progress.store(1);
 
-    // locale（避免中文乱码）
-    setenv("LC_ALL", "zh_CN.UTF-8", 1);
-    setenv("LANG", "zh_CN.UTF-8", 1);
-    setlocale(LC_ALL, "");
-
     if (cancel_flag.load()) {
       err_out = "cancelled";
       return "";
     }
 
-    // 1) OCR
-    std::string ocr = ocr_with_vision(image_path);
-    trim_inplace(ocr);
+    // 1) OCR：位图只在这一段里，预订到 OCR 结束
+    std::string ocr;
+    const auto t_ocr = std::chrono::steady_clock::now();
+    {
+      MemoryGovernor::Reservation mem;
+      if (!reserve_stage_memory(opts, MemStage::ocr, estimate_image_bytes(image_path, cfg_.ocr_max_side), cancel_flag,
+                                mem, err_out)) {
+        progress.store(100);
+        return "";
+      }
+      TraceSpan span(opts.trace, "ocr");
+      ocr = ocr_with_vision(image_path, preproc_options_from_config(cfg_), opts.trace);
+      trim_inplace(ocr);
+      span.set_arg((int64_t)ocr.size());
+    }
+    if (opts.stats) {
+      opts.stats->ocr_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t_ocr).count();
+    }
     if (ocr.empty()) {
       err_out = "OCR失败或未识别到文字";
       progress.store(100);
       return "";
     }
     progress.store(10);
+    if (opts.on_ocr) opts.on_ocr(ocr);
 
     if (cancel_flag.load()) {
       err_out = "cancelled";
@@ -139,179 +116,310 @@ public:
     }
 
     // 2) prompt（用你 prompt.cpp 提供的 build_prompt）
-    const std::string prompt = build_prompt(ocr);
+    GenRequest req;
+    req.prompt = build_prompt(ocr);
+    req.cancel = &cancel_flag;
+    req.trace = opts.trace;
+    req.monitor = monitor_options_from_config(cfg_);
+    if (cfg_.structure_grammar) req.grammar = two_paragraph_grammar();
+    req.max_new_tokens = opts.max_new_tokens;
+    req.min_new_tokens = opts.min_new_tokens;
     progress.store(15);
 
-    // 3) llama init
-    llama_backend_init();
+    // 3) 语义缓存：OCR 文本的向量和最近完成的任务比，够近就直接用上次的结果。
+    //    n-gram / 单独的向量模型不用生成模型，先查再租，命中的任务不占租约、不会把别的模型挤出 registry
+    std::string cached;
+    if (opts.on_embedding && !cfg_.embed_model.empty() && semantic_hit(nullptr, ocr, opts, cancel_flag, cached)) {
+      progress.store(100);
+      return cached;
+    }
 
-    llama_model_params mparams = llama_model_default_params();
-    llama_model *model = llama_model_load_from_file(cfg_.model_path.c_str(), mparams);
-    if (!model) {
-      err_out = "模型加载失败: " + cfg_.model_path;
-      llama_backend_free();
+    // 4) 从 registry 租用模型（常驻、跨 job 共享）
+    ModelLease lease;
+    {
+      TraceSpan span(opts.trace, "model_acquire");
+      lease = models_->acquire(opts.model, err_out);
+    }
+    if (!lease) {
       progress.store(100);
       return "";
     }
 
-    llama_context_params cparams = llama_context_default_params();
-    cparams.n_ctx   = cfg_.n_ctx;
-    cparams.n_batch = cfg_.n_batch;
-
-    llama_context *ctx = llama_init_from_model(model, cparams);
-    if (!ctx) {
-      err_out = "llama context 创建失败";
-      llama_model_free(model);
-      llama_backend_free();
+    // 用任务自己的模型开 embeddings 模式算向量的，只能租到之后再查
+    if (opts.on_embedding && cfg_.embed_model.empty() && semantic_hit(lease->model, ocr, opts, cancel_flag, cached)) {
       progress.store(100);
-      return "";
+      return cached;
     }
 
-    const llama_vocab *vocab = llama_model_get_vocab(model);
+    LLMResult r = generate(*lease, req, opts, progress);
+    if (opts.stats) opts.stats->transcript = req.prompt + r.text;
+
+    // cancelled 或 decode 失败时 text 可能为空，仍然把已生成的部分返回
+    err_out = r.error;
+    progress.store(100);
+    return r.text;
+  }
 
-    // tokenize prompt
-    std::vector<llama_token> prompt_tokens = tokenize(vocab, prompt);
-    if (prompt_tokens.empty()) {
-      err_out = "prompt tokenize 失败";
-      llama_free(ctx);
-      llama_model_free(model);
-      llama_backend_free();
+  // 追问：优先恢复 parent 的 KV 状态，只 prefill 新的一轮；状态不可用时把整段对话重新 prefill
+  std::string followup(const FollowupRequest &freq,
+                       const JobOptions &opts,
+                       std::atomic<int> &progress,
+                       std::atomic<bool> &cancel_flag,
+                       std::string &err_out) override {
+    err_out.clear();
+    progress.store(5);
+
+    ModelLease lease;
+    {
+      TraceSpan span(opts.trace, "model_acquire");
+      lease = models_->acquire(opts.model, err_out);
+    }
+    if (!lease) {
       progress.store(100);
       return "";
     }
 
-    // 4) sampler
-    llama_sampler *sampler =
-        llama_sampler_chain_init(llama_sampler_chain_default_params());
-    llama_sampler_chain_add(sampler, llama_sampler_init_top_k(cfg_.top_k));
-    llama_sampler_chain_add(sampler, llama_sampler_init_top_p(cfg_.top_p, 1));
-    llama_sampler_chain_add(sampler, llama_sampler_init_temp(cfg_.temp));
-    llama_sampler_chain_add(sampler, llama_sampler_init_dist(LLAMA_DEFAULT_SEED));
-
-    // 5) decode prompt（关键：只给最后一个 token 打 logits=1）
-    llama_batch batch = llama_batch_init((int32_t)prompt_tokens.size(), 0, 1);
-    batch.n_tokens = 0;
-    for (int32_t i = 0; i < (int32_t)prompt_tokens.size(); ++i) {
-      const bool want_logits = (i == (int32_t)prompt_tokens.size() - 1);
-      batch_add_token(batch, prompt_tokens[i], /*pos*/i, /*seq*/0, want_logits);
+    const auto t0 = std::chrono::steady_clock::now();
+    SeqState state;
+    std::string why;
+    bool warm = false;
+    {
+      TraceSpan span(opts.trace, "kv_load");
+      warm = kv_.load(freq.parent_id, lease->path, state, why);
+      span.set_arg((int64_t)state.data.size());
     }
-
-    if (llama_decode(ctx, batch) != 0) {
-      err_out = "llama_decode(prompt) 失败";
-      llama_batch_free(batch);
-      llama_sampler_free(sampler);
-      llama_free(ctx);
-      llama_model_free(model);
-      llama_backend_free();
+    const double load_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    if (!warm && freq.transcript.empty()) {
+      err_out = "找不到原任务的上下文（" + why + "）";
       progress.store(100);
       return "";
     }
 
-    // 关键修复：第一次采样必须用 prompt 最后 token 的 logits index（n_prompt-1）
-    const int32_t prompt_logits_idx = (int32_t)prompt_tokens.size() - 1;
-
-    llama_batch_free(batch);
-
-    // 6) generation
-    const llama_token tok_eos = llama_vocab_eos(vocab);
-    const std::vector<std::string> stopStrings = {"<|im_end|>", "<|endoftext|>"};
-
-    std::string out;
-    out.reserve(8192);
-
-    int32_t n_past = (int32_t)prompt_tokens.size();
-    int eos_resample_left = cfg_.max_resample_eos;
+    const std::string turn = build_followup_prompt(freq.question);
+    GenRequest req;
+    req.cancel = &cancel_flag;
+    req.trace = opts.trace;
+    // 追问不限两段：只在跑偏 / 换语言时停
+    req.monitor = monitor_options_from_config(cfg_);
+    req.monitor.paragraphs = 0;
+    req.max_new_tokens = opts.max_new_tokens;
+    req.min_new_tokens = opts.min_new_tokens;
+    if (warm) {
+      req.prompt = turn;
+      req.restore = &state;
+    } else {
+      req.prompt = freq.transcript + turn;
+    }
+    progress.store(15);
 
-    for (int step = 0; step < cfg_.max_new_tokens; ++step) {
-      if (cancel_flag.load()) {
-        err_out = "cancelled";
-        break;
+    LLMResult r = generate(*lease, req, opts, progress);
+    if (warm && !r.ok && r.n_gen_tokens == 0 && !cancel_flag.load() && !freq.transcript.empty()) {
+      // 状态和当前 context 对不上（比如 n_ctx 改过）：退回冷启动
+      warm = false;
+      req.restore = nullptr;
+      req.prompt = freq.transcript + turn;
+      r = generate(*lease, req, opts, progress);
+    }
+    if (opts.stats) {
+      opts.stats->transcript = freq.transcript + turn + r.text;
+      opts.stats->kv_restored = warm;
+      if (warm) {
+        opts.stats->restore_ms = load_ms + r.restore_ms;
+        opts.stats->ttft_ms += load_ms;  // 读文件 + 解压也算在首 token 延迟里
       }
+    }
 
-      // 进度条：15% ~ 95%
-      const int p = 15 + (int)((double)step / std::max(1, cfg_.max_new_tokens) * 80.0);
-      progress.store(std::min(95, p));
+    err_out = r.error;
+    progress.store(100);
+    return r.text;
+  }
 
-      // step==0 用 prompt_logits_idx；之后每轮 decode 的 batch 只有 1 token，logits index 就是 0
-      int32_t sample_idx = (step == 0) ? prompt_logits_idx : 0;
-
-      llama_token tok = llama_sampler_sample(sampler, ctx, sample_idx);
-
-      // 早 eos：在 min_new_tokens 前尽量重采样，避免“越来越短”
-      if (tok == tok_eos && step < cfg_.min_new_tokens && eos_resample_left > 0) {
-        int tries = std::min(eos_resample_left, 8);
-        bool replaced = false;
-        while (tries-- > 0) {
-          llama_token t2 = llama_sampler_sample(sampler, ctx, sample_idx);
-          if (t2 != tok_eos) {
-            tok = t2;
-            replaced = true;
-            break;
-          }
-        }
-        eos_resample_left--;
-        if (!replaced && eos_resample_left > 0) {
-          // 继续下一轮再试一次（不 accept eos）
-          step--;
-          continue;
-        }
+private:
+  // 语义缓存的文本向量：Config::embed_model 为 "ngram" 时用字符 n-gram（不碰模型），为 GGUF 路径时用单独的向量模型
+  // （第一次用到时加载、之后常驻，不进 registry 的 LRU），否则用任务自己的模型（job_model）开 embeddings 模式
+  bool embed(llama_model *job_model, const std::string &text, const JobOptions &opts, const std::atomic<bool> &cancel_flag,
+             std::vector<float> &out, std::string &err) {
+    if (cfg_.embed_model == "ngram") {
+      ngram_embedding(text, kNgramEmbeddingDim, out);
+      return true;
+    }
+    llama_model *m = job_model;
+    if (!cfg_.embed_model.empty()) {
+      std::lock_guard<std::mutex> lk(embed_mu_);
+      if (!embed_model_ && !embed_load_failed_) {
+        embed_model_ = llama_model_load_from_file(cfg_.embed_model.c_str(), llama_model_default_params());
+        embed_load_failed_ = embed_model_ == nullptr;
       }
-
-      // 如果允许结束
-      if (tok == tok_eos && step >= cfg_.min_new_tokens) {
-        break;
+      if (!embed_model_) {
+        err = "向量模型加载失败: " + cfg_.embed_model;
+        return false;
       }
+      m = embed_model_;
+    }
+    // 每次临时建一个 embeddings context：和生成一样按 llm 阶段预订（按最多 embed_max_tokens 个 token 估），
+    // 没命中缓存的任务扎堆时也绕不过预算；算完就放掉，生成再单独预订
+    const GenParams params = gen_params_from_config(cfg_);
+    const int n_tok = cfg_.embed_max_tokens > 0 ? std::max(cfg_.embed_max_tokens, 64) : cfg_.n_ctx;
+    MemoryGovernor::Reservation mem;
+    if (!reserve_stage_memory(opts, MemStage::llm, estimate_context_bytes(m, params, n_tok, n_tok), cancel_flag, mem, err)) {
+      return false;
+    }
+    return embed_text(m, text, params, cfg_.embed_max_tokens, out, err);
+  }
 
-      // accept
-      llama_sampler_accept(sampler, tok);
-
-      // append text
-      out += token_to_piece(vocab, tok);
-
-      // stop strings
-      std::string tmp = out;
-      cut_after_any_stop(tmp, stopStrings);
-      if (tmp.size() != out.size()) {
-        out = tmp;
-        break;
-      }
+  // 算向量并交给 JobManager 查语义缓存，命中时 cached 是上次的结果；算不出向量只提示一次，当没命中
+  bool semantic_hit(llama_model *job_model, const std::string &ocr, const JobOptions &opts,
+                    const std::atomic<bool> &cancel_flag, std::string &cached) {
+    std::vector<float> emb;
+    std::string why;
+    bool ok;
+    {
+      TraceSpan span(opts.trace, "embed");
+      ok = embed(job_model, ocr, opts, cancel_flag, emb, why);
+      span.set_arg((int64_t)emb.size());
+    }
+    if (!ok) {
+      if (cancel_flag.load()) return false;
+      static std::once_flag warned;
+      std::call_once(warned, [&] { std::cerr << "[semcache] 算向量失败，本次不查缓存: " << why << "\n"; });
+      return false;
+    }
+    return opts.on_embedding(emb, cached);
+  }
 
-      // decode this token（logits=1 留给下一轮采样 idx=0）
-      llama_batch b = llama_batch_init(1, 0, 1);
-      b.n_tokens = 0;
-      batch_add_token(b, tok, /*pos*/n_past, /*seq*/0, /*logits*/true);
-      n_past += 1;
+  // context 从模型的池子里拿（没有就新建），用完放回；结束后把 KV 状态交给 kv_ 异步落盘
+  LLMResult generate(LoadedModel &model, GenRequest &req, const JobOptions &opts, std::atomic<int> &progress) {
+    if (opts.n_candidates > 1 && !req.restore) return generate_candidates(model, req, opts, progress);
+
+    // context 用到结束才放回池子：预订覆盖整个生成（追问恢复的 KV 状态在内存里也算上）
+    MemoryGovernor::Reservation mem;
+    const uint64_t need = estimate_context_bytes(model.model, gen_params_from_config(cfg_), cfg_.n_ctx, cfg_.n_batch) +
+                          (req.restore ? (uint64_t)req.restore->data.size() : 0);
+    std::string err;
+    if (!reserve_stage_memory(opts, MemStage::llm, need, *req.cancel, mem, err)) {
+      LLMResult r;
+      r.error = err;
+      return r;
+    }
 
-      if (llama_decode(ctx, b) != 0) {
-        llama_batch_free(b);
-        err_out = "llama_decode(next) 失败";
-        break;
-      }
-      llama_batch_free(b);
+    std::optional<LlmRunner> runner_holder;
+    {
+      TraceSpan span(opts.trace, "context_init");
+      runner_holder.emplace(model.model, model.take_context(), gen_params_from_config(cfg_), cfg_.n_ctx, cfg_.n_batch);
+      span.set_arg(runner_holder->reused() ? 1 : 0);
+    }
+    LlmRunner &runner = *runner_holder;
+    if (!runner.ok()) {
+      LLMResult r;
+      r.error = runner.error();
+      return r;
     }
 
-    trim_inplace(out);
-    if (!err_out.empty() && out.empty()) {
-      // cancelled 或 decode 失败时可能为空
+    // generation：进度条 15% ~ 95%
+    const int max_new = std::max(1, req.max_new_tokens > 0 ? req.max_new_tokens : cfg_.max_new_tokens);
+    req.on_token = [&](const std::string &piece, int n_gen) {
+      const int p = 15 + (int)((double)n_gen / max_new * 80.0);
+      progress.store(std::min(95, p));
+      if (opts.on_delta) opts.on_delta(piece);
+    };
+    req.save_state = kv_.enabled() && !opts.job_id.empty();
+
+    std::vector<GenRequest> reqs;
+    reqs.push_back(req);
+    LLMResult r = runner.generate(std::move(reqs)).front();
+    model.put_context(runner.release_context());
+
+    if (opts.stats) {
+      opts.stats->prompt_tokens = r.n_prompt_tokens;
+      opts.stats->gen_tokens = r.n_gen_tokens;
+      opts.stats->ttft_ms = r.prefill_ms;
+      opts.stats->decode_ms = r.decode_ms;
+      opts.stats->stop_reason = stop_reason_name(r.stop_reason);
+      opts.stats->tokens_saved = r.n_saved_tokens;
+      opts.stats->tokens_cut = r.n_cut_tokens;
     }
+    if (r.ok && !r.state.data.empty()) kv_.save(opts.job_id, model.path, std::move(r.state));
+    r.state = SeqState{};
+    return r;
+  }
 
-    progress.store(100);
+  // 多候选：prompt 只 prefill 一次，fork 成 n 个 sequence 一起 decode，按格式打分取最好的。
+  // context 的 KV 布局（unified、多 sequence）和池里的不一样，所以单独建、用完就释放。
+  // 候选是并行生成的，中途不推 delta，最后把选中的那个一次性推出去
+  LLMResult generate_candidates(LoadedModel &model, GenRequest &req, const JobOptions &opts,
+                                std::atomic<int> &progress) {
+    const int n = std::min(opts.n_candidates, std::max(1, cfg_.max_candidates));
+    MemoryGovernor::Reservation mem;
+    const uint64_t need = estimate_context_bytes(model.model, gen_params_from_config(cfg_), cfg_.n_ctx, cfg_.n_batch, n, true);
+    std::string err;
+    if (!reserve_stage_memory(opts, MemStage::llm, need, *req.cancel, mem, err)) {
+      LLMResult r;
+      r.error = err;
+      return r;
+    }
 
-    llama_sampler_free(sampler);
-    llama_free(ctx);
-    llama_model_free(model);
-    llama_backend_free();
+    std::optional<LlmRunner> runner_holder;
+    {
+      TraceSpan span(opts.trace, "context_init");
+      runner_holder.emplace(model.model, gen_params_from_config(cfg_), cfg_.n_ctx, cfg_.n_batch, n, true);
+      span.set_arg(n);
+    }
+    LlmRunner &runner = *runner_holder;
+    if (!runner.ok()) {
+      LLMResult r;
+      r.error = runner.error();
+      return r;
+    }
 
-    return out;
+    const int max_new = std::max(1, req.max_new_tokens > 0 ? req.max_new_tokens : cfg_.max_new_tokens) * n;
+    int total = 0;
+    req.on_token = [&](const std::string &, int) {
+      const int p = 15 + (int)((double)++total / max_new * 80.0);
+      progress.store(std::min(95, p));
+    };
+    req.save_state = kv_.enabled() && !opts.job_id.empty();
+
+    std::vector<LLMResult> rs = runner.generate_candidates(req, n, score_summary_format);
+    LLMResult r = std::move(rs.front());
+
+    if (opts.stats) {
+      opts.stats->prompt_tokens = r.n_prompt_tokens;
+      opts.stats->gen_tokens = total;
+      opts.stats->ttft_ms = r.prefill_ms;
+      opts.stats->decode_ms = r.decode_ms;
+      opts.stats->stop_reason = stop_reason_name(r.stop_reason);
+      opts.stats->tokens_saved = 0;
+      opts.stats->tokens_cut = 0;
+      for (const LLMResult &c : rs) {
+        opts.stats->tokens_saved += c.n_saved_tokens;
+        opts.stats->tokens_cut += c.n_cut_tokens;
+      }
+      opts.stats->candidates.clear();
+      opts.stats->candidates.push_back({r.text, r.score, r.n_gen_tokens});
+      for (size_t i = 1; i < rs.size(); ++i) {
+        if (rs[i].ok) opts.stats->candidates.push_back({rs[i].text, rs[i].score, rs[i].n_gen_tokens});
+      }
+    }
+    if (opts.on_delta && !r.text.empty()) opts.on_delta(r.text);
+    if (r.ok && !r.state.data.empty()) kv_.save(opts.job_id, model.path, std::move(r.state));
+    r.state = SeqState{};
+    return r;
   }
 
 private:
   Config cfg_;
+  std::shared_ptr<ModelRegistry> models_;
+  KvStore kv_;
+
+  std::mutex embed_mu_;
+  llama_model *embed_model_ = nullptr;  // WS_AI_EMBED_MODEL 指向单独的向量模型时
+  bool embed_load_failed_ = false;
 };
 
 // 工厂函数：提供给 JobManager 调用（必须有定义，否则会链接失败）
-std::unique_ptr<Pipeline> make_pipeline(const Config &cfg) {
-  return std::make_unique<PipelineImpl>(cfg);
+std::unique_ptr<Pipeline> make_pipeline(const Config &cfg,
+                                        std::shared_ptr<ModelRegistry> models) {
+  return std::make_unique<PipelineImpl>(cfg, std::move(models));
 }
 
-} // namespace ws_ai
\ No newline at end of file
+} // namespace ws_ai
@@ -1,5 +1,11 @@
 #include "ws_ai/prompt.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <initializer_list>
 #include <sstream>
+#include <vector>
 
 namespace ws_ai {
 
@@ -16,4 +22,86 @@ std::string build_prompt(const std::string &ocr_text) {
     return oss.str();
 }
 
-} // namespace ws_ai
\ No newline at end of file
+std::string build_followup_prompt(const std::string &question) {
+    std::ostringstream oss;
+    oss << "<|im_end|>\n"
+        << "<|im_start|>user\n"
+        << "针对上面的截图内容和你的回答，继续回答这个追问（用中文，可以不限两段）：\n"
+        << question << "\n"
+        << "<|im_end|>\n"
+        << "<|im_start|>assistant\n";
+    return oss.str();
+}
+
+// UTF-8 码点数（中文按 1 个字算）
+static size_t utf8_len(const std::string &s) {
+    size_t n = 0;
+    for (unsigned char c : s) n += (c & 0xC0) != 0x80;
+    return n;
+}
+
+static bool starts_with_any(const std::string &s, std::initializer_list<const char *> prefixes) {
+    for (const char *p : prefixes) {
+        if (s.rfind(p, 0) == 0) return true;
+    }
+    return false;
+}
+
+double score_summary_format(const std::string &text) {
+    // 按行切，空行分段；行首的空白去掉
+    std::vector<std::string> paras;
+    std::string cur;
+    int bullets = 0, headings = 0;
+    std::istringstream iss(text);
+    std::string line;
+    while (std::getline(iss, line)) {
+        size_t b = line.find_first_not_of(" \t\r");
+        if (b == std::string::npos) {
+            if (!cur.empty()) paras.push_back(cur);
+            cur.clear();
+            continue;
+        }
+        line = line.substr(b);
+        while (!line.empty() && (line.back() == ' ' || line.back() == '\r')) line.pop_back();
+
+        // 分点 / 编号 / 标题都违反“不分点、不要标题”
+        if (starts_with_any(line, {"- ", "* ", "• ", "·", "1.", "2.", "3.", "1、", "2、", "3、", "（1）", "(1)", "一、", "二、"})) bullets++;
+        if (starts_with_any(line, {"#", "**", "第一段", "第二段", "总结：", "总结:", "扩展知识", "相关扩展"})) headings++;
+        if (utf8_len(line) <= 12 && (line.find("：") != std::string::npos || line.back() == ':')) headings++;
+
+        // 模型常常只换一行不空行：单独一行的长句也算一段
+        if (!cur.empty()) {
+            paras.push_back(cur);
+            cur.clear();
+        }
+        cur = line;
+    }
+    if (!cur.empty()) paras.push_back(cur);
+    if (paras.empty()) return 0.0;
+
+    double score = 1.0;
+    score -= 0.35 * std::abs((int)paras.size() - 2);
+    score -= 0.15 * std::min(bullets, 4);
+    score -= 0.15 * std::min(headings, 2);
+
+    // 每段 60 ~ 400 字比较合适，太短说明没展开，太长一般是啰嗦或跑题
+    for (size_t i = 0; i < std::min<size_t>(paras.size(), 2); ++i) {
+        const double n = (double)utf8_len(paras[i]);
+        if (n < 60) score -= 0.2 * (60 - n) / 60;
+        else if (n > 400) score -= std::min(0.2, 0.2 * (n - 400) / 400);
+    }
+
+    // 只用中文：ASCII 字母占比太高扣分（专有名词、代码片段少量没关系）
+    size_t letters = 0;
+    for (unsigned char c : text) letters += (c < 0x80 && std::isalpha(c)) ? 1 : 0;
+    const double en_ratio = (double)letters / (double)std::max<size_t>(1, utf8_len(text));
+    if (en_ratio > 0.3) score -= 0.5;
+    else if (en_ratio > 0.15) score -= 0.1;
+
+    // 最后以问句结尾（“你还想了解…？”）也不符合要求
+    if (text.size() >= 3 && (text.compare(text.size() - 3, 3, "？") == 0 || text.back() == '?')) score -= 0.1;
+
+    return std::max(0.0, score);
+}
+
+} // namespace ws_ai
@@ -0,0 +1,166 @@
+#include "ws_ai/static_assets.h"
+#include "ws_ai/util.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <vector>
+
+#ifdef WS_AI_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef WS_AI_HAVE_BROTLI
+#include <brotli/encode.h>
+#endif
+
+namespace ws_ai {
+
+namespace {
+
+struct EmbeddedAsset {
+  const char *url;
+  const unsigned char *data;
+  size_t size;
+};
+
+#ifdef WS_AI_EMBED_WEB
+#include "web_assets.inc"
+#else
+static const EmbeddedAsset kEmbeddedWeb[] = {{nullptr, nullptr, 0}};
+#endif
+
+// 太小的文件压缩收益比头部开销还小
+constexpr size_t kMinCompressBytes = 256;
+
+std::string content_hash(const std::string &s) {
+  // FNV-1a 64：只用来区分版本，不需要抗碰撞
+  uint64_t h = 1469598103934665603ULL;
+  for (unsigned char c : s) {
+    h ^= c;
+    h *= 1099511628211ULL;
+  }
+  char buf[24];
+  std::snprintf(buf, sizeof(buf), "%016llx", (unsigned long long)h);
+  return buf;
+}
+
+std::shared_ptr<const std::string> gzip_compress(const std::string &in) {
+#ifdef WS_AI_HAVE_ZLIB
+  z_stream zs{};
+  // windowBits 15 + 16 = gzip 头
+  if (deflateInit2(&zs, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK) return nullptr;
+  std::string out;
+  out.resize(deflateBound(&zs, (uLong)in.size()));
+  zs.next_in = (Bytef *)in.data();
+  zs.avail_in = (uInt)in.size();
+  zs.next_out = (Bytef *)out.data();
+  zs.avail_out = (uInt)out.size();
+  int rc = deflate(&zs, Z_FINISH);
+  out.resize(zs.total_out);
+  deflateEnd(&zs);
+  if (rc != Z_STREAM_END) return nullptr;
+  return std::make_shared<const std::string>(std::move(out));
+#else
+  (void)in;
+  return nullptr;
+#endif
+}
+
+std::shared_ptr<const std::string> brotli_compress(const std::string &in) {
+#ifdef WS_AI_HAVE_BROTLI
+  size_t n = BrotliEncoderMaxCompressedSize(in.size());
+  if (n == 0) return nullptr;
+  std::string out(n, '\0');
+  if (!BrotliEncoderCompress(BROTLI_MAX_QUALITY, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_TEXT,
+                             in.size(), (const uint8_t *)in.data(), &n, (uint8_t *)out.data()))
+    return nullptr;
+  out.resize(n);
+  return std::make_shared<const std::string>(std::move(out));
+#else
+  (void)in;
+  return nullptr;
+#endif
+}
+
+bool is_html(const std::string &url) {
+  return url.size() >= 5 && url.compare(url.size() - 5, 5, ".html") == 0;
+}
+
+} // namespace
+
+size_t StaticAssets::load(const std::string &web_root) {
+  assets_.clear();
+
+  namespace fs = std::filesystem;
+  std::error_code ec;
+  if (!web_root.empty() && fs::is_regular_file(join_path(web_root, "index.html"), ec)) {
+    for (auto it = fs::directory_iterator(web_root, ec); !ec && it != fs::directory_iterator(); it.increment(ec)) {
+      if (!it->is_regular_file()) continue;
+      std::string bytes;
+      if (!read_file_binary(it->path().string(), bytes)) continue;
+      add("/" + it->path().filename().string(), std::move(bytes));
+    }
+    std::cout << "[static] loaded " << assets_.size() << " files from " << web_root << "\n";
+  } else {
+    for (const EmbeddedAsset *e = kEmbeddedWeb; e->url; ++e)
+      add(e->url, std::string((const char *)e->data, e->size));
+    std::cout << "[static] using " << assets_.size() << " embedded files\n";
+  }
+
+  finalize();
+  return assets_.size();
+}
+
+void StaticAssets::add(const std::string &url, std::string content) {
+  StaticAsset a;
+  a.mime = guess_mime(url);
+  a.identity = std::make_shared<const std::string>(std::move(content));
+  assets_[url] = std::move(a);
+}
+
+void StaticAssets::finalize() {
+  // 1) 非 html 资源：按内容算版本号，可以 immutable
+  std::vector<std::pair<std::string, std::string>> versioned;  // url -> url?v=hash
+  for (auto &[url, a] : assets_) {
+    if (is_html(url)) continue;
+    const std::string h = content_hash(*a.identity);
+    a.etag = h;
+    a.immutable = true;
+    versioned.emplace_back(url, url + "?v=" + h.substr(0, 12));
+  }
+
+  // 2) html：把 "/app.js" 这类引用改成带版本号的，再算 html 自己的 ETag
+  for (auto &[url, a] : assets_) {
+    if (!is_html(url)) continue;
+    std::string html = *a.identity;
+    for (auto &[from, to] : versioned) {
+      const std::string q1 = "\"" + from + "\"", q2 = "\"" + to + "\"";
+      for (size_t p = html.find(q1); p != std::string::npos; p = html.find(q1, p + q2.size()))
+        html.replace(p, q1.size(), q2);
+    }
+    a.identity = std::make_shared<const std::string>(std::move(html));
+    a.etag = content_hash(*a.identity);
+  }
+
+  // 3) 预压缩（比原文还大就丢掉）
+  for (auto &[url, a] : assets_) {
+    (void)url;
+    if (a.identity->size() < kMinCompressBytes) continue;
+    a.gzip = gzip_compress(*a.identity);
+    if (a.gzip && a.gzip->size() >= a.identity->size()) a.gzip.reset();
+    a.brotli = brotli_compress(*a.identity);
+    if (a.brotli && a.brotli->size() >= a.identity->size()) a.brotli.reset();
+  }
+
+  // "/" 就是 index.html
+  auto idx = assets_.find("/index.html");
+  if (idx != assets_.end()) assets_["/"] = idx->second;
+}
+
+const StaticAsset *StaticAssets::find(const std::string &url) const {
+  auto it = assets_.find(url);
+  return it == assets_.end() ? nullptr : &it->second;
+}
+
+} // namespace ws_ai
@@ -0,0 +1,243 @@
+#include "ws_ai/thread_plan.h"
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <thread>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+#if defined(__APPLE__)
+#include <sys/sysctl.h>
+#endif
+
+namespace ws_ai {
+
+// "0-3,8-11" -> {0,1,2,3,8,9,10,11}
+static std::vector<int> parse_cpu_list(const std::string &s) {
+    std::vector<int> out;
+    std::stringstream ss(s);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (item.empty()) continue;
+        const auto dash = item.find('-');
+        const int a = std::atoi(item.c_str());
+        const int b = dash == std::string::npos ? a : std::atoi(item.c_str() + dash + 1);
+        for (int i = a; i <= b; ++i) out.push_back(i);
+    }
+    return out;
+}
+
+// {0,1,2,3,8} -> "0-3,8"
+static std::string format_cpu_list(std::vector<int> cpus) {
+    if (cpus.empty()) return "-";
+    std::sort(cpus.begin(), cpus.end());
+    std::ostringstream oss;
+    for (size_t i = 0; i < cpus.size();) {
+        size_t j = i;
+        while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1) j++;
+        if (i) oss << ",";
+        oss << cpus[i];
+        if (j > i) oss << "-" << cpus[j];
+        i = j + 1;
+    }
+    return oss.str();
+}
+
+#if defined(__linux__)
+static bool read_line(const std::string &path, std::string &out) {
+    std::ifstream ifs(path);
+    return (bool)std::getline(ifs, out);
+}
+
+static int read_int(const std::string &path, int fallback) {
+    std::string s;
+    return read_line(path, s) ? std::atoi(s.c_str()) : fallback;
+}
+#endif
+
+#if defined(__APPLE__)
+static int sysctl_int(const char *name) {
+    int v = 0;
+    size_t len = sizeof(v);
+    return sysctlbyname(name, &v, &len, nullptr, 0) == 0 ? v : 0;
+}
+#endif
+
+CpuTopology detect_cpu_topology() {
+    CpuTopology t;
+    t.n_logical = std::max(1u, std::thread::hardware_concurrency());
+    t.n_physical = t.n_logical;
+
+#if defined(__linux__)
+    // 只看当前进程允许用的 CPU（容器 / taskset 下比 online 少）
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    const bool have_mask = sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+
+    std::string online;
+    std::vector<int> ids = read_line("/sys/devices/system/cpu/online", online) ? parse_cpu_list(online)
+                                                                               : std::vector<int>{};
+    std::map<int, int> node_of;
+    for (int n = 0; n < 1024; ++n) {
+        std::string list;
+        if (!read_line("/sys/devices/system/node/node" + std::to_string(n) + "/cpulist", list)) {
+            if (n > 0) break;
+            continue;
+        }
+        for (int c : parse_cpu_list(list)) node_of[c] = n;
+    }
+
+    std::set<std::pair<int, int>> cores;  // (package, core_id)
+    std::set<int> nodes;
+    std::map<std::pair<int, int>, int> core_index;
+    for (int id : ids) {
+        if (have_mask && !CPU_ISSET(id, &allowed)) continue;
+        const std::string base = "/sys/devices/system/cpu/cpu" + std::to_string(id) + "/topology/";
+        const std::pair<int, int> key{read_int(base + "physical_package_id", 0), read_int(base + "core_id", id)};
+        if (!core_index.count(key)) core_index.emplace(key, (int)core_index.size());
+
+        CpuInfo c;
+        c.id = id;
+        c.core = core_index[key];
+        c.node = node_of.count(id) ? node_of[id] : 0;
+        t.cpus.push_back(c);
+        cores.insert(key);
+        nodes.insert(c.node);
+    }
+    if (!t.cpus.empty()) {
+        t.n_logical = (int)t.cpus.size();
+        t.n_physical = (int)cores.size();
+        t.n_nodes = (int)nodes.size();
+    }
+#elif defined(__APPLE__)
+    if (int v = sysctl_int("hw.logicalcpu")) t.n_logical = v;
+    if (int v = sysctl_int("hw.physicalcpu")) t.n_physical = v;
+    t.n_perf = sysctl_int("hw.perflevel0.physicalcpu");  // Intel Mac 上没有这个键 -> 0
+#endif
+    return t;
+}
+
+ThreadPlan make_thread_plan(const Config &cfg, bool overlap_ocr) {
+    return make_thread_plan(cfg, overlap_ocr, detect_cpu_topology());
+}
+
+ThreadPlan make_thread_plan(const Config &cfg, bool overlap_ocr, const CpuTopology &topo) {
+    ThreadPlan p;
+    p.topo = topo;
+    const CpuTopology &t = p.topo;
+
+    // 生成是算力 / 带宽密集型，只按物理（性能）核算；SMT 和能效核留给 OCR / HTTP
+    const int fast = std::max(1, t.n_perf > 0 ? t.n_perf : t.n_physical);
+    p.ocr_workers = cfg.ocr_workers > 0 ? cfg.ocr_workers : (fast >= 8 ? 2 : 1);
+    p.http_workers = cfg.http_workers > 0 ? cfg.http_workers : std::clamp(t.n_logical / 4, 2, 8);
+    p.pin = cfg.pin_threads && !t.cpus.empty();
+
+    int avail = fast;
+    int reserved = overlap_ocr ? p.ocr_workers : 0;
+    std::map<int, std::set<int>> cores_per_node;
+    if (p.pin) {
+        // 绑核时 llama 只放在物理核最多的 NUMA 节点上（跨节点访存比少几个线程更亏）；
+        // 别的节点核够的话 OCR 放过去，不占 llama 的节点
+        for (const auto &c : t.cpus) cores_per_node[c.node].insert(c.core);
+        auto best = std::max_element(cores_per_node.begin(), cores_per_node.end(),
+                                     [](const auto &a, const auto &b) { return a.second.size() < b.second.size(); });
+        p.llm_node = best->first;
+        avail = (int)best->second.size();
+        if (fast - avail >= reserved) reserved = 0;
+    }
+    // 服务端并发任务数：每个至少分到 4 个核才值得并发（decode 吃带宽，核太少时并发反而互相拖慢），最多 4 个
+    p.job_workers = overlap_ocr ? 1 : cfg.job_workers > 0 ? cfg.job_workers : std::clamp(avail / 4, 1, 4);
+    p.n_threads = cfg.n_threads > 0 ? cfg.n_threads : std::max(1, (avail - reserved) / p.job_workers);
+    p.n_threads_batch = cfg.n_threads_batch > 0 ? cfg.n_threads_batch : p.n_threads;
+    if (!p.pin) return p;
+
+    std::vector<CpuInfo> cpus = t.cpus;
+    std::stable_sort(cpus.begin(), cpus.end(), [&](const CpuInfo &a, const CpuInfo &b) {
+        const bool na = a.node == p.llm_node, nb = b.node == p.llm_node;
+        if (na != nb) return na;
+        if (a.node != b.node) return a.node < b.node;
+        return a.core != b.core ? a.core < b.core : a.id < b.id;
+    });
+
+    std::set<int> used_cores;
+    std::set<int> used_cpus;
+    enum { kLlmNode, kOtherNodes, kAnyNode };
+    auto take_cores = [&](int n, int where, std::vector<int> &out) {
+        for (const auto &c : cpus) {
+            if ((int)out.size() >= n) break;
+            if (where == kLlmNode && c.node != p.llm_node) continue;
+            if (where == kOtherNodes && c.node == p.llm_node) continue;
+            if (used_cores.count(c.core)) continue;
+            used_cores.insert(c.core);
+            used_cpus.insert(c.id);
+            out.push_back(c.id);
+        }
+    };
+
+    const int llm_cores = std::max(p.n_threads, p.n_threads_batch) * p.job_workers;
+    take_cores(llm_cores, kLlmNode, p.llm_cpus);
+    take_cores(llm_cores, kAnyNode, p.llm_cpus);  // 手动指定的线程数比一个节点的核多
+    if (overlap_ocr) {
+        take_cores(p.ocr_workers, kOtherNodes, p.ocr_cpus);
+        take_cores(p.ocr_workers, kAnyNode, p.ocr_cpus);
+    }
+
+    // 剩下的逻辑核（含 llama 核的 SMT 兄弟）给 HTTP；一个都不剩就不绑 HTTP
+    for (const auto &c : cpus) {
+        if (!used_cpus.count(c.id)) p.http_cpus.push_back(c.id);
+    }
+    if (!overlap_ocr) p.ocr_cpus = p.llm_cpus;  // 服务端 OCR 跑在 job worker 线程上
+    if (p.ocr_cpus.empty()) p.ocr_cpus = p.http_cpus;
+    return p;
+}
+
+void apply_thread_plan(const ThreadPlan &plan, Config &cfg) {
+    cfg.n_threads = plan.n_threads;
+    cfg.n_threads_batch = plan.n_threads_batch;
+    cfg.ocr_workers = plan.ocr_workers;
+    cfg.http_workers = plan.http_workers;
+    cfg.job_workers = plan.job_workers;
+}
+
+bool pin_current_thread(const ThreadPlan &plan, ThreadRole role) {
+#if defined(__linux__)
+    if (!plan.pin) return false;
+    const std::vector<int> &cpus = role == ThreadRole::llm ? plan.llm_cpus
+                                 : role == ThreadRole::ocr ? plan.ocr_cpus
+                                                           : plan.http_cpus;
+    if (cpus.empty()) return false;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int c : cpus) CPU_SET(c, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    // macOS 没有硬绑核的接口，交给调度器（QoS）
+    (void)plan;
+    (void)role;
+    return false;
+#endif
+}
+
+std::string ThreadPlan::report() const {
+    std::ostringstream oss;
+    oss << "[threads] cpus: " << topo.n_logical << " logical / " << topo.n_physical << " physical";
+    if (topo.n_perf > 0) oss << " (" << topo.n_perf << " performance)";
+    oss << ", " << topo.n_nodes << " NUMA node(s)\n";
+    oss << "[threads] llama: decode " << n_threads << ", prefill " << n_threads_batch;
+    if (job_workers > 1) oss << " (x" << job_workers << " job workers)";
+    if (pin) oss << ", cpus " << format_cpu_list(llm_cpus) << " (node " << llm_node << ")";
+    oss << "\n[threads] ocr: " << ocr_workers << " worker(s)";
+    if (pin) oss << ", cpus " << format_cpu_list(ocr_cpus);
+    oss << "\n[threads] http: " << http_workers << " worker(s)";
+    if (pin) oss << ", cpus " << format_cpu_list(http_cpus);
+    oss << "\n";
+    if (!pin) oss << "[threads] affinity: not pinned" << (topo.cpus.empty() ? " (unsupported on this platform)" : "") << "\n";
+    return oss.str();
+}
+
+} // namespace ws_ai
@@ -0,0 +1,168 @@
+#include "ws_ai/trace.h"
+#include "ws_ai/util.h"
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <sstream>
+#include <utility>
+
+namespace ws_ai {
+
+static const auto g_t0 = std::chrono::steady_clock::now();
+
+uint64_t trace_now_us() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - g_t0).count();
+}
+
+// 线程号：按首次打点顺序编 1, 2, 3 ...，比 pthread id 好读
+static uint32_t trace_tid() {
+    static std::atomic<uint32_t> next{1};
+    thread_local uint32_t tid = next.fetch_add(1);
+    return tid;
+}
+
+// -------------------------
+// TraceRing
+// -------------------------
+TraceRing::TraceRing(size_t capacity) {
+    size_t cap = 1;
+    while (cap < capacity) cap <<= 1;
+    slots_.reset(new Slot[cap]);
+    mask_ = cap - 1;
+}
+
+void TraceRing::push(const TraceEvent &e) {
+    const uint64_t idx = head_.fetch_add(1, std::memory_order_relaxed);
+    Slot &s = slots_[idx & mask_];
+    s.seq.store(2 * idx + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    s.w[0].store((uint64_t)(uintptr_t)e.name, std::memory_order_relaxed);
+    s.w[1].store(e.ts_us, std::memory_order_relaxed);
+    s.w[2].store(e.dur_us, std::memory_order_relaxed);
+    s.w[3].store(((uint64_t)e.tid << 32) | e.job, std::memory_order_relaxed);
+    s.w[4].store((uint64_t)e.arg, std::memory_order_relaxed);
+    s.seq.store(2 * idx + 2, std::memory_order_release);
+}
+
+std::vector<TraceEvent> TraceRing::snapshot() const {
+    const uint64_t head = head_.load(std::memory_order_acquire);
+    const uint64_t cap = mask_ + 1;
+    std::vector<TraceEvent> out;
+    out.reserve((size_t)std::min(head, cap));
+
+    for (uint64_t idx = head > cap ? head - cap : 0; idx < head; ++idx) {
+        const Slot &s = slots_[idx & mask_];
+        const uint64_t s1 = s.seq.load(std::memory_order_acquire);
+        if (s1 != 2 * idx + 2) continue;  // 还在写，或已被后面的写覆盖
+
+        uint64_t w[5];
+        for (int i = 0; i < 5; ++i) w[i] = s.w[i].load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (s.seq.load(std::memory_order_relaxed) != s1) continue;
+
+        TraceEvent e;
+        e.name = (const char *)(uintptr_t)w[0];
+        e.ts_us = w[1];
+        e.dur_us = w[2];
+        e.tid = (uint32_t)(w[3] >> 32);
+        e.job = (uint32_t)w[3];
+        e.arg = (int64_t)w[4];
+        out.push_back(e);
+    }
+    std::sort(out.begin(), out.end(), [](const TraceEvent &a, const TraceEvent &b) { return a.ts_us < b.ts_us; });
+    return out;
+}
+
+// -------------------------
+// 全局滚动环 + job 序号 -> id（只在创建 JobTrace / 导出时加锁）
+// -------------------------
+static constexpr size_t kGlobalEvents = 16384;
+static constexpr size_t kJobEvents = 512;
+static constexpr size_t kJobNames = 1024;
+
+static TraceRing &global_ring() {
+    static TraceRing ring(kGlobalEvents);
+    return ring;
+}
+
+static std::mutex g_names_mu;
+static std::deque<std::pair<uint32_t, std::string>> g_job_names;
+
+JobTrace::JobTrace(std::string job_id, int decode_every)
+: job_id_(std::move(job_id)), decode_every_(std::max(1, decode_every)), ring_(new TraceRing(kJobEvents)) {
+    static std::atomic<uint32_t> next{1};
+    seq_ = next.fetch_add(1);
+
+    std::lock_guard<std::mutex> lk(g_names_mu);
+    g_job_names.emplace_back(seq_, job_id_);
+    if (g_job_names.size() > kJobNames) g_job_names.pop_front();
+}
+
+void JobTrace::span(const char *name, uint64_t start_us, uint64_t dur_us, int64_t arg) {
+    TraceEvent e;
+    e.name = name;
+    e.ts_us = start_us;
+    e.dur_us = dur_us;
+    e.tid = trace_tid();
+    e.job = seq_;
+    e.arg = arg;
+    if (ring_) ring_->push(e);
+    global_ring().push(e);
+}
+
+static void write_event(std::ostringstream &oss, const TraceEvent &e, uint32_t pid, bool &first) {
+    if (!first) oss << ",";
+    first = false;
+    oss << "{\"name\":\"" << e.name << "\",\"cat\":\"ws_ai\",\"ph\":\"X\""
+        << ",\"ts\":" << e.ts_us << ",\"dur\":" << e.dur_us
+        << ",\"pid\":" << pid << ",\"tid\":" << e.tid;
+    if (e.arg >= 0) oss << ",\"args\":{\"n\":" << e.arg << "}";
+    oss << "}";
+}
+
+static void write_process_name(std::ostringstream &oss, uint32_t pid, const std::string &name, bool &first) {
+    if (!first) oss << ",";
+    first = false;
+    oss << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << pid
+        << ",\"args\":{\"name\":\"" << json_escape(name) << "\"}}";
+}
+
+std::string JobTrace::chrome_json() const {
+    std::ostringstream oss;
+    bool first = true;
+    oss << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    write_process_name(oss, 1, "job " + job_id_, first);
+    for (const auto &e : ring_ ? ring_->snapshot() : spans_) write_event(oss, e, 1, first);
+    oss << "]}";
+    return oss.str();
+}
+
+std::shared_ptr<JobTrace> JobTrace::frozen() const {
+    std::shared_ptr<JobTrace> t(new JobTrace());
+    t->job_id_ = job_id_;
+    t->seq_ = seq_;
+    t->decode_every_ = decode_every_;
+    t->spans_ = ring_ ? ring_->snapshot() : spans_;
+    t->spans_.shrink_to_fit();
+    return t;
+}
+
+std::string global_trace_json() {
+    const std::vector<TraceEvent> events = global_ring().snapshot();
+
+    std::ostringstream oss;
+    bool first = true;
+    oss << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    {
+        std::lock_guard<std::mutex> lk(g_names_mu);
+        for (const auto &kv : g_job_names) write_process_name(oss, kv.first, "job " + kv.second, first);
+    }
+    for (const auto &e : events) write_event(oss, e, e.job, first);
+    oss << "]}";
+    return oss.str();
+}
+
+} // namespace ws_ai
@@ -1,4 +1,5 @@
 #include "ws_ai/util.h"
+#include <cstdio>
 #include <filesystem>
 #include <fstream>
 #include <random>
@@ -63,6 +64,31 @@ std::string guess_mime(const std::string& path) {
     return "application/octet-stream";
 }
 
+std::string json_escape(const std::string& s) {
+    std::string o;
+    o.reserve(s.size() + 16);
+    for (unsigned char c : s) {
+        switch (c) {
+            case '\"': o += "\\\""; break;
+            case '\\': o += "\\\\"; break;
+            case '\b': o += "\\b"; break;
+            case '\f': o += "\\f"; break;
+            case '\n': o += "\\n"; break;
+            case '\r': o += "\\r"; break;
+            case '\t': o += "\\t"; break;
+            default:
+                if (c < 0x20) {
+                    char buf[8];
+                    std::snprintf(buf, sizeof(buf), "\\u%04x", (int)c);
+                    o += buf;
+                } else {
+                    o.push_back((char)c);
+                }
+        }
+    }
+    return o;
+}
+
 std::string join_path(const std::string& a, const std::string& b) {
     if (a.empty()) return b;
     if (a.back() == '/') return a + b;
@@ -0,0 +1,691 @@
+#include "ws_ai/watch_server.h"
+#include "ws_ai/util.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
+
+namespace ws_ai {
+
+using Clock = std::chrono::steady_clock;
+
+static const size_t kMaxRequest = 8192;        // 请求头上限
+static const size_t kMaxPending = 256 * 1024;  // 单个连接积压的待发字节上限，超过按慢客户端断开
+static const auto kKeepalive = std::chrono::seconds(15);
+static const auto kHeaderTimeout = std::chrono::seconds(10);
+
+#ifdef MSG_NOSIGNAL
+static const int kSendFlags = MSG_NOSIGNAL;
+#else
+static const int kSendFlags = 0;  // macOS：accept 后设 SO_NOSIGPIPE
+#endif
+
+// -------------------------
+// 多路复用：Linux 用 epoll（水平触发），其它平台退回 poll
+// -------------------------
+struct PollEvent {
+    int fd;
+    bool in;
+    bool out;
+    bool err;
+};
+
+#ifdef __linux__
+class Poller {
+public:
+    Poller() : ep_(epoll_create1(EPOLL_CLOEXEC)) {}
+    ~Poller() { if (ep_ >= 0) ::close(ep_); }
+    bool ok() const { return ep_ >= 0; }
+    static const char *name() { return "epoll"; }
+
+    // exclusive：监听 socket 注册在每个循环里，来连接时只唤醒其中一个
+    // （EPOLLEXCLUSIVE 不能和 EPOLLRDHUP 一起用，否则 EINVAL）
+    bool add(int fd, bool exclusive = false) {
+        epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLRDHUP;
+#ifdef EPOLLEXCLUSIVE
+        if (exclusive) ev.events = EPOLLIN | EPOLLEXCLUSIVE;
+#else
+        (void)exclusive;
+#endif
+        ev.data.fd = fd;
+        return epoll_ctl(ep_, EPOLL_CTL_ADD, fd, &ev) == 0;
+    }
+    void want_write(int fd, bool on) {
+        epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLRDHUP | (on ? EPOLLOUT : 0u);
+        ev.data.fd = fd;
+        epoll_ctl(ep_, EPOLL_CTL_MOD, fd, &ev);
+    }
+    void del(int fd) { epoll_ctl(ep_, EPOLL_CTL_DEL, fd, nullptr); }
+
+    void wait(std::vector<PollEvent> &out, int timeout_ms) {
+        epoll_event evs[256];
+        const int n = epoll_wait(ep_, evs, 256, timeout_ms);
+        out.clear();
+        for (int i = 0; i < n; ++i) {
+            const uint32_t e = evs[i].events;
+            out.push_back({evs[i].data.fd, (e & EPOLLIN) != 0, (e & EPOLLOUT) != 0,
+                           (e & (EPOLLERR | EPOLLHUP | EPOLLRDHUP)) != 0});
+        }
+    }
+
+private:
+    int ep_;
+};
+#else
+class Poller {
+public:
+    bool ok() const { return true; }
+    static const char *name() { return "poll"; }
+
+    bool add(int fd, bool = false) {
+        idx_[fd] = fds_.size();
+        fds_.push_back({fd, POLLIN, 0});
+        return true;
+    }
+    void want_write(int fd, bool on) {
+        auto it = idx_.find(fd);
+        if (it != idx_.end()) fds_[it->second].events = (short)(POLLIN | (on ? POLLOUT : 0));
+    }
+    void del(int fd) {
+        auto it = idx_.find(fd);
+        if (it == idx_.end()) return;
+        const size_t i = it->second;
+        idx_.erase(it);
+        if (i + 1 != fds_.size()) {
+            fds_[i] = fds_.back();
+            idx_[fds_[i].fd] = i;
+        }
+        fds_.pop_back();
+    }
+
+    void wait(std::vector<PollEvent> &out, int timeout_ms) {
+        out.clear();
+        if (::poll(fds_.data(), (nfds_t)fds_.size(), timeout_ms) <= 0) return;
+        for (const pollfd &p : fds_) {
+            if (!p.revents) continue;
+            out.push_back({p.fd, (p.revents & POLLIN) != 0, (p.revents & POLLOUT) != 0,
+                           (p.revents & (POLLERR | POLLHUP | POLLNVAL)) != 0});
+        }
+    }
+
+private:
+    std::vector<pollfd> fds_;
+    std::unordered_map<int, size_t> idx_;
+};
+#endif
+
+static bool set_nonblock(int fd) {
+    const int fl = fcntl(fd, F_GETFL, 0);
+    return fl >= 0 && fcntl(fd, F_SETFL, fl | O_NONBLOCK) == 0;
+}
+
+static const char *state_name(JobState s) {
+    switch (s) {
+    case JobState::queued: return "queued";
+    case JobState::running: return "running";
+    case JobState::done: return "done";
+    case JobState::error: return "error";
+    }
+    return "unknown";
+}
+
+// query 里取一个参数（带 %XX / + 解码）
+static std::string query_param(const std::string &query, const std::string &key) {
+    size_t pos = 0;
+    while (pos <= query.size()) {
+        size_t amp = query.find('&', pos);
+        if (amp == std::string::npos) amp = query.size();
+        const std::string kv = query.substr(pos, amp - pos);
+        if (kv.compare(0, key.size() + 1, key + "=") == 0) {
+            std::string out;
+            for (size_t i = key.size() + 1; i < kv.size(); ++i) {
+                if (kv[i] == '%' && i + 2 < kv.size() && isxdigit((unsigned char)kv[i + 1]) &&
+                    isxdigit((unsigned char)kv[i + 2])) {
+                    out += (char)std::stoi(kv.substr(i + 1, 2), nullptr, 16);
+                    i += 2;
+                } else {
+                    out += kv[i] == '+' ? ' ' : kv[i];
+                }
+            }
+            return out;
+        }
+        pos = amp + 1;
+    }
+    return {};
+}
+
+// 一个客户端连接；只在所属循环线程里访问
+struct Conn {
+    enum class Kind { request, stream, watch };
+
+    int fd = -1;
+    Kind kind = Kind::request;
+    std::string in;       // 请求头
+    std::string out;      // 待发送
+    size_t out_off = 0;
+    bool writing = false;  // 已注册可写事件
+    bool closing = false;  // 发完就关
+    bool dead = false;     // 等本轮结束统一关闭
+
+    std::string job;
+    bool subscribed = false;
+    size_t sub_idx = 0;  // 在 subs[job] 里的下标
+    size_t offset = 0;   // stream：partial 已推到哪
+    int progress = -1;   // watch：上次推的进度 / 状态
+    int state = -1;
+
+    Clock::time_point since;
+    Clock::time_point last_out;
+};
+
+// 一个事件循环线程：自己的 poller、连接表和订阅表（job id -> 连接），只有 pending 跨线程
+struct WatchServer::Loop {
+    WatchServer *srv = nullptr;
+    Poller poller;
+    int wake_rd = -1;
+    int wake_wr = -1;
+    std::thread th;
+    std::atomic<bool> stop{false};
+    std::atomic<int> n_subs{0};
+
+    std::mutex mu;
+    std::unordered_set<std::string> pending;  // 有更新、还没推的 job
+    bool woken = false;
+
+    std::unordered_map<int, std::unique_ptr<Conn>> conns;
+    std::unordered_map<std::string, std::vector<Conn *>> subs;
+    std::vector<int> doomed;
+
+    ~Loop() {
+        if (wake_rd >= 0) ::close(wake_rd);
+        if (wake_wr >= 0) ::close(wake_wr);
+    }
+
+    bool init() {
+        int p[2];
+        if (!poller.ok() || ::pipe(p) != 0) return false;
+        wake_rd = p[0];
+        wake_wr = p[1];
+        set_nonblock(wake_rd);
+        set_nonblock(wake_wr);
+        fcntl(wake_rd, F_SETFD, FD_CLOEXEC);
+        fcntl(wake_wr, F_SETFD, FD_CLOEXEC);
+        return poller.add(wake_rd);
+    }
+
+    void wake() {
+        const char c = 1;
+        (void)!::write(wake_wr, &c, 1);
+    }
+
+    // 任意线程：记下有更新的 job，同一批里多次更新只唤醒一次
+    void post(const std::string &id) {
+        if (n_subs.load() == 0) return;
+        bool need_wake;
+        {
+            std::lock_guard<std::mutex> lk(mu);
+            pending.insert(id);
+            need_wake = !woken;
+            woken = true;
+        }
+        if (need_wake) wake();
+    }
+
+    void run() {
+        std::vector<PollEvent> evs;
+        auto last_sweep = Clock::now();
+        while (!stop.load()) {
+            poller.wait(evs, 1000);
+            for (const PollEvent &e : evs) {
+                if (e.fd == srv->listen_fd_) {
+                    accept_all();
+                    continue;
+                }
+                if (e.fd == wake_rd) {
+                    drain();
+                    continue;
+                }
+                auto it = conns.find(e.fd);
+                if (it == conns.end() || it->second->dead) continue;
+                Conn &c = *it->second;
+                if (e.in || e.err) on_readable(c);  // 断开 / 出错时 recv 会返回 0 或 -1
+                if (!c.dead && e.out) flush(c);
+            }
+            reap();
+
+            const auto now = Clock::now();
+            if (now - last_sweep >= std::chrono::seconds(1)) {
+                sweep(now);
+                reap();
+                last_sweep = now;
+            }
+        }
+        for (auto &kv : conns) ::close(kv.first);
+        srv->counters_.open -= (int64_t)conns.size();
+        conns.clear();
+        subs.clear();
+    }
+
+    void accept_all() {
+        const auto now = Clock::now();
+        for (int i = 0; i < 256; ++i) {
+            const int fd = ::accept(srv->listen_fd_, nullptr, nullptr);
+            if (fd < 0) {
+                if (errno == EINTR) continue;
+                if (errno == EMFILE || errno == ENFILE) {
+                    // fd 用完：监听 socket 是水平触发的，不歇一下会空转
+                    srv->counters_.rejected++;
+                    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                }
+                return;
+            }
+            if (srv->counters_.open.load() >= srv->cfg_.watch_max_conns) {
+                ::close(fd);
+                srv->counters_.rejected++;
+                continue;
+            }
+            set_nonblock(fd);
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+#ifdef SO_NOSIGPIPE
+            setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+            auto c = std::make_unique<Conn>();
+            c->fd = fd;
+            c->since = c->last_out = now;
+            if (!poller.add(fd)) {
+                ::close(fd);
+                continue;
+            }
+            conns.emplace(fd, std::move(c));
+            srv->counters_.open++;
+            srv->counters_.accepted++;
+        }
+    }
+
+    void drain() {
+        char buf[64];
+        while (::read(wake_rd, buf, sizeof(buf)) > 0) {}
+        std::unordered_set<std::string> ids;
+        {
+            std::lock_guard<std::mutex> lk(mu);
+            ids.swap(pending);
+            woken = false;
+        }
+        if (stop.load()) return;
+        srv->counters_.wakeups++;
+        for (const std::string &id : ids) publish(id, nullptr);
+    }
+
+    void on_readable(Conn &c) {
+        char buf[4096];
+        for (;;) {
+            const ssize_t n = ::recv(c.fd, buf, sizeof(buf), 0);
+            if (n > 0) {
+                // 订阅之后客户端不该再发东西，读掉丢弃
+                if (c.kind == Conn::Kind::request && !c.closing) {
+                    c.in.append(buf, (size_t)n);
+                    if (c.in.size() > kMaxRequest) {
+                        kill(c);
+                        return;
+                    }
+                }
+                continue;
+            }
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+            kill(c);  // 0：对端关闭
+            return;
+        }
+        if (c.kind == Conn::Kind::request && !c.closing && c.in.find("\r\n\r\n") != std::string::npos) {
+            handle_request(c);
+        }
+    }
+
+    void handle_request(Conn &c) {
+        std::istringstream first(c.in.substr(0, c.in.find("\r\n")));
+        std::string method, target;
+        first >> method >> target;
+        c.in.clear();
+
+        if (method != "GET") {
+            respond(c, "405 Method Not Allowed", "{\"ok\":false,\"error\":\"method not allowed\"}");
+            return;
+        }
+        std::string path = target, query;
+        const size_t q = target.find('?');
+        if (q != std::string::npos) {
+            path = target.substr(0, q);
+            query = target.substr(q + 1);
+        }
+
+        if (path == "/api/watch/stats") {
+            respond(c, "200 OK", srv->stats_json());
+            return;
+        }
+        if (path != "/api/stream" && path != "/api/watch") {
+            respond(c, "404 Not Found", "{\"ok\":false,\"error\":\"not found\"}");
+            return;
+        }
+        const std::string id = query_param(query, "id");
+        if (id.empty()) {
+            respond(c, "400 Bad Request", "{\"ok\":false,\"error\":\"missing id\"}");
+            return;
+        }
+
+        c.kind = path == "/api/stream" ? Conn::Kind::stream : Conn::Kind::watch;
+        c.job = id;
+        send(c, "HTTP/1.1 200 OK\r\n"
+                "Content-Type: text/event-stream\r\n"
+                "Cache-Control: no-cache\r\n"
+                "Access-Control-Allow-Origin: *\r\n"
+                "Connection: close\r\n\r\n");
+        if (c.dead) return;
+
+        std::vector<Conn *> &v = subs[id];
+        c.subscribed = true;
+        c.sub_idx = v.size();
+        v.push_back(&c);
+        n_subs++;
+        publish(id, &c);  // 先把当前进度 / 已生成的文本补上（任务可能已经结束）
+    }
+
+    void respond(Conn &c, const char *status, const std::string &body) {
+        std::ostringstream oss;
+        oss << "HTTP/1.1 " << status << "\r\n"
+            << "Content-Type: application/json; charset=utf-8\r\n"
+            << "Content-Length: " << body.size() << "\r\n"
+            << "Access-Control-Allow-Origin: *\r\n"
+            << "Connection: close\r\n\r\n"
+            << body;
+        c.closing = true;
+        send(c, oss.str());
+    }
+
+    // 把 job 的最新状态推给订阅它的连接（only 非空时只推这一个）。
+    // 每个 job 只拿一次快照（一次 JobManager 锁），再按各连接的位置切出 delta
+    void publish(const std::string &id, Conn *only) {
+        auto it = subs.find(id);
+        if (it == subs.end() || it->second.empty()) return;
+
+        size_t from = (size_t)-1;
+        if (only) {
+            if (only->kind == Conn::Kind::stream) from = only->offset;
+        } else {
+            for (const Conn *c : it->second) {
+                if (c->kind == Conn::Kind::stream) from = std::min(from, c->offset);
+            }
+        }
+
+        StreamSnapshot snap;
+        const bool found = srv->jm_->stream_snapshot(id, from, snap);
+        const std::string not_found = "event: error\ndata: {\"ok\":false,\"error\":\"not found\"}\n\n";
+        const bool finished = !snap.final_json.empty();
+        const size_t end = snap.from + snap.text.size();
+
+        std::string final_ev, progress_ev, delta_ev;
+        size_t delta_off = (size_t)-1;  // delta_ev 对应的起点：大多数连接位置相同，只拼一次
+        if (finished) {
+            final_ev = std::string("event: ") + (snap.state == JobState::done ? "done" : "error") + "\ndata: " +
+                       snap.final_json + "\n\n";
+        }
+
+        auto emit = [&](Conn &c) {
+            if (c.dead || c.closing) return;
+            std::string out;
+            if (!found) {
+                out = not_found;
+            } else if (c.kind == Conn::Kind::stream) {
+                if (end > c.offset && c.offset >= snap.from) {
+                    if (c.offset != delta_off) {
+                        delta_off = c.offset;
+                        delta_ev = "event: delta\ndata: {\"text\":\"" + json_escape(snap.text.substr(c.offset - snap.from)) +
+                                   "\"}\n\n";
+                    }
+                    out = delta_ev;
+                    c.offset = end;
+                }
+            } else if (snap.progress != c.progress || (int)snap.state != c.state) {
+                c.progress = snap.progress;
+                c.state = (int)snap.state;
+                if (progress_ev.empty()) {
+                    progress_ev = "event: progress\ndata: {\"id\":\"" + json_escape(id) + "\",\"state\":\"" +
+                                  state_name(snap.state) + "\",\"progress\":" + std::to_string(snap.progress) + "}\n\n";
+                }
+                out = progress_ev;
+            }
+            if (finished) out += final_ev;
+            if (!found || finished) c.closing = true;
+            if (out.empty()) return;
+            srv->counters_.events++;
+            send(c, out);
+        };
+
+        if (only) {
+            emit(*only);
+        } else {
+            for (Conn *c : it->second) emit(*c);
+        }
+    }
+
+    void send(Conn &c, const std::string &data) {
+        if (c.out.size() - c.out_off + data.size() > kMaxPending) {
+            srv->counters_.dropped_slow++;
+            kill(c);
+            return;
+        }
+        c.out.append(data);
+        c.last_out = Clock::now();
+        flush(c);
+    }
+
+    void flush(Conn &c) {
+        while (c.out_off < c.out.size()) {
+            const ssize_t n = ::send(c.fd, c.out.data() + c.out_off, c.out.size() - c.out_off, kSendFlags);
+            if (n > 0) {
+                c.out_off += (size_t)n;
+                srv->counters_.bytes += (uint64_t)n;
+                continue;
+            }
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                if (!c.writing) {
+                    poller.want_write(c.fd, true);
+                    c.writing = true;
+                }
+                return;
+            }
+            kill(c);
+            return;
+        }
+        c.out.clear();
+        c.out_off = 0;
+        if (c.writing) {
+            poller.want_write(c.fd, false);
+            c.writing = false;
+        }
+        if (c.closing) kill(c);
+    }
+
+    void sweep(Clock::time_point now) {
+        for (auto &kv : conns) {
+            Conn &c = *kv.second;
+            if (c.dead) continue;
+            if (c.kind == Conn::Kind::request) {
+                if (now - c.since > kHeaderTimeout) kill(c);
+            } else if (now - c.last_out > kKeepalive) {
+                send(c, ": keepalive\n\n");
+            }
+        }
+    }
+
+    // 只做标记：publish / sweep 还在遍历连接表和订阅表，本轮结束后在 reap 里统一关
+    void kill(Conn &c) {
+        if (c.dead) return;
+        c.dead = true;
+        doomed.push_back(c.fd);
+    }
+
+    void reap() {
+        for (int fd : doomed) {
+            auto it = conns.find(fd);
+            if (it == conns.end()) continue;
+            Conn &c = *it->second;
+            if (c.subscribed) {
+                auto sit = subs.find(c.job);
+                if (sit != subs.end()) {
+                    std::vector<Conn *> &v = sit->second;
+                    v[c.sub_idx] = v.back();
+                    v[c.sub_idx]->sub_idx = c.sub_idx;
+                    v.pop_back();
+                    if (v.empty()) subs.erase(sit);
+                    n_subs--;
+                }
+            }
+            poller.del(fd);
+            ::close(fd);
+            conns.erase(it);
+            srv->counters_.open--;
+        }
+        doomed.clear();
+    }
+};
+
+// 一万个连接在默认的 ulimit -n（常见 1024 / 256）下开不出来：把软上限提到硬上限
+static void raise_fd_limit(size_t want, size_t need) {
+    rlimit rl{};
+    if (getrlimit(RLIMIT_NOFILE, &rl) != 0) return;
+    if (rl.rlim_cur < want) {
+        rl.rlim_cur = rl.rlim_max == RLIM_INFINITY ? want : std::min<rlim_t>(rl.rlim_max, want);
+        setrlimit(RLIMIT_NOFILE, &rl);
+        getrlimit(RLIMIT_NOFILE, &rl);
+    }
+    if (rl.rlim_cur < need) {
+        std::cerr << "[watch] 文件描述符上限只有 " << rl.rlim_cur << "，连接数会先撞到它（ulimit -n）\n";
+    }
+}
+
+WatchServer::WatchServer(const Config &cfg, std::shared_ptr<JobManager> jm)
+: cfg_(cfg), jm_(std::move(jm)) {}
+
+WatchServer::~WatchServer() {
+    stop();
+}
+
+bool WatchServer::start(const std::string &host, int port, std::string &err) {
+    if (!jm_) {
+        err = "job manager not ready";
+        return false;
+    }
+    // 留点余量给模型文件、httplib 的连接
+    raise_fd_limit((size_t)std::max(0, cfg_.watch_max_conns) + 256, (size_t)std::max(0, cfg_.watch_max_conns));
+
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    addrinfo *res = nullptr;
+    const std::string port_s = std::to_string(port);
+    if (getaddrinfo(host.empty() ? nullptr : host.c_str(), port_s.c_str(), &hints, &res) != 0 || !res) {
+        err = "解析监听地址失败: " + host;
+        return false;
+    }
+    for (addrinfo *ai = res; ai && listen_fd_ < 0; ai = ai->ai_next) {
+        const int fd = ::socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0) continue;
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (::bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 && ::listen(fd, SOMAXCONN) == 0) {
+            listen_fd_ = fd;
+        } else {
+            ::close(fd);
+        }
+    }
+    freeaddrinfo(res);
+    if (listen_fd_ < 0) {
+        err = "监听 " + host + ":" + port_s + " 失败: " + std::strerror(errno);
+        return false;
+    }
+    set_nonblock(listen_fd_);
+    fcntl(listen_fd_, F_SETFD, FD_CLOEXEC);
+
+    const int n = std::max(1, cfg_.watch_threads);
+    for (int i = 0; i < n; ++i) {
+        auto loop = std::make_unique<Loop>();
+        loop->srv = this;
+        if (!loop->init() || !loop->poller.add(listen_fd_, /*exclusive*/ true)) {
+            err = std::string("创建事件循环失败: ") + std::strerror(errno);
+            stop();
+            return false;
+        }
+        loops_.push_back(std::move(loop));
+    }
+    for (auto &l : loops_) {
+        Loop *p = l.get();
+        p->th = std::thread([p] { p->run(); });
+    }
+    jm_->set_update_listener([this](const std::string &id) { on_update(id); });
+    return true;
+}
+
+void WatchServer::stop() {
+    if (jm_) jm_->set_update_listener(nullptr);
+    for (auto &l : loops_) {
+        l->stop = true;
+        l->wake();
+    }
+    for (auto &l : loops_) {
+        if (l->th.joinable()) l->th.join();
+    }
+    loops_.clear();
+    if (listen_fd_ >= 0) {
+        ::close(listen_fd_);
+        listen_fd_ = -1;
+    }
+}
+
+void WatchServer::on_update(const std::string &id) {
+    for (auto &l : loops_) l->post(id);
+}
+
+std::string WatchServer::stats_json() const {
+    int subs = 0;
+    for (const auto &l : loops_) subs += l->n_subs.load();
+    std::ostringstream oss;
+    oss << "{\"ok\":true"
+        << ",\"backend\":\"" << Poller::name() << "\""
+        << ",\"threads\":" << loops_.size()
+        << ",\"open\":" << counters_.open.load()
+        << ",\"subscribed\":" << subs
+        << ",\"accepted\":" << counters_.accepted.load()
+        << ",\"rejected\":" << counters_.rejected.load()
+        << ",\"dropped_slow\":" << counters_.dropped_slow.load()
+        << ",\"events\":" << counters_.events.load()
+        << ",\"bytes\":" << counters_.bytes.load()
+        << ",\"wakeups\":" << counters_.wakeups.load()
+        << "}";
+    return oss.str();
+}
+
+} // namespace ws_ai
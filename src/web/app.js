@@ -1,122 +1,112 @@
-const fileEl = document.getElementById('file');
+const file = document.getElementById('file');
+const model = document.getElementById('model');
 const btnUpload = document.getElementById('btnUpload');
-const bar = document.getElementById('bar');
-const statusText = document.getElementById('statusText');
+const btnClear = document.getElementById('btnClear');
+const drop = document.getElementById('drop');
+const preview = document.getElementById('preview');
+const barFill = document.getElementById('barFill');
+const pct = document.getElementById('pct');
+const state = document.getElementById('state');
+const tid = document.getElementById('tid');
 const out = document.getElementById('out');
-const imgPreview = document.getElementById('imgPreview');
 
-let pastedBlob = null;
-
-function setProgress(p) {
-  const v = Math.max(0, Math.min(100, p));
-  bar.style.width = v + '%';
-}
-
-function setStatus(s) {
-  statusText.textContent = s;
+let currentTaskId = null, pastedDataUrl = null, pollingTimer = null;
+
+function setProgress(p) { p = Math.max(0, Math.min(100, p | 0)); barFill.style.width = p + '%'; pct.textContent = p + '%'; }
+function setState(s) { state.textContent = s; }
+function setTaskId(id) { tid.textContent = id || '-'; }
+function stopPolling() { if (pollingTimer) { clearInterval(pollingTimer); pollingTimer = null; } }
+
+function startPolling(taskId) {
+  stopPolling();
+  pollingTimer = setInterval(async () => {
+    try {
+      const r = await fetch('/api/status?id=' + encodeURIComponent(taskId));
+      const j = await r.json();
+      setProgress(j.progress || 0);
+      setState(j.state || 'unknown');
+      if (j.state === 'done') { stopPolling(); out.value = j.result || ''; }
+      else if (j.state === 'error') { stopPolling(); out.value = j.error || 'error'; }
+    } catch (e) {}
+  }, 250);
 }
 
-// 粘贴剪贴板图片
-window.addEventListener('paste', (e) => {
-  const items = e.clipboardData && e.clipboardData.items;
-  if (!items) return;
-
-  for (const it of items) {
-    if (it.type.startsWith('image/')) {
-      pastedBlob = it.getAsFile();
-      const url = URL.createObjectURL(pastedBlob);
-      imgPreview.src = url;
-      imgPreview.style.display = 'block';
-      setStatus('已粘贴图片，可点击“上传并开始”');
-      return;
+// 有多个模型时才显示下拉框
+async function loadModels() {
+  try {
+    const r = await fetch('/api/models');
+    const j = await r.json();
+    if (!j.ok || !j.models || j.models.length < 2) return;
+    for (const m of j.models) {
+      const o = document.createElement('option');
+      o.value = m.name; o.textContent = m.name; o.selected = (m.name === j.default);
+      model.appendChild(o);
     }
-  }
-});
-
-function pickFile() {
-  if (fileEl.files && fileEl.files[0]) return fileEl.files[0];
-  if (pastedBlob) return pastedBlob;
-  return null;
+    model.style.display = '';
+  } catch (e) {}
 }
 
-async function createJob(file) {
-  const fd = new FormData();
-  fd.append('file', file, file.name || 'paste.png');
+function showPreview(dataUrl) { preview.src = dataUrl; preview.style.display = 'inline-block'; }
 
-  const r = await fetch('/api/job', { method: 'POST', body: fd });
-  if (!r.ok) throw new Error(await r.text());
-  const j = await r.json();
-  return j.job_id;
+function jobStarted(j) {
+  currentTaskId = j.id; setTaskId(currentTaskId); setState('queued'); setProgress(3); startPolling(currentTaskId);
 }
 
-function phaseText(phase) {
-  if (phase === 'queued') return '排队中';
-  if (phase === 'ocr') return 'OCR 识别中';
-  if (phase === 'llm') return '模型生成中';
-  if (phase === 'done') return '完成';
-  if (phase === 'error') return '失败';
-  return phase;
+async function uploadFileAndStart(f) {
+  const fd = new FormData(); fd.append('file', f);
+  if (model.value) fd.append('model', model.value);
+  setState('uploading'); setProgress(1);
+  const r = await fetch('/api/upload', { method: 'POST', body: fd });
+  const j = await r.json(); if (!j.ok) throw new Error(j.error || 'upload failed');
+  jobStarted(j);
 }
 
-function listenJob(jobId) {
-  out.textContent = '';
-  setProgress(1);
-  setStatus('任务已创建，开始处理…');
-
-  const es = new EventSource(`/api/events?job_id=${encodeURIComponent(jobId)}`);
-
-  es.onmessage = (ev) => {
-    const st = JSON.parse(ev.data);
-
-    if (st.error && st.phase === 'error') {
-      setProgress(100);
-      setStatus('失败：' + st.error);
-      es.close();
-      return;
-    }
-
-    setProgress(st.progress || 0);
-    setStatus(`${phaseText(st.phase)}（${st.progress}%）`);
-
-    // 直接显示累计结果
-    if (typeof st.result_text === 'string') {
-      out.textContent = st.result_text;
-    }
-
-    if (st.phase === 'done' || st.phase === 'error') {
-      es.close();
-    }
-  };
-
-  es.addEventListener('ping', () => {
-    // 心跳，不做处理
-  });
-
-  es.onerror = () => {
-    setStatus('连接中断，尝试刷新页面或重试');
-    es.close();
-  };
+async function uploadDataUrlAndStart(dataUrl) {
+  setState('uploading'); setProgress(1);
+  const body = { data_url: dataUrl };
+  if (model.value) body.model = model.value;
+  const r = await fetch('/api/clipboard', { method: 'POST', headers: { 'Content-Type': 'application/json' }, body: JSON.stringify(body) });
+  const j = await r.json(); if (!j.ok) throw new Error(j.error || 'clipboard upload failed');
+  jobStarted(j);
 }
 
-btnUpload.addEventListener('click', async () => {
-  const f = pickFile();
-  if (!f) {
-    alert('请选择或粘贴一张图片');
-    return;
-  }
-
-  // 预览
-  const url = URL.createObjectURL(f);
-  imgPreview.src = url;
-  imgPreview.style.display = 'block';
-
+btnUpload.onclick = async () => {
+  try {
+    out.value = '';
+    if (pastedDataUrl) { await uploadDataUrlAndStart(pastedDataUrl); return; }
+    const f = file.files[0]; if (!f) { alert('请选择文件或粘贴图片'); return; }
+    await uploadFileAndStart(f);
+  } catch (e) { setState('error'); out.value = String(e); }
+};
+
+btnClear.onclick = () => {
+  pastedDataUrl = null; currentTaskId = null; stopPolling();
+  setProgress(0); setState('idle'); setTaskId(null); out.value = '';
+  preview.style.display = 'none'; preview.src = ''; file.value = '';
+};
+
+window.addEventListener('paste', (ev) => {
   try {
-    setStatus('上传中…');
-    setProgress(0);
+    const items = (ev.clipboardData || ev.originalEvent.clipboardData).items;
+    for (const it of items) {
+      if (it.type && it.type.startsWith('image/')) {
+        const blob = it.getAsFile(); const reader = new FileReader();
+        reader.onload = () => { pastedDataUrl = reader.result; showPreview(pastedDataUrl); };
+        reader.readAsDataURL(blob); ev.preventDefault(); return;
+      }
+    }
+  } catch (e) {}
+});
+
+drop.addEventListener('dragover', (e) => { e.preventDefault(); drop.style.borderColor = '#111'; });
+drop.addEventListener('dragleave', () => { drop.style.borderColor = '#bbb'; });
+drop.addEventListener('drop', (e) => {
+  e.preventDefault(); drop.style.borderColor = '#bbb';
+  const f = e.dataTransfer.files && e.dataTransfer.files[0];
+  if (!f) return; if (!f.type.startsWith('image/')) { alert('请拖拽图片文件'); return; }
+  const reader = new FileReader();
+  reader.onload = () => { pastedDataUrl = reader.result; showPreview(pastedDataUrl); };
+  reader.readAsDataURL(f);
+});
 
-    const jobId = await createJob(f);
-    listenJob(jobId);
-  } catch (e) {
-    setStatus('失败：' + e.message);
-  }
-});
\ No newline at end of file
+loadModels();